@@ -46,6 +46,7 @@ static const char* action_names[] = {
     [action_info] = "info",
     [action_exec] = "exec",
     [action_status] = "status",
+    [action_perf] = "perf",
     [action_exit] = "exit",
 };
 
@@ -40,6 +40,7 @@ enum action_type {
     action_info,
     action_exec,
     action_status,
+    action_perf,
     action_exit,
 };
 
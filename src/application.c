@@ -5,12 +5,20 @@
 #include "application.h"
 
 #include "buildcfg.h"
+#include "control.h"
+#include "diskcache.h"
 #include "font.h"
 #include "gallery.h"
+#include "headless.h"
 #include "imagelist.h"
 #include "info.h"
 #include "loader.h"
+#include "perf.h"
+#include "shmcache.h"
 #include "sway.h"
+#include "thumbdb.h"
+#include "tpool.h"
+#include "trace.h"
 #include "ui.h"
 #include "viewer.h"
 
@@ -31,6 +39,10 @@
 #define SIZE_FROM_PARENT (SIZE_MAX - 2)
 #define POS_FROM_PARENT  SSIZE_MAX
 
+// Flags of signals received by the handler
+#define SIGNAL_USR1 (1 << 0)
+#define SIGNAL_USR2 (1 << 1)
+
 /** Main loop state */
 enum loop_state {
     loop_run,
@@ -45,10 +57,16 @@ struct watchfd {
     fd_callback callback;
 };
 
-/* Application event queue (list). */
-struct event_queue {
-    struct list list;
-    struct event event;
+/** Event names used in timeline trace. */
+static const char* event_names[] = {
+    [event_action] = "Event: action",
+    [event_redraw] = "Event: redraw",
+    [event_resize] = "Event: resize",
+    [event_drag] = "Event: drag",
+    [event_load] = "Event: load",
+    [event_preview] = "Event: preview",
+    [event_activate] = "Event: activate",
+    [event_open] = "Event: open",
 };
 
 /** Application context */
@@ -57,17 +75,19 @@ struct application {
 
     struct watchfd* wfds; ///< FD polling descriptors
     size_t wfds_num;      ///< Number of polling FD
+    bool wfds_changed;    ///< Polling descriptors were added or removed
 
-    struct event_queue* events;  ///< Event queue
-    pthread_mutex_t events_lock; ///< Event queue lock
-    int event_signal;            ///< Queue change notification
+    int event_signal;    ///< Queue change notification
+    bool event_notified; ///< Notification is raised and not handled yet
 
     struct action_seq sigusr1; ///< Actions applied by USR1 signal
     struct action_seq sigusr2; ///< Actions applied by USR2 signal
+    int signals;               ///< Received signals (SIGNAL_* flags)
 
     event_handler ehandler; ///< Event handler for the current mode
     struct wndrect window;  ///< Preferable window position and size
     char* app_id;           ///< Application id (app_id name)
+    bool perf_report;       ///< Print performance counters at exit
 };
 
 /** Global application context. */
@@ -115,54 +135,32 @@ static void sway_setup(void)
     sway_disconnect(ipc);
 }
 
-/** Notification callback: handle event queue. */
-static void handle_event_queue(__attribute__((unused)) void* data)
-{
-    notification_reset(ctx.event_signal);
-
-    while (ctx.events && ctx.state == loop_run) {
-        struct event_queue* entry = NULL;
-        pthread_mutex_lock(&ctx.events_lock);
-        if (ctx.events) {
-            entry = ctx.events;
-            ctx.events = list_remove(entry);
-        }
-        pthread_mutex_unlock(&ctx.events_lock);
-        if (entry) {
-            ctx.ehandler(&entry->event);
-            free(entry);
-        }
-    }
-}
-
 /**
  * Append event to queue.
  * @param event pointer to the event
  */
 static void append_event(const struct event* event)
 {
-    struct event_queue* entry;
-
-    // create new entry
-    entry = malloc(sizeof(*entry));
-    if (!entry) {
+    if (!evqueue_push(event)) {
+        fprintf(stderr, "Not enough memory, event dropped\n");
+        if (event->type == event_load || event->type == event_preview) {
+            image_free(event->param.load.image);
+        }
         return;
     }
-    memcpy(&entry->event, event, sizeof(entry->event));
-
-    // add to queue tail
-    pthread_mutex_lock(&ctx.events_lock);
-    ctx.events = list_append(ctx.events, entry);
-    pthread_mutex_unlock(&ctx.events_lock);
 
-    notification_raise(ctx.event_signal);
+    // raise notification only once per queue handling
+    if (!__atomic_exchange_n(&ctx.event_notified, true, __ATOMIC_SEQ_CST)) {
+        notification_raise(ctx.event_signal);
+    }
 }
 
 /**
  * Apply action.
  * @param action pointer to the action being performed
+ * @param sync handle action immediately instead of queueing it
  */
-static void apply_action(const struct action* action)
+static void apply_action(const struct action* action, bool sync)
 {
     struct event event;
 
@@ -182,6 +180,10 @@ static void apply_action(const struct action* action)
             info_switch_help();
             app_redraw();
             break;
+        case action_perf:
+            perf_dump(STDOUT_FILENO);
+            app_redraw();
+            break;
         case action_exit:
             if (info_help_active()) {
                 info_switch_help(); // remove help overlay
@@ -194,32 +196,79 @@ static void apply_action(const struct action* action)
             // not a general action, add to event queue
             event.type = event_action;
             event.param.action = action;
-            append_event(&event);
+            if (sync) {
+                ctx.ehandler(&event);
+            } else {
+                append_event(&event);
+            }
             break;
     }
 }
 
 /**
  * POSIX Signal handler.
+ * Only async-signal-safe calls are allowed here: the signal is marked as
+ * received and the actions are applied by the main loop.
  * @param signum signal number
  */
 static void on_signal(int signum)
 {
-    const struct action_seq* sigact;
+    const int errno_save = errno;
+    int flag;
 
     switch (signum) {
         case SIGUSR1:
-            sigact = &ctx.sigusr1;
+            flag = SIGNAL_USR1;
             break;
         case SIGUSR2:
-            sigact = &ctx.sigusr2;
+            flag = SIGNAL_USR2;
             break;
         default:
             return;
     }
 
-    for (size_t i = 0; i < sigact->num; ++i) {
-        apply_action(&sigact->sequence[i]);
+    __atomic_or_fetch(&ctx.signals, flag, __ATOMIC_SEQ_CST);
+    notification_raise(ctx.event_signal);
+
+    errno = errno_save;
+}
+
+/** Apply actions of the received signals, called from the main loop. */
+static void handle_signals(void)
+{
+    const int signals = __atomic_exchange_n(&ctx.signals, 0, __ATOMIC_SEQ_CST);
+
+    if (signals & SIGNAL_USR1) {
+        for (size_t i = 0; i < ctx.sigusr1.num; ++i) {
+            apply_action(&ctx.sigusr1.sequence[i], false);
+        }
+    }
+    if (signals & SIGNAL_USR2) {
+        for (size_t i = 0; i < ctx.sigusr2.num; ++i) {
+            apply_action(&ctx.sigusr2.sequence[i], false);
+        }
+    }
+}
+
+/** Notification callback: handle event queue. */
+static void handle_event_queue(__attribute__((unused)) void* data)
+{
+    struct event event;
+
+    // consume the signal first, then allow producers to raise a new one:
+    // events pushed after the flag is cleared are signaled again
+    notification_reset(ctx.event_signal);
+    __atomic_store_n(&ctx.event_notified, false, __ATOMIC_SEQ_CST);
+
+    handle_signals();
+
+    while (ctx.state == loop_run && evqueue_pop(&event)) {
+        const uint64_t start = trace_begin();
+        if (event.type != event_redraw) {
+            thumbdb_busy(); // postpone background indexing
+        }
+        ctx.ehandler(&event);
+        trace_end(event_names[event.type], start);
     }
 }
 
@@ -356,15 +405,94 @@ static void load_config(struct config* cfg)
     // app id
     value = config_get_string(cfg, APP_CFG_SECTION, APP_CFG_APP_ID, APP_NAME);
     str_dup(value, &ctx.app_id);
+
+    // CPU affinity of background threads
+    value = config_get_string(cfg, APP_CFG_SECTION, APP_CFG_BKG_CPUS, "");
+    if (*value && !tpool_affinity(value)) {
+        config_error_val(APP_CFG_SECTION, APP_CFG_BKG_CPUS);
+    }
+
+    // performance report at exit
+    ctx.perf_report =
+        config_get_bool(cfg, APP_CFG_SECTION, APP_CFG_PERF, false);
+}
+
+/** Startup context: independent initialization steps run in parallel. */
+struct startup {
+    struct config* cfg;  ///< Config instance
+    size_t index;        ///< Index of the first image
+    bool force;          ///< Mandatory image index flag
+    struct image* image; ///< Loaded first image
+    bool window;         ///< Window was created at the parallel stage
+    bool ui_ok;          ///< Window creation status
+};
+
+/**
+ * Check if window size depends on the first image.
+ * @return true if the image is required to create window
+ */
+static bool window_from_image(void)
+{
+    return ctx.window.width == SIZE_FROM_IMAGE ||
+        ctx.window.width == SIZE_FROM_PARENT;
+}
+
+/**
+ * Connect to Wayland and create window.
+ * @return false on errors
+ */
+static bool create_window(void)
+{
+    if (ctx.window.width == SIZE_FULLSCREEN) {
+        ui_toggle_fullscreen();
+    }
+    return ui_init(ctx.app_id, ctx.window.width, ctx.window.height);
+}
+
+/** First image loader thread. */
+static void* load_first_thread(void* data)
+{
+    struct startup* st = data;
+    trace_thread("startup");
+    st->image = load_first_file(st->index, st->force);
+    return NULL;
+}
+
+/** Startup task: see tpool_fn. */
+static void startup_task(void* data, size_t index,
+                         __attribute__((unused)) size_t thread)
+{
+    struct startup* st = data;
+
+    if (index == 0) {
+        // setup window position and size, connect to Wayland if the window
+        // size doesn't depend on the first image
+        if (ctx.window.width != SIZE_FULLSCREEN && !headless_enabled()) {
+            sway_setup(); // try Sway integration
+        }
+        if (!window_from_image()) {
+            st->window = true;
+            st->ui_ok = create_window();
+        }
+    } else {
+        font_init(st->cfg); // fontconfig is slow on cold start
+    }
 }
 
 bool app_init(struct config* cfg, const char** sources, size_t num)
 {
     bool force_load = false;
+    struct startup st = { .cfg = cfg };
+    pthread_t loader;
+    bool loader_started;
     struct image* first_image;
     struct sigaction sigact;
 
+    evqueue_reset();
+
     load_config(cfg);
+    shmcache_init(cfg);
+    diskcache_init(cfg);
 
     // compose image list
     if (num == 0) {
@@ -389,28 +517,36 @@ bool app_init(struct config* cfg, const char** sources, size_t num)
         return false;
     }
 
-    // load the first image
-    first_image = load_first_file(image_list_find(sources[0]), force_load);
+    // load the first image in background while the window is created,
+    // the size limit must be set before
+    loader_configure(cfg);
+    st.index = image_list_find(sources[0]);
+    st.force = force_load;
+    loader_started =
+        (pthread_create(&loader, NULL, load_first_thread, &st) == 0);
+    if (!loader_started) {
+        load_first_thread(&st);
+    }
+    tpool_run(startup_task, &st, 2);
+    if (loader_started) {
+        pthread_join(loader, NULL);
+    }
+    first_image = st.image;
     if (!first_image) {
+        if (st.window && st.ui_ok) {
+            ui_destroy();
+        }
         return false;
     }
 
-    // setup window position and size
-    if (ctx.window.width != SIZE_FULLSCREEN) {
-        sway_setup(); // try Sway integration
-    }
-    if (ctx.window.width == SIZE_FULLSCREEN) {
-        ui_toggle_fullscreen();
-    } else if (ctx.window.width == SIZE_FROM_IMAGE ||
-               ctx.window.width == SIZE_FROM_PARENT) {
+    if (!st.window) {
         // fixup window size form the first image
         const struct pixmap* pm = &first_image->frames[0].pm;
         ctx.window.width = pm->width;
         ctx.window.height = pm->height;
+        st.ui_ok = create_window();
     }
-
-    // connect to wayland
-    if (!ui_init(ctx.app_id, ctx.window.width, ctx.window.height)) {
+    if (!st.ui_ok) {
         return false;
     }
 
@@ -422,13 +558,11 @@ bool app_init(struct config* cfg, const char** sources, size_t num)
         perror("Unable to create eventfd");
         return false;
     }
-    pthread_mutex_init(&ctx.events_lock, NULL);
 
     // initialize other subsystems
-    font_init(cfg);
     keybind_init(cfg);
     info_init(cfg);
-    loader_init();
+    loader_init(cfg);
     viewer_init(cfg, ctx.ehandler == viewer_handle ? first_image : NULL);
     gallery_init(cfg, ctx.ehandler == gallery_handle ? first_image : NULL);
 
@@ -445,12 +579,23 @@ bool app_init(struct config* cfg, const char** sources, size_t num)
     sigaction(SIGUSR1, &sigact, NULL);
     sigaction(SIGUSR2, &sigact, NULL);
 
+    control_init(cfg);
+
     return true;
 }
 
 void app_destroy(void)
 {
+    struct event event;
+
+    if (ctx.perf_report) {
+        perf_dump(STDOUT_FILENO);
+    }
+
+    control_destroy();
     loader_destroy();
+    shmcache_destroy();
+    diskcache_destroy();
     gallery_destroy();
     viewer_destroy();
     ui_destroy();
@@ -458,22 +603,23 @@ void app_destroy(void)
     info_destroy();
     keybind_destroy();
     font_destroy();
+    tpool_destroy();
 
     for (size_t i = 0; i < ctx.wfds_num; ++i) {
-        close(ctx.wfds[i].fd);
+        if (ctx.wfds[i].fd != -1) {
+            close(ctx.wfds[i].fd);
+        }
     }
     free(ctx.wfds);
 
-    list_for_each(ctx.events, struct event_queue, it) {
-        if (it->event.type == event_load) {
-            image_free(it->event.param.load.image);
+    while (evqueue_pop(&event)) {
+        if (event.type == event_load || event.type == event_preview) {
+            image_free(event.param.load.image);
         }
-        free(it);
     }
     if (ctx.event_signal != -1) {
         notification_free(ctx.event_signal);
     }
-    pthread_mutex_destroy(&ctx.events_lock);
 
     action_free(&ctx.sigusr1);
     action_free(&ctx.sigusr2);
@@ -489,31 +635,75 @@ void app_watch(int fd, fd_callback cb, void* data)
         ctx.wfds[ctx.wfds_num].data = data;
         ctx.wfds[ctx.wfds_num].callback = cb;
         ++ctx.wfds_num;
+        ctx.wfds_changed = true;
     }
 }
 
-bool app_run(void)
+void app_unwatch(int fd)
 {
-    struct pollfd* fds;
+    // entry is removed from the list on the next main loop iteration
+    for (size_t i = 0; i < ctx.wfds_num; ++i) {
+        if (ctx.wfds[i].fd == fd) {
+            ctx.wfds[i].fd = -1;
+            ctx.wfds_changed = true;
+            break;
+        }
+    }
+}
 
-    // file descriptors to poll
-    fds = calloc(1, ctx.wfds_num * sizeof(struct pollfd));
-    if (!fds) {
-        perror("Failed to allocate memory");
+/**
+ * Update list of polling descriptors, removes unwatched entries.
+ * @param fds pointer to the poll array to reallocate
+ * @return false on errors
+ */
+static bool update_pollfd(struct pollfd** fds)
+{
+    struct pollfd* pfd;
+    size_t num = 0;
+
+    for (size_t i = 0; i < ctx.wfds_num; ++i) {
+        if (ctx.wfds[i].fd != -1) {
+            ctx.wfds[num++] = ctx.wfds[i];
+        }
+    }
+    ctx.wfds_num = num;
+    ctx.wfds_changed = false;
+
+    pfd = realloc(*fds, (num ? num : 1) * sizeof(*pfd));
+    if (!pfd) {
         return false;
     }
-    for (size_t i = 0; i < ctx.wfds_num; ++i) {
-        fds[i].fd = ctx.wfds[i].fd;
-        fds[i].events = POLLIN;
+    for (size_t i = 0; i < num; ++i) {
+        pfd[i].fd = ctx.wfds[i].fd;
+        pfd[i].events = POLLIN;
+        pfd[i].revents = 0;
     }
+    *fds = pfd;
+
+    return true;
+}
+
+bool app_run(void)
+{
+    struct pollfd* fds = NULL;
+    size_t fds_num;
 
     // main event loop
     ctx.state = loop_run;
+    ctx.wfds_changed = true;
     while (ctx.state == loop_run) {
+        // file descriptors to poll, the list can be changed by handlers
+        if (ctx.wfds_changed && !update_pollfd(&fds)) {
+            perror("Failed to allocate memory");
+            ctx.state = loop_error;
+            break;
+        }
+        fds_num = ctx.wfds_num;
+
         ui_event_prepare();
 
         // poll events
-        if (poll(fds, ctx.wfds_num, -1) < 0) {
+        if (poll(fds, fds_num, -1) < 0) {
             if (errno != EINTR) {
                 perror("Error polling events");
                 ctx.state = loop_error;
@@ -522,8 +712,8 @@ bool app_run(void)
         }
 
         // call handlers for each active event
-        for (size_t i = 0; i < ctx.wfds_num; ++i) {
-            if (fds[i].revents & POLLIN) {
+        for (size_t i = 0; i < fds_num; ++i) {
+            if ((fds[i].revents & POLLIN) && ctx.wfds[i].fd != -1) {
                 ctx.wfds[i].callback(ctx.wfds[i].data);
             }
         }
@@ -589,23 +779,7 @@ void app_redraw(void)
     const struct event event = {
         .type = event_redraw,
     };
-
-    // remove the same event to append new one to tail
-    pthread_mutex_lock(&ctx.events_lock);
-    list_for_each(ctx.events, struct event_queue, it) {
-        if (it->event.type == event_redraw) {
-            if (list_is_last(it)) {
-                pthread_mutex_unlock(&ctx.events_lock);
-                return;
-            }
-            ctx.events = list_remove(it);
-            free(it);
-            break;
-        }
-    }
-    pthread_mutex_unlock(&ctx.events_lock);
-
-    append_event(&event);
+    append_event(&event); // merged with pending redraw
 }
 
 void app_on_resize(void)
@@ -622,7 +796,7 @@ void app_on_keyboard(xkb_keysym_t key, uint8_t mods)
 
     if (kb) {
         for (size_t i = 0; i < kb->actions.num; ++i) {
-            apply_action(&kb->actions.sequence[i]);
+            apply_action(&kb->actions.sequence[i], false);
         }
     } else {
         char* name = keybind_name(key, mods);
@@ -639,20 +813,7 @@ void app_on_drag(int dx, int dy)
     const struct event event = { .type = event_drag,
                                  .param.drag.dx = dx,
                                  .param.drag.dy = dy };
-
-    // merge with existing event
-    pthread_mutex_lock(&ctx.events_lock);
-    list_for_each(ctx.events, struct event_queue, it) {
-        if (it->event.type == event_drag) {
-            it->event.param.drag.dx += dx;
-            it->event.param.drag.dy += dy;
-            pthread_mutex_unlock(&ctx.events_lock);
-            return;
-        }
-    }
-    pthread_mutex_unlock(&ctx.events_lock);
-
-    append_event(&event);
+    append_event(&event); // merged with pending drag
 }
 
 void app_on_load(struct image* image, size_t index)
@@ -665,6 +826,42 @@ void app_on_load(struct image* image, size_t index)
     append_event(&event);
 }
 
+void app_on_preview(struct image* image, size_t index)
+{
+    const struct event event = {
+        .type = event_preview,
+        .param.load.image = image,
+        .param.load.index = index,
+    };
+    append_event(&event);
+}
+
+void app_open(size_t index)
+{
+    const struct event event = {
+        .type = event_open,
+        .param.open.index = index,
+    };
+    append_event(&event);
+}
+
+bool app_apply(const char* text)
+{
+    struct action_seq actions = { 0 };
+
+    if (!action_create(text, &actions)) {
+        return false;
+    }
+
+    // actions are handled immediately as the sequence is freed right after
+    for (size_t i = 0; i < actions.num && ctx.state == loop_run; ++i) {
+        apply_action(&actions.sequence[i], true);
+    }
+    action_free(&actions);
+
+    return true;
+}
+
 void app_execute(const char* expr, const char* path)
 {
     char* cmd = NULL;
@@ -8,18 +8,25 @@
 #include "keybind.h"
 
 // Configuration parameters
-#define APP_CFG_SECTION  "general"
-#define APP_CFG_MODE     "mode"
-#define APP_CFG_POSITION "position"
-#define APP_CFG_SIZE     "size"
-#define APP_CFG_SIGUSR1  "sigusr1"
-#define APP_CFG_SIGUSR2  "sigusr2"
-#define APP_CFG_APP_ID   "app_id"
-#define APP_MODE_VIEWER  "viewer"
-#define APP_MODE_GALLERY "gallery"
-#define APP_FROM_PARENT  "parent"
-#define APP_FROM_IMAGE   "image"
-#define APP_FULLSCREEN   "fullscreen"
+#define APP_CFG_SECTION   "general"
+#define APP_CFG_MODE      "mode"
+#define APP_CFG_POSITION  "position"
+#define APP_CFG_SIZE      "size"
+#define APP_CFG_SIGUSR1   "sigusr1"
+#define APP_CFG_SIGUSR2   "sigusr2"
+#define APP_CFG_APP_ID    "app_id"
+#define APP_CFG_DECODERS  "preload_decoders"
+#define APP_CFG_MAXPIXELS "max_pixels"
+#define APP_CFG_SHMCACHE  "shared_cache"
+#define APP_CFG_DISKCACHE "disk_cache"
+#define APP_CFG_PERF      "perf_report"
+#define APP_CFG_CONTROL   "control"
+#define APP_CFG_BKG_CPUS  "background_cpus"
+#define APP_MODE_VIEWER   "viewer"
+#define APP_MODE_GALLERY  "gallery"
+#define APP_FROM_PARENT   "parent"
+#define APP_FROM_IMAGE    "image"
+#define APP_FULLSCREEN    "fullscreen"
 
 /**
  * Handler of the fd poll events.
@@ -49,6 +56,12 @@ void app_destroy(void);
  */
 void app_watch(int fd, fd_callback cb, void* data);
 
+/**
+ * Remove file descriptor from polling, the descriptor is not closed.
+ * @param fd file descriptor to remove
+ */
+void app_unwatch(int fd);
+
 /**
  * Run application.
  * @return true if application was closed by user, false on errors
@@ -108,6 +121,27 @@ void app_on_drag(int dx, int dy);
  */
 void app_on_load(struct image* image, size_t index);
 
+/**
+ * Handler of progressive decoding (background thread loader).
+ * @param image preview of the image being loaded, the handler owns it
+ * @param index index of the image in the image list
+ */
+void app_on_preview(struct image* image, size_t index);
+
+/**
+ * Handler of external event: open image.
+ * @param index index of the image in the image list
+ */
+void app_open(size_t index);
+
+/**
+ * Handler of external event: apply actions from text description.
+ * Must be called from the main loop thread.
+ * @param text action sequence in config format, e.g. "next_file;zoom +10"
+ * @return false if actions have invalid format
+ */
+bool app_apply(const char* text);
+
 /**
  * Execute system command for the specified image.
  * @param expr command expression
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 /** Config file location. */
 struct location {
@@ -25,6 +26,11 @@ static const struct location config_locations[] = {
     { NULL,              "/etc/xdg/swayimg/config" }
 };
 
+static const struct location cache_locations[] = {
+    { "XDG_CACHE_HOME", "/swayimg"        },
+    { "HOME",           "/.cache/swayimg" },
+};
+
 /**
  * Create key/value entry.
  * @param key,value config param
@@ -217,6 +223,45 @@ struct config* config_load(void)
     return cfg;
 }
 
+char* config_cache_path(const char* name)
+{
+    const size_t name_len = strlen(name);
+
+    for (size_t i = 0; i < ARRAY_SIZE(cache_locations); ++i) {
+        const struct location* cl = &cache_locations[i];
+        char* dir = expand_path(cl->prefix, cl->postfix);
+        const size_t dir_len = dir ? strlen(dir) : 0;
+        char* path;
+
+        if (!dir) {
+            continue;
+        }
+
+        // create directory with all parents
+        for (char* delim = strchr(dir + 1, '/'); delim;
+             delim = strchr(delim + 1, '/')) {
+            *delim = 0;
+            mkdir(dir, 0755);
+            *delim = '/';
+        }
+        if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+            free(dir);
+            continue;
+        }
+
+        path = realloc(dir, dir_len + name_len + 2 /* slash and last null */);
+        if (!path) {
+            free(dir);
+            return NULL;
+        }
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+        return path;
+    }
+
+    return NULL;
+}
+
 void config_free(struct config* cfg)
 {
     // free resources
@@ -28,6 +28,15 @@ struct config {
  */
 struct config* config_load(void);
 
+/**
+ * Get path to the file in the cache directory ($XDG_CACHE_HOME/swayimg or
+ * ~/.cache/swayimg), the directory is created if it doesn't exist.
+ * @param name file name
+ * @return path to the file or NULL if cache is not available, caller should
+ *         free it after use
+ */
+char* config_cache_path(const char* name);
+
 /**
  * Free configuration instance.
  * @param cfg config instance
@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: MIT
+// Control socket: commands and prefetch hints from external programs.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "control.h"
+
+#include "application.h"
+#include "buildcfg.h"
+#include "fetcher.h"
+#include "imagelist.h"
+#include "memdata.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Special value of the socket path: create socket in the runtime directory
+#define CONTROL_AUTO "auto"
+// Max length of the command line
+#define MAX_LINE (PATH_MAX + 32)
+// Max number of simultaneous connections
+#define MAX_CLIENTS 16
+
+/** Client connection. */
+struct client {
+    struct list list;      ///< Links to prev/next entry
+    int fd;                ///< Socket descriptor
+    size_t len;            ///< Number of bytes in the buffer
+    char buffer[MAX_LINE]; ///< Incomplete command line
+};
+
+/** Control command handler. */
+typedef const char* (*command_fn)(const char* args);
+
+/** Control command description. */
+struct command {
+    const char* name; ///< Command name
+    command_fn fn;    ///< Command handler
+};
+
+/** Control socket context. */
+struct control {
+    int fd;                 ///< Listening socket
+    char* path;             ///< Path to the socket file
+    struct client* clients; ///< Active connections
+    size_t clients_num;     ///< Number of active connections
+};
+
+static struct control ctx = {
+    .fd = -1,
+};
+
+/**
+ * Find image in the image list.
+ * @param path path to the image file
+ * @return index of the image or IMGLIST_INVALID if not found
+ */
+static size_t find_image(const char* path)
+{
+    size_t index = image_list_find(path);
+
+    if (index == IMGLIST_INVALID && path[0] == '/') {
+        // image list contains paths relative to the working directory
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd))) {
+            const size_t len = strlen(cwd);
+            if (strncmp(path, cwd, len) == 0 && path[len] == '/') {
+                index = image_list_find(path + len + 1);
+            }
+        }
+    }
+
+    return index;
+}
+
+/** Command handler: open image by path. */
+static const char* cmd_open(const char* args)
+{
+    const size_t index = find_image(args);
+    if (index == IMGLIST_INVALID) {
+        return "image is not in the list";
+    }
+    app_open(index);
+    return NULL;
+}
+
+/** Command handler: open image by its number in the list. */
+static const char* cmd_index(const char* args)
+{
+    ssize_t num;
+    if (!str_to_num(args, 0, &num, 0) || num <= 0 ||
+        !image_list_get(num - 1)) {
+        return "invalid image number";
+    }
+    app_open(num - 1);
+    return NULL;
+}
+
+/** Command handler: apply actions. */
+static const char* cmd_action(const char* args)
+{
+    return app_apply(args) ? NULL : "invalid action";
+}
+
+/** Command handler: add prefetch hint. */
+static const char* cmd_prefetch(const char* args)
+{
+    const char* path = strchr(args, ' ');
+    ssize_t priority;
+    size_t index;
+
+    if (!path || !str_to_num(args, path - args, &priority, 0) ||
+        priority < INT_MIN || priority > INT_MAX) {
+        return "invalid format, expected: prefetch PRIORITY PATH";
+    }
+    while (*path == ' ') {
+        ++path;
+    }
+    index = find_image(path);
+    if (index == IMGLIST_INVALID) {
+        return "image is not in the list";
+    }
+    if (!fetcher_prefetch(index, priority)) {
+        return "prefetch queue is full";
+    }
+    return NULL;
+}
+
+/** Command handler: drop prefetch hints. */
+static const char* cmd_drop(const char* args)
+{
+    size_t index = IMGLIST_INVALID;
+    if (*args) {
+        index = find_image(args);
+        if (index == IMGLIST_INVALID) {
+            return "image is not in the list";
+        }
+    }
+    fetcher_drop(index);
+    return NULL;
+}
+
+// clang-format off
+static const struct command commands[] = {
+    { "open",     cmd_open     },
+    { "index",    cmd_index    },
+    { "action",   cmd_action   },
+    { "prefetch", cmd_prefetch },
+    { "drop",     cmd_drop     },
+};
+// clang-format on
+
+/**
+ * Send reply to the client, errors are ignored.
+ * @param fd socket descriptor
+ * @param error error description or NULL on success
+ */
+static void send_reply(int fd, const char* error)
+{
+    char reply[128];
+
+    if (error) {
+        snprintf(reply, sizeof(reply), "error: %s\n", error);
+    } else {
+        snprintf(reply, sizeof(reply), "ok\n");
+    }
+    send(fd, reply, strlen(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/**
+ * Close client connection.
+ * @param client connection to close
+ */
+static void disconnect(struct client* client)
+{
+    app_unwatch(client->fd);
+    close(client->fd);
+    ctx.clients = list_remove(client);
+    --ctx.clients_num;
+    free(client);
+}
+
+/** Client socket handler: read and execute commands. */
+static void on_client(void* data)
+{
+    struct client* client = data;
+    const size_t space = sizeof(client->buffer) - client->len - 1;
+    ssize_t rc;
+    char* line;
+    char* end;
+
+    rc = recv(client->fd, client->buffer + client->len, space, MSG_DONTWAIT);
+    if (rc == -1 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+    if (rc <= 0) {
+        // connection closed, execute the last command without line feed
+        if (rc == 0 && client->len) {
+            client->buffer[client->len] = 0;
+            send_reply(client->fd, control_execute(client->buffer));
+        }
+        disconnect(client);
+        return;
+    }
+    client->len += rc;
+    client->buffer[client->len] = 0;
+
+    // execute complete lines
+    line = client->buffer;
+    while ((end = strchr(line, '\n'))) {
+        *end = 0;
+        if (end > line && end[-1] == '\r') {
+            end[-1] = 0;
+        }
+        if (*line) {
+            send_reply(client->fd, control_execute(line));
+        }
+        line = end + 1;
+    }
+    client->len -= line - client->buffer;
+    memmove(client->buffer, line, client->len);
+
+    if (client->len == sizeof(client->buffer) - 1) {
+        send_reply(client->fd, "line too long");
+        disconnect(client);
+    }
+}
+
+/** Listening socket handler: accept new connection. */
+static void on_connect(__attribute__((unused)) void* data)
+{
+    struct client* client;
+    int fd;
+
+    fd = accept(ctx.fd, NULL, NULL);
+    if (fd == -1) {
+        return;
+    }
+    if (ctx.clients_num >= MAX_CLIENTS) {
+        send_reply(fd, "too many connections");
+        close(fd);
+        return;
+    }
+
+    client = calloc(1, sizeof(*client));
+    if (!client) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    client->fd = fd;
+    ctx.clients = list_add(ctx.clients, client);
+    ++ctx.clients_num;
+
+    app_watch(fd, on_client, client);
+}
+
+/**
+ * Compose path to the socket file.
+ * @param value config value
+ * @return false if path is not available
+ */
+static bool set_path(const char* value)
+{
+    if (strcmp(value, CONTROL_AUTO) == 0) {
+        const char* runtime = getenv("XDG_RUNTIME_DIR");
+        char path[PATH_MAX];
+        if (!runtime || !*runtime) {
+            return false;
+        }
+        snprintf(path, sizeof(path), "%s/" APP_NAME "-%d.sock", runtime,
+                 (int)getpid());
+        str_dup(path, &ctx.path);
+    } else {
+        str_dup(value, &ctx.path);
+    }
+    return !!ctx.path;
+}
+
+void control_init(struct config* cfg)
+{
+    const char* value;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct stat st;
+    int fd;
+
+    value = config_get_string(cfg, APP_CFG_SECTION, APP_CFG_CONTROL, "");
+    if (!*value) {
+        return; // disabled
+    }
+    if (!set_path(value) || strlen(ctx.path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Invalid control socket path: %s\n", value);
+        free(ctx.path);
+        ctx.path = NULL;
+        return;
+    }
+    strcpy(addr.sun_path, ctx.path);
+
+    // remove stale socket file, but don't interfere with the running
+    // instance and never remove anything that is not a socket
+    if (lstat(ctx.path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1) {
+            const int rc =
+                connect(fd, (const struct sockaddr*)&addr, sizeof(addr));
+            if (rc == -1 && errno == ECONNREFUSED) {
+                unlink(ctx.path);
+            }
+            close(fd);
+        }
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 ||
+        bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(fd, MAX_CLIENTS) == -1) {
+        fprintf(stderr, "Unable to create control socket %s: %s\n", ctx.path,
+                strerror(errno));
+        if (fd != -1) {
+            close(fd);
+        }
+        free(ctx.path);
+        ctx.path = NULL;
+        return;
+    }
+
+    ctx.fd = fd;
+    app_watch(ctx.fd, on_connect, NULL);
+
+    // let child processes (exec action) know where to send commands
+    setenv(CONTROL_ENV, ctx.path, 1);
+}
+
+void control_destroy(void)
+{
+    list_for_each(ctx.clients, struct client, it) {
+        disconnect(it);
+    }
+    if (ctx.fd != -1) {
+        app_unwatch(ctx.fd);
+        close(ctx.fd);
+        ctx.fd = -1;
+    }
+    if (ctx.path) {
+        unlink(ctx.path);
+        free(ctx.path);
+        ctx.path = NULL;
+    }
+}
+
+const char* control_execute(const char* cmd)
+{
+    const char* args;
+    size_t len;
+
+    while (*cmd == ' ') {
+        ++cmd;
+    }
+    args = strchr(cmd, ' ');
+    if (args) {
+        len = args - cmd;
+        while (*args == ' ') {
+            ++args;
+        }
+    } else {
+        len = strlen(cmd);
+        args = cmd + len;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(commands); ++i) {
+        const struct command* command = &commands[i];
+        if (strlen(command->name) == len &&
+            strncmp(command->name, cmd, len) == 0) {
+            return command->fn(args);
+        }
+    }
+
+    return "unknown command";
+}
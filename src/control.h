@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: MIT
+// Control socket: commands and prefetch hints from external programs.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+
+// Name of the environment variable with the control socket path
+#define CONTROL_ENV "SWAYIMG_CONTROL"
+
+/**
+ * Create control socket and register it in the main loop.
+ * @param cfg config instance
+ */
+void control_init(struct config* cfg);
+
+/**
+ * Close connections and remove control socket.
+ */
+void control_destroy(void);
+
+/**
+ * Execute single control command.
+ * @param cmd command text: name followed by arguments
+ * @return error description or NULL on success
+ */
+const char* control_execute(const char* cmd);
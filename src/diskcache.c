@@ -0,0 +1,254 @@
+// SPDX-License-Identifier: MIT
+// Persistent cache of decoded images for formats that are slow to decode.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "diskcache.h"
+
+#include "application.h"
+#include "perf.h"
+#include "pixcache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Default cache size limit in MiB, 0 disables the cache
+#define CFG_DISKCACHE_DEF 0
+
+// Name of the cache directory
+#define CACHE_DIR "decoded"
+// Extension of the cache files
+#define CACHE_EXT ".pix"
+// Suffix of temporary files, see `mkstemp`
+#define TEMP_SUFFIX ".XXXXXX"
+// Age (seconds) of temporary file left by interrupted write
+#define TEMP_STALE (10 * 60)
+// Min decoding time (ms) to put the image to the cache
+#define MIN_DECODE_TIME 100
+
+/** Cache file description used for eviction. */
+struct cache_entry {
+    char name[NAME_MAX + 1]; ///< File name
+    time_t mtime;            ///< Last access time
+    uint64_t size;           ///< File size
+    bool temp;               ///< Temporary file that is being written
+};
+
+/** Disk cache context. */
+struct diskcache {
+    char* dir;      ///< Cache directory, NULL if cache is disabled
+    uint64_t limit; ///< Max total size of cache files
+};
+
+static struct diskcache ctx;
+
+/**
+ * Compose path to the cache file.
+ * @param path output buffer
+ * @param key cached image identifier
+ * @return false if path is too long
+ */
+static bool file_path(char* path, const struct pixcache_key* key)
+{
+    // one file per source file, the key is validated on loading
+    const int len = snprintf(path, PATH_MAX,
+                             "%s/%" PRIx64 "-%" PRIx64 CACHE_EXT, ctx.dir,
+                             key->dev, key->ino);
+    return len > 0 && len < PATH_MAX;
+}
+
+/** Compare cache entries by access time: see `qsort`. */
+static int compare_entries(const void* a, const void* b)
+{
+    const struct cache_entry* ea = a;
+    const struct cache_entry* eb = b;
+    return (ea->mtime > eb->mtime) - (ea->mtime < eb->mtime);
+}
+
+/**
+ * Check if the file belongs to the cache.
+ * @param name file name
+ * @param temp output flag: the file is temporary
+ * @return true if it is a cache file or temporary one
+ */
+static bool is_cache_file(const char* name, bool* temp)
+{
+    const char* ext = strstr(name, CACHE_EXT);
+
+    if (!ext || ext == name) {
+        return false;
+    }
+    ext += sizeof(CACHE_EXT) - 1;
+    *temp = *ext;
+
+    return !*temp ||
+        (*ext == '.' && strlen(ext) == sizeof(TEMP_SUFFIX) - 1);
+}
+
+/**
+ * Remove the least recently used files to fit the size limit,
+ * temporary files left by crashed writers are removed too.
+ */
+static void evict(void)
+{
+    struct cache_entry* entries = NULL;
+    size_t num = 0, max = 0;
+    uint64_t total = 0;
+    struct dirent* de;
+    DIR* dir;
+
+    dir = opendir(ctx.dir);
+    if (!dir) {
+        return;
+    }
+
+    while ((de = readdir(dir))) {
+        struct stat st;
+        bool temp;
+
+        if (!is_cache_file(de->d_name, &temp) ||
+            fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (temp && time(NULL) - st.st_mtime > TEMP_STALE) {
+            unlinkat(dirfd(dir), de->d_name, 0);
+            continue;
+        }
+        if (num == max) {
+            const size_t new_max = max ? max * 2 : 64;
+            struct cache_entry* new_entries =
+                realloc(entries, new_max * sizeof(*entries));
+            if (!new_entries) {
+                break;
+            }
+            entries = new_entries;
+            max = new_max;
+        }
+        strcpy(entries[num].name, de->d_name);
+        entries[num].mtime = st.st_mtime;
+        entries[num].size = st.st_size;
+        entries[num].temp = temp;
+        total += st.st_size;
+        ++num;
+    }
+
+    if (total > ctx.limit) {
+        qsort(entries, num, sizeof(*entries), compare_entries);
+        for (size_t i = 0; i < num && total > ctx.limit; ++i) {
+            // temporary files are in use by other writers
+            if (!entries[i].temp &&
+                unlinkat(dirfd(dir), entries[i].name, 0) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+
+    closedir(dir);
+    free(entries);
+}
+
+void diskcache_init(struct config* cfg)
+{
+    const ssize_t limit =
+        config_get_num(cfg, APP_CFG_SECTION, APP_CFG_DISKCACHE, 0,
+                       1024 * 1024, CFG_DISKCACHE_DEF);
+
+    if (limit == 0) {
+        return;
+    }
+
+    ctx.dir = config_cache_path(CACHE_DIR);
+    if (!ctx.dir) {
+        return;
+    }
+    if (mkdir(ctx.dir, 0700) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create cache directory %s: %s\n", ctx.dir,
+                strerror(errno));
+        free(ctx.dir);
+        ctx.dir = NULL;
+        return;
+    }
+
+    ctx.limit = (uint64_t)limit * 1024 * 1024;
+}
+
+void diskcache_destroy(void)
+{
+    free(ctx.dir);
+    ctx.dir = NULL;
+}
+
+bool diskcache_load(struct image* img, const struct stat* st)
+{
+    struct pixcache_key key;
+    char path[PATH_MAX];
+    bool rc;
+    int fd;
+
+    if (!ctx.dir) {
+        return false;
+    }
+
+    pixcache_make_key(&key, st);
+    if (!file_path(path, &key)) {
+        return false;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perf_cache(perf_diskcache, false);
+        return false;
+    }
+    rc = pixcache_map(img, fd, &key);
+    if (rc) {
+        futimens(fd, NULL); // update access time for LRU eviction
+    }
+    close(fd);
+
+    perf_cache(perf_diskcache, rc);
+
+    return rc;
+}
+
+void diskcache_save(const struct image* img, const struct stat* st,
+                    size_t decode_time)
+{
+    struct pixcache_key key;
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    size_t size;
+    int fd;
+
+    if (!ctx.dir || decode_time < MIN_DECODE_TIME) {
+        return;
+    }
+    size = pixcache_size(img);
+    if (size == 0 || size > ctx.limit) {
+        return;
+    }
+
+    pixcache_make_key(&key, st);
+    if (!file_path(path, &key) ||
+        snprintf(tmp, sizeof(tmp), "%s" TEMP_SUFFIX, path) >= (int)sizeof(tmp)) {
+        return;
+    }
+
+    // write to temporary file and rename it to replace the cache atomically
+    fd = mkstemp(tmp);
+    if (fd == -1) {
+        return;
+    }
+    if (pixcache_write(fd, img, &key, size) && rename(tmp, path) == 0) {
+        evict();
+    } else {
+        unlink(tmp);
+    }
+    close(fd);
+}
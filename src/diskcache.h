@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+// Persistent cache of decoded images for formats that are slow to decode.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+#include "image.h"
+
+#include <sys/stat.h>
+
+/**
+ * Initialize disk cache, the cache is disabled if its size limit is not set
+ * in the config.
+ * @param cfg config instance
+ */
+void diskcache_init(struct config* cfg);
+
+/**
+ * Free disk cache resources.
+ */
+void diskcache_destroy(void);
+
+/**
+ * Load decoded image from the cache. Frames of the loaded image reference
+ * the cache file via copy-on-write image mapping.
+ * @param img destination image
+ * @param st attributes of the image file
+ * @return true if image was found in the cache
+ */
+bool diskcache_load(struct image* img, const struct stat* st);
+
+/**
+ * Put decoded image to the cache if decoding was slow enough.
+ * @param img image to store
+ * @param st attributes of the image file
+ * @param decode_time time spent to decode the image in milliseconds
+ */
+void diskcache_save(const struct image* img, const struct stat* st,
+                    size_t decode_time);
@@ -4,10 +4,58 @@
 
 #include "event.h"
 
+#include "memdata.h"
+#include "perf.h"
+
 #include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/eventfd.h>
 #include <unistd.h>
 
+// Capacity of the event queue, must be a power of 2
+#define QUEUE_SIZE 1024
+
+/** Event queue cell. */
+struct cell {
+    size_t seq;         ///< Sequence number, defines the cell state
+    struct event event; ///< Event data
+};
+
+/** Event that didn't fit into the ring. */
+struct overflow {
+    struct list list;   ///< Links to prev/next entry
+    struct event event; ///< Event data
+};
+
+/**
+ * Event queue: bounded lock-free ring for multiple producers and a single
+ * consumer, and pending slots for events that can be merged.
+ */
+struct evqueue {
+    struct cell cells[QUEUE_SIZE]; ///< Ring buffer
+    size_t head;                   ///< Write position (producers)
+    size_t tail;                   ///< Read position (consumer)
+
+    struct overflow* overflow; ///< Events queued while the ring is full
+    bool overflowed;           ///< Overflow list is not empty
+
+    bool redraw; ///< Redraw is pending
+    bool resize; ///< Resize is pending
+    bool drag;   ///< Drag is pending
+    int drag_dx; ///< Accumulated horizontal drag delta
+    int drag_dy; ///< Accumulated vertical drag delta
+};
+
+/** Global event queue. */
+static struct evqueue queue;
+
+/** Overflow list lock. */
+static pthread_mutex_t overflow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Queue initialization guard for the first use. */
+static bool queue_init;
+
 int notification_create(void)
 {
     return eventfd(0, 0);
@@ -37,3 +85,225 @@ void notification_reset(int fd)
         len = read(fd, &value, sizeof(value));
     } while (len == -1 && errno == EINTR);
 }
+
+/**
+ * Append event to the overflow list.
+ * @param event event to append
+ * @return false if memory allocation failed
+ */
+static bool overflow_push(const struct event* event)
+{
+    struct overflow* entry = malloc(sizeof(*entry));
+    if (!entry) {
+        return false;
+    }
+    entry->event = *event;
+
+    pthread_mutex_lock(&overflow_lock);
+    queue.overflow = list_append(queue.overflow, entry);
+    __atomic_store_n(&queue.overflowed, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&overflow_lock);
+    perf_queue(perf_event_queue, 1);
+
+    return true;
+}
+
+/**
+ * Get the first event from the overflow list.
+ * @param event output event
+ * @return false if list is empty
+ */
+static bool overflow_pop(struct event* event)
+{
+    struct overflow* entry = NULL;
+
+    if (!__atomic_load_n(&queue.overflowed, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&overflow_lock);
+    if (queue.overflow) {
+        entry = queue.overflow;
+        queue.overflow = list_remove(entry);
+    }
+    if (!queue.overflow) {
+        // the ring is used again by producers
+        __atomic_store_n(&queue.overflowed, false, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&overflow_lock);
+
+    if (!entry) {
+        return false;
+    }
+    *event = entry->event;
+    free(entry);
+    perf_queue(perf_event_queue, -1);
+
+    return true;
+}
+
+void evqueue_reset(void)
+{
+    list_for_each(queue.overflow, struct overflow, it) {
+        free(it);
+    }
+    queue.overflow = NULL;
+    queue.overflowed = false;
+
+    for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+        queue.cells[i].seq = i;
+    }
+    queue.head = 0;
+    queue.tail = 0;
+    queue.redraw = false;
+    queue.resize = false;
+    queue.drag = false;
+    queue.drag_dx = 0;
+    queue.drag_dy = 0;
+    __atomic_store_n(&queue_init, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get pending drag.
+ * @param event output drag event
+ * @return false if there is no pending drag
+ */
+static bool take_drag(struct event* event)
+{
+    if (!__atomic_exchange_n(&queue.drag, false, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    event->type = event_drag;
+    event->param.drag.dx =
+        __atomic_exchange_n(&queue.drag_dx, 0, __ATOMIC_RELAXED);
+    event->param.drag.dy =
+        __atomic_exchange_n(&queue.drag_dy, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * Merge drag with the pending one.
+ * @param dx,dy drag delta
+ */
+static void merge_drag(int dx, int dy)
+{
+    __atomic_add_fetch(&queue.drag_dx, dx, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&queue.drag_dy, dy, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue.drag, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * Put event to the ring or to the overflow list.
+ * @param event event to append
+ * @return false if memory allocation failed
+ */
+static bool enqueue(const struct event* event)
+{
+    struct cell* cell;
+    size_t pos;
+
+    // keep order of events from the same producer: the ring is not used
+    // until the overflow list is drained, but events from different
+    // producers that race with the overflow can be reordered
+    if (__atomic_load_n(&queue.overflowed, __ATOMIC_ACQUIRE)) {
+        return overflow_push(event);
+    }
+
+    // claim the cell at the head
+    pos = __atomic_load_n(&queue.head, __ATOMIC_RELAXED);
+    while (true) {
+        size_t seq;
+        cell = &queue.cells[pos & (QUEUE_SIZE - 1)];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&queue.head, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (seq < pos) {
+            // cell is not consumed yet: ring is full
+            return overflow_push(event);
+        } else {
+            pos = __atomic_load_n(&queue.head, __ATOMIC_RELAXED);
+        }
+    }
+
+    // publish the event to consumer
+    cell->event = *event;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    perf_queue(perf_event_queue, 1);
+
+    return true;
+}
+
+bool evqueue_push(const struct event* event)
+{
+    struct event drag;
+
+    if (!__atomic_load_n(&queue_init, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    // merge with the pending event of the same type
+    switch (event->type) {
+        case event_redraw:
+            __atomic_store_n(&queue.redraw, true, __ATOMIC_RELEASE);
+            return true;
+        case event_resize:
+            __atomic_store_n(&queue.resize, true, __ATOMIC_RELEASE);
+            return true;
+        case event_drag:
+            merge_drag(event->param.drag.dx, event->param.drag.dy);
+            return true;
+        default:
+            break;
+    }
+
+    // keep order of user input: pending drag must be applied before the
+    // event, e.g. before zoom or reset
+    if (take_drag(&drag) && !enqueue(&drag)) {
+        merge_drag(drag.param.drag.dx, drag.param.drag.dy);
+    }
+
+    return enqueue(event);
+}
+
+bool evqueue_pop(struct event* event)
+{
+    struct cell* cell = &queue.cells[queue.tail & (QUEUE_SIZE - 1)];
+
+    if (!__atomic_load_n(&queue_init, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    // resize doesn't carry data, so handle it first to let queued events use
+    // the actual window size
+    if (__atomic_exchange_n(&queue.resize, false, __ATOMIC_ACQUIRE)) {
+        event->type = event_resize;
+        return true;
+    }
+
+    if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == queue.tail + 1) {
+        *event = cell->event;
+        // release the cell for the next round
+        __atomic_store_n(&cell->seq, queue.tail + QUEUE_SIZE, __ATOMIC_RELEASE);
+        ++queue.tail;
+        perf_queue(perf_event_queue, -1);
+        return true;
+    }
+
+    if (overflow_pop(event)) {
+        return true;
+    }
+
+    if (take_drag(event)) {
+        return true;
+    }
+    if (__atomic_exchange_n(&queue.redraw, false, __ATOMIC_ACQUIRE)) {
+        event->type = event_redraw;
+        return true;
+    }
+
+    return false;
+}
@@ -14,7 +14,9 @@ enum event_type {
     event_resize,   ///< Window resize notification
     event_drag,     ///< Mouse or touch drag operation
     event_load,     ///< Image loaded (preload thread notification)
+    event_preview,  ///< Preview of the image being loaded (progressive)
     event_activate, ///< The mode is activating (viewer/gallery switch)
+    event_open,     ///< Open image (external control request)
 };
 
 /** Event description. */
@@ -34,6 +36,11 @@ struct event {
             size_t index;
         } activate;
 
+        struct open {
+            size_t index;
+        } open;
+
+        // used by load and preview events
         struct load {
             struct image* image;
             size_t index;
@@ -71,3 +78,30 @@ void notification_raise(int fd);
  * @param fd file descriptor for the notification
  */
 void notification_reset(int fd);
+
+/**
+ * Reset event queue, pending events are discarded.
+ * Must not be called while the queue is in use.
+ */
+void evqueue_reset(void);
+
+/**
+ * Append event to the queue, can be called from any thread.
+ * Redraw, resize and drag events are merged with the pending ones of the
+ * same type instead of being queued, pending drag is queued before other
+ * events to keep order of user input. When the ring buffer is full, events
+ * are stored in the overflow list. Order is kept for events from the same
+ * thread, events from different threads can be reordered on overflow.
+ * @param event event to append
+ * @return false if memory allocation failed
+ */
+bool evqueue_push(const struct event* event);
+
+/**
+ * Get the next event from the queue, must be called from a single thread.
+ * Pending resize is returned first, then queued events, then pending drag
+ * (the one that is not followed by other events) and redraw.
+ * @param event output event
+ * @return false if queue is empty
+ */
+bool evqueue_pop(struct event* event);
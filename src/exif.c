@@ -4,49 +4,171 @@
 
 #include "exif.h"
 
-#include <libexif/exif-data.h>
 #include <string.h>
 
+#ifdef HAVE_LIBEXIF
+#include <libexif/exif-data.h>
+#endif
+
+// JPEG markers
+#define JPEG_MARKER 0xff
+#define JPEG_SOI    0xd8
+#define JPEG_SOS    0xda
+#define JPEG_APP1   0xe1
+
+// EXIF header in JPEG APP1 segment
+static const uint8_t exif_header[] = { 'E', 'x', 'i', 'f', 0, 0 };
+
+// Orientation tag in TIFF IFD
+#define TIFF_TAG_ORIENTATION 0x0112
+#define TIFF_TYPE_SHORT      3
+#define TIFF_ENTRY_SIZE      12
+
 /**
- * Fix orientation from EXIF data.
- * @param img target image instance
- * @param exif instance of EXIF reader
+ * Read 16-bit value from TIFF data.
+ * @param data pointer to the value
+ * @param le byte order: true for little-endian, false for big-endian
+ * @return value
  */
-static void fix_orientation(struct image* img, ExifData* exif)
+static inline uint16_t get_u16(const uint8_t* data, bool le)
 {
-    const ExifEntry* entry = exif_data_get_entry(exif, EXIF_TAG_ORIENTATION);
-    if (entry) {
-        const ExifByteOrder byte_order = exif_data_get_byte_order(exif);
-        switch (exif_get_short(entry->data, byte_order)) {
-            case 2: // flipped back-to-front
-                image_flip_horizontal(img);
-                break;
-            case 3: // upside down
-                image_rotate(img, 180);
-                break;
-            case 4: // flipped back-to-front and upside down
-                image_flip_vertical(img);
-                break;
-            case 5: // flipped back-to-front and on its side
-                image_flip_horizontal(img);
-                image_rotate(img, 90);
-                break;
-            case 6: // on its side
-                image_rotate(img, 90);
-                break;
-            case 7: // flipped back-to-front and on its far side
-                image_flip_vertical(img);
-                image_rotate(img, 270);
-                break;
-            case 8: // on its far side
-                image_rotate(img, 270);
-                break;
-            default:
-                break;
+    return le ? data[0] | data[1] << 8 : data[0] << 8 | data[1];
+}
+
+/**
+ * Read 32-bit value from TIFF data.
+ * @param data pointer to the value
+ * @param le byte order: true for little-endian, false for big-endian
+ * @return value
+ */
+static inline uint32_t get_u32(const uint8_t* data, bool le)
+{
+    return le ? (uint32_t)get_u16(data + 2, le) << 16 | get_u16(data, le)
+              : (uint32_t)get_u16(data, le) << 16 | get_u16(data + 2, le);
+}
+
+const uint8_t* exif_from_jpeg(const uint8_t* data, size_t size,
+                              size_t* exif_size)
+{
+    size_t pos = 2;
+
+    if (size < 2 || data[0] != JPEG_MARKER || data[1] != JPEG_SOI) {
+        return NULL;
+    }
+
+    // walk through segments until the image data begins
+    while (pos + 4 <= size && data[pos] == JPEG_MARKER) {
+        const uint8_t marker = data[pos + 1];
+        const size_t len = data[pos + 2] << 8 | data[pos + 3];
+
+        if (marker == JPEG_MARKER) {
+            ++pos; // fill byte
+            continue;
+        }
+        if (marker == JPEG_SOS || len < 2 || pos + 2 + len > size) {
+            break;
+        }
+        if (marker == JPEG_APP1 && len >= 2 + sizeof(exif_header) &&
+            memcmp(data + pos + 4, exif_header, sizeof(exif_header)) == 0) {
+            *exif_size = len - 2 - sizeof(exif_header);
+            return data + pos + 4 + sizeof(exif_header);
         }
+        pos += 2 + len;
     }
+
+    return NULL;
+}
+
+const uint8_t* exif_from_block(const uint8_t* data, size_t size,
+                               size_t* exif_size)
+{
+    if (size >= sizeof(exif_header) &&
+        memcmp(data, exif_header, sizeof(exif_header)) == 0) {
+        data += sizeof(exif_header);
+        size -= sizeof(exif_header);
+    }
+    *exif_size = size;
+    return data;
+}
+
+uint8_t exif_orientation(const uint8_t* data, size_t size)
+{
+    uint32_t ifd;
+    uint16_t entries;
+    bool le;
+
+    // TIFF header: byte order, magic and offset of the first IFD
+    if (size < 8) {
+        return 0;
+    }
+    if (data[0] == 'I' && data[1] == 'I') {
+        le = true;
+    } else if (data[0] == 'M' && data[1] == 'M') {
+        le = false;
+    } else {
+        return 0;
+    }
+    if (get_u16(data + 2, le) != 42) {
+        return 0;
+    }
+    ifd = get_u32(data + 4, le);
+    if (ifd < 8 || ifd > size - 2) {
+        return 0;
+    }
+
+    // search for orientation tag in the first IFD
+    entries = get_u16(data + ifd, le);
+    if (entries > (size - ifd - 2) / TIFF_ENTRY_SIZE) {
+        return 0;
+    }
+    for (size_t i = 0; i < entries; ++i) {
+        const uint8_t* entry = data + ifd + 2 + i * TIFF_ENTRY_SIZE;
+        if (get_u16(entry, le) == TIFF_TAG_ORIENTATION) {
+            const uint16_t value = get_u16(entry + 8, le);
+            if (get_u16(entry + 2, le) != TIFF_TYPE_SHORT || value < 1 ||
+                value > 8) {
+                return 0;
+            }
+            return value;
+        }
+    }
+
+    return 0;
 }
 
+void exif_orient(struct image* img, uint8_t orientation)
+{
+    switch (orientation) {
+        case 2: // flipped back-to-front
+            image_flip_horizontal(img);
+            break;
+        case 3: // upside down
+            image_rotate(img, 180);
+            break;
+        case 4: // flipped back-to-front and upside down
+            image_flip_vertical(img);
+            break;
+        case 5: // flipped back-to-front and on its side
+            image_flip_horizontal(img);
+            image_rotate(img, 90);
+            break;
+        case 6: // on its side
+            image_rotate(img, 90);
+            break;
+        case 7: // flipped back-to-front and on its far side
+            image_flip_vertical(img);
+            image_rotate(img, 270);
+            break;
+        case 8: // on its far side
+            image_rotate(img, 270);
+            break;
+        default:
+            break;
+    }
+}
+
+#ifdef HAVE_LIBEXIF
+
 /**
  * Add meta info from EXIF tag.
  * @param img target image instance
@@ -158,12 +280,10 @@ static void read_location(struct image* img, ExifData* exif)
     // NOLINTEND(clang-analyzer-optin.core.EnumCastOutOfRange)
 }
 
-void process_exif(struct image* img, const uint8_t* data, size_t size)
+void exif_read_meta(struct image* img, const uint8_t* data, size_t size)
 {
     ExifData* exif = exif_data_new_from_data(data, (unsigned int)size);
     if (exif) {
-        fix_orientation(img, exif);
-
         add_meta(img, exif, EXIF_TAG_DATE_TIME, "DateTime");
         add_meta(img, exif, EXIF_TAG_MAKE, "Camera");
         add_meta(img, exif, EXIF_TAG_MODEL, "Model");
@@ -176,3 +296,5 @@ void process_exif(struct image* img, const uint8_t* data, size_t size)
         exif_data_unref(exif);
     }
 }
+
+#endif // HAVE_LIBEXIF
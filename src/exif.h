@@ -4,12 +4,51 @@
 
 #pragma once
 
+#include "buildcfg.h"
 #include "image.h"
 
 /**
- * Read and handle EXIF data.
+ * Find EXIF data in JPEG file (APP1 segment), only headers are scanned.
+ * @param data image file data
+ * @param size size of image data in bytes
+ * @param exif_size output size of EXIF data in bytes
+ * @return pointer to EXIF data (TIFF header) or NULL if not found
+ */
+const uint8_t* exif_from_jpeg(const uint8_t* data, size_t size,
+                              size_t* exif_size);
+
+/**
+ * Find TIFF header in EXIF block stored as a separate chunk (WebP, HEIF),
+ * the block can start with the "Exif" header.
+ * @param data EXIF block
+ * @param size size of EXIF block in bytes
+ * @param exif_size output size of EXIF data in bytes
+ * @return pointer to EXIF data (TIFF header)
+ */
+const uint8_t* exif_from_block(const uint8_t* data, size_t size,
+                               size_t* exif_size);
+
+/**
+ * Get orientation from EXIF data, only the first IFD is scanned.
+ * @param data EXIF data started with TIFF header
+ * @param size size of EXIF data in bytes
+ * @return orientation (1-8), 0 if orientation is not specified
+ */
+uint8_t exif_orientation(const uint8_t* data, size_t size);
+
+/**
+ * Fix image orientation.
+ * @param img target image context
+ * @param orientation EXIF orientation (1-8)
+ */
+void exif_orient(struct image* img, uint8_t orientation);
+
+#ifdef HAVE_LIBEXIF
+/**
+ * Read EXIF data and add it to the image meta info.
  * @param img target image context
  * @param data image file data
  * @param size size of image data in bytes
  */
-void process_exif(struct image* img, const uint8_t* data, size_t size);
+void exif_read_meta(struct image* img, const uint8_t* data, size_t size);
+#endif
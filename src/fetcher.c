@@ -8,9 +8,11 @@
 #include "buildcfg.h"
 #include "imagelist.h"
 #include "loader.h"
+#include "perf.h"
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #ifdef HAVE_INOTIFY
@@ -23,11 +25,24 @@ struct image_cache {
     struct image** queue; ///< Cache queue
 };
 
+/** Prefetch hint from external program. */
+struct hint {
+    size_t index; ///< Index of the image in the image list
+    int priority; ///< Load priority, adjacent images have priority 0
+};
+
 /** Image fetch context. */
 struct fetch {
     struct image* current;      ///< Current image
+    bool outdated;              ///< Current image is being reloaded
+    size_t pending;             ///< Image being loaded to open
+    bool forward;               ///< Direction to look up on pending failure
+    bool seeking;               ///< Loading is suspended (fast navigation)
     struct image_cache history; ///< Least recently viewed images
     struct image_cache preload; ///< Preloaded images
+    struct image_cache hinted;  ///< Images loaded by prefetch hints
+    struct hint* hints;         ///< Prefetch hints, sorted by priority
+    size_t hints_num;           ///< Number of prefetch hints
 #ifdef HAVE_INOTIFY
     int notify; ///< inotify file handler
     int watch;  ///< Current file watcher
@@ -81,13 +96,17 @@ static void cache_free(struct image_cache* cache)
 }
 
 /**
- * Put image handle to cache queue.
+ * Put image handle to cache queue, the cache takes ownership of the image.
  * @param cache context
  * @param image pointer to image instance
  */
 static void cache_put(struct image_cache* cache, struct image* image)
 {
-    if (cache->capacity == 0 || !image) {
+    if (cache->capacity == 0) {
+        image_free(image); // caching is disabled
+        return;
+    }
+    if (!image) {
         return;
     }
 
@@ -140,6 +159,22 @@ static struct image* cache_take(struct image_cache* cache, size_t index)
     return img;
 }
 
+/**
+ * Check if image is in the cache queue.
+ * @param cache context
+ * @param index index of the image in the image list
+ * @return true if image is in the cache
+ */
+static bool cache_has(const struct image_cache* cache, size_t index)
+{
+    for (size_t i = 0; i < cache->capacity && cache->queue[i]; ++i) {
+        if (cache->queue[i]->index == index) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Remove oldest entries from cache.
  * @param cache context
@@ -157,6 +192,80 @@ static void cache_trim(struct image_cache* cache, size_t size)
     }
 }
 
+/**
+ * Get size of pixel data of all images in the cache.
+ * @param cache context
+ * @return size of pixel data in bytes
+ */
+static size_t cache_memory(const struct image_cache* cache)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        size += image_memory(cache->queue[i]);
+    }
+    return size;
+}
+
+/**
+ * Update pixel memory counters.
+ */
+static void update_memory(void)
+{
+    perf_mem_set(perf_mem_current, image_memory(ctx.current));
+    perf_mem_set(perf_mem_history, cache_memory(&ctx.history));
+    perf_mem_set(perf_mem_preload,
+                 cache_memory(&ctx.preload) + cache_memory(&ctx.hinted));
+}
+
+/**
+ * Find prefetch hint.
+ * @param index index of the image in the image list
+ * @return position of the hint or -1 if not found
+ */
+static ssize_t find_hint(size_t index)
+{
+    for (size_t i = 0; i < ctx.hints_num; ++i) {
+        if (ctx.hints[i].index == index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Remove prefetch hint and its preloaded image.
+ * @param pos position of the hint
+ */
+static void remove_hint(size_t pos)
+{
+    image_free(cache_take(&ctx.hinted, ctx.hints[pos].index));
+    --ctx.hints_num;
+    memmove(&ctx.hints[pos], &ctx.hints[pos + 1],
+            (ctx.hints_num - pos) * sizeof(*ctx.hints));
+}
+
+/**
+ * Append hinted images to the loader queue.
+ * @param high true to append hints with priority above adjacent images
+ */
+static void queue_hints(bool high)
+{
+    for (size_t i = 0; i < ctx.hints_num; ++i) {
+        const struct hint* hint = &ctx.hints[i];
+        if ((hint->priority > 0) != high) {
+            continue;
+        }
+        if ((ctx.current && ctx.current->index == hint->index) ||
+            ctx.pending == hint->index) {
+            continue;
+        }
+        if (!cache_has(&ctx.hinted, hint->index) &&
+            !cache_has(&ctx.preload, hint->index)) {
+            loader_queue_append(hint->index, tpool_background);
+        }
+    }
+}
+
 #ifdef HAVE_INOTIFY
 /** inotify handler. */
 static void on_inotify(__attribute__((unused)) void* data)
@@ -199,19 +308,35 @@ static void reset_preloader(void)
     size_t found = 0;
     size_t next;
 
-    if (ctx.preload.capacity == 0) {
+    loader_queue_reset();
+
+    if (ctx.seeking) {
+        return; // nothing to load until the position is fixed
+    }
+
+    // image being opened goes first, preloads are around it
+    if (ctx.pending != IMGLIST_INVALID) {
+        loader_queue_append(ctx.pending, tpool_interactive);
+        next = ctx.pending;
+    } else if (ctx.current) {
+        next = ctx.current->index;
+    } else {
         return;
     }
 
-    loader_queue_reset();
+    if (ctx.preload.capacity == 0 && ctx.hints_num == 0) {
+        return;
+    }
+
+    queue_hints(true);
 
-    preload = malloc(ctx.preload.capacity * sizeof(*preload));
+    // preload capacity can be 0 if only hints are queued
+    preload = malloc((ctx.preload.capacity + 1) * sizeof(*preload));
     if (!preload) {
         return;
     }
 
     // reorder preloads and create list of preloads
-    next = ctx.current->index;
     for (size_t i = 0; i < ctx.preload.capacity; ++i) {
         struct image* img;
 
@@ -224,7 +349,8 @@ static void reset_preloader(void)
         if (img) {
             cache_put(&ctx.preload, img);
             ++found;
-        } else if (next != ctx.current->index) {
+        } else if (next != ctx.pending &&
+                   (!ctx.current || next != ctx.current->index)) {
             preload[preload_num++] = next;
         }
     }
@@ -234,8 +360,11 @@ static void reset_preloader(void)
 
     // add preloads to queue
     for (size_t i = 0; i < preload_num; ++i) {
-        loader_queue_append(preload[i]);
+        if (find_hint(preload[i]) < 0) {
+            loader_queue_append(preload[i], tpool_background);
+        }
     }
+    queue_hints(false);
 
     free(preload);
 }
@@ -248,15 +377,17 @@ static void set_current(struct image* image)
 {
     // put current image to history cache
     if (ctx.current) {
-        if (ctx.history.capacity) {
-            cache_put(&ctx.history, ctx.current);
-        } else {
+        if (ctx.outdated) {
             image_free(ctx.current);
+        } else {
+            cache_put(&ctx.history, ctx.current);
         }
     }
 
     ctx.current = image;
+    ctx.outdated = false;
     reset_preloader();
+    update_memory();
 
 #ifdef HAVE_INOTIFY
     // register inotify watcher
@@ -270,10 +401,53 @@ static void set_current(struct image* image)
 #endif
 }
 
-void fetcher_init(struct image* image, size_t history, size_t preload)
+/**
+ * Take image from caches.
+ * @param index index of the image in the image list
+ * @return image instance or NULL if image is not cached
+ */
+static struct image* take_cached(size_t index)
+{
+    struct image* img;
+    ssize_t pos;
+
+    img = cache_take(&ctx.history, index);
+    if (!img) {
+        img = cache_take(&ctx.preload, index);
+    }
+    if (!img) {
+        img = cache_take(&ctx.hinted, index);
+    }
+    pos = find_hint(index);
+    if (pos >= 0) {
+        remove_hint(pos); // hint is fulfilled
+    }
+
+    return img;
+}
+
+/**
+ * Check if the image is the current one and it is up to date.
+ * @param index index of the image in the image list
+ * @return true if image is the current one
+ */
+static bool is_current(size_t index)
+{
+    return ctx.current && !ctx.outdated && ctx.current->index == index;
+}
+
+void fetcher_init(struct image* image, size_t history, size_t preload,
+                  size_t prefetch)
 {
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.pending = IMGLIST_INVALID;
     cache_init(&ctx.history, history);
     cache_init(&ctx.preload, preload);
+    cache_init(&ctx.hinted, prefetch);
+    ctx.hints = prefetch ? calloc(prefetch, sizeof(*ctx.hints)) : NULL;
+    if (!ctx.hints) {
+        ctx.hinted.capacity = 0;
+    }
 
 #ifdef HAVE_INOTIFY
     ctx.notify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
@@ -292,67 +466,194 @@ void fetcher_destroy(void)
 {
     cache_free(&ctx.history);
     cache_free(&ctx.preload);
+    cache_free(&ctx.hinted);
+    free(ctx.hints);
     image_free(ctx.current);
 }
 
-bool fetcher_reset(size_t index, bool force)
+void fetcher_reset(size_t index)
 {
-    loader_queue_reset();
+    if (index == IMGLIST_INVALID) {
+        index = image_list_first();
+    }
+
     cache_reset(&ctx.history);
     cache_reset(&ctx.preload);
-    image_free(ctx.current);
-    ctx.current = NULL;
+    cache_reset(&ctx.hinted);
 
-    if (force && index != IMGLIST_INVALID) {
-        fetcher_open(index);
-    } else {
-        if (index == IMGLIST_INVALID) {
-            index = image_list_first();
-        }
-        while (index != IMGLIST_INVALID && !fetcher_open(index)) {
-            index = image_list_skip(index);
-        }
+    // outdated version of the image is displayed until it is reloaded
+    if (ctx.current && ctx.current->index != index) {
+        image_free(ctx.current);
+        ctx.current = NULL;
     }
+    ctx.outdated = !!ctx.current;
+    update_memory();
 
-    return !!ctx.current;
+    ctx.pending = index;
+    ctx.forward = true;
+    ctx.seeking = false;
+    reset_preloader();
 }
 
-bool fetcher_open(size_t index)
+bool fetcher_open(size_t index, bool forward)
 {
+    const bool seeking = ctx.seeking;
     struct image* img;
 
-    if (ctx.current && ctx.current->index == index) {
-        return true;
-    }
+    ctx.forward = forward;
+    ctx.seeking = false;
 
-    // check history and preload
-    img = cache_take(&ctx.history, index);
-    if (!img) {
-        img = cache_take(&ctx.preload, index);
+    if (is_current(index)) {
+        if (ctx.pending != IMGLIST_INVALID || seeking) {
+            ctx.pending = IMGLIST_INVALID;
+            reset_preloader();
+        }
+        return true;
     }
 
-    if (!img) {
-        loader_from_index(index, &img);
-    }
+    img = take_cached(index);
     if (img) {
+        ctx.pending = IMGLIST_INVALID;
         set_current(img);
+        return true;
     }
 
-    return !!img;
+    // decode in background, the current image stays until load completes
+    if (ctx.pending != index || seeking) {
+        ctx.pending = index;
+        reset_preloader();
+    }
+
+    return false;
 }
 
-void fetcher_attach(struct image* image, size_t index)
+void fetcher_seek(size_t index)
 {
+    ctx.seeking = true;
+    ctx.pending = is_current(index) ? IMGLIST_INVALID : index;
+    loader_queue_reset();
+}
+
+bool fetcher_attach(struct image* image, size_t index)
+{
+    if (index == ctx.pending) {
+        size_t next;
+        ctx.pending = IMGLIST_INVALID;
+        if (image) {
+            ctx.seeking = false; // target of fast navigation is reached
+            set_current(image);
+            return true;
+        }
+        // remove broken image and try the next one in the same direction
+        next = ctx.forward ? image_list_next_file(index)
+                           : image_list_prev_file(index);
+        image_list_skip(index);
+        if (next != IMGLIST_INVALID && next != index) {
+            return fetcher_open(next, ctx.forward);
+        }
+        if (ctx.outdated) {
+            // reloaded image is broken and there is nothing to open instead
+            image_free(ctx.current);
+            ctx.current = NULL;
+            ctx.outdated = false;
+            update_memory();
+        }
+        reset_preloader();
+        return false;
+    }
+
+    if (image && ctx.current && ctx.current->index == index) {
+        // preload of the image opened by the interactive loader
+        image_free(image);
+        return false;
+    }
+
     if (image) {
-        cache_put(&ctx.preload, image);
+        if (find_hint(index) >= 0) {
+            cache_put(&ctx.hinted, image);
+        } else {
+            cache_put(&ctx.preload, image);
+        }
     } else {
-        loader_queue_reset();
+        const ssize_t pos = find_hint(index);
+        if (pos >= 0) {
+            remove_hint(pos);
+        }
         image_list_skip(index);
         reset_preloader();
     }
+    update_memory();
+
+    return false;
+}
+
+bool fetcher_prefetch(size_t index, int priority)
+{
+    ssize_t pos = find_hint(index);
+    size_t insert;
+
+    if (ctx.hinted.capacity == 0 || !image_list_get(index)) {
+        return false;
+    }
+
+    if (pos >= 0) {
+        // update priority of the existing hint, keep preloaded image
+        --ctx.hints_num;
+        memmove(&ctx.hints[pos], &ctx.hints[pos + 1],
+                (ctx.hints_num - pos) * sizeof(*ctx.hints));
+    } else if (ctx.hints_num == ctx.hinted.capacity) {
+        // replace the hint with the lowest priority
+        if (ctx.hints[ctx.hints_num - 1].priority > priority) {
+            return false;
+        }
+        remove_hint(ctx.hints_num - 1);
+    }
+
+    // insert hint keeping the list sorted
+    insert = 0;
+    while (insert < ctx.hints_num && ctx.hints[insert].priority >= priority) {
+        ++insert;
+    }
+    memmove(&ctx.hints[insert + 1], &ctx.hints[insert],
+            (ctx.hints_num - insert) * sizeof(*ctx.hints));
+    ctx.hints[insert].index = index;
+    ctx.hints[insert].priority = priority;
+    ++ctx.hints_num;
+
+    // the loader thread is shared with gallery
+    if (app_is_viewer()) {
+        reset_preloader();
+    }
+
+    return true;
+}
+
+void fetcher_drop(size_t index)
+{
+    if (index == IMGLIST_INVALID) {
+        while (ctx.hints_num) {
+            remove_hint(ctx.hints_num - 1);
+        }
+    } else {
+        const ssize_t pos = find_hint(index);
+        if (pos < 0) {
+            return;
+        }
+        remove_hint(pos);
+    }
+
+    if (app_is_viewer()) {
+        reset_preloader();
+    }
+    update_memory();
 }
 
 struct image* fetcher_current(void)
 {
     return ctx.current;
 }
+
+size_t fetcher_pending(void)
+{
+    return ctx.pending;
+}
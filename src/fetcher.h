@@ -11,8 +11,10 @@
  * @param image initial image
  * @param history max number of images in history
  * @param preload max number of preloaded images
+ * @param prefetch max number of images preloaded by external hints
  */
-void fetcher_init(struct image* image, size_t history, size_t preload);
+void fetcher_init(struct image* image, size_t history, size_t preload,
+                  size_t prefetch);
 
 /**
  * Destroy global fetch context.
@@ -20,29 +22,63 @@ void fetcher_init(struct image* image, size_t history, size_t preload);
 void fetcher_destroy(void);
 
 /**
- * Reset cache and reload current image.
- * @param index preferable index of image in the image list
- * @param force flag to fail if loading specified image failed
- * @return true if image was reloaded
+ * Reset cache and load image in background, it becomes the current one when
+ * the load completes (see fetcher_attach). If the current image is reloaded,
+ * its outdated version stays until then.
+ * @param index preferable index of image in the image list, IMGLIST_INVALID
+ *        for the first one
  */
-bool fetcher_reset(size_t index, bool force);
+void fetcher_reset(size_t index);
 
 /**
  * Open image and set it as the current one.
+ * If the image is not cached, it is loaded in background and becomes the
+ * current one when the load completes (see fetcher_attach).
  * @param index index of the image to fetch
- * @return true if image opened
+ * @param forward direction to look for the next image if loading fails
+ * @return true if image opened, false if it is being loaded
  */
-bool fetcher_open(size_t index);
+bool fetcher_open(size_t index, bool forward);
 
 /**
- * Attach image to preload cache.
+ * Set pending image without loading it, used for fast navigation: background
+ * loading is suspended until the image is opened with fetcher_open().
+ * @param index index of the image in the image list
+ */
+void fetcher_seek(size_t index);
+
+/**
+ * Attach image loaded in background: open pending image or put it to the
+ * preload cache.
  * @param image loaded image instance, NULL if load error
  * @param index index of the image in the image list
+ * @return true if the current image was changed
+ */
+bool fetcher_attach(struct image* image, size_t index);
+
+/**
+ * Add prefetch hint: load image in background and keep it in cache until
+ * it is opened or dropped.
+ * @param index index of the image in the image list
+ * @param priority load priority, adjacent images are preloaded with 0
+ * @return false if hint was rejected (no space for lower priority)
+ */
+bool fetcher_prefetch(size_t index, int priority);
+
+/**
+ * Remove prefetch hint and free preloaded image.
+ * @param index index of the image in the image list, IMGLIST_INVALID for all
  */
-void fetcher_attach(struct image* image, size_t index);
+void fetcher_drop(size_t index);
 
 /**
  * Get current image.
  * @return current image or NULL if no image loaded yet
  */
 struct image* fetcher_current(void);
+
+/**
+ * Get image that is being loaded to become the current one.
+ * @return index of the image or IMGLIST_INVALID if there is no pending image
+ */
+size_t fetcher_pending(void);
@@ -5,6 +5,14 @@
 #include "font.h"
 
 #include "memdata.h"
+#include "perf.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // font realted
 #include <fontconfig/fontconfig.h>
@@ -23,6 +31,9 @@
 #define CFG_SHADOW     "shadow"
 #define CFG_SHADOW_DEF ARGB(0x80, 0, 0, 0)
 
+// File in the cache directory to store resolved font path
+#define CACHE_FILE "font"
+
 #define POINT_FACTOR 64.0 // default points per pixel for 26.6 format
 #define SPACE_WH_REL 2.0
 
@@ -30,6 +41,7 @@
 struct font {
     FT_Library lib; ///< Font lib instance
     FT_Face face;   ///< Font face instance
+    char* name;     ///< Name of the loaded font
     argb_t color;   ///< Font color
     argb_t shadow;  ///< Font shadow color
 };
@@ -80,6 +92,115 @@ static bool search_font_file(const char* name, char* font_file, size_t len)
     return *font_file;
 }
 
+/**
+ * Check if fontconfig configuration was changed after the time stamp.
+ * @param time time stamp to check
+ * @return true if any of fontconfig config files is newer
+ */
+static bool fc_config_changed(time_t time)
+{
+    const char* files[] = { "fonts.conf", "conf.d" };
+    const char* config_home = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    char path[PATH_MAX];
+    struct stat st;
+
+    for (size_t i = 0; i < ARRAY_SIZE(files); ++i) {
+        // system wide config
+        snprintf(path, sizeof(path), "/etc/fonts/%s", files[i]);
+        if (stat(path, &st) == 0 && st.st_mtime >= time) {
+            return true;
+        }
+        // user config
+        if (config_home && *config_home) {
+            snprintf(path, sizeof(path), "%s/fontconfig/%s", config_home,
+                     files[i]);
+        } else if (home && *home) {
+            snprintf(path, sizeof(path), "%s/.config/fontconfig/%s", home,
+                     files[i]);
+        } else {
+            continue;
+        }
+        if (stat(path, &st) == 0 && st.st_mtime >= time) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Get path to the font file from the cache, fontconfig initialization
+ * is expensive on cold start.
+ * @param name font name
+ * @param font_file output buffer for file path
+ * @param len size of buffer
+ * @return false if font not found in the cache or cache is outdated
+ */
+static bool cache_load(const char* name, char* font_file, size_t len)
+{
+    char* path = config_cache_path(CACHE_FILE);
+    char* buff = NULL;
+    size_t buff_sz = 0;
+    bool found = false;
+    struct stat st;
+    FILE* fd;
+
+    fd = path ? fopen(path, "r") : NULL;
+    free(path);
+    if (!fd) {
+        return false;
+    }
+
+    // file format: font name on the first line, path on the second one
+    if (fstat(fileno(fd), &st) == 0 && !fc_config_changed(st.st_mtime) &&
+        getline(&buff, &buff_sz, fd) > 0 &&
+        strcspn(buff, "\n") == strlen(name) &&
+        strncmp(buff, name, strlen(name)) == 0 &&
+        getline(&buff, &buff_sz, fd) > 0) {
+        buff[strcspn(buff, "\n")] = 0;
+        if (*buff && strlen(buff) < len && access(buff, R_OK) == 0) {
+            strcpy(font_file, buff);
+            found = true;
+        }
+    }
+
+    free(buff);
+    fclose(fd);
+
+    return found;
+}
+
+/**
+ * Save path to the font file in the cache.
+ * @param name font name
+ * @param font_file path to the font file
+ */
+static void cache_save(const char* name, const char* font_file)
+{
+    char* path = config_cache_path(CACHE_FILE);
+    char tmp[PATH_MAX];
+    FILE* fd;
+
+    if (!path) {
+        return;
+    }
+
+    // write to temporary file and rename it to replace the cache atomically
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    fd = fopen(tmp, "w");
+    if (fd) {
+        const bool ok = fprintf(fd, "%s\n%s\n", name, font_file) > 0;
+        if (fclose(fd) == 0 && ok) {
+            rename(tmp, path);
+        } else {
+            unlink(tmp);
+        }
+    }
+
+    free(path);
+}
+
 /**
  * Calc size of the surface and allocate memory for the mask.
  * @param text string to print
@@ -134,13 +255,21 @@ void font_init(struct config* cfg)
     const char* font_name;
     size_t font_size;
 
-    // load font
+    // load font, the face can be already loaded by the server process
     font_name = config_get_string(cfg, CFG_SECTION, CFG_NAME, CFG_NAME_DEF);
-    if (!search_font_file(font_name, font_file, sizeof(font_file)) ||
-        FT_Init_FreeType(&ctx.lib) != 0 ||
-        FT_New_Face(ctx.lib, font_file, 0, &ctx.face) != 0) {
-        fprintf(stderr, "WARNING: Unable to load font %s\n", font_name);
-        return;
+    if (!ctx.face || !ctx.name || strcmp(ctx.name, font_name) != 0) {
+        font_destroy();
+        if (!cache_load(font_name, font_file, sizeof(font_file))) {
+            if (search_font_file(font_name, font_file, sizeof(font_file))) {
+                cache_save(font_name, font_file);
+            }
+        }
+        if (!*font_file || FT_Init_FreeType(&ctx.lib) != 0 ||
+            FT_New_Face(ctx.lib, font_file, 0, &ctx.face) != 0) {
+            fprintf(stderr, "WARNING: Unable to load font %s\n", font_name);
+            return;
+        }
+        ctx.name = str_dup(font_name, NULL);
     }
 
     // set font size
@@ -157,10 +286,14 @@ void font_destroy(void)
 {
     if (ctx.face) {
         FT_Done_Face(ctx.face);
+        ctx.face = NULL;
     }
     if (ctx.lib) {
         FT_Done_FreeType(ctx.lib);
+        ctx.lib = NULL;
     }
+    free(ctx.name);
+    ctx.name = NULL;
 }
 
 bool font_render(const char* text, struct text_surface* surface)
@@ -170,11 +303,14 @@ bool font_render(const char* text, struct text_surface* surface)
     wchar_t* wide;
     wchar_t* it;
     size_t x = 0;
+    uint64_t start;
 
     if (!ctx.face) {
         return false;
     }
 
+    start = perf_start();
+
     space_size = ctx.face->size->metrics.x_ppem / SPACE_WH_REL;
 
     wide = str_to_wide(text, NULL);
@@ -220,12 +356,16 @@ bool font_render(const char* text, struct text_surface* surface)
 
     free(wide);
 
+    perf_stop(perf_text, start);
+
     return true;
 }
 
 void font_print(struct pixmap* wnd, ssize_t x, ssize_t y,
                 const struct text_surface* text)
 {
+    const uint64_t start = perf_start();
+
     if (ARGB_GET_A(ctx.shadow)) {
         ssize_t shadow_offset = text->height / 16;
         if (shadow_offset < 1) {
@@ -237,4 +377,6 @@ void font_print(struct pixmap* wnd, ssize_t x, ssize_t y,
 
     pixmap_apply_mask(wnd, x, y, text->data, text->width, text->height,
                       ctx.color);
+
+    perf_stop(perf_text, start);
 }
@@ -3,6 +3,7 @@
 // Copyright (C) 2023 Artem Senichev <artemsen@gmail.com>
 
 #include "../loader.h"
+#include "../tpool.h"
 
 #include <avif/avif.h>
 #include <stdio.h>
@@ -13,121 +14,172 @@
 static const uint32_t signature = 'f' | 't' << 8 | 'y' << 16 | 'p' << 24;
 #define SIGNATURE_OFFSET 4
 
-static int decode_frame(struct image* ctx, avifDecoder* decoder)
+/** Animation sequence decoder: frames are decoded during playback. */
+struct avif_stream {
+    avifDecoder* decoder; ///< AV1 decoder instance
+    uint8_t* data;        ///< Copy of the source data, NULL if it is mapped
+};
+
+/**
+ * Create decoder and parse AV1 container.
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return decoder instance or NULL on errors
+ */
+static avifDecoder* create_decoder(const uint8_t* data, size_t size)
+{
+    avifDecoder* decoder = avifDecoderCreate();
+
+    if (decoder) {
+        decoder->maxThreads = (int)tpool_threads();
+        if (avifDecoderSetIOMemory(decoder, data, size) != AVIF_RESULT_OK ||
+            avifDecoderParse(decoder) != AVIF_RESULT_OK) {
+            avifDecoderDestroy(decoder);
+            decoder = NULL;
+        }
+    }
+
+    return decoder;
+}
+
+/**
+ * Convert currently decoded image from YUV to RGB.
+ * @param decoder AV1 decoder instance
+ * @param pm destination pixmap, allocated by this function
+ * @return true if image was converted
+ */
+static bool convert_frame(avifDecoder* decoder, struct pixmap* pm)
 {
     avifRGBImage rgb;
-    avifResult rc;
-    struct pixmap* pm;
 
-    rc = avifDecoderNextImage(decoder);
-    if (rc != AVIF_RESULT_OK) {
-        goto decode_fail;
+    if (!pixmap_create(pm, decoder->image->width, decoder->image->height)) {
+        return false;
     }
 
+    // convert directly into the pixmap buffer
     memset(&rgb, 0, sizeof(rgb));
     avifRGBImageSetDefaults(&rgb, decoder->image);
-
     rgb.depth = 8;
     rgb.format = AVIF_RGB_FORMAT_BGRA;
-#if AVIF_VERSION_MAJOR > 0
-    rc =
-#endif
-        avifRGBImageAllocatePixels(&rgb);
-#if AVIF_VERSION_MAJOR > 0
-    if (rc != AVIF_RESULT_OK) {
-        goto decode_fail;
-    }
-#endif
+    rgb.pixels = (uint8_t*)pm->data;
+    rgb.rowBytes = pm->width * sizeof(argb_t);
 
-    rc = avifImageYUVToRGB(decoder->image, &rgb);
-    if (rc != AVIF_RESULT_OK) {
-        goto fail_pixels;
+    if (avifImageYUVToRGB(decoder->image, &rgb) != AVIF_RESULT_OK) {
+        pixmap_free(pm);
+        pm->data = NULL;
+        return false;
     }
 
-    pm = image_allocate_frame(ctx, decoder->image->width,
-                              decoder->image->height);
-    if (!pm) {
-        goto fail_pixels;
-    }
-
-    memcpy(pm->data, rgb.pixels, rgb.width * rgb.height * sizeof(argb_t));
-
-    avifRGBImageFreePixels(&rgb);
-    return 0;
-
-fail_pixels:
-    avifRGBImageFreePixels(&rgb);
-decode_fail:
-    return -1;
+    return true;
 }
 
-static int decode_frames(struct image* ctx, avifDecoder* decoder)
+/** Frame decoder used by image stream, see image_stream_fn. */
+static bool decode_stream(void* data, size_t index, struct pixmap* pm)
 {
-    avifImageTiming timing;
-    avifRGBImage rgb = { 0 };
-    avifResult rc = AVIF_RESULT_UNKNOWN_ERROR;
+    struct avif_stream* stream = data;
+    avifDecoder* decoder = stream->decoder;
+    avifResult rc;
 
-    if (!image_create_frames(ctx, decoder->imageCount)) {
-        return AVIF_RESULT_UNKNOWN_ERROR;
+    if ((int)index == decoder->imageIndex + 1) {
+        rc = avifDecoderNextImage(decoder); // sequential playback
+    } else {
+        rc = avifDecoderNthImage(decoder, index);
     }
 
-    for (size_t i = 0; i < ctx->num_frames; ++i) {
-        rc = avifDecoderNthImage(decoder, i);
-        if (rc != AVIF_RESULT_OK) {
-            break;
-        }
-
-        avifRGBImageSetDefaults(&rgb, decoder->image);
-        rgb.depth = 8;
-        rgb.format = AVIF_RGB_FORMAT_BGRA;
+    return rc == AVIF_RESULT_OK && convert_frame(decoder, pm);
+}
 
-#if AVIF_VERSION_MAJOR == 0
-        avifRGBImageAllocatePixels(&rgb);
-#else
-        rc = avifRGBImageAllocatePixels(&rgb);
-        if (rc != AVIF_RESULT_OK) {
-            break;
-        }
-#endif
+/** Stream data destructor. */
+static void free_stream(void* data)
+{
+    struct avif_stream* stream = data;
 
-        rc = avifImageYUVToRGB(decoder->image, &rgb);
-        if (rc != AVIF_RESULT_OK) {
-            break;
-        }
+    avifDecoderDestroy(stream->decoder);
+    free(stream->data);
+    free(stream);
+}
 
-        if (!pixmap_create(&ctx->frames[i].pm, rgb.width, rgb.height)) {
-            break;
-        }
+/**
+ * Decode single image.
+ * @param ctx image context
+ * @param decoder AV1 decoder instance
+ * @return true if image was decoded
+ */
+static bool decode_frame(struct image* ctx, avifDecoder* decoder)
+{
+    return avifDecoderNextImage(decoder) == AVIF_RESULT_OK &&
+        image_create_frames(ctx, 1) &&
+        convert_frame(decoder, &ctx->frames[0].pm);
+}
 
-        rc = avifDecoderNthImageTiming(decoder, i, &timing);
-        if (rc != AVIF_RESULT_OK) {
-            break;
-        }
+/**
+ * Set image format description and alpha flag.
+ * @param ctx image context
+ * @param decoder AV1 decoder instance
+ */
+static void set_format(struct image* ctx, const avifDecoder* decoder)
+{
+    ctx->alpha = decoder->alphaPresent;
+    image_set_format(ctx, "AV1 %dbpc %s", decoder->image->depth,
+                     avifPixelFormatToString(decoder->image->yuvFormat));
+}
 
-        ctx->frames[i].duration = (size_t)(1000.0f / (float)timing.timescale *
-                                           (float)timing.durationInTimescales);
+/**
+ * Setup animation sequence: decode the first frame only, the rest are
+ * decoded in background during playback.
+ * @param ctx image context
+ * @param decoder AV1 decoder instance, owned by the stream
+ * @param data copy of the source data used by decoder, owned by the stream,
+ *             NULL if the decoder reads the file mapping kept by the image
+ * @return true if the first frame was decoded
+ */
+static bool decode_frames(struct image* ctx, avifDecoder* decoder,
+                          uint8_t* data)
+{
+    struct avif_stream* stream;
+    avifImageTiming timing;
 
-        memcpy(ctx->frames[i].pm.data, rgb.pixels,
-               rgb.width * rgb.height * sizeof(argb_t));
+    stream = calloc(1, sizeof(*stream));
+    if (!stream) {
+        avifDecoderDestroy(decoder);
+        free(data);
+        return false;
+    }
+    stream->decoder = decoder;
+    stream->data = data;
 
-        avifRGBImageFreePixels(&rgb);
-        rgb.pixels = NULL;
+    if (!image_create_frames(ctx, decoder->imageCount)) {
+        free_stream(stream);
+        return false;
+    }
+    if (!image_set_stream(ctx, decode_stream, free_stream, stream)) {
+        return false;
     }
 
-    if (rgb.pixels) {
-        avifRGBImageFreePixels(&rgb);
+    for (size_t i = 0; i < ctx->num_frames; ++i) {
+        struct image_frame* frame = &ctx->frames[i];
+        if (avifDecoderNthImageTiming(decoder, i, &timing) == AVIF_RESULT_OK) {
+            frame->duration =
+                (size_t)(1000.0f / (float)timing.timescale *
+                         (float)timing.durationInTimescales);
+        }
+        frame->pm.width = decoder->image->width;
+        frame->pm.height = decoder->image->height;
     }
 
-    return rc;
+    // read image info before the background thread takes the decoder
+    set_format(ctx, decoder);
+
+    return image_load_frame(ctx, 0);
 }
 
 // AV1 loader implementation
 enum loader_status decode_avif(struct image* ctx, const uint8_t* data,
                                size_t size)
 {
-    avifResult rc;
-    avifDecoder* decoder = NULL;
-    int ret;
+    avifDecoder* decoder;
+    uint8_t* copy = NULL;
+    bool rc;
 
     // check signature
     if (size < SIGNATURE_OFFSET + sizeof(signature) ||
@@ -135,40 +187,70 @@ enum loader_status decode_avif(struct image* ctx, const uint8_t* data,
         return ldr_unsupported;
     }
 
+    // frames of animation sequence are decoded during playback, the file
+    // mapping is kept by the image, but other sources are released after
+    // loading, so the decoder must use a copy of them
+    if (data != ctx->map) {
+        copy = malloc(size);
+        if (!copy) {
+            return ldr_fmterror;
+        }
+        memcpy(copy, data, size);
+        data = copy;
+    }
+
     // open file in decoder
-    decoder = avifDecoderCreate();
+    decoder = create_decoder(data, size);
     if (!decoder) {
+        free(copy);
         return ldr_fmterror;
     }
-    rc = avifDecoderSetIOMemory(decoder, data, size);
-    if (rc != AVIF_RESULT_OK) {
-        goto fail;
-    }
-    rc = avifDecoderParse(decoder);
-    if (rc != AVIF_RESULT_OK) {
-        goto fail;
-    }
 
     if (decoder->imageCount > 1) {
-        ret = decode_frames(ctx, decoder);
+        rc = decode_frames(ctx, decoder, copy);
     } else {
-        ret = decode_frame(ctx, decoder);
+        rc = decode_frame(ctx, decoder);
+        if (rc) {
+            set_format(ctx, decoder);
+        }
+        avifDecoderDestroy(decoder);
+        free(copy);
     }
 
-    if (ret != 0) {
-        goto fail;
+    if (!rc) {
+        image_free_frames(ctx);
+        return ldr_fmterror;
     }
 
-    ctx->alpha = decoder->alphaPresent;
+    return ldr_success;
+}
 
-    image_set_format(ctx, "AV1 %dbpc %s", decoder->image->depth,
-                     avifPixelFormatToString(decoder->image->yuvFormat));
+// AV1 probe implementation
+enum loader_status probe_avif(struct image_header* header, const uint8_t* data,
+                              size_t size)
+{
+    avifDecoder* decoder;
 
-    avifDecoderDestroy(decoder);
-    return ldr_success;
+    // check signature
+    if (size < SIGNATURE_OFFSET + sizeof(signature) ||
+        *(const uint32_t*)(data + SIGNATURE_OFFSET) != signature) {
+        return ldr_unsupported;
+    }
+
+    // parsing reads the container only, no frames are decoded
+    decoder = create_decoder(data, size);
+    if (!decoder) {
+        return ldr_fmterror;
+    }
+
+    header->width = decoder->image->width;
+    header->height = decoder->image->height;
+    header->frames = decoder->imageCount;
+    header->lazy = decoder->imageCount > 1;
+    header->alpha = decoder->alphaPresent;
+    header->bpp = decoder->image->depth * (header->alpha ? 4 : 3);
 
-fail:
     avifDecoderDestroy(decoder);
-    image_free_frames(ctx);
-    return ldr_fmterror;
+
+    return ldr_success;
 }
@@ -3,6 +3,8 @@
 // Copyright (C) 2020 Artem Senichev <artemsen@gmail.com>
 
 #include "../loader.h"
+#include "../pixconv.h"
+#include "../tpool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,6 +30,12 @@
 #define MASK555_BLUE  0x001f
 #define MASK555_ALPHA 0x0000
 
+// Mask for 32-bit images that matches our pixmap format
+#define MASK_BGRA_RED   0x00ff0000
+#define MASK_BGRA_GREEN 0x0000ff00
+#define MASK_BGRA_BLUE  0x000000ff
+#define MASK_BGRA_ALPHA 0xff000000
+
 // Sizes of DIB Headers
 #define BITMAPINFOHEADER_SIZE   0x28
 #define BITMAPINFOV2HEADER_SIZE 0x34
@@ -37,6 +45,9 @@
 
 #define BITS_PER_BYTE 8
 
+// Max number of colors in palette of indexed image
+#define BMP_CM_MAX 256
+
 // Bitmap file header: BITMAPFILEHEADER
 struct __attribute__((__packed__)) bmp_file {
     uint16_t type;
@@ -74,6 +85,25 @@ struct bmp_palette {
     size_t size;
 };
 
+// Color channel extracted by mask
+struct bmp_channel {
+    uint32_t mask;
+    uint32_t rshift;
+    uint32_t lshift;
+};
+
+// Rows decoding context, shared between worker threads
+struct bmp_rows {
+    struct pixmap* pm;
+    const struct bmp_info* bmp;
+    const argb_t* cmap;
+    size_t cmap_size;
+    const uint8_t* buffer;
+    size_t stride;
+    struct bmp_channel ch[4]; // channels in ARGB order
+    argb_t alpha;             // alpha used if there is no alpha mask
+};
+
 /**
  * Get number of the consecutive zero bits (trailing) on the right.
  * @param val source value
@@ -117,14 +147,71 @@ static inline size_t bits_set(uint32_t val)
 }
 
 /**
- * Get shift size for color channel.
- * @param val color channel mask
- * @return shift size: positive=right, negative=left
+ * Setup color channel extractor.
+ * @param ch channel to set up
+ * @param mask color channel mask
  */
-static inline ssize_t mask_shift(uint32_t mask)
+static void set_channel(struct bmp_channel* ch, uint32_t mask)
 {
+    // shift size: positive=right, negative=left
     const ssize_t start = right_zeros(mask) + bits_set(mask);
-    return start - BITS_PER_BYTE;
+    const ssize_t shift = start - BITS_PER_BYTE;
+
+    ch->mask = mask;
+    ch->rshift = shift > 0 ? shift : 0;
+    ch->lshift = shift < 0 ? -shift : 0;
+}
+
+/**
+ * Extract color channel value from masked pixel.
+ * @param ch color channel
+ * @param m source masked value
+ * @return channel value
+ */
+static inline uint32_t masked_channel(const struct bmp_channel* ch, uint32_t m)
+{
+    return 0xff & (((m & ch->mask) >> ch->rshift) << ch->lshift);
+}
+
+/**
+ * Convert masked value to ARGB.
+ * @param rows rows decoding context
+ * @param m source masked value
+ * @return ARGB color
+ */
+static inline argb_t masked_pixel(const struct bmp_rows* rows, uint32_t m)
+{
+    return rows->alpha | ARGB_SET_A(masked_channel(&rows->ch[0], m)) |
+        ARGB_SET_R(masked_channel(&rows->ch[1], m)) |
+        ARGB_SET_G(masked_channel(&rows->ch[2], m)) |
+        ARGB_SET_B(masked_channel(&rows->ch[3], m));
+}
+
+/** Masked rows decoder, see tpool_rows_fn. */
+static bool masked_rows(void* data, size_t start, size_t end)
+{
+    // local copy lets the compiler keep masks in registers
+    const struct bmp_rows ctx = *(const struct bmp_rows*)data;
+    const struct bmp_rows* rows = &ctx;
+    const size_t width = rows->pm->width;
+
+    for (size_t y = start; y < end; ++y) {
+        argb_t* dst = &rows->pm->data[y * width];
+        const uint8_t* src = rows->buffer + y * rows->stride;
+        if (rows->bmp->bpp == 32) {
+            const uint32_t* src32 = (const uint32_t*)src;
+            for (size_t x = 0; x < width; ++x) {
+                dst[x] = masked_pixel(rows, src32[x]);
+            }
+        } else {
+            const uint16_t* src16 = (const uint16_t*)src;
+            for (size_t x = 0; x < width; ++x) {
+                dst[x] = masked_pixel(rows, src16[x]);
+            }
+        }
+    }
+
+    return true;
 }
 
 /**
@@ -144,56 +231,29 @@ static bool decode_masked(struct image* ctx, const struct bmp_info* bmp,
     const bool default_mask = !mask ||
         (mask->red == 0 && mask->green == 0 && mask->blue == 0 &&
          mask->alpha == 0);
-
-    const uint32_t mask_r = default_mask ? MASK555_RED : mask->red;
-    const uint32_t mask_g = default_mask ? MASK555_GREEN : mask->green;
-    const uint32_t mask_b = default_mask ? MASK555_BLUE : mask->blue;
-    const uint32_t mask_a = default_mask ? MASK555_ALPHA : mask->alpha;
-    const ssize_t shift_r = mask_shift(mask_r);
-    const ssize_t shift_g = mask_shift(mask_g);
-    const ssize_t shift_b = mask_shift(mask_b);
-    const ssize_t shift_a = mask_shift(mask_a);
-
-    const size_t stride = 4 * ((bmp->width * bmp->bpp + 31) / 32);
+    struct bmp_rows rows = {
+        .pm = pm,
+        .bmp = bmp,
+        .buffer = buffer,
+        .stride = 4 * ((bmp->width * bmp->bpp + 31) / 32),
+    };
+
+    if (bmp->bpp != 32 && bmp->bpp != 16) {
+        return false;
+    }
 
     // check size of source buffer
-    if (buffer_sz < pm->height * stride) {
+    if (buffer_sz < pm->height * rows.stride) {
         return false;
     }
 
-    for (size_t y = 0; y < pm->height; ++y) {
-        argb_t* dst = &pm->data[y * pm->width];
-        const uint8_t* src_y = buffer + y * stride;
-        for (size_t x = 0; x < pm->width; ++x) {
-            const uint8_t* src = src_y + x * (bmp->bpp / BITS_PER_BYTE);
-            uint32_t m, r, g, b, a;
-            if (bmp->bpp == 32) {
-                m = *(uint32_t*)src;
-            } else if (bmp->bpp == 16) {
-                m = *(uint16_t*)src;
-            } else {
-                return false;
-            }
-            r = m & mask_r;
-            g = m & mask_g;
-            b = m & mask_b;
-            r = 0xff & (shift_r > 0 ? r >> shift_r : r << -shift_r);
-            g = 0xff & (shift_g > 0 ? g >> shift_g : g << -shift_g);
-            b = 0xff & (shift_b > 0 ? b >> shift_b : b << -shift_b);
-
-            if (mask_a) {
-                a = m & mask_a;
-                a = 0xff & (shift_a > 0 ? a >> shift_a : a << -shift_a);
-            } else {
-                a = 0xff;
-            }
-
-            dst[x] =
-                ARGB_SET_A(a) | ARGB_SET_R(r) | ARGB_SET_G(g) | ARGB_SET_B(b);
-        }
-    }
+    set_channel(&rows.ch[0], default_mask ? MASK555_ALPHA : mask->alpha);
+    set_channel(&rows.ch[1], default_mask ? MASK555_RED : mask->red);
+    set_channel(&rows.ch[2], default_mask ? MASK555_GREEN : mask->green);
+    set_channel(&rows.ch[3], default_mask ? MASK555_BLUE : mask->blue);
+    rows.alpha = rows.ch[0].mask ? 0 : ARGB_SET_A(0xff);
 
-    return true;
+    return tpool_rows(masked_rows, &rows, pm->height, pm->width);
 }
 
 /**
@@ -304,6 +364,47 @@ static bool decode_rle(struct image* ctx, const struct bmp_info* bmp,
     return false;
 }
 
+/** Uncompressed rows decoder, see tpool_rows_fn. */
+static bool rgb_rows(void* data, size_t start, size_t end)
+{
+    const struct bmp_rows* rows = data;
+    const size_t width = rows->pm->width;
+    const size_t bpp = rows->bmp->bpp;
+
+    for (size_t y = start; y < end; ++y) {
+        argb_t* dst = &rows->pm->data[y * width];
+        const uint8_t* src = rows->buffer + y * rows->stride;
+        if (bpp == 32) {
+            pixconv_bgrx(dst, src, width);
+        } else if (bpp == 24) {
+            pixconv_bgr(dst, src, width);
+        } else if (bpp == 8) {
+            if (!pixconv_palette(dst, src, width, rows->cmap,
+                                 rows->cmap_size)) {
+                return false;
+            }
+        } else {
+            // indexed colors
+            for (size_t x = 0; x < width; ++x) {
+                const size_t bits_offset = x * bpp;
+                const size_t byte_offset = bits_offset / BITS_PER_BYTE;
+                const size_t start_bit =
+                    bits_offset - byte_offset * BITS_PER_BYTE;
+                const uint8_t index =
+                    (*(src + byte_offset) >>
+                     (BITS_PER_BYTE - bpp - start_bit)) &
+                    (0xff >> (BITS_PER_BYTE - bpp));
+                if (index >= rows->cmap_size) {
+                    return false;
+                }
+                dst[x] = rows->cmap[index];
+            }
+        }
+    }
+
+    return true;
+}
+
 /**
  * Decode uncompressed bitmap.
  * @param img decoded image context
@@ -318,43 +419,32 @@ static bool decode_rgb(struct image* ctx, const struct bmp_info* bmp,
                        size_t buffer_sz)
 {
     struct pixmap* pm = &ctx->frames[0].pm;
-    const size_t stride = 4 * ((bmp->width * bmp->bpp + 31) / 32);
+    argb_t cmap[BMP_CM_MAX];
+    struct bmp_rows rows = {
+        .pm = pm,
+        .bmp = bmp,
+        .cmap = cmap,
+        .buffer = buffer,
+        .stride = 4 * ((bmp->width * bmp->bpp + 31) / 32),
+    };
+
+    if (bmp->bpp != 32 && bmp->bpp != 24 && bmp->bpp != 8 && bmp->bpp != 4 &&
+        bmp->bpp != 1) {
+        return false;
+    }
 
     // check size of source buffer
-    if (buffer_sz < pm->height * stride) {
+    if (buffer_sz < pm->height * rows.stride) {
         return false;
     }
 
-    for (size_t y = 0; y < pm->height; ++y) {
-        argb_t* dst = &pm->data[y * pm->width];
-        const uint8_t* src_y = buffer + y * stride;
-        for (size_t x = 0; x < pm->width; ++x) {
-            const uint8_t* src = src_y + x * (bmp->bpp / BITS_PER_BYTE);
-            if (bmp->bpp == 32) {
-                dst[x] = ARGB_SET_A(0xff) | *(uint32_t*)src;
-            } else if (bmp->bpp == 24) {
-                dst[x] = ARGB_SET_A(0xff) | *(uint32_t*)src;
-            } else if (bmp->bpp == 8 || bmp->bpp == 4 || bmp->bpp == 1) {
-                // indexed colors
-                const size_t bits_offset = x * bmp->bpp;
-                const size_t byte_offset = bits_offset / BITS_PER_BYTE;
-                const size_t start_bit =
-                    bits_offset - byte_offset * BITS_PER_BYTE;
-                const uint8_t index = (*(src_y + byte_offset) >>
-                                       (BITS_PER_BYTE - bmp->bpp - start_bit)) &
-                    (0xff >> (BITS_PER_BYTE - bmp->bpp));
-
-                if (index >= palette->size) {
-                    return false;
-                }
-                dst[x] = ARGB_SET_A(0xff) | palette->table[index];
-            } else {
-                return false;
-            }
-        }
+    if (bmp->bpp <= 8) {
+        // convert palette once instead of setting alpha for each pixel
+        rows.cmap_size = min(palette->size, BMP_CM_MAX);
+        pixconv_bgrx(cmap, palette->table, rows.cmap_size);
     }
 
-    return true;
+    return tpool_rows(rgb_rows, &rows, pm->height, pm->width);
 }
 
 // BMP loader implementation
@@ -385,10 +475,6 @@ enum loader_status decode_bmp(struct image* ctx, const uint8_t* data,
         return ldr_fmterror;
     }
 
-    if (!image_allocate_frame(ctx, abs(bmp->width), abs(bmp->height))) {
-        return ldr_fmterror;
-    }
-
     color_data = (const uint8_t*)bmp + bmp->dib_size;
     color_data_sz = hdr->offset - sizeof(struct bmp_file) - bmp->dib_size;
     palette.table = color_data;
@@ -412,6 +498,22 @@ enum loader_status decode_bmp(struct image* ctx, const uint8_t* data,
             bmp->dib_size > BITMAPINFOV2HEADER_SIZE ? mask_location[3] : 0;
     }
 
+    // top-down BGRA bitmap has the same layout as our pixmap
+    if (bmp->compression == BI_BITFIELDS && bmp->bpp == 32 &&
+        bmp->height < 0 && mask.alpha == MASK_BGRA_ALPHA &&
+        mask.red == MASK_BGRA_RED && mask.green == MASK_BGRA_GREEN &&
+        mask.blue == MASK_BGRA_BLUE &&
+        image_map_frame(ctx, data + hdr->offset, abs(bmp->width),
+                        abs(bmp->height))) {
+        image_set_format(ctx, "BMP %dbit masked", bmp->bpp);
+        ctx->alpha = true;
+        return ldr_success;
+    }
+
+    if (!image_allocate_frame(ctx, abs(bmp->width), abs(bmp->height))) {
+        return ldr_fmterror;
+    }
+
     // decode bitmap
     if (bmp->compression == BI_BITFIELDS || bmp->bpp == 16) {
         rc = decode_masked(ctx, bmp, &mask, data + hdr->offset,
@@ -440,3 +542,26 @@ enum loader_status decode_bmp(struct image* ctx, const uint8_t* data,
 
     return (rc ? ldr_success : ldr_fmterror);
 }
+
+// BMP probe implementation
+enum loader_status probe_bmp(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    const struct bmp_file* hdr = (const struct bmp_file*)data;
+    const struct bmp_info* bmp = (const struct bmp_info*)(data + sizeof(*hdr));
+
+    if (size < sizeof(*hdr) || hdr->type != BMP_TYPE) {
+        return ldr_unsupported;
+    }
+    if (size < sizeof(*hdr) + sizeof(*bmp)) {
+        return ldr_fmterror;
+    }
+
+    header->width = abs(bmp->width);
+    header->height = abs(bmp->height);
+    header->frames = 1;
+    header->bpp = bmp->bpp;
+    header->alpha = bmp->bpp == 32;
+
+    return ldr_success;
+}
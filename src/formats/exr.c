@@ -383,3 +383,53 @@ done:
     }
     return ldr_success;
 }
+
+// EXR probe implementation
+enum loader_status probe_exr(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    exr_result_t rc;
+    exr_context_t exr;
+    exr_context_initializer_t einit = EXR_DEFAULT_CONTEXT_INITIALIZER;
+    exr_attr_box2i_t dwnd;
+    const exr_attr_chlist_t* channels;
+    struct data_buffer buf = {
+        .data = data,
+        .size = size,
+    };
+
+    einit.user_data = &buf;
+    einit.read_fn = exr_reader;
+
+    // check signature
+    if (size < sizeof(signature) ||
+        memcmp(data, signature, sizeof(signature))) {
+        return ldr_unsupported;
+    }
+
+    // read header only
+    rc = exr_start_read(&exr, "exr", &einit);
+    if (rc != EXR_ERR_SUCCESS) {
+        return ldr_fmterror;
+    }
+    rc = exr_get_data_window(exr, 0, &dwnd);
+    if (rc == EXR_ERR_SUCCESS) {
+        rc = exr_get_channels(exr, 0, &channels);
+    }
+    if (rc == EXR_ERR_SUCCESS) {
+        header->width = dwnd.max.x - dwnd.min.x + 1;
+        header->height = dwnd.max.y - dwnd.min.y + 1;
+        header->frames = 1;
+        for (int32_t i = 0; i < channels->num_channels; ++i) {
+            const exr_attr_chlist_entry_t* ch = &channels->entries[i];
+            header->bpp += ch->pixel_type == EXR_PIXEL_HALF ? 16 : 32;
+            if (strcmp(ch->name.str, "A") == 0) {
+                header->alpha = true;
+            }
+        }
+    }
+
+    exr_finish(&exr);
+
+    return rc == EXR_ERR_SUCCESS ? ldr_success : ldr_fmterror;
+}
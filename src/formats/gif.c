@@ -12,6 +12,9 @@
 // GIF signature
 static const uint8_t signature[] = { 'G', 'I', 'F' };
 
+// Max number of colors in color map
+#define GIF_CM_MAX 256
+
 // Buffer description for GIF reader
 struct buffer {
     const uint8_t* data;
@@ -46,6 +49,7 @@ static bool decode_frame(struct image* ctx, GifFileType* gif, size_t index)
         desc->ColorMap ? desc->ColorMap : gif->SColorMap;
     GraphicsControlBlock ctl = { .TransparentColor = NO_TRANSPARENT_COLOR };
     struct image_frame* frame = &ctx->frames[index];
+    argb_t palette[GIF_CM_MAX];
 
     const size_t width = (size_t)desc->Width > frame->pm.width - desc->Left
         ? frame->pm.width - desc->Left
@@ -61,20 +65,26 @@ static bool decode_frame(struct image* ctx, GifFileType* gif, size_t index)
         pixmap_copy(&frame->pm, next, 0, 0, false);
     }
 
+    // convert color map once, transparent and invalid entries are left empty
+    memset(palette, 0, sizeof(palette));
+    for (int i = 0; i < color_map->ColorCount && i < GIF_CM_MAX; ++i) {
+        if (i != ctl.TransparentColor) {
+            const GifColorType* rgb = &color_map->Colors[i];
+            palette[i] = ARGB(0xff, rgb->Red, rgb->Green, rgb->Blue);
+        }
+    }
+
     for (size_t y = 0; y < height; ++y) {
         const uint8_t* raster = &img->RasterBits[y * desc->Width];
         argb_t* pixel = frame->pm.data + desc->Top * frame->pm.width +
             y * frame->pm.width + desc->Left;
 
         for (size_t x = 0; x < width; ++x) {
-            const uint8_t color = raster[x];
-            if (color != ctl.TransparentColor &&
-                color < color_map->ColorCount) {
-                const GifColorType* rgb = &color_map->Colors[color];
-                *pixel = ARGB_SET_A(0xff) | ARGB_SET_R(rgb->Red) |
-                    ARGB_SET_G(rgb->Green) | ARGB_SET_B(rgb->Blue);
+            // empty entry keeps pixel of the previous frame
+            const argb_t color = palette[raster[x]];
+            if (color) {
+                pixel[x] = color;
             }
-            ++pixel;
         }
     }
 
@@ -149,3 +159,58 @@ fail:
     image_free_frames(ctx);
     return ldr_fmterror;
 }
+
+// GIF probe implementation
+enum loader_status probe_gif(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    GifFileType* gif = NULL;
+    struct buffer buf = {
+        .data = data,
+        .size = size,
+        .position = 0,
+    };
+    GifRecordType record;
+    GifByteType* block;
+    int code, err;
+
+    // check signature
+    if (size < sizeof(signature) ||
+        memcmp(data, signature, sizeof(signature))) {
+        return ldr_unsupported;
+    }
+
+    gif = DGifOpen(&buf, gif_reader, &err);
+    if (!gif) {
+        return ldr_fmterror;
+    }
+
+    header->width = gif->SWidth;
+    header->height = gif->SHeight;
+    header->bpp = 8;
+    header->alpha = true;
+
+    // count frames, compressed data is skipped without decoding
+    do {
+        if (DGifGetRecordType(gif, &record) != GIF_OK) {
+            break;
+        }
+        if (record == IMAGE_DESC_RECORD_TYPE) {
+            if (DGifGetImageDesc(gif) != GIF_OK ||
+                DGifGetCode(gif, &code, &block) != GIF_OK) {
+                break;
+            }
+            while (block && DGifGetCodeNext(gif, &block) == GIF_OK) { }
+            ++header->frames;
+        } else if (record == EXTENSION_RECORD_TYPE) {
+            if (DGifGetExtension(gif, &code, &block) != GIF_OK) {
+                break;
+            }
+            while (block && DGifGetExtensionNext(gif, &block) == GIF_OK) { }
+        }
+    } while (record != TERMINATE_RECORD_TYPE);
+
+    DGifCloseFile(gif, NULL);
+
+    return ldr_success;
+}
@@ -4,15 +4,15 @@
 
 #include "../exif.h"
 #include "../loader.h"
+#include "../pixconv.h"
 #include "buildcfg.h"
 
 #include <libheif/heif.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifdef HAVE_LIBEXIF
 /**
- * Read Exif info.
+ * Read Exif info: fix orientation and load meta data.
  * @param ctx image context
  * @param pih handle of HEIF/AVIF image
  */
@@ -23,19 +23,29 @@ static void read_exif(struct image* ctx, struct heif_image_handle* pih)
         heif_image_handle_get_list_of_metadata_block_IDs(pih, "Exif", &id, 1);
 
     for (int i = 0; i < count; i++) {
-        size_t sz = heif_image_handle_get_metadata_size(pih, id);
-        uint8_t* data = malloc(sz);
+        const size_t sz = heif_image_handle_get_metadata_size(pih, id);
+        uint8_t* data = sz > 4 ? malloc(sz) : NULL;
         if (data) {
             const struct heif_error err =
                 heif_image_handle_get_metadata(pih, id, data);
             if (err.code == heif_error_Ok) {
-                process_exif(ctx, data + 4 /* skip offset */, sz);
+                // block starts with offset to the TIFF header
+                const size_t offset = (size_t)data[0] << 24 |
+                    (size_t)data[1] << 16 | (size_t)data[2] << 8 | data[3];
+                if (offset < sz - 4) {
+                    size_t exif_size;
+                    const uint8_t* exif = exif_from_block(
+                        data + 4 + offset, sz - 4 - offset, &exif_size);
+                    exif_orient(ctx, exif_orientation(exif, exif_size));
+                }
+#ifdef HAVE_LIBEXIF
+                exif_read_meta(ctx, data + 4 /* skip offset */, sz - 4);
+#endif
             }
             free(data);
         }
     }
 }
-#endif // HAVE_LIBEXIF
 
 // HEIF/AVIF loader implementation
 enum loader_status decode_heif(struct image* ctx, const uint8_t* data,
@@ -85,19 +95,14 @@ enum loader_status decode_heif(struct image* ctx, const uint8_t* data,
 
     // convert to plain image frame
     for (size_t y = 0; y < pm->height; ++y) {
-        const argb_t* src = (const argb_t*)(decoded + y * stride);
-        argb_t* dst = &pm->data[y * pm->width];
-        for (size_t x = 0; x < pm->width; ++x) {
-            dst[x] = ABGR_TO_ARGB(src[x]);
-        }
+        pixconv_rgba(&pm->data[y * pm->width], decoded + y * stride,
+                     pm->width);
     }
 
     ctx->alpha = heif_image_handle_has_alpha_channel(pih);
     image_set_format(ctx, "HEIF/AVIF %dbpp",
                      heif_image_handle_get_luma_bits_per_pixel(pih));
-#ifdef HAVE_LIBEXIF
     read_exif(ctx, pih);
-#endif
 
     status = ldr_success;
 
@@ -116,3 +121,41 @@ done:
     }
     return status;
 }
+
+// HEIF/AVIF probe implementation
+enum loader_status probe_heif(struct image_header* header, const uint8_t* data,
+                              size_t size)
+{
+    struct heif_context* heif = NULL;
+    struct heif_image_handle* pih = NULL;
+    struct heif_error err;
+    enum loader_status status = ldr_fmterror;
+
+    if (heif_check_filetype(data, size) != heif_filetype_yes_supported) {
+        return ldr_unsupported;
+    }
+
+    heif = heif_context_alloc();
+    if (!heif) {
+        return ldr_fmterror;
+    }
+    err = heif_context_read_from_memory_without_copy(heif, data, size, NULL);
+    if (err.code == heif_error_Ok) {
+        err = heif_context_get_primary_image_handle(heif, &pih);
+    }
+    if (err.code == heif_error_Ok) {
+        // size is reported with transformations applied
+        header->width = heif_image_handle_get_width(pih);
+        header->height = heif_image_handle_get_height(pih);
+        header->frames = 1;
+        header->alpha = heif_image_handle_has_alpha_channel(pih);
+        header->bpp = heif_image_handle_get_luma_bits_per_pixel(pih) *
+            (header->alpha ? 4 : 3);
+        heif_image_handle_release(pih);
+        status = ldr_success;
+    }
+
+    heif_context_free(heif);
+
+    return status;
+}
@@ -2,7 +2,9 @@
 // JPEG format decoder.
 // Copyright (C) 2020 Artem Senichev <artemsen@gmail.com>
 
+#include "../exif.h"
 #include "../loader.h"
+#include "../pixconv.h"
 
 #include <errno.h>
 #include <setjmp.h>
@@ -56,10 +58,23 @@ enum loader_status decode_jpeg(struct image* ctx, const uint8_t* data,
     jpeg_create_decompress(&jpg);
     jpeg_mem_src(&jpg, data, size);
     jpeg_read_header(&jpg, TRUE);
-    jpeg_start_decompress(&jpg);
+    switch (jpg.jpeg_color_space) {
+        case JCS_CMYK:
+        case JCS_YCCK:
+            jpg.out_color_space = JCS_CMYK;
+            break;
 #ifdef LIBJPEG_TURBO_VERSION
-    jpg.out_color_space = JCS_EXT_BGRA;
+        case JCS_GRAYSCALE:
+        case JCS_RGB:
+        case JCS_YCbCr:
+            // decode directly to the pixmap format
+            jpg.out_color_space = JCS_EXT_BGRA;
+            break;
 #endif // LIBJPEG_TURBO_VERSION
+        default:
+            break;
+    }
+    jpeg_start_decompress(&jpg);
 
     pm = image_allocate_frame(ctx, jpg.output_width, jpg.output_height);
     if (!pm) {
@@ -67,37 +82,78 @@ enum loader_status decode_jpeg(struct image* ctx, const uint8_t* data,
         return ldr_fmterror;
     }
 
-    while (jpg.output_scanline < jpg.output_height) {
-        uint8_t* line = (uint8_t*)&pm->data[jpg.output_scanline * pm->width];
-        jpeg_read_scanlines(&jpg, &line, 1);
-
-        // convert grayscale to argb
-        if (jpg.out_color_components == 1) {
-            uint32_t* pixel = (uint32_t*)line;
-            for (int x = jpg.output_width - 1; x >= 0; --x) {
-                const uint8_t src = *(line + x);
-                pixel[x] = ((argb_t)0xff << 24) | (argb_t)src << 16 |
-                    (argb_t)src << 8 | src;
-            }
+    if (jpg.out_color_space != JCS_CMYK && jpg.out_color_components == 4) {
+        // decode directly to the pixmap
+        while (jpg.output_scanline < jpg.output_height) {
+            uint8_t* line =
+                (uint8_t*)&pm->data[jpg.output_scanline * pm->width];
+            jpeg_read_scanlines(&jpg, &line, 1);
         }
-
-#ifndef LIBJPEG_TURBO_VERSION
-        // convert rgb to argb
-        if (jpg.out_color_components == 3) {
-            uint32_t* pixel = (uint32_t*)line;
-            for (int x = jpg.output_width - 1; x >= 0; --x) {
-                const uint8_t* src = line + x * 3;
-                pixel[x] = ((argb_t)0xff << 24) | (argb_t)src[0] << 16 |
-                    (argb_t)src[1] << 8 | src[2];
+    } else {
+        // decode grayscale, rgb or cmyk to the temporary buffer and convert
+        JSAMPARRAY buffer = (*jpg.mem->alloc_sarray)(
+            (j_common_ptr)&jpg, JPOOL_IMAGE,
+            jpg.output_width * jpg.out_color_components, 1);
+        while (jpg.output_scanline < jpg.output_height) {
+            argb_t* dst = &pm->data[jpg.output_scanline * pm->width];
+            jpeg_read_scanlines(&jpg, buffer, 1);
+            if (jpg.out_color_space == JCS_CMYK) {
+                pixconv_cmyk(dst, buffer[0], pm->width, jpg.saw_Adobe_marker);
+            } else if (jpg.out_color_components == 1) {
+                pixconv_gray(dst, buffer[0], pm->width);
+            } else {
+                pixconv_rgb(dst, buffer[0], pm->width);
             }
         }
-#endif // LIBJPEG_TURBO_VERSION
     }
 
-    image_set_format(ctx, "JPEG %dbit", jpg.out_color_components * 8);
+    image_set_format(ctx, "JPEG %dbit", jpg.num_components * 8);
 
     jpeg_finish_decompress(&jpg);
     jpeg_destroy_decompress(&jpg);
 
     return ldr_success;
 }
+
+// JPEG probe implementation
+enum loader_status probe_jpeg(struct image_header* header, const uint8_t* data,
+                              size_t size)
+{
+    struct jpeg_decompress_struct jpg;
+    struct jpg_error_manager err;
+    const uint8_t* exif;
+    size_t exif_size;
+
+    // check signature
+    if (size < sizeof(signature) ||
+        memcmp(data, signature, sizeof(signature))) {
+        return ldr_unsupported;
+    }
+
+    exif = exif_from_jpeg(data, size, &exif_size);
+    if (exif) {
+        header->orientation = exif_orientation(exif, exif_size);
+    }
+
+    jpg.err = jpeg_std_error(&err.mgr);
+    err.img = NULL;
+    err.mgr.error_exit = jpg_error_exit;
+    if (setjmp(err.setjmp)) {
+        jpeg_destroy_decompress(&jpg);
+        return ldr_fmterror;
+    }
+
+    // read markers up to the start of scan
+    jpeg_create_decompress(&jpg);
+    jpeg_mem_src(&jpg, data, size);
+    jpeg_read_header(&jpg, TRUE);
+
+    header->width = jpg.image_width;
+    header->height = jpg.image_height;
+    header->frames = 1;
+    header->bpp = jpg.num_components * 8;
+
+    jpeg_destroy_decompress(&jpg);
+
+    return ldr_success;
+}
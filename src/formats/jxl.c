@@ -3,10 +3,54 @@
 // Copyright (C) 2021 Artem Senichev <artemsen@gmail.com>
 
 #include "../loader.h"
+#include "../pixconv.h"
+#include "../tpool.h"
 
 #include <jxl/decode.h>
 #include <stdlib.h>
 
+/** Parallel job for libjxl runner. */
+struct jxl_job {
+    void* opaque;                ///< libjxl internal data
+    JxlParallelRunFunction func; ///< libjxl task function
+    uint32_t start;              ///< First value of the range
+};
+
+/** Thread pool task: execute single libjxl task, see tpool_fn. */
+static void run_task(void* data, size_t index, size_t thread)
+{
+    const struct jxl_job* job = data;
+    job->func(job->opaque, job->start + (uint32_t)index, thread);
+}
+
+/** libjxl parallel runner based on our thread pool, see JxlParallelRunner. */
+static JxlParallelRetCode run_parallel(__attribute__((unused)) void* runner,
+                                       void* opaque, JxlParallelRunInit init,
+                                       JxlParallelRunFunction func,
+                                       uint32_t start, uint32_t end)
+{
+    struct jxl_job job = { .opaque = opaque, .func = func, .start = start };
+
+    if (init(opaque, tpool_threads()) != 0) {
+        return JXL_PARALLEL_RET_RUNNER_ERROR;
+    }
+    tpool_run(run_task, &job, end - start);
+
+    return JXL_PARALLEL_RET_SUCCESS;
+}
+
+/**
+ * Image output callback: write RGBA pixels in our native ARGB format,
+ * so no separate conversion pass over the image is needed.
+ * Called by libjxl from multiple threads for different parts of the image.
+ */
+static void write_pixels(void* opaque, size_t x, size_t y, size_t num_pixels,
+                         const void* pixels)
+{
+    const struct pixmap* pm = opaque;
+    pixconv_rgba(&pm->data[y * pm->width + x], pixels, num_pixels);
+}
+
 // JPEG XL loader implementation
 enum loader_status decode_jxl(struct image* ctx, const uint8_t* data,
                               size_t size)
@@ -14,6 +58,7 @@ enum loader_status decode_jxl(struct image* ctx, const uint8_t* data,
     JxlDecoder* jxl;
     JxlBasicInfo info = { 0 };
     JxlDecoderStatus status;
+    int events;
     size_t buffer_sz;
     struct image_frame* frames;
     size_t frame_num = 0;
@@ -37,14 +82,25 @@ enum loader_status decode_jxl(struct image* ctx, const uint8_t* data,
     if (!jxl) {
         return ldr_fmterror;
     }
+    status = JxlDecoderSetParallelRunner(jxl, run_parallel, NULL);
+    if (status != JXL_DEC_SUCCESS) {
+        goto fail;
+    }
     status = JxlDecoderSetInput(jxl, data, size);
     if (status != JXL_DEC_SUCCESS) {
         goto fail;
     }
 
     // process decoding
-    status = JxlDecoderSubscribeEvents(
-        jxl, JXL_DEC_BASIC_INFO | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE);
+    events = JXL_DEC_BASIC_INFO | JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE;
+#if JPEGXL_NUMERIC_VERSION >= JPEGXL_COMPUTE_NUMERIC_VERSION(0, 9, 0)
+    if (loader_has_preview()) {
+        // progressive mode: show DC (1:8) preview while the rest is decoded
+        events |= JXL_DEC_FRAME_PROGRESSION;
+        JxlDecoderSetProgressiveDetail(jxl, kDC);
+    }
+#endif
+    status = JxlDecoderSubscribeEvents(jxl, events);
     if (status != JXL_DEC_SUCCESS) {
         goto fail;
     }
@@ -63,15 +119,17 @@ enum loader_status decode_jxl(struct image* ctx, const uint8_t* data,
                 }
                 break;
             case JXL_DEC_FULL_IMAGE:
-                // convert ABGR -> ARGB
-                for (size_t i = 0; i < ctx->frames[frame_num].pm.width *
-                         ctx->frames[frame_num].pm.height;
-                     ++i) {
-                    ctx->frames[frame_num].pm.data[i] =
-                        ABGR_TO_ARGB(ctx->frames[frame_num].pm.data[i]);
-                }
                 frame_num = ctx->num_frames;
                 break;
+#if JPEGXL_NUMERIC_VERSION >= JPEGXL_COMPUTE_NUMERIC_VERSION(0, 9, 0)
+            case JXL_DEC_FRAME_PROGRESSION:
+                // preview makes sense only for the first frame of still image
+                if (!info.have_animation && frame_num == 0 &&
+                    JxlDecoderFlushImage(jxl) == JXL_DEC_SUCCESS) {
+                    loader_preview(ctx);
+                }
+                break;
+#endif
             case JXL_DEC_FRAME:
                 frames = realloc(ctx->frames,
                                  sizeof(*ctx->frames) * (ctx->num_frames + 1));
@@ -108,10 +166,10 @@ enum loader_status decode_jxl(struct image* ctx, const uint8_t* data,
                         ctx->frames[frame_num].pm.height * sizeof(argb_t)) {
                     goto fail;
                 }
-                // set output buffer
-                rc = JxlDecoderSetImageOutBuffer(jxl, &jxl_format,
-                                                 ctx->frames[frame_num].pm.data,
-                                                 buffer_sz);
+                // set output callback, it writes pixels to the frame buffer
+                rc = JxlDecoderSetImageOutCallback(jxl, &jxl_format,
+                                                   write_pixels,
+                                                   &ctx->frames[frame_num].pm);
                 if (rc != JXL_DEC_SUCCESS) {
                     goto fail;
                 }
@@ -138,3 +196,58 @@ fail:
     image_free_frames(ctx);
     return ldr_fmterror;
 }
+
+// JPEG XL probe implementation
+enum loader_status probe_jxl(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    JxlDecoder* jxl;
+    JxlBasicInfo info;
+    JxlDecoderStatus status;
+
+    // check signature
+    switch (JxlSignatureCheck(data, size)) {
+        case JXL_SIG_NOT_ENOUGH_BYTES:
+        case JXL_SIG_INVALID:
+            return ldr_unsupported;
+        default:
+            break;
+    }
+
+    jxl = JxlDecoderCreate(NULL);
+    if (!jxl) {
+        return ldr_fmterror;
+    }
+    if (JxlDecoderSetInput(jxl, data, size) != JXL_DEC_SUCCESS ||
+        JxlDecoderSubscribeEvents(jxl, JXL_DEC_BASIC_INFO | JXL_DEC_FRAME) !=
+            JXL_DEC_SUCCESS) {
+        JxlDecoderDestroy(jxl);
+        return ldr_fmterror;
+    }
+
+    // frame headers are parsed without decoding pixel data
+    do {
+        status = JxlDecoderProcessInput(jxl);
+        if (status == JXL_DEC_BASIC_INFO) {
+            if (JxlDecoderGetBasicInfo(jxl, &info) != JXL_DEC_SUCCESS) {
+                break;
+            }
+            header->width = info.xsize;
+            header->height = info.ysize;
+            header->bpp = info.bits_per_sample * info.num_color_channels +
+                info.alpha_bits;
+            header->alpha = info.alpha_bits != 0;
+            header->orientation = info.orientation;
+            if (!info.have_animation) {
+                header->frames = 1;
+                break;
+            }
+        } else if (status == JXL_DEC_FRAME) {
+            ++header->frames;
+        }
+    } while (status == JXL_DEC_BASIC_INFO || status == JXL_DEC_FRAME);
+
+    JxlDecoderDestroy(jxl);
+
+    return header->width ? ldr_success : ldr_fmterror;
+}
@@ -320,3 +320,57 @@ enum loader_status decode_png(struct image* ctx, const uint8_t* data,
 
     return rc ? ldr_success : ldr_fmterror;
 }
+
+// PNG probe implementation
+enum loader_status probe_png(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    png_struct* png = NULL;
+    png_info* info = NULL;
+
+    struct mem_reader reader = {
+        .data = data,
+        .size = size,
+        .position = 0,
+    };
+
+    // check signature
+    if (png_sig_cmp(data, 0, size) != 0) {
+        return ldr_unsupported;
+    }
+
+    // create decoder
+    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        return ldr_fmterror;
+    }
+    info = png_create_info_struct(png);
+    if (!info) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return ldr_fmterror;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        return ldr_fmterror;
+    }
+
+    // read chunks up to the image data
+    png_set_read_fn(png, &reader, &png_reader);
+    png_read_info(png, info);
+
+    header->width = png_get_image_width(png, info);
+    header->height = png_get_image_height(png, info);
+    header->bpp = png_get_bit_depth(png, info) * png_get_channels(png, info);
+    header->alpha = (png_get_color_type(png, info) & PNG_COLOR_MASK_ALPHA) ||
+        png_get_valid(png, info, PNG_INFO_tRNS);
+    header->frames = 1;
+#ifdef PNG_APNG_SUPPORTED
+    if (png_get_valid(png, info, PNG_INFO_acTL)) {
+        header->frames = png_get_num_frames(png, info);
+    }
+#endif // PNG_APNG_SUPPORTED
+
+    png_destroy_read_struct(&png, &info, NULL);
+
+    return ldr_success;
+}
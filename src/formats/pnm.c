@@ -3,9 +3,14 @@
 // Copyright (C) 2023 Abe Wieland <abe.wieland@gmail.com>
 
 #include "../loader.h"
+#include "../pixconv.h"
+#include "../tpool.h"
 
 #include <limits.h>
 
+// Number of pixels in a chunk of 16-bit row converted at once
+#define PNM_CHUNK 256
+
 // Divide a by b, rounding to the nearest integer; evaluates b twice
 #define div_near(a, b) (((a) + (b) / 2) / (b))
 // Divide a by b, rounding up; evaluates b twice
@@ -18,6 +23,25 @@ enum pnm_type {
     pnm_ppm  // Color pixmap
 };
 
+// PNM file header
+struct pnm_header {
+    enum pnm_type type;
+    bool plain;
+    int width;
+    int height;
+    int maxval;
+};
+
+// Raw rows decoding context, shared between worker threads
+struct pnm_rows {
+    struct pixmap* pm;
+    const uint8_t* data;
+    size_t rowsz;
+    enum pnm_type type;
+    size_t bpc;
+    int maxval;
+};
+
 // A file-like abstraction for cleaner number parsing
 struct pnm_iter {
     const uint8_t* pos;
@@ -154,6 +178,102 @@ static int decode_plain(struct pixmap* pm, struct pnm_iter* it,
     return 0;
 }
 
+/**
+ * Convert a row of raw gray or RGB samples with arbitrary maxval
+ * @param dst destination row
+ * @param src source row
+ * @param width number of pixels
+ * @param channels number of channels: 1 for PGM, 3 for PPM
+ * @param bpc bytes per channel
+ * @param maxval maximum value for each sample
+ * @return false if any sample exceeds maxval
+ */
+static inline bool convert_row(argb_t* restrict dst,
+                               const uint8_t* restrict src, size_t width,
+                               size_t channels, size_t bpc, int maxval)
+{
+    int overflow = 0;
+    for (size_t x = 0; x < width; ++x) {
+        argb_t pix = ARGB_SET_A(0xff);
+        for (size_t c = 0; c < 3; ++c) {
+            const uint8_t* s = src + (x * channels + c % channels) * bpc;
+            int v = bpc == 1 ? s[0] : s[0] << 8 | s[1];
+            overflow |= v > maxval;
+            if (maxval != UINT8_MAX) {
+                v = div_near(v * UINT8_MAX, maxval);
+            }
+            pix |= (argb_t)(v & 0xff) << (16 - c * 8);
+        }
+        dst[x] = pix;
+    }
+    return !overflow;
+}
+
+/**
+ * Convert a row of raw 16-bit gray or RGB samples with maxval 65535
+ * @param dst destination row
+ * @param src source row
+ * @param width number of pixels
+ * @param channels number of channels: 1 for PGM, 3 for PPM
+ */
+static void convert_row16(argb_t* dst, const uint8_t* src, size_t width,
+                          size_t channels)
+{
+    uint8_t buf[PNM_CHUNK * 3];
+    while (width) {
+        const size_t num = min(width, PNM_CHUNK);
+        pixconv_be16(buf, src, num * channels);
+        if (channels == 1) {
+            pixconv_gray(dst, buf, num);
+        } else {
+            pixconv_rgb(dst, buf, num);
+        }
+        dst += num;
+        src += num * channels * 2;
+        width -= num;
+    }
+}
+
+/**
+ * Decode rows of a raw/binary PNM file, see tpool_rows_fn
+ * @param data rows decoding context
+ * @param start first row to decode
+ * @param end row after the last one
+ * @return false if any sample exceeds maxval
+ */
+static bool raw_rows(void* data, size_t start, size_t end)
+{
+    const struct pnm_rows* rows = data;
+    const size_t width = rows->pm->width;
+    const size_t channels = rows->type == pnm_pgm ? 1 : 3;
+    bool rc = true;
+
+    for (size_t y = start; y < end && rc; ++y) {
+        argb_t* dst = rows->pm->data + y * width;
+        const uint8_t* src = rows->data + y * rows->rowsz;
+        if (rows->type == pnm_pbm) {
+            for (size_t x = 0; x < width; ++x) {
+                const int bit = (src[x / 8] >> (7 - x % 8)) & 1;
+                dst[x] = ARGB_SET_A(0xff) | (argb_t)(bit - 1);
+            }
+        } else if (rows->maxval == UINT8_MAX) {
+            // the most common formats: 8-bit gray and RGB24
+            if (channels == 1) {
+                pixconv_gray(dst, src, width);
+            } else {
+                pixconv_rgb(dst, src, width);
+            }
+        } else if (rows->maxval == UINT16_MAX) {
+            // 16-bit gray and RGB48
+            convert_row16(dst, src, width, channels);
+        } else {
+            rc = convert_row(dst, src, width, channels, rows->bpc,
+                             rows->maxval);
+        }
+    }
+    return rc;
+}
+
 /**
  * Decode a raw/binary PNM file
  * @param f image frame to write data to
@@ -168,142 +288,160 @@ static int decode_raw(struct pixmap* pm, struct pnm_iter* it,
     // PGM and PPM use bpc (bytes per channel) bytes for each channel depending
     // on the max, with 1 channel for PGM and 3 for PPM; PBM pads each row to
     // the nearest whole byte
-    size_t bpc = maxval <= UINT8_MAX ? 1 : 2;
-    size_t rowsz = type == pnm_pbm
+    struct pnm_rows rows = {
+        .pm = pm,
+        .data = it->pos,
+        .type = type,
+        .bpc = maxval <= UINT8_MAX ? 1 : 2,
+        .maxval = maxval,
+    };
+    rows.rowsz = type == pnm_pbm
         ? div_ceil(pm->width, 8)
-        : pm->width * bpc * (type == pnm_pgm ? 1 : 3);
-    if (it->end < it->pos + pm->height * rowsz) {
+        : pm->width * rows.bpc * (type == pnm_pgm ? 1 : 3);
+    if (it->end < it->pos + pm->height * rows.rowsz) {
         return PNM_EEOF;
     }
-    for (size_t y = 0; y < pm->height; ++y) {
-        argb_t* dst = pm->data + y * pm->width;
-        const uint8_t* src = it->pos + y * rowsz;
-        for (size_t x = 0; x < pm->width; ++x) {
-            argb_t pix = ARGB_SET_A(0xff);
-            if (type == pnm_pbm) {
-                const int bit = (src[x / 8] >> (7 - x % 8)) & 1;
-                pix |= bit - 1;
-            } else if (type == pnm_pgm) {
-                int v = bpc == 1 ? src[x] : src[x] << 8 | src[x + 1];
-                if (v > maxval) {
-                    return PNM_EOVF;
-                }
-                if (maxval != UINT8_MAX) {
-                    v = div_near(v * UINT8_MAX, maxval);
-                }
-                pix |= ARGB_SET_R(v) | ARGB_SET_G(v) | ARGB_SET_B(v);
-            } else {
-                int r, g, b;
-                if (bpc == 1) {
-                    r = src[x * 3];
-                    g = src[x * 3 + 1];
-                    b = src[x * 3 + 2];
-                } else {
-                    r = src[x * 3] << 8 | src[x * 3 + 1];
-                    g = src[x * 3 + 2] << 8 | src[x * 3 + 3];
-                    b = src[x * 3 + 4] << 8 | src[x * 3 + 5];
-                }
-                if (r > maxval || g > maxval || b > maxval) {
-                    return PNM_EOVF;
-                }
-                if (maxval != UINT8_MAX) {
-                    r = div_near(r * UINT8_MAX, maxval);
-                    g = div_near(g * UINT8_MAX, maxval);
-                    b = div_near(b * UINT8_MAX, maxval);
-                }
-                pix |= ARGB_SET_R(r) | ARGB_SET_G(g) | ARGB_SET_B(b);
-            }
-            dst[x] = pix;
-        }
+    if (!tpool_rows(raw_rows, &rows, pm->height, pm->width)) {
+        return PNM_EOVF;
     }
     return 0;
 }
 
-enum loader_status decode_pnm(struct image* ctx, const uint8_t* data,
-                              size_t size)
+/**
+ * Read PNM file header
+ * @param hdr header to fill
+ * @param it image iterator, points to the pixel data on success
+ * @param data image data
+ * @param size size of image data in bytes
+ * @return loader status
+ */
+static enum loader_status read_header(struct pnm_header* hdr,
+                                      struct pnm_iter* it, const uint8_t* data,
+                                      size_t size)
 {
-    struct pnm_iter it;
-    bool plain;
-    enum pnm_type type;
-    int width, height, maxval, ret;
-
     if (size < 2 || data[0] != 'P') {
         return ldr_unsupported;
     }
     switch (data[1]) {
         case '1':
-            plain = true;
-            type = pnm_pbm;
+            hdr->plain = true;
+            hdr->type = pnm_pbm;
             break;
         case '2':
-            plain = true;
-            type = pnm_pgm;
+            hdr->plain = true;
+            hdr->type = pnm_pgm;
             break;
         case '3':
-            plain = true;
-            type = pnm_ppm;
+            hdr->plain = true;
+            hdr->type = pnm_ppm;
             break;
         case '4':
-            plain = false;
-            type = pnm_pbm;
+            hdr->plain = false;
+            hdr->type = pnm_pbm;
             break;
         case '5':
-            plain = false;
-            type = pnm_pgm;
+            hdr->plain = false;
+            hdr->type = pnm_pgm;
             break;
         case '6':
-            plain = false;
-            type = pnm_ppm;
+            hdr->plain = false;
+            hdr->type = pnm_ppm;
             break;
         default:
             return ldr_unsupported;
     }
-    it.pos = data + 2;
-    it.end = data + size;
+    it->pos = data + 2;
+    it->end = data + size;
 
-    width = pnm_readint(&it, 0);
-    if (width < 0) {
+    hdr->width = pnm_readint(it, 0);
+    if (hdr->width < 0) {
         return ldr_fmterror;
     }
-    height = pnm_readint(&it, 0);
-    if (height < 0) {
+    hdr->height = pnm_readint(it, 0);
+    if (hdr->height < 0) {
         return ldr_fmterror;
     }
-    if (type == pnm_pbm) {
-        maxval = 1;
+    if (hdr->type == pnm_pbm) {
+        hdr->maxval = 1;
     } else {
-        maxval = pnm_readint(&it, 0);
-        if (maxval < 0) {
+        hdr->maxval = pnm_readint(it, 0);
+        if (hdr->maxval < 0) {
             return ldr_fmterror;
         }
-        if (!maxval || maxval > UINT16_MAX) {
+        if (!hdr->maxval || hdr->maxval > UINT16_MAX) {
             return ldr_fmterror;
         }
     }
-    if (!plain) {
+    if (!hdr->plain) {
         // Again, the specifications technically allow for comments here, but no
         // other parsers support that (they treat that comment as image data),
         // so we won't allow one either
-        const char c = *it.pos;
+        if (it->pos == it->end) {
+            return ldr_fmterror;
+        }
+        const char c = *it->pos;
         if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
             return ldr_fmterror;
         }
-        ++it.pos;
+        ++it->pos;
     }
-    if (!image_allocate_frame(ctx, width, height)) {
+
+    return ldr_success;
+}
+
+enum loader_status decode_pnm(struct image* ctx, const uint8_t* data,
+                              size_t size)
+{
+    struct pnm_header hdr;
+    struct pnm_iter it;
+    enum loader_status status;
+    int ret;
+
+    status = read_header(&hdr, &it, data, size);
+    if (status != ldr_success) {
+        return status;
+    }
+
+    if (!image_allocate_frame(ctx, hdr.width, hdr.height)) {
         return ldr_fmterror;
     }
 
-    ret = plain ? decode_plain(&ctx->frames[0].pm, &it, type, maxval)
-                : decode_raw(&ctx->frames[0].pm, &it, type, maxval);
+    ret = hdr.plain
+        ? decode_plain(&ctx->frames[0].pm, &it, hdr.type, hdr.maxval)
+        : decode_raw(&ctx->frames[0].pm, &it, hdr.type, hdr.maxval);
     if (ret < 0) {
         image_free_frames(ctx);
         return ldr_fmterror;
     }
 
     image_set_format(ctx, "P%cM (%s)",
-                     type == pnm_pbm ? 'B' : (type == pnm_pgm ? 'G' : 'P'),
-                     plain ? "ASCII" : "raw");
+                     hdr.type == pnm_pbm ? 'B'
+                                         : (hdr.type == pnm_pgm ? 'G' : 'P'),
+                     hdr.plain ? "ASCII" : "raw");
 
     return ldr_success;
 }
+
+// PNM probe implementation
+enum loader_status probe_pnm(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    struct pnm_header hdr;
+    struct pnm_iter it;
+    enum loader_status status;
+
+    status = read_header(&hdr, &it, data, size);
+    if (status == ldr_success) {
+        header->width = hdr.width;
+        header->height = hdr.height;
+        header->frames = 1;
+        if (hdr.type == pnm_pbm) {
+            header->bpp = 1;
+        } else {
+            header->bpp = (hdr.maxval > UINT8_MAX ? 16 : 8) *
+                (hdr.type == pnm_ppm ? 3 : 1);
+        }
+    }
+
+    return status;
+}
@@ -138,3 +138,27 @@ fail:
     image_free_frames(ctx);
     return ldr_fmterror;
 }
+
+// QOI probe implementation
+enum loader_status probe_qoi(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    const struct qoi_header* qoi = (const struct qoi_header*)data;
+
+    if (size < sizeof(*qoi) ||
+        memcmp(qoi->magic, signature, sizeof(signature))) {
+        return ldr_unsupported;
+    }
+    if (qoi->width == 0 || qoi->height == 0 || qoi->channels < 3 ||
+        qoi->channels > 4) {
+        return ldr_fmterror;
+    }
+
+    header->width = htonl(qoi->width);
+    header->height = htonl(qoi->height);
+    header->frames = 1;
+    header->bpp = qoi->channels * 8;
+    header->alpha = (qoi->channels == 4);
+
+    return ldr_success;
+}
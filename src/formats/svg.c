@@ -57,6 +57,39 @@ static bool is_svg(const uint8_t* data, size_t size)
     return false;
 }
 
+/**
+ * Get rendering view box: image is scaled to fit the rendering size.
+ * @param svg svg handle
+ * @param vb_real output real view box
+ * @param vb_render output rendering view box
+ * @return true if real view box is defined
+ */
+static gboolean get_render_box(RsvgHandle* svg, RsvgRectangle* vb_real,
+                               RsvgRectangle* vb_render)
+{
+    gboolean has_vb_real;
+
+    rsvg_handle_get_intrinsic_dimensions(svg, NULL, NULL, NULL, NULL,
+                                         &has_vb_real, vb_real);
+    vb_render->x = 0;
+    vb_render->y = 0;
+    if (has_vb_real) {
+        if (vb_real->width < vb_real->height) {
+            vb_render->width = RENDER_SIZE * (vb_real->width / vb_real->height);
+            vb_render->height = RENDER_SIZE;
+        } else {
+            vb_render->width = RENDER_SIZE;
+            vb_render->height =
+                RENDER_SIZE * (vb_real->height / vb_real->width);
+        }
+    } else {
+        vb_render->width = RENDER_SIZE;
+        vb_render->height = RENDER_SIZE;
+    }
+
+    return has_vb_real;
+}
+
 // SVG loader implementation
 enum loader_status decode_svg(struct image* ctx, const uint8_t* data,
                               size_t size)
@@ -81,22 +114,7 @@ enum loader_status decode_svg(struct image* ctx, const uint8_t* data,
     }
 
     // define image size in pixels
-    rsvg_handle_get_intrinsic_dimensions(svg, NULL, NULL, NULL, NULL,
-                                         &has_vb_real, &vb_real);
-    vb_render.x = 0;
-    vb_render.y = 0;
-    if (has_vb_real) {
-        if (vb_real.width < vb_real.height) {
-            vb_render.width = RENDER_SIZE * (vb_real.width / vb_real.height);
-            vb_render.height = RENDER_SIZE;
-        } else {
-            vb_render.width = RENDER_SIZE;
-            vb_render.height = RENDER_SIZE * (vb_real.height / vb_real.width);
-        }
-    } else {
-        vb_render.width = RENDER_SIZE;
-        vb_render.height = RENDER_SIZE;
-    }
+    has_vb_real = get_render_box(svg, &vb_real, &vb_render);
 
     // allocate and bind buffer
     pm = image_allocate_frame(ctx, vb_render.width, vb_render.height);
@@ -142,3 +160,33 @@ fail:
     g_object_unref(svg);
     return ldr_fmterror;
 }
+
+// SVG probe implementation
+enum loader_status probe_svg(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    RsvgHandle* svg;
+    RsvgRectangle vb_real;
+    RsvgRectangle vb_render;
+
+    if (!is_svg(data, size)) {
+        return ldr_unsupported;
+    }
+
+    // there is no header in svg, the document has to be parsed
+    svg = rsvg_handle_new_from_data(data, size, NULL);
+    if (!svg) {
+        return ldr_fmterror;
+    }
+
+    get_render_box(svg, &vb_real, &vb_render);
+    header->width = vb_render.width;
+    header->height = vb_render.height;
+    header->frames = 1;
+    header->bpp = 32;
+    header->alpha = true;
+
+    g_object_unref(svg);
+
+    return ldr_success;
+}
@@ -3,6 +3,8 @@
 // Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
 
 #include "../loader.h"
+#include "../pixconv.h"
+#include "../tpool.h"
 
 #include <string.h>
 
@@ -39,6 +41,18 @@ struct __attribute__((__packed__)) tga_header {
 #define TGA_PACKET_RLE (1 << 7) // rle/raw field
 #define TGA_PACKET_LEN 0x7f     // length mask
 
+#define TGA_CM_MAX 256 // max number of color map entries addressed by index
+
+/** Uncompressed rows decoding context, shared between worker threads. */
+struct tga_rows {
+    struct pixmap* pm;   ///< Destination pixmap
+    const uint8_t* data; ///< Pixel data
+    uint8_t bpp;         ///< Bits per pixel
+    uint8_t bytes;       ///< Bytes per pixel
+    const argb_t* cmap;  ///< Decoded color map, NULL for true-color images
+    size_t cmap_size;    ///< Number of entries in the color map
+};
+
 /**
  * Get pixel color from data stream.
  * @param data pointer to stream data
@@ -72,6 +86,55 @@ static inline argb_t get_pixel(const uint8_t* data, size_t bpp)
     return pixel;
 }
 
+/** Uncompressed rows decoder, see tpool_rows_fn. */
+static bool unc_rows(void* data, size_t start, size_t end)
+{
+    const struct tga_rows* rows = data;
+    const size_t width = rows->pm->width;
+
+    for (size_t y = start; y < end; ++y) {
+        argb_t* dst = &rows->pm->data[y * width];
+        const uint8_t* src = rows->data + y * width * rows->bytes;
+        if (rows->cmap) {
+            if (rows->bytes == 1) {
+                if (!pixconv_palette(dst, src, width, rows->cmap,
+                                     rows->cmap_size)) {
+                    return false;
+                }
+                continue;
+            }
+            for (size_t x = 0; x < width; ++x) {
+                const uint8_t index = src[x * rows->bytes];
+                if (index >= rows->cmap_size) {
+                    return false;
+                }
+                dst[x] = rows->cmap[index];
+            }
+            continue;
+        }
+        // constant bpp allows the compiler to specialize each loop
+        switch (rows->bpp) {
+            case 8:
+                pixconv_gray(dst, src, width);
+                break;
+            case 15:
+            case 16:
+                for (size_t x = 0; x < width; ++x) {
+                    dst[x] = get_pixel(src + x * 2, 16);
+                }
+                break;
+            case 24:
+                pixconv_bgr(dst, src, width);
+                break;
+            default:
+                memcpy(dst, src, width * sizeof(argb_t));
+                break;
+        }
+    }
+
+    return true;
+}
+
 /**
  * Decode uncompressed image.
  * @param pm destination pixmap
@@ -86,32 +149,31 @@ static bool decode_unc(struct pixmap* pm, const struct tga_header* tga,
                        size_t size)
 {
     const uint8_t bytes_per_pixel = tga->bpp / 8 + (tga->bpp % 8 ? 1 : 0);
-    const size_t num_pixels = pm->width * pm->height;
-    const size_t data_size = num_pixels * bytes_per_pixel;
+    const size_t data_size = pm->width * pm->height * bytes_per_pixel;
+    argb_t cmap[TGA_CM_MAX];
+    struct tga_rows rows = {
+        .pm = pm,
+        .data = data,
+        .bpp = tga->bpp,
+        .bytes = bytes_per_pixel,
+    };
 
     if (data_size > size) {
         return false;
     }
 
-    if (tga->bpp == 32) {
-        memcpy(pm->data, data, data_size);
-    } else {
+    if (colormap) {
+        // decode color map once instead of decoding entry for each pixel
         const uint8_t cm_bpp = tga->cm_bpc / 8 + (tga->cm_bpc % 8 ? 1 : 0);
-        for (size_t i = 0; i < num_pixels; ++i) {
-            const uint8_t* src = data + i * bytes_per_pixel;
-            if (!colormap) {
-                pm->data[i] = get_pixel(src, tga->bpp);
-            } else {
-                const uint8_t* entry = colormap + cm_bpp * (*src);
-                if (entry + cm_bpp > data) {
-                    return false;
-                }
-                pm->data[i] = get_pixel(entry, tga->cm_bpc);
-            }
+        const uint8_t* entry = colormap;
+        while (rows.cmap_size < TGA_CM_MAX && entry + cm_bpp <= data) {
+            cmap[rows.cmap_size++] = get_pixel(entry, tga->cm_bpc);
+            entry += cm_bpp;
         }
+        rows.cmap = cmap;
     }
 
-    return true;
+    return tpool_rows(unc_rows, &rows, pm->height, pm->width);
 }
 
 /**
@@ -168,52 +230,73 @@ static bool decode_rle(struct pixmap* pm, const struct tga_header* tga,
     return true;
 }
 
-// TGA loader implementation
-enum loader_status decode_tga(struct image* ctx, const uint8_t* data,
-                              size_t size)
+/**
+ * Check TGA header: there is no signature, so all fields are validated.
+ * @param data image data
+ * @param size size of image data in bytes
+ * @return true if header is valid
+ */
+static bool check_header(const uint8_t* data, size_t size)
 {
     const struct tga_header* tga = (const struct tga_header*)data;
-    const uint8_t* colormap = NULL;
-    size_t colormap_sz = 0;
-    const char* type_name = NULL;
-    bool rc = false;
-    size_t data_offset;
-    struct pixmap* pm;
 
     // check type
     if (size < sizeof(struct tga_header) ||
         (tga->image_type != TGA_UNC_CM && tga->image_type != TGA_UNC_TC &&
          tga->image_type != TGA_UNC_GS && tga->image_type != TGA_RLE_CM &&
          tga->image_type != TGA_RLE_TC && tga->image_type != TGA_RLE_GS)) {
-        return ldr_unsupported;
+        return false;
     }
     // check image params
     if (tga->width == 0 || tga->height == 0 ||
         (tga->bpp != 8 && tga->bpp != 15 && tga->bpp != 16 && tga->bpp != 24 &&
          tga->bpp != 32)) {
-        return ldr_unsupported;
+        return false;
     }
 
-    // get color map
+    // check color map
     switch (tga->image_type) {
         case TGA_UNC_CM:
         case TGA_RLE_CM:
             if (!(tga->clrmap_type & TGA_COLORMAP) || !tga->cm_size ||
                 !tga->cm_bpc) {
-                return ldr_unsupported;
+                return false;
             }
-            colormap_sz =
-                tga->cm_size * (tga->cm_bpc / 8 + (tga->cm_bpc % 8 ? 1 : 0));
-            colormap = data + sizeof(struct tga_header) + tga->id_len;
             break;
         default:
             if (tga->clrmap_type & TGA_COLORMAP || tga->cm_size ||
                 tga->cm_bpc) {
-                return ldr_unsupported;
+                return false;
             }
             break;
     }
 
+    return true;
+}
+
+// TGA loader implementation
+enum loader_status decode_tga(struct image* ctx, const uint8_t* data,
+                              size_t size)
+{
+    const struct tga_header* tga = (const struct tga_header*)data;
+    const uint8_t* colormap = NULL;
+    size_t colormap_sz = 0;
+    const char* type_name = NULL;
+    bool rc = false;
+    size_t data_offset;
+    struct pixmap* pm;
+
+    if (!check_header(data, size)) {
+        return ldr_unsupported;
+    }
+
+    // get color map
+    if (tga->image_type == TGA_UNC_CM || tga->image_type == TGA_RLE_CM) {
+        colormap_sz =
+            tga->cm_size * (tga->cm_bpc / 8 + (tga->cm_bpc % 8 ? 1 : 0));
+        colormap = data + sizeof(struct tga_header) + tga->id_len;
+    }
+
     // get pixel array offset
     data_offset = sizeof(struct tga_header) + tga->id_len + colormap_sz;
     if (data_offset >= size) {
@@ -222,6 +305,17 @@ enum loader_status decode_tga(struct image* ctx, const uint8_t* data,
     data += data_offset;
     size -= data_offset;
 
+    // top-down BGRA image has the same layout as our pixmap
+    if (tga->image_type == TGA_UNC_TC && tga->bpp == 32 &&
+        (tga->desc & TGA_ORDER_T2B) && !(tga->desc & TGA_ORDER_R2L) &&
+        (size_t)tga->width * tga->height * sizeof(argb_t) <= size &&
+        image_map_frame(ctx, data, tga->width, tga->height)) {
+        image_set_format(ctx, "TARGA %dbpp, uncompressed true-color",
+                         tga->bpp);
+        ctx->alpha = true;
+        return ldr_success;
+    }
+
     // decode image
     pm = image_allocate_frame(ctx, tga->width, tga->height);
     if (!pm) {
@@ -278,3 +372,22 @@ enum loader_status decode_tga(struct image* ctx, const uint8_t* data,
 
     return ldr_success;
 }
+
+// TGA probe implementation
+enum loader_status probe_tga(struct image_header* header, const uint8_t* data,
+                             size_t size)
+{
+    const struct tga_header* tga = (const struct tga_header*)data;
+
+    if (!check_header(data, size)) {
+        return ldr_unsupported;
+    }
+
+    header->width = tga->width;
+    header->height = tga->height;
+    header->frames = 1;
+    header->bpp = tga->bpp;
+    header->alpha = (tga->bpp == 32);
+
+    return ldr_success;
+}
@@ -3,6 +3,7 @@
 // Copyright (C) 2022 Artem Senichev <artemsen@gmail.com>
 
 #include "../loader.h"
+#include "../pixconv.h"
 
 #include <string.h>
 #include <tiffio.h>
@@ -128,9 +129,7 @@ enum loader_status decode_tiff(struct image* ctx, const uint8_t* data,
     }
 
     // convert ABGR -> ARGB
-    for (size_t i = 0; i < pm->width * pm->height; ++i) {
-        pm->data[i] = ABGR_TO_ARGB(pm->data[i]);
-    }
+    pixconv_rgba(pm->data, pm->data, pm->width * pm->height);
 
     if (timg.orientation == ORIENTATION_TOPLEFT) {
         image_flip_vertical(ctx);
@@ -150,3 +149,55 @@ fail:
     TIFFClose(tiff);
     return ldr_fmterror;
 }
+
+// TIFF probe implementation
+enum loader_status probe_tiff(struct image_header* header, const uint8_t* data,
+                              size_t size)
+{
+    TIFF* tiff;
+    struct mem_reader reader;
+    uint32_t width = 0, height = 0;
+    uint16_t bps = 0, spp = 0, orientation = 0, extra = 0;
+    uint16_t* extra_types;
+
+    // check signature
+    if (size < sizeof(signature1) || size < sizeof(signature2) ||
+        (memcmp(data, signature1, sizeof(signature1)) &&
+         memcmp(data, signature2, sizeof(signature2)))) {
+        return ldr_unsupported;
+    }
+
+    reader.data = data;
+    reader.size = size;
+    reader.position = 0;
+
+    TIFFSetErrorHandler(NULL);
+    TIFFSetWarningHandler(NULL);
+
+    // open reads the first directory only
+    tiff = TIFFClientOpen("", "r", &reader, tiff_read, tiff_write, tiff_seek,
+                          tiff_close, tiff_size, tiff_map, tiff_unmap);
+    if (!tiff) {
+        return ldr_fmterror;
+    }
+    if (!TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width) ||
+        !TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height)) {
+        TIFFClose(tiff);
+        return ldr_fmterror;
+    }
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_EXTRASAMPLES, &extra, &extra_types);
+    TIFFGetField(tiff, TIFFTAG_ORIENTATION, &orientation);
+
+    header->width = width;
+    header->height = height;
+    header->frames = 1;
+    header->bpp = bps * spp;
+    header->alpha = extra != 0;
+    header->orientation = orientation;
+
+    TIFFClose(tiff);
+
+    return ldr_success;
+}
@@ -75,16 +75,20 @@ enum loader_status decode_webp(struct image* ctx, const uint8_t* data,
         }
     }
 
-#ifdef HAVE_LIBEXIF
     const WebPDemuxer* webp_dmx = WebPAnimDecoderGetDemuxer(webp_dec);
     if (WebPDemuxGetI(webp_dmx, WEBP_FF_FORMAT_FLAGS) & EXIF_FLAG) {
         WebPChunkIterator it;
         if (WebPDemuxGetChunk(webp_dmx, "EXIF", 1, &it)) {
-            process_exif(ctx, it.chunk.bytes, it.chunk.size);
+            size_t exif_size;
+            const uint8_t* exif =
+                exif_from_block(it.chunk.bytes, it.chunk.size, &exif_size);
+            exif_orient(ctx, exif_orientation(exif, exif_size));
+#ifdef HAVE_LIBEXIF
+            exif_read_meta(ctx, it.chunk.bytes, it.chunk.size);
+#endif
             WebPDemuxReleaseChunkIterator(&it);
         }
     }
-#endif // HAVE_LIBEXIF
 
     WebPAnimDecoderDelete(webp_dec);
 
@@ -101,3 +105,33 @@ fail:
     }
     return ldr_fmterror;
 }
+
+// WebP probe implementation
+enum loader_status probe_webp(struct image_header* header, const uint8_t* data,
+                              size_t size)
+{
+    const WebPData raw = { .bytes = data, .size = size };
+    WebPDemuxer* webp_dmx;
+
+    // check signature
+    if (size < sizeof(signature) ||
+        memcmp(data, signature, sizeof(signature))) {
+        return ldr_unsupported;
+    }
+
+    // demuxer parses chunks only, the bitstream is not decoded
+    webp_dmx = WebPDemux(&raw);
+    if (!webp_dmx) {
+        return ldr_fmterror;
+    }
+
+    header->width = WebPDemuxGetI(webp_dmx, WEBP_FF_CANVAS_WIDTH);
+    header->height = WebPDemuxGetI(webp_dmx, WEBP_FF_CANVAS_HEIGHT);
+    header->frames = WebPDemuxGetI(webp_dmx, WEBP_FF_FRAME_COUNT);
+    header->alpha = WebPDemuxGetI(webp_dmx, WEBP_FF_FORMAT_FLAGS) & ALPHA_FLAG;
+    header->bpp = header->alpha ? 32 : 24;
+
+    WebPDemuxDelete(webp_dmx);
+
+    return ldr_success;
+}
@@ -8,6 +8,8 @@
 #include "imagelist.h"
 #include "info.h"
 #include "loader.h"
+#include "perf.h"
+#include "thumbdb.h"
 #include "ui.h"
 
 #include <stdlib.h>
@@ -33,6 +35,8 @@
 #define CFG_SHADOW_DEF ARGB(0xff, 0, 0, 0)
 #define CFG_AA         "antialiasing"
 #define CFG_AA_DEF     false
+#define CFG_STORE      "persistent"
+#define CFG_STORE_DEF  false
 
 // Scale for selected thumbnail
 #define THUMB_SELECTED_SCALE 1.15f
@@ -65,6 +69,17 @@ struct gallery {
 /** Global gallery context. */
 static struct gallery ctx;
 
+/**
+ * Free thumbnail entry.
+ * @param entry thumbnail to free
+ */
+static void free_thumbnail(struct thumbnail* entry)
+{
+    perf_mem_add(perf_mem_thumbnails, -(ssize_t)image_memory(entry->image));
+    image_free(entry->image);
+    free(entry);
+}
+
 /**
  * Add new thumbnail from existing image.
  * @param image original image
@@ -79,7 +94,9 @@ static void add_thumbnail(struct image* image)
         entry->height = image->frames[0].pm.height;
         entry->image = image;
         image_thumbnail(image, ctx.thumb_size, ctx.thumb_fill, ctx.thumb_aa);
+        thumbdb_save(image, entry->width, entry->height);
         ctx.thumbs = list_append(ctx.thumbs, entry);
+        perf_mem_add(perf_mem_thumbnails, image_memory(image));
     }
 }
 
@@ -98,14 +115,56 @@ static struct thumbnail* get_thumbnail(size_t index)
     return NULL;
 }
 
+/**
+ * Load thumbnail from the persistent storage.
+ * @param index image position in the image list
+ * @return true if thumbnail was loaded
+ */
+static bool load_stored(size_t index)
+{
+    const char* source = image_list_get(index);
+    struct thumbnail* entry;
+    struct image* image;
+    size_t width, height;
+
+    image = source ? thumbdb_load(source, &width, &height) : NULL;
+    if (!image) {
+        return false;
+    }
+    entry = malloc(sizeof(*entry));
+    if (!entry) {
+        image_free(image);
+        return false;
+    }
+
+    image->index = index;
+    entry->width = width;
+    entry->height = height;
+    entry->image = image;
+    ctx.thumbs = list_append(ctx.thumbs, entry);
+    perf_mem_add(perf_mem_thumbnails, image_memory(image));
+
+    return true;
+}
+
+/**
+ * Request thumbnail: load it from the storage or put to the loader queue.
+ * @param index image position in the image list
+ */
+static void request_thumbnail(size_t index)
+{
+    if (!get_thumbnail(index) && !load_stored(index)) {
+        loader_queue_append(index, tpool_user);
+    }
+}
+
 /**
  * Clear thumbnails cache.
  */
 static void clear_thumbnails(void)
 {
     list_for_each(ctx.thumbs, struct thumbnail, it) {
-        image_free(it->image);
-        free(it);
+        free_thumbnail(it);
     }
     ctx.thumbs = NULL;
 }
@@ -151,22 +210,16 @@ static void reset_loader(void)
     size_t next_b = ctx.selected;
 
     loader_queue_reset();
-    if (!get_thumbnail(ctx.selected)) {
-        loader_queue_append(ctx.selected);
-    }
+    request_thumbnail(ctx.selected);
 
     for (size_t i = 0; i < max(max_f, max_b); ++i) {
         if (i < max_f) {
             next_f = image_list_nearest(next_f, true, false);
-            if (!get_thumbnail(next_f)) {
-                loader_queue_append(next_f);
-            }
+            request_thumbnail(next_f);
         }
         if (i < max_b) {
             next_b = image_list_nearest(next_b, false, false);
-            if (!get_thumbnail(next_b)) {
-                loader_queue_append(next_b);
-            }
+            request_thumbnail(next_b);
         }
     }
 
@@ -179,8 +232,7 @@ static void reset_loader(void)
             if ((min_id != IMGLIST_INVALID && it->image->index < min_id) ||
                 (max_id != IMGLIST_INVALID && it->image->index > max_id)) {
                 ctx.thumbs = list_remove(it);
-                image_free(it->image);
-                free(it);
+                free_thumbnail(it);
             }
         }
     }
@@ -236,8 +288,8 @@ static void update_info(void)
 static void select_thumbnail(size_t index)
 {
     ctx.selected = index;
+    update_layout(); // can load thumbnail from the persistent storage
     update_info();
-    update_layout();
     app_redraw();
 }
 
@@ -260,8 +312,7 @@ static bool skip_thumbnail(size_t index)
     list_for_each(ctx.thumbs, struct thumbnail, it) {
         if (it->image->index == index) {
             ctx.thumbs = list_remove(it);
-            image_free(it->image);
-            free(it);
+            free_thumbnail(it);
         }
     }
 
@@ -511,6 +562,7 @@ static void apply_action(const struct action* action)
     switch (action->type) {
         case action_antialiasing:
             ctx.thumb_aa = !ctx.thumb_aa;
+            thumbdb_set_params(ctx.thumb_size, ctx.thumb_fill, ctx.thumb_aa);
             clear_thumbnails();
             reset_loader();
             app_redraw();
@@ -594,6 +646,10 @@ void gallery_init(struct config* cfg, struct image* image)
     ctx.clr_shadow =
         config_get_color(cfg, CFG_SECTION, CFG_SHADOW, CFG_SHADOW_DEF);
 
+    if (config_get_bool(cfg, CFG_SECTION, CFG_STORE, CFG_STORE_DEF)) {
+        thumbdb_init(ctx.thumb_size, ctx.thumb_fill, ctx.thumb_aa);
+    }
+
     ctx.top = image_list_first();
     ctx.selected = ctx.top;
     if (image) {
@@ -604,6 +660,7 @@ void gallery_init(struct config* cfg, struct image* image)
 
 void gallery_destroy(void)
 {
+    thumbdb_destroy();
     clear_thumbnails();
 }
 
@@ -619,13 +676,32 @@ void gallery_handle(const struct event* event)
         case event_activate:
             select_thumbnail(event->param.activate.index);
             break;
+        case event_open:
+            select_thumbnail(event->param.open.index);
+            break;
         case event_load:
             on_image_load(event->param.load.image, event->param.load.index);
             break;
         case event_resize:
             update_layout();
             break;
+        case event_preview:
+            image_free(event->param.load.image); // viewer only
+            break;
         case event_drag:
             break; // unused in gallery mode
     }
 }
+
+struct image* gallery_thumbnail(size_t index, size_t* width, size_t* height)
+{
+    const struct thumbnail* th = get_thumbnail(index);
+    struct image* image = th ? image_copy_frame(th->image) : NULL;
+
+    if (image) {
+        *width = th->width;
+        *height = th->height;
+    }
+
+    return image;
+}
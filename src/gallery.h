@@ -23,3 +23,11 @@ void gallery_destroy(void);
  * Event handler, see `event_handler` for details.
  */
 void gallery_handle(const struct event* event);
+
+/**
+ * Get copy of the thumbnail from the gallery cache.
+ * @param index index of the image in the image list
+ * @param width,height pointers to output size of the original image
+ * @return thumbnail image instance or NULL if thumbnail is not cached
+ */
+struct image* gallery_thumbnail(size_t index, size_t* width, size_t* height);
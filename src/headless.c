@@ -0,0 +1,472 @@
+// SPDX-License-Identifier: MIT
+// Headless UI: in-memory window with scripted input replay.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "headless.h"
+
+#include "application.h"
+#include "keybind.h"
+#include "memdata.h"
+#include "perf.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+// Window size
+#define WINDOW_MIN            10
+#define WINDOW_MAX            100000
+#define WINDOW_DEFAULT_WIDTH  800
+#define WINDOW_DEFAULT_HEIGHT 600
+
+// Default time to wait for a frame after input (ms)
+#define TIMEOUT_DEFAULT 5000
+
+/** Script command types. */
+enum script_type {
+    script_key,     ///< Key press
+    script_drag,    ///< Mouse drag
+    script_resize,  ///< Window resize
+    script_wait,    ///< Pause before the next command
+    script_timeout, ///< Set max time to wait for a frame
+    script_exit,    ///< Stop replay and exit
+};
+
+/** Input latency statistics. */
+struct latency {
+    size_t count;   ///< Number of inputs
+    size_t frames;  ///< Number of inputs completed with a frame
+    uint64_t min;   ///< Min latency (ns)
+    uint64_t max;   ///< Max latency (ns)
+    uint64_t total; ///< Total latency of all frames (ns)
+};
+
+/** Script command. */
+struct script_cmd {
+    enum script_type type; ///< Command type
+    union {
+        struct {
+            xkb_keysym_t key; ///< Keyboard key
+            uint8_t mods;     ///< Key modifiers
+        } key;
+        struct {
+            int dx; ///< Horizontal offset
+            int dy; ///< Vertical offset
+        } drag;
+        struct {
+            size_t width;  ///< New window width
+            size_t height; ///< New window height
+        } resize;
+        size_t ms; ///< Time for wait and timeout commands
+    } param;
+    size_t repeat;     ///< Number of executions
+    char* text;        ///< Command text for the report
+    struct latency lt; ///< Latency statistics
+};
+
+/** Headless UI context. */
+struct headless {
+    struct script_cmd* script; ///< Script commands
+    size_t script_num;         ///< Number of commands
+    size_t pos;                ///< Index of the next command
+    size_t repeat;             ///< Number of executions of the next command
+    bool enabled;              ///< Headless mode flag
+
+    struct pixmap wnd;   ///< Window buffer
+    int timer;           ///< Script timer
+    size_t timeout;      ///< Max time to wait for a frame (ms)
+    bool started;        ///< Script replay started
+    uint64_t draw_start; ///< Start time of the current redraw
+
+    struct latency startup;  ///< Time to the first frame
+    struct latency* pending; ///< Statistics of input waiting for a frame
+    uint64_t input;          ///< Timestamp of the pending input
+};
+
+/** Global headless UI context. */
+static struct headless ctx = {
+    .timer = -1,
+    .timeout = TIMEOUT_DEFAULT,
+};
+
+/**
+ * Get current monotonic time.
+ * @return timestamp in nanoseconds
+ */
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Arm script timer.
+ * @param ms delay in milliseconds, 0 to fire as soon as possible
+ */
+static void set_timer(size_t ms)
+{
+    struct itimerspec ts = { 0 };
+
+    if (ms) {
+        ts.it_value.tv_sec = ms / 1000;
+        ts.it_value.tv_nsec = (ms % 1000) * 1000000;
+    } else {
+        ts.it_value.tv_nsec = 1; // zero value disarms the timer
+    }
+    timerfd_settime(ctx.timer, 0, &ts, NULL);
+}
+
+/**
+ * Register input that waits for a frame.
+ * @param lt latency statistics of the input
+ */
+static void start_input(struct latency* lt)
+{
+    ++lt->count;
+    ctx.pending = lt;
+    ctx.input = now();
+    set_timer(ctx.timeout);
+}
+
+/**
+ * Resize window buffer.
+ * @param width,height new window size
+ * @return false if buffer can not be allocated
+ */
+static bool resize(size_t width, size_t height)
+{
+    const size_t size = width * height * sizeof(argb_t);
+    argb_t* data = realloc(ctx.wnd.data, size);
+
+    if (!data) {
+        return false;
+    }
+
+    ctx.wnd.width = width;
+    ctx.wnd.height = height;
+    ctx.wnd.data = data;
+    perf_mem_set(perf_mem_window, size);
+
+    return true;
+}
+
+/**
+ * Execute the next script command, exit at the end of the script.
+ */
+static void next_command(void)
+{
+    while (ctx.pos < ctx.script_num) {
+        struct script_cmd* cmd = &ctx.script[ctx.pos];
+
+        if (++ctx.repeat >= cmd->repeat) {
+            ctx.repeat = 0;
+            ++ctx.pos;
+        }
+
+        switch (cmd->type) {
+            case script_key:
+                start_input(&cmd->lt);
+                app_on_keyboard(cmd->param.key.key, cmd->param.key.mods);
+                return;
+            case script_drag:
+                start_input(&cmd->lt);
+                app_on_drag(cmd->param.drag.dx, cmd->param.drag.dy);
+                return;
+            case script_resize:
+                if (resize(cmd->param.resize.width,
+                           cmd->param.resize.height)) {
+                    start_input(&cmd->lt);
+                    app_on_resize();
+                    return;
+                }
+                break;
+            case script_wait:
+                set_timer(cmd->param.ms);
+                return;
+            case script_timeout:
+                ctx.timeout = cmd->param.ms;
+                break;
+            case script_exit:
+                ctx.pos = ctx.script_num;
+                break;
+        }
+    }
+
+    app_exit(0);
+}
+
+/** Script timer handler. */
+static void on_timer(__attribute__((unused)) void* data)
+{
+    uint64_t expirations;
+
+    if (read(ctx.timer, &expirations, sizeof(expirations)) !=
+        sizeof(expirations)) {
+        return;
+    }
+
+    if (!ctx.started) {
+        // initial window configuration, the script starts after first frame
+        ctx.started = true;
+        start_input(&ctx.startup);
+        app_on_resize();
+        return;
+    }
+
+    // input without frame: no redraw within timeout
+    ctx.pending = NULL;
+
+    next_command();
+}
+
+/**
+ * Parse script line.
+ * @param line text to parse
+ * @param cmd output command
+ * @return false if line has invalid format
+ */
+static bool parse_line(const char* line, struct script_cmd* cmd)
+{
+    char name[64];
+    char tail;
+    int dx, dy;
+    size_t a, b;
+
+    cmd->repeat = 1;
+
+    if (sscanf(line, "key %63s %c", name, &tail) == 1) {
+        cmd->type = script_key;
+        return keybind_parse(name, &cmd->param.key.key, &cmd->param.key.mods);
+    }
+    if (sscanf(line, "drag %d %d %c", &dx, &dy, &tail) == 2) {
+        cmd->type = script_drag;
+        cmd->param.drag.dx = dx;
+        cmd->param.drag.dy = dy;
+        return true;
+    }
+    if (sscanf(line, "resize %zu %zu %c", &a, &b, &tail) == 2) {
+        cmd->type = script_resize;
+        cmd->param.resize.width = a;
+        cmd->param.resize.height = b;
+        return a >= WINDOW_MIN && a <= WINDOW_MAX && b >= WINDOW_MIN &&
+            b <= WINDOW_MAX;
+    }
+    if (sscanf(line, "wait %zu %c", &a, &tail) == 1) {
+        cmd->type = script_wait;
+        cmd->param.ms = a;
+        return true;
+    }
+    if (sscanf(line, "timeout %zu %c", &a, &tail) == 1) {
+        cmd->type = script_timeout;
+        cmd->param.ms = a;
+        return a > 0;
+    }
+    if (strcmp(line, "exit") == 0) {
+        cmd->type = script_exit;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Free script commands.
+ */
+static void free_script(void)
+{
+    for (size_t i = 0; i < ctx.script_num; ++i) {
+        free(ctx.script[i].text);
+    }
+    free(ctx.script);
+    ctx.script = NULL;
+    ctx.script_num = 0;
+}
+
+/**
+ * Print latency statistics.
+ * @param name input name
+ * @param lt latency statistics
+ */
+static void print_latency(const char* name, const struct latency* lt)
+{
+    printf("%-24.24s %8zu %8zu", name, lt->count, lt->frames);
+    if (lt->frames) {
+        printf(" %10.2f %10.2f %10.2f\n", (double)lt->min / 1000000,
+               (double)lt->total / lt->frames / 1000000,
+               (double)lt->max / 1000000);
+    } else {
+        puts("          -          -          -");
+    }
+}
+
+bool headless_load(const char* path)
+{
+    FILE* file;
+    char* buf = NULL;
+    size_t buf_sz = 0;
+    ssize_t len;
+    size_t line_num = 0;
+    size_t repeat = 1;
+    bool rc = true;
+
+    file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Unable to open script %s: %s\n", path,
+                strerror(errno));
+        return false;
+    }
+
+    while (rc && (len = getline(&buf, &buf_sz, file)) != -1) {
+        struct script_cmd cmd = { 0 };
+        struct script_cmd* script;
+        char* line = buf;
+        size_t count;
+        char tail;
+
+        ++line_num;
+
+        // trim spaces and skip comments
+        while (len && (buf[len - 1] == '\n' || buf[len - 1] == ' ' ||
+                       buf[len - 1] == '\t')) {
+            buf[--len] = 0;
+        }
+        while (*line == ' ' || *line == '\t') {
+            ++line;
+        }
+        if (!*line || *line == '#') {
+            continue;
+        }
+
+        // repeat modifier for the next command
+        if (sscanf(line, "repeat %zu %c", &count, &tail) == 1 && count > 0) {
+            repeat = count;
+            continue;
+        }
+
+        if (!parse_line(line, &cmd)) {
+            fprintf(stderr, "Invalid script line in %s:%zu: %s\n", path,
+                    line_num, line);
+            rc = false;
+            break;
+        }
+        cmd.repeat = repeat;
+        cmd.text = str_dup(line, NULL);
+        repeat = 1;
+
+        script = realloc(ctx.script, (ctx.script_num + 1) * sizeof(*script));
+        if (!script || !cmd.text) {
+            free(cmd.text);
+            rc = false;
+            break;
+        }
+        ctx.script = script;
+        ctx.script[ctx.script_num++] = cmd;
+    }
+
+    free(buf);
+    fclose(file);
+
+    if (!rc) {
+        free_script();
+    }
+    ctx.enabled = rc;
+
+    return rc;
+}
+
+bool headless_enabled(void)
+{
+    return ctx.enabled;
+}
+
+bool headless_init(size_t width, size_t height)
+{
+    if (width < WINDOW_MIN || height < WINDOW_MIN || width > WINDOW_MAX ||
+        height > WINDOW_MAX) {
+        width = WINDOW_DEFAULT_WIDTH;
+        height = WINDOW_DEFAULT_HEIGHT;
+    }
+    if (!resize(width, height)) {
+        fprintf(stderr, "Not enough memory for window %zux%zu\n", width,
+                height);
+        return false;
+    }
+
+    ctx.timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ctx.timer == -1) {
+        perror("Unable to create timer");
+        return false;
+    }
+    app_watch(ctx.timer, on_timer, NULL);
+
+    // the first event is handled from the main loop
+    set_timer(0);
+
+    return true;
+}
+
+void headless_destroy(void)
+{
+    if (ctx.started) {
+        printf("%-24s %8s %8s %10s %10s %10s\n", "Input", "Count", "Frames",
+               "Min, ms", "Avg, ms", "Max, ms");
+        print_latency("First frame", &ctx.startup);
+        for (size_t i = 0; i < ctx.script_num; ++i) {
+            const struct script_cmd* cmd = &ctx.script[i];
+            if (cmd->lt.count) {
+                print_latency(cmd->text, &cmd->lt);
+            }
+        }
+    }
+
+    if (ctx.timer != -1) {
+        close(ctx.timer);
+        ctx.timer = -1;
+    }
+    free_script();
+    free(ctx.wnd.data);
+    ctx.wnd.data = NULL;
+    perf_mem_set(perf_mem_window, 0);
+}
+
+struct pixmap* headless_draw_begin(void)
+{
+    ctx.draw_start = perf_start();
+    return &ctx.wnd;
+}
+
+void headless_draw_commit(void)
+{
+    struct latency* lt = ctx.pending;
+
+    perf_stop(perf_redraw, ctx.draw_start);
+
+    if (lt) {
+        const uint64_t latency = now() - ctx.input;
+        if (!lt->frames || latency < lt->min) {
+            lt->min = latency;
+        }
+        if (latency > lt->max) {
+            lt->max = latency;
+        }
+        lt->total += latency;
+        ++lt->frames;
+        ctx.pending = NULL;
+        set_timer(0); // execute the next command
+    }
+}
+
+size_t headless_get_width(void)
+{
+    return ctx.wnd.width;
+}
+
+size_t headless_get_height(void)
+{
+    return ctx.wnd.height;
+}
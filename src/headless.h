@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: MIT
+// Headless UI: in-memory window with scripted input replay.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "pixmap.h"
+
+/**
+ * Load input script and enable headless mode.
+ * @param path path to the script file
+ * @return false if the script can not be loaded
+ */
+bool headless_load(const char* path);
+
+/**
+ * Check if headless mode is enabled.
+ * @return true if the window is emulated
+ */
+bool headless_enabled(void);
+
+/**
+ * Create in-memory window and start script replay.
+ * @param width,height window size in pixels
+ * @return true if window created
+ */
+bool headless_init(size_t width, size_t height);
+
+/**
+ * Print latency report and free resources.
+ */
+void headless_destroy(void);
+
+/**
+ * Begin window redraw procedure.
+ * @return window pixmap
+ */
+struct pixmap* headless_draw_begin(void);
+
+/**
+ * Finish window redraw procedure, completes the pending input.
+ */
+void headless_draw_commit(void);
+
+/**
+ * Get window width.
+ * @return window width in pixels
+ */
+size_t headless_get_width(void);
+
+/**
+ * Get window height.
+ * @return window height in pixels
+ */
+size_t headless_get_height(void);
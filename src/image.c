@@ -4,9 +4,41 @@
 
 #include "image.h"
 
+#include "perf.h"
+
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Number of frames kept decoded by lazy stream (shown and next ones)
+#define STREAM_WINDOW 3
+
+// Invalid frame index
+#define NO_FRAME SIZE_MAX
+
+/** Lazy frame decoder: frames are decoded ahead in background thread. */
+struct image_stream {
+    image_stream_fn decode;   ///< Frame decoder
+    void (*free)(void* data); ///< Decoder data destructor
+    void* data;               ///< Decoder specific data
+    size_t rotate;            ///< Rotation angle applied to decoded frames
+    bool flip;                ///< Horizontal flip applied before rotation
+    size_t transform;         ///< Transformation counter, outdates decodes
+
+    pthread_t tid;         ///< Decoder thread
+    pthread_mutex_t lock;  ///< Frame list access lock
+    pthread_cond_t signal; ///< Decoder thread notification
+    bool started;          ///< Decoder thread is started
+    bool active;           ///< Decoder thread has frames to decode
+    bool stop;             ///< Decoder thread stop request
+    size_t shown;          ///< Shown frame, the window starts from it
+    size_t wanted;         ///< Requested frame that is not decoded yet
+    void (*ready)(void);   ///< Requested frame notification
+};
 
 struct image* image_create(void)
 {
@@ -17,6 +49,7 @@ void image_free(struct image* ctx)
 {
     if (ctx) {
         image_free_frames(ctx);
+        image_unmap(ctx);
         free(ctx->source);
         free(ctx->format);
 
@@ -30,25 +63,109 @@ void image_free(struct image* ctx)
     }
 }
 
+/**
+ * Check if pixmap references file mapping.
+ * @param ctx image context
+ * @param pm pixmap to check
+ * @return true if pixmap data is a part of file mapping
+ */
+static bool is_mapped(const struct image* ctx, const struct pixmap* pm)
+{
+    const uint8_t* map = ctx->map;
+    const uint8_t* data = (const uint8_t*)pm->data;
+    return map && data >= map && data < map + ctx->map_size;
+}
+
+/**
+ * Rotate frame, the frame can be not decoded yet.
+ * @param ctx image context
+ * @param pm frame pixmap
+ * @param angle rotation angle (only 90, 180, or 270)
+ */
+static void rotate_frame(struct image* ctx, struct pixmap* pm, size_t angle)
+{
+    if (angle != 180 && is_mapped(ctx, pm)) {
+        // rotation reallocates buffer, move frame out of the file mapping
+        struct pixmap copy;
+        if (!pixmap_create(&copy, pm->width, pm->height)) {
+            return;
+        }
+        memcpy(copy.data, pm->data, pm->width * pm->height * sizeof(argb_t));
+        *pm = copy;
+    }
+    if (pm->data) {
+        pixmap_rotate(pm, angle);
+    } else if (angle == 90 || angle == 270) {
+        const size_t width = pm->width;
+        pm->width = pm->height;
+        pm->height = width;
+    }
+}
+
+/**
+ * Lock frame list of lazy stream before transformation.
+ * @param ctx image context
+ */
+static void transform_begin(struct image* ctx)
+{
+    if (ctx->stream) {
+        pthread_mutex_lock(&ctx->stream->lock);
+    }
+}
+
+/**
+ * Unlock frame list of lazy stream, frames being decoded are outdated.
+ * @param ctx image context
+ */
+static void transform_end(struct image* ctx)
+{
+    if (ctx->stream) {
+        ++ctx->stream->transform;
+        pthread_mutex_unlock(&ctx->stream->lock);
+    }
+}
+
 void image_flip_vertical(struct image* ctx)
 {
+    transform_begin(ctx);
     for (size_t i = 0; i < ctx->num_frames; ++i) {
-        pixmap_flip_vertical(&ctx->frames[i].pm);
+        if (ctx->frames[i].pm.data) {
+            pixmap_flip_vertical(&ctx->frames[i].pm);
+        }
+    }
+    if (ctx->stream) {
+        // vertical flip is horizontal flip with rotation by 180 degrees
+        ctx->stream->rotate = (360 + 180 - ctx->stream->rotate) % 360;
+        ctx->stream->flip = !ctx->stream->flip;
     }
+    transform_end(ctx);
 }
 
 void image_flip_horizontal(struct image* ctx)
 {
+    transform_begin(ctx);
     for (size_t i = 0; i < ctx->num_frames; ++i) {
-        pixmap_flip_horizontal(&ctx->frames[i].pm);
+        if (ctx->frames[i].pm.data) {
+            pixmap_flip_horizontal(&ctx->frames[i].pm);
+        }
+    }
+    if (ctx->stream) {
+        ctx->stream->rotate = (360 - ctx->stream->rotate) % 360;
+        ctx->stream->flip = !ctx->stream->flip;
     }
+    transform_end(ctx);
 }
 
 void image_rotate(struct image* ctx, size_t angle)
 {
+    transform_begin(ctx);
     for (size_t i = 0; i < ctx->num_frames; ++i) {
-        pixmap_rotate(&ctx->frames[i].pm, angle);
+        rotate_frame(ctx, &ctx->frames[i].pm, angle);
     }
+    if (ctx->stream) {
+        ctx->stream->rotate = (ctx->stream->rotate + angle) % 360;
+    }
+    transform_end(ctx);
 }
 
 void image_thumbnail(struct image* image, size_t size, bool fill,
@@ -65,6 +182,7 @@ void image_thumbnail(struct image* image, size_t size, bool fill,
     size_t thumb_height = scale * full->height;
     ssize_t offset_x, offset_y;
     enum pixmap_scale scaler;
+    const uint64_t start = perf_start();
 
     if (antialias) {
         scaler = (scale > 1.0) ? pixmap_bicubic : pixmap_average;
@@ -83,16 +201,41 @@ void image_thumbnail(struct image* image, size_t size, bool fill,
     }
 
     // create thumbnail
-    if (!pixmap_create(&thumb, thumb_width, thumb_height)) {
+    if (!image_load_frame(image, 0) ||
+        !pixmap_create(&thumb, thumb_width, thumb_height)) {
         return;
     }
     pixmap_scale(scaler, full, &thumb, offset_x, offset_y, scale, image->alpha);
 
     image_free_frames(image);
+    image_unmap(image);
     frame = image_create_frames(image, 1);
     if (frame) {
         frame->pm = thumb;
     }
+
+    perf_stop(perf_thumbnail, start);
+}
+
+struct image* image_copy_frame(const struct image* ctx)
+{
+    const struct pixmap* src = &ctx->frames[0].pm;
+    struct image* copy = image_create();
+    struct pixmap* dst;
+
+    if (!copy) {
+        return NULL;
+    }
+    dst = image_allocate_frame(copy, src->width, src->height);
+    if (!dst) {
+        image_free(copy);
+        return NULL;
+    }
+    memcpy(dst->data, src->data, src->width * src->height * sizeof(argb_t));
+    copy->index = ctx->index;
+    copy->alpha = ctx->alpha;
+
+    return copy;
 }
 
 void image_set_format(struct image* ctx, const char* fmt, ...)
@@ -178,12 +321,315 @@ struct image_frame* image_create_frames(struct image* ctx, size_t num)
     return frames;
 }
 
+bool image_set_stream(struct image* ctx, image_stream_fn decode,
+                      void (*free_fn)(void*), void* data)
+{
+    struct image_stream* stream = calloc(1, sizeof(*stream));
+
+    if (!stream) {
+        free_fn(data);
+        return false;
+    }
+
+    stream->decode = decode;
+    stream->free = free_fn;
+    stream->data = data;
+    stream->wanted = NO_FRAME;
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->signal, NULL);
+    ctx->stream = stream;
+
+    return true;
+}
+
+/**
+ * Decode frame of lazy stream and apply current transformations.
+ * @param stream lazy frame decoder
+ * @param index index of the frame
+ * @param pm destination pixmap
+ * @param rotate rotation angle
+ * @param flip horizontal flip flag
+ * @return true if frame was decoded
+ */
+static bool decode_frame(const struct image_stream* stream, size_t index,
+                         struct pixmap* pm, size_t rotate, bool flip)
+{
+    if (!stream->decode(stream->data, index, pm)) {
+        return false;
+    }
+
+    // apply transformations made before the frame was decoded
+    if (flip) {
+        pixmap_flip_horizontal(pm);
+    }
+    if (rotate) {
+        pixmap_rotate(pm, rotate);
+    }
+
+    return true;
+}
+
+/**
+ * Get next frame to decode in background, stream lock must be held.
+ * @param ctx image context
+ * @return index of the frame or NO_FRAME if all frames are decoded
+ */
+static size_t next_stream_frame(const struct image* ctx)
+{
+    const struct image_stream* stream = ctx->stream;
+
+    if (stream->wanted != NO_FRAME) {
+        return stream->wanted;
+    }
+    for (size_t i = 1; i < STREAM_WINDOW && i < ctx->num_frames; ++i) {
+        const size_t index = (stream->shown + i) % ctx->num_frames;
+        if (!ctx->frames[index].pm.data) {
+            return index;
+        }
+    }
+
+    return NO_FRAME;
+}
+
+/**
+ * Check if the frame must be kept decoded, stream lock must be held.
+ * @param ctx image context
+ * @param index index of the frame
+ * @return true if the frame is shown, requested or is in the window
+ */
+static bool in_stream_window(const struct image* ctx, size_t index)
+{
+    const struct image_stream* stream = ctx->stream;
+    const size_t ahead =
+        (index + ctx->num_frames - stream->shown) % ctx->num_frames;
+    return ahead < STREAM_WINDOW || index == stream->wanted;
+}
+
+/**
+ * Lazy stream decoder thread: decodes requested and next frames.
+ * @param data image context
+ */
+static void* stream_thread(void* data)
+{
+    struct image* ctx = data;
+    struct image_stream* stream = ctx->stream;
+
+    pthread_mutex_lock(&stream->lock);
+
+    while (!stream->stop) {
+        struct pixmap pm = { 0 };
+        struct pixmap* frame;
+        void (*ready)(void) = NULL;
+        size_t index, rotate, transform;
+        bool flip, decoded;
+
+        index = stream->active ? next_stream_frame(ctx) : NO_FRAME;
+        if (index == NO_FRAME) {
+            stream->active = false;
+            pthread_cond_wait(&stream->signal, &stream->lock);
+            continue;
+        }
+        rotate = stream->rotate;
+        flip = stream->flip;
+        transform = stream->transform;
+
+        pthread_mutex_unlock(&stream->lock);
+        decoded = decode_frame(stream, index, &pm, rotate, flip);
+        pthread_mutex_lock(&stream->lock);
+
+        frame = &ctx->frames[index].pm;
+        if (!decoded || pm.width != frame->width ||
+            pm.height != frame->height) {
+            // don't retry until the next request
+            stream->active = false;
+            pixmap_free(&pm);
+            continue;
+        }
+        if (transform != stream->transform || frame->data ||
+            !in_stream_window(ctx, index)) {
+            pixmap_free(&pm); // outdated
+            continue;
+        }
+
+        frame->data = pm.data;
+        perf_mem_add(perf_mem_frames, pm.width * pm.height * sizeof(argb_t));
+
+        if (index == stream->wanted) {
+            stream->wanted = NO_FRAME;
+            ready = stream->ready;
+        }
+        if (ready) {
+            pthread_mutex_unlock(&stream->lock);
+            ready();
+            pthread_mutex_lock(&stream->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&stream->lock);
+
+    return NULL;
+}
+
+bool image_load_frame(struct image* ctx, size_t index)
+{
+    struct image_stream* stream = ctx->stream;
+    struct pixmap* pm;
+
+    if (index >= ctx->num_frames) {
+        return false;
+    }
+
+    pm = &ctx->frames[index].pm;
+    if (pm->data) {
+        return true;
+    }
+    if (!stream ||
+        !decode_frame(stream, index, pm, stream->rotate, stream->flip)) {
+        return false;
+    }
+    perf_mem_add(perf_mem_frames, pm->width * pm->height * sizeof(argb_t));
+
+    return true;
+}
+
+size_t image_show_frame(struct image* ctx, size_t index, void (*ready)(void))
+{
+    struct image_stream* stream = ctx->stream;
+
+    if (!stream || index >= ctx->num_frames) {
+        return index;
+    }
+
+    pthread_mutex_lock(&stream->lock);
+
+    if (ctx->frames[index].pm.data) {
+        stream->shown = index;
+        stream->wanted = NO_FRAME;
+        // release frames out of the window
+        for (size_t i = 0; i < ctx->num_frames; ++i) {
+            struct pixmap* frame = &ctx->frames[i].pm;
+            if (frame->data && !in_stream_window(ctx, i)) {
+                perf_mem_add(perf_mem_frames,
+                             -(ssize_t)(frame->width * frame->height *
+                                        sizeof(argb_t)));
+                pixmap_free(frame);
+                frame->data = NULL;
+            }
+        }
+    } else {
+        // the frame is decoded first, the shown one stays on the screen
+        stream->wanted = index;
+        stream->ready = ready;
+        index = stream->shown;
+    }
+
+    // wake up the decoder to fill the window
+    stream->active = true;
+    if (!stream->started) {
+        stream->started =
+            (pthread_create(&stream->tid, NULL, stream_thread, ctx) == 0);
+    }
+    pthread_cond_signal(&stream->signal);
+
+    pthread_mutex_unlock(&stream->lock);
+
+    return index;
+}
+
+struct pixmap* image_map_frame(struct image* ctx, const uint8_t* data,
+                               size_t width, size_t height)
+{
+    const uint8_t* map = ctx->map;
+    const size_t size = width * height * sizeof(argb_t);
+    struct pixmap* pm;
+
+    // pixel data must be inside the mapping and properly aligned
+    if (!map || data < map || data + size > map + ctx->map_size ||
+        (uintptr_t)data % sizeof(argb_t)) {
+        return NULL;
+    }
+
+    // make mapping writable to allow in-place transformations
+    if (mprotect(ctx->map, ctx->map_size, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    if (!image_create_frames(ctx, 1)) {
+        return NULL;
+    }
+    pm = &ctx->frames[0].pm;
+    pm->width = width;
+    pm->height = height;
+    pm->data = (argb_t*)data;
+
+    return pm;
+}
+
+void image_unmap(struct image* ctx)
+{
+    if (!ctx->map || ctx->stream) {
+        return; // lazy decoder reads frames from the mapping
+    }
+    for (size_t i = 0; i < ctx->num_frames; ++i) {
+        if (is_mapped(ctx, &ctx->frames[i].pm)) {
+            return; // still in use
+        }
+    }
+    munmap(ctx->map, ctx->map_size);
+    ctx->map = NULL;
+    ctx->map_size = 0;
+}
+
 void image_free_frames(struct image* ctx)
 {
+    if (ctx->stream) {
+        struct image_stream* stream = ctx->stream;
+        if (stream->started) {
+            pthread_mutex_lock(&stream->lock);
+            stream->stop = true;
+            pthread_cond_signal(&stream->signal);
+            pthread_mutex_unlock(&stream->lock);
+            pthread_join(stream->tid, NULL);
+        }
+        pthread_mutex_destroy(&stream->lock);
+        pthread_cond_destroy(&stream->signal);
+
+        for (size_t i = 0; i < ctx->num_frames; ++i) {
+            const struct pixmap* pm = &ctx->frames[i].pm;
+            if (pm->data) {
+                perf_mem_add(perf_mem_frames,
+                             -(ssize_t)(pm->width * pm->height *
+                                        sizeof(argb_t)));
+            }
+        }
+        ctx->stream->free(ctx->stream->data);
+        free(ctx->stream);
+        ctx->stream = NULL;
+    }
+
     for (size_t i = 0; i < ctx->num_frames; ++i) {
-        pixmap_free(&ctx->frames[i].pm);
+        if (!is_mapped(ctx, &ctx->frames[i].pm)) {
+            pixmap_free(&ctx->frames[i].pm);
+        }
     }
     free(ctx->frames);
     ctx->frames = NULL;
     ctx->num_frames = 0;
 }
+
+size_t image_memory(const struct image* ctx)
+{
+    size_t size = 0;
+
+    if (!ctx || ctx->stream) {
+        return 0;
+    }
+    for (size_t i = 0; i < ctx->num_frames; ++i) {
+        const struct pixmap* pm = &ctx->frames[i].pm;
+        if (pm->data) {
+            size += pm->width * pm->height * sizeof(argb_t);
+        }
+    }
+
+    return size;
+}
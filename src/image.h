@@ -8,19 +8,24 @@
 
 struct image_frame;
 struct image_info;
+struct image_stream;
 
 /** Image context. */
 struct image {
-    size_t index;               ///< Index of the entry in the image list
-    char* source;               ///< Image source (e.g. path to the image file)
-    const char* name;           ///< Name of the image file
-    size_t file_size;           ///< Size of image file
-    char* format;               ///< Format description
-    struct image_frame* frames; ///< Image frames
-    size_t num_frames;          ///< Total number of frames
-    bool alpha;                 ///< Image has alpha channel
-    struct image_info* info;    ///< Image meta info
-    size_t num_info;            ///< Total number of meta info entries
+    size_t index;                ///< Index of the entry in the image list
+    char* source;                ///< Image source (e.g. path to the file)
+    const char* name;            ///< Name of the image file
+    size_t file_size;            ///< Size of image file
+    char* format;                ///< Format description
+    struct image_frame* frames;  ///< Image frames
+    size_t num_frames;           ///< Total number of frames
+    struct image_stream* stream; ///< Lazy frame decoder, NULL if not used
+    void* map;                   ///< File mapping referenced by frames
+    size_t map_size;             ///< Size of the file mapping
+    bool alpha;                  ///< Image has alpha channel
+    struct image_info* info;     ///< Image meta info
+    size_t num_info;             ///< Total number of meta info entries
+    bool exif_deferred;          ///< EXIF meta info is not loaded yet
 };
 
 /** Image frame. */
@@ -29,6 +34,15 @@ struct image_frame {
     size_t duration;  ///< Frame duration in milliseconds (animation)
 };
 
+/**
+ * Frame decoder callback used for lazy loaded animation sequences.
+ * @param data decoder specific data
+ * @param index index of the frame to decode
+ * @param pm destination pixmap, must be allocated by the decoder
+ * @return true if frame was decoded
+ */
+typedef bool (*image_stream_fn)(void* data, size_t index, struct pixmap* pm);
+
 /** Image meta info. */
 struct image_info {
     const char* key; ///< Meta key name
@@ -83,6 +97,13 @@ void image_rotate(struct image* ctx, size_t angle);
 void image_thumbnail(struct image* image, size_t size, bool fill,
                      bool antialias);
 
+/**
+ * Create single frame copy of the image, the first frame is copied only.
+ * @param ctx image context
+ * @return new image instance or NULL on errors
+ */
+struct image* image_copy_frame(const struct image* ctx);
+
 /**
  * Set image format description.
  * @param ctx image context
@@ -109,6 +130,27 @@ void image_add_meta(struct image* ctx, const char* key, const char* fmt, ...)
 struct pixmap* image_allocate_frame(struct image* ctx, size_t width,
                                     size_t height);
 
+/**
+ * Create single frame that references pixel data in the file mapping
+ * (zero-copy), the data must be in ARGB format already.
+ * The mapping is private, so the frame can be transformed in place
+ * (copy-on-write) without changing the file.
+ * @param ctx image context
+ * @param data pointer to the pixel data inside the file mapping
+ * @param width frame width in px
+ * @param height frame height in px
+ * @return pointer to the pixmap associated with the frame, or NULL if the
+ *         data can not be used directly (caller must decode it)
+ */
+struct pixmap* image_map_frame(struct image* ctx, const uint8_t* data,
+                               size_t width, size_t height);
+
+/**
+ * Release file mapping if it is not referenced by frames or lazy decoder.
+ * @param ctx image context
+ */
+void image_unmap(struct image* ctx);
+
 /**
  * Create list of empty frames.
  * @param ctx image context
@@ -117,8 +159,53 @@ struct pixmap* image_allocate_frame(struct image* ctx, size_t width,
  */
 struct image_frame* image_create_frames(struct image* ctx, size_t num);
 
+/**
+ * Attach lazy frame decoder to the image.
+ * Frame list must be created before, frames without pixel data will be
+ * decoded by the specified callback in the background thread during playback.
+ * @param ctx image context
+ * @param decode frame decoder callback
+ * @param free_fn decoder data destructor
+ * @param data decoder specific data
+ * @return false on errors, the data is freed in this case
+ */
+bool image_set_stream(struct image* ctx, image_stream_fn decode,
+                      void (*free_fn)(void*), void* data);
+
+/**
+ * Make sure the frame has pixel data, decode it in the calling thread if
+ * necessary. Used by loaders before the image is shown, must not be
+ * called after image_show_frame().
+ * @param ctx image context
+ * @param index index of the frame
+ * @return true if frame pixel data is available
+ */
+bool image_load_frame(struct image* ctx, size_t index);
+
+/**
+ * Get frame to display without waiting for the decoder.
+ * Frames of lazy stream are decoded by the background thread: the shown
+ * frame and the next ones are kept, all others are released. If the
+ * requested frame is not decoded yet, it is queued first and the last
+ * shown frame is returned instead.
+ * @param ctx image context
+ * @param index index of the requested frame
+ * @param ready callback called from the decoder thread when the requested
+ *              frame is decoded
+ * @return index of the frame to display
+ */
+size_t image_show_frame(struct image* ctx, size_t index, void (*ready)(void));
+
 /**
  * Free image frames.
  * @param ctx image context
  */
 void image_free_frames(struct image* ctx);
+
+/**
+ * Get size of pixel data owned by the image, frames of lazy stream are
+ * accounted separately.
+ * @param ctx image context
+ * @return size of pixel data in bytes
+ */
+size_t image_memory(const struct image* ctx);
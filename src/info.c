@@ -9,6 +9,7 @@
 #include "imagelist.h"
 #include "keybind.h"
 #include "loader.h"
+#include "perf.h"
 #include "ui.h"
 
 #include <stdarg.h>
@@ -54,6 +55,7 @@ static const char* field_names[] = {
     [info_index] = "index",
     [info_scale] = "scale",
     [info_status] = "status",
+    [info_perf] = "perf",
 };
 #define FIELDS_NUM ARRAY_SIZE(field_names)
 // clang-format on
@@ -93,7 +95,10 @@ static const char* default_gallery[] = {
 };
 
 // Max number of lines in one positioned block
-#define MAX_LINES (FIELDS_NUM + 10 /* EXIF and duplicates */)
+#define MAX_LINES (FIELDS_NUM + 40 /* EXIF, perf counters and duplicates */)
+
+// Max length of performance counter text
+#define PERF_TEXT_MAX 128
 
 // Space between text layout and window edge
 #define TEXT_PADDING 10
@@ -136,6 +141,9 @@ struct info_context {
     struct keyval* exif_lines; ///< EXIF data lines
     size_t exif_num;           ///< Number of lines in EXIF data
 
+    struct keyval* perf_lines; ///< Performance counters lines
+    size_t perf_num;           ///< Number of lines with counters
+
     struct keyval fields[FIELDS_NUM];                    ///< Info data
     struct block_scheme scheme[MODES_NUM][POSITION_NUM]; ///< Info scheme
 };
@@ -336,6 +344,26 @@ static void print_keyval(struct pixmap* wnd, enum block_position pos,
     }
 }
 
+/**
+ * Check if the field is displayed in any of the modes.
+ * @param field field type
+ * @return true if field is displayed
+ */
+static bool is_field_used(enum info_field field)
+{
+    for (size_t mode = 0; mode < MODES_NUM; ++mode) {
+        for (size_t pos = 0; pos < POSITION_NUM; ++pos) {
+            const struct block_scheme* block = &ctx.scheme[mode][pos];
+            for (size_t i = 0; i < block->fields_num; ++i) {
+                if (block->fields[i].type == field) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
 /**
  * Import meta data from image.
  * @param image source image
@@ -375,6 +403,40 @@ static void import_exif(const struct image* image)
     }
 }
 
+/**
+ * Import current values of performance counters.
+ */
+static void import_perf(void)
+{
+    char key[PERF_TEXT_MAX];
+    char value[PERF_TEXT_MAX];
+    size_t num = 0;
+
+    while (perf_line(num, key, value, sizeof(key) - 1 /* colon */)) {
+        if (num == ctx.perf_num) {
+            const size_t buf_size = (num + 1) * sizeof(*ctx.perf_lines);
+            struct keyval* lines = realloc(ctx.perf_lines, buf_size);
+            if (!lines) {
+                break;
+            }
+            memset(&lines[num], 0, sizeof(*lines));
+            ctx.perf_lines = lines;
+            ++ctx.perf_num;
+        }
+        strcat(key, ":");
+        font_render(key, &ctx.perf_lines[num].key);
+        font_render(value, &ctx.perf_lines[num].value);
+        ++num;
+    }
+
+    // free lines of counters that are not used anymore
+    while (ctx.perf_num > num) {
+        --ctx.perf_num;
+        free(ctx.perf_lines[ctx.perf_num].key.data);
+        free(ctx.perf_lines[ctx.perf_num].value.data);
+    }
+}
+
 /**
  * Parse and load scheme from config line.
  * @param config line to parse
@@ -483,6 +545,12 @@ void info_destroy(void)
         free(ctx.exif_lines[i].value.data);
     }
 
+    for (size_t i = 0; i < ctx.perf_num; ++i) {
+        free(ctx.perf_lines[i].key.data);
+        free(ctx.perf_lines[i].value.data);
+    }
+    free(ctx.perf_lines);
+
     for (size_t i = 0; i < MODES_NUM; ++i) {
         for (size_t j = 0; j < POSITION_NUM; ++j) {
             free(ctx.scheme[i][j].fields);
@@ -565,7 +633,7 @@ bool info_enabled(void)
     return (ctx.mode != mode_off);
 }
 
-void info_reset(const struct image* image)
+void info_reset(struct image* image)
 {
     const size_t mib = 1024 * 1024;
     const char unit = image->file_size >= mib ? 'M' : 'K';
@@ -580,6 +648,9 @@ void info_reset(const struct image* image)
     info_update(info_image_size, "%zux%zu", image->frames[0].pm.width,
                 image->frames[0].pm.height);
 
+    if (image->exif_deferred && is_field_used(info_exif)) {
+        loader_load_meta(image);
+    }
     import_exif(image);
 
     info_update(info_frame, NULL);
@@ -653,6 +724,21 @@ void info_print(struct pixmap* window)
         return;
     }
 
+    // counters are rendered on each redraw to show the current state
+    for (size_t i = 0; i < POSITION_NUM; ++i) {
+        const struct block_scheme* block = &ctx.scheme[ctx.mode][i];
+        size_t j;
+        for (j = 0; j < block->fields_num; ++j) {
+            if (block->fields[j].type == info_perf) {
+                break;
+            }
+        }
+        if (j < block->fields_num) {
+            import_perf();
+            break;
+        }
+    }
+
     for (size_t i = 0; i < POSITION_NUM; ++i) {
         struct keyval lines[MAX_LINES] = { 0 };
         const struct block_scheme* block = &ctx.scheme[ctx.mode][i];
@@ -673,6 +759,16 @@ void info_print(struct pixmap* window)
                         }
                     }
                     break;
+                case info_perf:
+                    for (size_t n = 0; n < ctx.perf_num; ++n) {
+                        if (lnum < ARRAY_SIZE(lines)) {
+                            if (field->title) {
+                                lines[lnum].key = ctx.perf_lines[n].key;
+                            }
+                            lines[lnum++].value = ctx.perf_lines[n].value;
+                        }
+                    }
+                    break;
                 case info_status:
                     if (origin->value.width && ctx.status.active) {
                         if (field->title) {
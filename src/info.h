@@ -19,6 +19,7 @@ enum info_field {
     info_index,
     info_scale,
     info_status,
+    info_perf,
 };
 
 /**
@@ -59,7 +60,7 @@ bool info_enabled(void);
  * Compose info data from image.
  * @param image image instance
  */
-void info_reset(const struct image* image);
+void info_reset(struct image* image);
 
 /**
  * Update info text.
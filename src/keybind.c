@@ -119,14 +119,7 @@ static const struct virtual_keys virtual_keys[] = {
 static struct keybind* kb_viewer;
 static struct keybind* kb_gallery;
 
-/**
- * Convert text name to key code with modifiers.
- * @param name key text name
- * @param key output keyboard key
- * @param mods output key modifiers (ctrl/alt/shift)
- * @return false if name is invalid
- */
-static bool parse_keymod(const char* name, xkb_keysym_t* key, uint8_t* mods)
+bool keybind_parse(const char* name, xkb_keysym_t* key, uint8_t* mods)
 {
     struct str_slice slices[4]; // mod[alt+ctrl+shift]+key
     const size_t snum = str_split(name, '+', slices, ARRAY_SIZE(slices));
@@ -158,10 +151,12 @@ static bool parse_keymod(const char* name, xkb_keysym_t* key, uint8_t* mods)
             }
         }
     }
-    // check for international symbols
+    // check for international symbols, the name must be a single character
     if (*key == XKB_KEY_NoSymbol) {
         wchar_t* wide = str_to_wide(slices[snum - 1].value, NULL);
-        *key = xkb_utf32_to_keysym(wide[0]);
+        if (wide && wide[0] && !wide[1]) {
+            *key = xkb_utf32_to_keysym(wide[0]);
+        }
         free(wide);
     }
 
@@ -317,7 +312,7 @@ static void load_binding(struct keybind** head, struct config* cfg,
                 kv->used = true;
 
                 // parse keyboard shortcut
-                if (!parse_keymod(kv->key, &keysym, &mods)) {
+                if (!keybind_parse(kv->key, &keysym, &mods)) {
                     config_error_key(section, kv->key);
                     continue;
                 }
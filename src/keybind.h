@@ -59,6 +59,15 @@ struct keybind* keybind_get(void);
  */
 struct keybind* keybind_find(xkb_keysym_t key, uint8_t mods);
 
+/**
+ * Convert text name to key code with modifiers.
+ * @param name key text name, e.g. "Ctrl+Right"
+ * @param key output keyboard key
+ * @param mods output key modifiers (ctrl/alt/shift)
+ * @return false if name is invalid
+ */
+bool keybind_parse(const char* name, xkb_keysym_t* key, uint8_t* mods);
+
 /**
  * Get key name.
  * @param key keyboard key
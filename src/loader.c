@@ -6,9 +6,15 @@
 
 #include "application.h"
 #include "buildcfg.h"
+#include "diskcache.h"
 #include "event.h"
 #include "exif.h"
 #include "imagelist.h"
+#include "perf.h"
+#include "server.h"
+#include "shmcache.h"
+#include "tpool.h"
+#include "trace.h"
 
 #include <errno.h>
 #include <fcntl.h>
@@ -22,12 +28,54 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#ifdef HAVE_MODULES
+#include <ctype.h>
+#include <dlfcn.h>
+#include <limits.h>
+#endif
+
 // Construct function name of loader
 #define LOADER_FUNCTION(name) decode_##name
-// Declaration of loader function
-#define LOADER_DECLARE(name)                                     \
-    enum loader_status LOADER_FUNCTION(name)(struct image * ctx, \
-                                             const uint8_t* data, size_t size)
+// Construct function name of header prober
+#define PROBE_FUNCTION(name) probe_##name
+// Declaration of loader and prober functions
+#define LOADER_DECLARE(name)                                              \
+    enum loader_status LOADER_FUNCTION(name)(struct image * ctx,          \
+                                             const uint8_t* data,         \
+                                             size_t size);                \
+    enum loader_status PROBE_FUNCTION(name)(struct image_header * header, \
+                                            const uint8_t* data, size_t size)
+// Entry in the list of decoders
+#define LOADER_ENTRY(name) \
+    { .decode = &LOADER_FUNCTION(name), .probe = &PROBE_FUNCTION(name) }
+// Entry for decoder that can be built as loadable module, the module is
+// loaded when the signature check passes for the first time
+#ifdef HAVE_MODULES
+#define MODULE_ENTRY(name, sig) \
+    { .module = #name, .match = MODULE_SIGNATURE(sig) }
+#define MODULE_SIGNATURE(sig) match_##sig
+#else
+#define MODULE_ENTRY(name, sig) LOADER_ENTRY(name)
+#endif
+// Entry for decoder that limits the image size itself (library limits or
+// fixed render size), probing such formats costs as much as decoding, so the
+// size is not checked before decoding
+#ifdef HAVE_MODULES
+#define LIMITED_ENTRY(name, sig) \
+    { .module = #name, .match = MODULE_SIGNATURE(sig), .self_limit = true }
+#else
+#define LIMITED_ENTRY(name, sig)                                        \
+    { .decode = &LOADER_FUNCTION(name), .probe = &PROBE_FUNCTION(name), \
+      .self_limit = true }
+#endif
+
+// Default value for eager loading of decoder modules
+#define CFG_DECODERS_DEF false
+
+// Max number of pixels in a frame (megapixels), protects from
+// decompression bombs: small files that expand to gigabytes of pixels
+#define CFG_MAX_PIXELS_DEF 1024
+#define CFG_MAX_PIXELS_MAX 1048576
 
 const char* supported_formats = "bmp, pnm, tga"
 #ifdef HAVE_LIBJPEG
@@ -101,59 +149,316 @@ LOADER_DECLARE(tiff);
 LOADER_DECLARE(webp);
 #endif
 
+/** Image format handlers. */
+struct decoder {
+    image_decoder decode; ///< Image decoder
+    image_prober probe;   ///< Header prober
+    bool self_limit;      ///< Decoder limits image size, no pre-check
+#ifdef HAVE_MODULES
+    const char* module;                    ///< Module name, NULL if built-in
+    bool (*match)(const uint8_t*, size_t); ///< Signature check
+    bool failed;                           ///< Module can not be loaded
+#endif
+};
+
+#ifdef HAVE_MODULES
+/* Signature checks for decoders built as modules: they are fast and allow
+ * to skip loading of the module for images of other formats. The check is
+ * not strict, the module decoder validates the data itself. */
+
+#ifdef HAVE_LIBWEBP
+static bool match_webp(const uint8_t* data, size_t size)
+{
+    return size >= 12 && memcmp(data, "RIFF", 4) == 0 &&
+        memcmp(data + 8, "WEBP", 4) == 0;
+}
+#endif
+
+#if defined(HAVE_LIBHEIF) || defined(HAVE_LIBAVIF)
+static bool match_isobmff(const uint8_t* data, size_t size)
+{
+    // HEIF and AVIF are ISO base media files started with "ftyp" box
+    return size >= 12 && memcmp(data + 4, "ftyp", 4) == 0;
+}
+#endif
+
+#ifdef HAVE_LIBRSVG
+static bool match_svg(const uint8_t* data, size_t size)
+{
+    // svg is an xml, skip spaces from the start
+    while (size && isspace(*data)) {
+        ++data;
+        --size;
+    }
+    return size && *data == '<';
+}
+#endif
+
+#ifdef HAVE_LIBJXL
+static bool match_jxl(const uint8_t* data, size_t size)
+{
+    static const uint8_t codestream[] = { 0xff, 0x0a };
+    static const uint8_t container[] = { 0x00, 0x00, 0x00, 0x0c, 'J',  'X',
+                                         'L',  ' ',  0x0d, 0x0a, 0x87, 0x0a };
+    return (size >= sizeof(codestream) &&
+            memcmp(data, codestream, sizeof(codestream)) == 0) ||
+        (size >= sizeof(container) &&
+         memcmp(data, container, sizeof(container)) == 0);
+}
+#endif
+
+#ifdef HAVE_LIBEXR
+static bool match_exr(const uint8_t* data, size_t size)
+{
+    static const uint8_t signature[] = { 0x76, 0x2f, 0x31, 0x01 };
+    return size >= sizeof(signature) &&
+        memcmp(data, signature, sizeof(signature)) == 0;
+}
+#endif
+
+#ifdef HAVE_LIBTIFF
+static bool match_tiff(const uint8_t* data, size_t size)
+{
+    return size >= 4 &&
+        (memcmp(data, "II\x2a\x00", 4) == 0 ||
+         memcmp(data, "MM\x00\x2a", 4) == 0);
+}
+#endif
+#endif // HAVE_MODULES
+
 // list of available decoders
-static const image_decoder decoders[] = {
+static struct decoder decoders[] = {
 #ifdef HAVE_LIBJPEG
-    &LOADER_FUNCTION(jpeg),
+    LOADER_ENTRY(jpeg),
 #endif
 #ifdef HAVE_LIBPNG
-    &LOADER_FUNCTION(png),
+    LOADER_ENTRY(png),
 #endif
 #ifdef HAVE_LIBGIF
-    &LOADER_FUNCTION(gif),
+    LOADER_ENTRY(gif),
 #endif
-    &LOADER_FUNCTION(bmp),  &LOADER_FUNCTION(pnm),
+    LOADER_ENTRY(bmp),
+    LOADER_ENTRY(pnm),
 #ifdef HAVE_LIBWEBP
-    &LOADER_FUNCTION(webp),
+    MODULE_ENTRY(webp, webp),
 #endif
 #ifdef HAVE_LIBHEIF
-    &LOADER_FUNCTION(heif),
+    LIMITED_ENTRY(heif, isobmff),
 #endif
 #ifdef HAVE_LIBAVIF
-    &LOADER_FUNCTION(avif),
+    LIMITED_ENTRY(avif, isobmff),
 #endif
 #ifdef HAVE_LIBRSVG
-    &LOADER_FUNCTION(svg),
+    LIMITED_ENTRY(svg, svg),
 #endif
 #ifdef HAVE_LIBJXL
-    &LOADER_FUNCTION(jxl),
+    MODULE_ENTRY(jxl, jxl),
 #endif
 #ifdef HAVE_LIBEXR
-    &LOADER_FUNCTION(exr),
+    MODULE_ENTRY(exr, exr),
 #endif
 #ifdef HAVE_LIBTIFF
-    &LOADER_FUNCTION(tiff),
+    MODULE_ENTRY(tiff, tiff),
 #endif
-    &LOADER_FUNCTION(qoi),  &LOADER_FUNCTION(tga),
+    LOADER_ENTRY(qoi),
+    LOADER_ENTRY(tga),
 };
 
+// Number of background loader threads, one per work class
+#define LOADER_THREADS (tpool_background + 1)
+
 /** Background thread loader queue. */
 struct loader_queue {
     struct list list; ///< Links to prev/next entry
     size_t index;     ///< Index of the image to load
 };
 
+/** Background loader thread, serves queue of one work class. */
+struct loader_thread {
+    pthread_t tid;              ///< Thread id
+    struct loader_queue* queue; ///< Queue of images to load
+    pthread_cond_t signal;      ///< Queue notification
+    size_t decoding;            ///< Image being decoded by the thread
+};
+
 /** Loader context. */
 struct loader {
-    pthread_t tid;              ///< Background loader thread id
-    struct loader_queue* queue; ///< Background thread loader queue
-    pthread_mutex_t lock;       ///< Queue access lock
-    pthread_cond_t signal;      ///< Queue notification
-    pthread_cond_t ready;       ///< Thread ready signal
+    struct loader_thread threads[LOADER_THREADS]; ///< Threads per work class
+    pthread_mutex_t lock;                         ///< Queue access lock
+    pthread_cond_t ready;                         ///< Thread ready signal
+    size_t started;                               ///< Number of started threads
+    size_t preview;                               ///< Image to show previews
+    size_t max_pixels;                            ///< Max pixels in a frame
 };
 
 /** Global loader context instance. */
-static struct loader ctx;
+static struct loader ctx = {
+    .max_pixels = (size_t)CFG_MAX_PIXELS_DEF << 20,
+};
+
+#ifdef HAVE_MODULES
+/** Module loader lock: decoders are used by main and background threads. */
+static pthread_mutex_t modules_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Open decoder module.
+ * @param name module name
+ * @return module handle or NULL if module not found
+ */
+static void* open_module(const char* name)
+{
+    char path[PATH_MAX];
+    char* delim;
+    void* handle;
+    ssize_t len;
+
+    snprintf(path, sizeof(path), MODULES_DIR "/%s.so", name);
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle) {
+        return handle;
+    }
+
+    // not installed yet: search in the directory of the executable
+    len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0) {
+        path[len] = 0;
+        delim = strrchr(path, '/');
+        if (delim) {
+            *delim = 0;
+            len = delim - path;
+            snprintf(path + len, sizeof(path) - len, "/%s.so", name);
+            handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        }
+    }
+
+    return handle;
+}
+
+/**
+ * Load decoder module and get its functions, the module is never unloaded.
+ * @param decoder decoder description
+ */
+static void load_module(struct decoder* decoder)
+{
+    char name[32];
+    void* handle;
+    void* decode;
+    void* probe;
+
+    handle = open_module(decoder->module);
+    if (!handle) {
+        fprintf(stderr, "Unable to load decoder module %s: %s\n",
+                decoder->module, dlerror());
+        decoder->failed = true;
+        return;
+    }
+
+    snprintf(name, sizeof(name), "decode_%s", decoder->module);
+    decode = dlsym(handle, name);
+    snprintf(name, sizeof(name), "probe_%s", decoder->module);
+    probe = dlsym(handle, name);
+    if (!decode || !probe) {
+        fprintf(stderr, "Invalid decoder module %s\n", decoder->module);
+        dlclose(handle);
+        decoder->failed = true;
+        return;
+    }
+
+    // POSIX way to convert object pointer to function pointer
+    *(void**)&decoder->decode = decode;
+    *(void**)&decoder->probe = probe;
+}
+#endif // HAVE_MODULES
+
+/**
+ * Get decoder that can handle the image, loads decoder module on demand.
+ * @param index index of the decoder in the list
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return pointer to the decoder or NULL if the format is not supported
+ */
+static const struct decoder* get_decoder(size_t index, const uint8_t* data,
+                                         size_t size)
+{
+    struct decoder* decoder = &decoders[index];
+
+#ifdef HAVE_MODULES
+    if (decoder->module) {
+        bool ready;
+        if (!decoder->match(data, size)) {
+            return NULL;
+        }
+        pthread_mutex_lock(&modules_lock);
+        if (!decoder->decode && !decoder->failed) {
+            load_module(decoder);
+        }
+        ready = decoder->decode;
+        pthread_mutex_unlock(&modules_lock);
+        if (!ready) {
+            return NULL;
+        }
+    }
+#else
+    (void)data;
+    (void)size;
+#endif
+
+    return decoder;
+}
+
+/**
+ * Read image properties from memory buffer.
+ * @param header output image properties
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return loader status
+ */
+static enum loader_status probe_memory(struct image_header* header,
+                                       const uint8_t* data, size_t size)
+{
+    enum loader_status status = ldr_unsupported;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(decoders) && status == ldr_unsupported; ++i) {
+        const struct decoder* decoder = get_decoder(i, data, size);
+        if (decoder) {
+            memset(header, 0, sizeof(*header));
+            status = decoder->probe(header, data, size);
+        }
+    }
+
+    return status;
+}
+
+/**
+ * Check if the image frame is too large to decode.
+ * @param img image being decoded
+ * @param decoder decoder to check the header with
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return true if frame size exceeds the limit
+ */
+static bool is_oversized(const struct image* img,
+                         const struct decoder* decoder, const uint8_t* data,
+                         size_t size)
+{
+    struct image_header header = { 0 };
+
+    if (ctx.max_pixels == 0 || decoder->self_limit) {
+        return false;
+    }
+    if (decoder->probe(&header, data, size) != ldr_success ||
+        header.width == 0 || header.height == 0) {
+        return false; // let the decoder handle it
+    }
+    if (header.width <= ctx.max_pixels / header.height) {
+        return false;
+    }
+
+    fprintf(stderr, "Image %s is too large: %zux%zu\n", img->source,
+            header.width, header.height);
+    return true;
+}
 
 /**
  * Load image from memory buffer.
@@ -166,17 +471,39 @@ static enum loader_status image_from_memory(struct image* img,
                                             const uint8_t* data, size_t size)
 {
     enum loader_status status = ldr_unsupported;
+    uint64_t start;
     size_t i;
 
+    start = perf_start();
     for (i = 0; i < ARRAY_SIZE(decoders) && status == ldr_unsupported; ++i) {
-        status = decoders[i](img, data, size);
+        const struct decoder* decoder = get_decoder(i, data, size);
+        if (decoder) {
+            if (is_oversized(img, decoder, data, size)) {
+                status = ldr_fmterror;
+            } else {
+                status = decoder->decode(img, data, size);
+            }
+        }
     }
+    perf_decoded(status == ldr_success ? img->format : NULL, start);
 
     img->file_size = size;
 
+    if (status == ldr_success) {
+        // only orientation is read here, other EXIF fields are loaded on
+        // demand, see `loader_load_meta`
+        size_t exif_size;
+        const uint8_t* exif;
+        start = perf_start();
+        exif = exif_from_jpeg(data, size, &exif_size);
+        if (exif) {
+            exif_orient(img, exif_orientation(exif, exif_size));
 #ifdef HAVE_LIBEXIF
-    process_exif(img, data, size);
+            img->exif_deferred = true;
 #endif
+        }
+        perf_stop(perf_orient, start);
+    }
 
     return status;
 }
@@ -191,6 +518,7 @@ static enum loader_status image_from_file(struct image* img, const char* file)
 {
     enum loader_status status = ldr_ioerror;
     void* data = MAP_FAILED;
+    uint64_t start = perf_start();
     struct stat st;
     int fd;
 
@@ -204,17 +532,41 @@ static enum loader_status image_from_file(struct image* img, const char* file)
         return ldr_ioerror;
     }
 
+    // try to get already decoded image from the caches
+    if (shmcache_load(img, &st)) {
+        close(fd);
+        return ldr_success;
+    }
+    if (diskcache_load(img, &st)) {
+        shmcache_save(img, &st);
+        close(fd);
+        return ldr_success;
+    }
+    if (server_decode(img, file, &st, &status)) {
+        close(fd);
+        return status;
+    }
+
     // map file to memory
     data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if (data == MAP_FAILED) {
         close(fd);
         return ldr_ioerror;
     }
+    perf_stop(perf_file_io, start);
 
-    // load from mapped memory
+    // load from mapped memory, decoders can use pixel data from the mapping
+    // directly, in this case the mapping is owned by the image
+    img->map = data;
+    img->map_size = st.st_size;
+    start = perf_start();
     status = image_from_memory(img, data, st.st_size);
-
-    munmap(data, st.st_size);
+    if (status == ldr_success) {
+        const size_t decode_time = (perf_start() - start) / 1000000;
+        shmcache_save(img, &st);
+        diskcache_save(img, &st, decode_time);
+    }
+    image_unmap(img);
     close(fd);
 
     return status;
@@ -232,6 +584,7 @@ static enum loader_status image_from_stream(struct image* img, int fd)
     uint8_t* data = NULL;
     size_t size = 0;
     size_t capacity = 0;
+    const uint64_t start = perf_start();
 
     while (true) {
         ssize_t rc;
@@ -248,7 +601,17 @@ static enum loader_status image_from_stream(struct image* img, int fd)
 
         rc = read(fd, data + size, capacity - size);
         if (rc == 0) {
+            perf_stop(perf_file_io, start);
             status = image_from_memory(img, data, size);
+#ifdef HAVE_LIBEXIF
+            // stream can not be read again, load meta info right now
+            if (status == ldr_success && img->exif_deferred) {
+                const uint64_t exif_start = perf_start();
+                img->exif_deferred = false;
+                exif_read_meta(img, data, size);
+                perf_stop(perf_exif, exif_start);
+            }
+#endif
             break;
         }
         if (rc == -1 && errno != EAGAIN) {
@@ -340,6 +703,74 @@ enum loader_status loader_from_source(const char* source, struct image** image)
     return status;
 }
 
+enum loader_status loader_probe(const char* source,
+                                struct image_header* header)
+{
+    enum loader_status status;
+    void* data;
+    struct stat st;
+    int fd;
+
+    if (strcmp(source, LDRSRC_STDIN) == 0 ||
+        strncmp(source, LDRSRC_EXEC, LDRSRC_EXEC_LEN) == 0) {
+        return ldr_unsupported;
+    }
+
+    fd = open(source, O_RDONLY);
+    if (fd == -1) {
+        return ldr_ioerror;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return ldr_ioerror;
+    }
+
+    // only header pages are read from the mapping
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return ldr_ioerror;
+    }
+
+    status = probe_memory(header, data, st.st_size);
+    munmap(data, st.st_size);
+
+    return status;
+}
+
+void loader_load_meta(struct image* image)
+{
+#ifdef HAVE_LIBEXIF
+    void* data;
+    struct stat st;
+    int fd;
+
+    if (!image->exif_deferred) {
+        return;
+    }
+    image->exif_deferred = false;
+
+    fd = open(image->source, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED) {
+        const uint64_t start = perf_start();
+        exif_read_meta(image, data, st.st_size);
+        munmap(data, st.st_size);
+        perf_stop(perf_exif, start);
+    }
+#else
+    (void)image;
+#endif
+}
+
 enum loader_status loader_from_index(size_t index, struct image** image)
 {
     enum loader_status status = ldr_ioerror;
@@ -355,84 +786,192 @@ enum loader_status loader_from_index(size_t index, struct image** image)
     return status;
 }
 
-/** Image loader executed in background thread. */
-static void* loading_thread(__attribute__((unused)) void* data)
+/**
+ * Image loader executed in background thread.
+ * @param data pointer to the loader thread description
+ */
+static void* loading_thread(void* data)
 {
+    static const char* names[LOADER_THREADS] = { "loader", "loader-user",
+                                                  "loader-bkg" };
+    struct loader_thread* thread = data;
+    const enum tpool_qos qos = thread - ctx.threads;
     struct loader_queue* entry;
     struct image* image;
+    uint64_t start;
+
+    // thread priority can't be raised back, so each work class is served
+    // by its own thread: the image opened in the viewer is never decoded
+    // at the priority of thumbnails or preloads
+    tpool_set_qos(qos);
+    trace_thread(names[qos]);
+
+    pthread_mutex_lock(&ctx.lock);
+    ++ctx.started;
+    pthread_cond_signal(&ctx.ready);
+    pthread_mutex_unlock(&ctx.lock);
 
     do {
+        start = trace_begin();
         pthread_mutex_lock(&ctx.lock);
-        pthread_cond_signal(&ctx.ready);
-        while (!ctx.queue) {
-            pthread_cond_wait(&ctx.signal, &ctx.lock);
-            if (!ctx.queue) {
-                pthread_cond_signal(&ctx.ready);
-            }
+        while (!thread->queue) {
+            pthread_cond_wait(&thread->signal, &ctx.lock);
         }
-        entry = ctx.queue;
-        ctx.queue = list_remove(entry);
+        entry = thread->queue;
+        thread->queue = list_remove(entry);
+        thread->decoding = entry->index;
         pthread_mutex_unlock(&ctx.lock);
+        perf_queue(perf_load_queue, -1);
+        trace_end("Queue wait", start);
 
         if (entry->index == IMGLIST_INVALID) {
             free(entry);
             return NULL;
         }
 
+        start = trace_begin();
         image = NULL;
         loader_from_index(entry->index, &image);
         app_on_load(image, entry->index);
         free(entry);
+        trace_end("Preload", start);
     } while (true);
 
     return NULL;
 }
 
-void loader_init(void)
+void loader_load_modules(void)
+{
+#ifdef HAVE_MODULES
+    pthread_mutex_lock(&modules_lock);
+    for (size_t i = 0; i < ARRAY_SIZE(decoders); ++i) {
+        struct decoder* decoder = &decoders[i];
+        if (decoder->module && !decoder->decode && !decoder->failed) {
+            load_module(decoder);
+        }
+    }
+    pthread_mutex_unlock(&modules_lock);
+#endif
+}
+
+void loader_configure(struct config* cfg)
 {
-    pthread_cond_init(&ctx.signal, NULL);
+    const size_t max_mp =
+        config_get_num(cfg, APP_CFG_SECTION, APP_CFG_MAXPIXELS, 0,
+                       CFG_MAX_PIXELS_MAX, CFG_MAX_PIXELS_DEF);
+    ctx.max_pixels = max_mp << 20;
+}
+
+void loader_init(struct config* cfg)
+{
+    loader_configure(cfg);
+
+    if (config_get_bool(cfg, APP_CFG_SECTION, APP_CFG_DECODERS,
+                        CFG_DECODERS_DEF)) {
+        loader_load_modules();
+    }
+
+    ctx.preview = IMGLIST_INVALID;
     pthread_cond_init(&ctx.ready, NULL);
     pthread_mutex_init(&ctx.lock, NULL);
-    pthread_create(&ctx.tid, NULL, loading_thread, NULL);
+    for (size_t i = 0; i < LOADER_THREADS; ++i) {
+        struct loader_thread* thread = &ctx.threads[i];
+        thread->decoding = IMGLIST_INVALID;
+        pthread_cond_init(&thread->signal, NULL);
+        pthread_create(&thread->tid, NULL, loading_thread, thread);
+    }
 
     pthread_mutex_lock(&ctx.lock);
-    pthread_cond_wait(&ctx.ready, &ctx.lock);
+    while (ctx.started < LOADER_THREADS) {
+        pthread_cond_wait(&ctx.ready, &ctx.lock);
+    }
     pthread_mutex_unlock(&ctx.lock);
 }
 
 void loader_destroy(void)
 {
-    if (ctx.tid) {
+    if (ctx.started) {
         loader_queue_reset();
-        loader_queue_append(IMGLIST_INVALID); // send stop signal
-        pthread_join(ctx.tid, NULL);
+        for (size_t i = 0; i < LOADER_THREADS; ++i) {
+            loader_queue_append(IMGLIST_INVALID, i); // send stop signal
+        }
+        for (size_t i = 0; i < LOADER_THREADS; ++i) {
+            pthread_join(ctx.threads[i].tid, NULL);
+            pthread_cond_destroy(&ctx.threads[i].signal);
+        }
+        ctx.started = 0;
 
         pthread_mutex_destroy(&ctx.lock);
-        pthread_cond_destroy(&ctx.signal);
         pthread_cond_destroy(&ctx.ready);
     }
 }
 
-void loader_queue_append(size_t index)
+void loader_queue_append(size_t index, enum tpool_qos qos)
 {
+    struct loader_thread* thread = &ctx.threads[qos];
     struct loader_queue* entry = malloc(sizeof(*entry));
     if (entry) {
         entry->index = index;
         pthread_mutex_lock(&ctx.lock);
-        ctx.queue = list_append(ctx.queue, entry);
-        pthread_cond_signal(&ctx.signal);
+        thread->queue = list_append(thread->queue, entry);
+        pthread_cond_signal(&thread->signal);
         pthread_mutex_unlock(&ctx.lock);
+        perf_queue(perf_load_queue, 1);
     }
 }
 
 void loader_queue_reset(void)
+{
+    const uint64_t start = trace_begin();
+
+    pthread_mutex_lock(&ctx.lock);
+    for (size_t i = 0; i < LOADER_THREADS; ++i) {
+        list_for_each(ctx.threads[i].queue, struct loader_queue, it) {
+            free(it);
+            perf_queue(perf_load_queue, -1);
+        }
+        ctx.threads[i].queue = NULL;
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    trace_end("Loader queue reset", start);
+}
+
+void loader_set_preview(size_t index)
 {
     pthread_mutex_lock(&ctx.lock);
-    list_for_each(ctx.queue, struct loader_queue, it) {
-        free(it);
+    ctx.preview = index;
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+bool loader_has_preview(void)
+{
+    const struct loader_thread* thread = &ctx.threads[tpool_interactive];
+    bool rc;
+
+    // previews are published for the image that the viewer waits for,
+    // other decodes (preloader, indexer, thread pool workers) skip them
+    if (!ctx.started || !pthread_equal(thread->tid, pthread_self())) {
+        return false;
     }
-    ctx.queue = NULL;
-    pthread_cond_signal(&ctx.signal);
-    pthread_cond_wait(&ctx.ready, &ctx.lock);
+
+    pthread_mutex_lock(&ctx.lock);
+    rc = ctx.preview != IMGLIST_INVALID && ctx.preview == thread->decoding;
     pthread_mutex_unlock(&ctx.lock);
+
+    return rc;
+}
+
+void loader_preview(const struct image* image)
+{
+    struct image* preview;
+
+    if (loader_has_preview()) {
+        // the image is modified by the decoder, the main thread gets a copy
+        preview = image_copy_frame(image);
+        if (preview) {
+            app_on_preview(preview,
+                           ctx.threads[tpool_interactive].decoding);
+        }
+    }
 }
@@ -4,7 +4,9 @@
 
 #pragma once
 
+#include "config.h"
 #include "image.h"
+#include "tpool.h"
 
 // File name used for image, that is read from stdin through pipe
 #define LDRSRC_STDIN     "stdin://"
@@ -22,6 +24,17 @@ enum loader_status {
     ldr_ioerror      ///< IO errors
 };
 
+/** Image properties read from the file header without decoding. */
+struct image_header {
+    size_t width;        ///< Image width (px)
+    size_t height;       ///< Image height (px)
+    size_t frames;       ///< Number of frames, 0 if unknown
+    size_t bpp;          ///< Bits per pixel
+    bool alpha;          ///< Image has alpha channel
+    uint8_t orientation; ///< EXIF orientation (1-8), 0 if not specified
+    bool lazy;           ///< Frames are decoded on demand during playback
+};
+
 /** Contains string with the names of the supported image formats. */
 extern const char* supported_formats;
 
@@ -35,10 +48,34 @@ extern const char* supported_formats;
 typedef enum loader_status (*image_decoder)(struct image* image,
                                             const uint8_t* data, size_t size);
 
+/**
+ * Image probe function prototype, implemented by decoders.
+ * Reads image properties from the header, pixel data is not decoded.
+ * @param header output image properties
+ * @param data raw image data
+ * @param size size of image data in bytes
+ * @return loader status
+ */
+typedef enum loader_status (*image_prober)(struct image_header* header,
+                                           const uint8_t* data, size_t size);
+
+/**
+ * Load all decoder modules, by default a module is loaded on first use.
+ */
+void loader_load_modules(void);
+
+/**
+ * Read decoding settings (image size limit), called by loader_init() or
+ * directly if the background thread is not used.
+ * @param cfg config instance
+ */
+void loader_configure(struct config* cfg);
+
 /**
  * Initialize background thread loader.
+ * @param cfg config instance
  */
-void loader_init(void);
+void loader_init(struct config* cfg);
 
 /**
  * Destroy background thread loader.
@@ -53,6 +90,23 @@ void loader_destroy(void);
  */
 enum loader_status loader_from_source(const char* source, struct image** image);
 
+/**
+ * Read image properties from the file header without decoding the image.
+ * Size of the image is reported as stored in the file, the orientation is
+ * not applied.
+ * @param source path to the image file, streams are not supported
+ * @param header output image properties
+ * @return loading status
+ */
+enum loader_status loader_probe(const char* source,
+                                struct image_header* header);
+
+/**
+ * Load meta info (EXIF) of the image, reading it is deferred at decoding.
+ * @param image image instance
+ */
+void loader_load_meta(struct image* image);
+
 /**
  * Load image with specified index in the image list.
  * @param index index of the entry in the image list
@@ -63,11 +117,37 @@ enum loader_status loader_from_index(size_t index, struct image** image);
 
 /**
  * Append image to background loader queue.
+ * Each work class has its own loader thread running at the class priority.
  * @param index index of the image in the image list
+ * @param qos work class of the load
  */
-void loader_queue_append(size_t index);
+void loader_queue_append(size_t index, enum tpool_qos qos);
 
 /**
  * Reset background loader queue.
+ * The image being decoded is not interrupted, its load notification is
+ * delivered as usual.
  */
 void loader_queue_reset(void);
+
+/**
+ * Set image to publish previews for: when the background thread decodes it,
+ * progressive decoders post low resolution approximations to the main loop
+ * (see app_on_preview).
+ * @param index index of the image in the image list, IMGLIST_INVALID to
+ *        disable previews
+ */
+void loader_set_preview(size_t index);
+
+/**
+ * Check if preview is requested for the image being decoded in the
+ * current thread, used by progressive decoders.
+ * @return true if previews should be published
+ */
+bool loader_has_preview(void);
+
+/**
+ * Publish preview of the image being decoded, used by progressive decoders.
+ * @param image image being decoded, the first frame contains preview data
+ */
+void loader_preview(const struct image* image);
@@ -5,8 +5,12 @@
 #include "application.h"
 #include "buildcfg.h"
 #include "config.h"
+#include "headless.h"
 #include "imagelist.h"
 #include "loader.h"
+#include "render.h"
+#include "server.h"
+#include "trace.h"
 #include "ui.h"
 #include "viewer.h"
 
@@ -36,6 +40,12 @@ static const struct cmdarg arguments[] = {
     { 'f', "fullscreen", NULL,    "show image in full screen mode" },
     { 'a', "class",      "NAME",  "set window class/app_id" },
     { 'c', "config",     "S.K=V", "set configuration parameter: section.key=value" },
+    { 'S', "server",     NULL,    "run resident server to open windows instantly" },
+    { 't', "trace",      "FILE",  "write timeline trace in Chrome JSON format" },
+    { 'H', "headless",   "FILE",  "run without window, replay input script" },
+    { 'R', "render",     "WxH",   "render images to files without window" },
+    { 'O', "output",     "DIR",   "set output directory for rendered images" },
+    { 'F', "format",     "FMT",   "set format of rendered images: png/qoi/ppm" },
     { 'v', "version",    NULL,    "print version info and exit" },
     { 'h', "help",       NULL,    "print this help and exit" },
 };
@@ -79,9 +89,12 @@ static void print_version(void)
  * Parse command line arguments.
  * @param argc number of arguments to parse
  * @param argv arguments array
+ * @param cfg config instance
+ * @param server output server mode flag
  * @return index of the first non option argument
  */
-static int parse_cmdargs(int argc, char* argv[], struct config** cfg)
+static int parse_cmdargs(int argc, char* argv[], struct config** cfg,
+                         bool* server)
 {
     struct option options[1 + ARRAY_SIZE(arguments)];
     char short_opts[ARRAY_SIZE(arguments) * 2];
@@ -143,6 +156,33 @@ static int parse_cmdargs(int argc, char* argv[], struct config** cfg)
                             optarg);
                 }
                 break;
+            case 'S':
+                *server = true;
+                break;
+            case 't':
+                trace_init(optarg);
+                break;
+            case 'H':
+                if (!headless_load(optarg)) {
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'R':
+                if (!render_set_size(optarg)) {
+                    fprintf(stderr, "Invalid render size: %s\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'O':
+                render_set_output(optarg);
+                break;
+            case 'F':
+                if (!render_set_format(optarg)) {
+                    fprintf(stderr, "Unsupported render format: %s\n",
+                            optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
             case 'v':
                 print_version();
                 exit(EXIT_SUCCESS);
@@ -160,18 +200,112 @@ static int parse_cmdargs(int argc, char* argv[], struct config** cfg)
 }
 
 /**
- * Application entry point.
+ * Find command line argument description.
+ * @param short_opt short option character, 0 to search by long name
+ * @param long_opt long option name (can be abbreviated)
+ * @param len length of the long option name
+ * @return pointer to the argument description or NULL if not found
  */
-int main(int argc, char* argv[])
+static const struct cmdarg* find_cmdarg(char short_opt, const char* long_opt,
+                                        size_t len)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(arguments); ++i) {
+        const struct cmdarg* arg = &arguments[i];
+        if (short_opt ? arg->short_opt == short_opt
+                      : len && strncmp(arg->long_opt, long_opt, len) == 0) {
+            return arg;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Check if the command line must not be passed to the resident server:
+ * starting the server, rendering, help and version info don't need a window.
+ * @param argc number of arguments
+ * @param argv arguments array
+ * @return true if the command line is handled by the current process
+ */
+static bool run_locally(int argc, char* argv[])
+{
+    static const char local_opts[] = "SRvh";
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const struct cmdarg* opt;
+
+        if (arg[0] != '-' || !arg[1]) {
+            continue; // file name or stdin
+        }
+        if (strcmp(arg, "--") == 0) {
+            break; // end of options
+        }
+
+        if (arg[1] == '-') {
+            const char* name = arg + 2;
+            const size_t len = strcspn(name, "=");
+            opt = find_cmdarg(0, name, len);
+            if (opt) {
+                if (strchr(local_opts, opt->short_opt)) {
+                    return true;
+                }
+                if (opt->format && !name[len]) {
+                    ++i; // skip option value
+                }
+            }
+        } else {
+            // group of short options, e.g. -rS
+            for (const char* ch = arg + 1; *ch; ++ch) {
+                opt = find_cmdarg(*ch, NULL, 0);
+                if (!opt) {
+                    break;
+                }
+                if (strchr(local_opts, opt->short_opt)) {
+                    return true;
+                }
+                if (opt->format) {
+                    if (!ch[1]) {
+                        ++i; // value in the next argument
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Run the viewer.
+ * @param argc number of arguments
+ * @param argv arguments array
+ * @return exit code
+ */
+static int run(int argc, char* argv[])
 {
     bool rc;
+    bool server = false;
     struct config* cfg;
     int argn;
 
-    setlocale(LC_ALL, "");
-
     cfg = config_load();
-    argn = parse_cmdargs(argc, argv, &cfg);
+    argn = parse_cmdargs(argc, argv, &cfg, &server);
+
+    if (server) {
+        rc = server_run(cfg, run);
+        config_free(cfg);
+        return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (render_enabled()) {
+        rc = render_run(cfg, (const char**)&argv[argn], argc - argn);
+        config_free(cfg);
+        trace_destroy();
+        return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    server_setup(&cfg);
     rc = app_init(cfg, (const char**)&argv[argn], argc - argn);
 
     if (cfg && rc) {
@@ -184,5 +318,26 @@ int main(int argc, char* argv[])
         app_destroy();
     }
 
+    // all threads are stopped at this point
+    trace_destroy();
+
     return rc ? EXIT_SUCCESS : EXIT_FAILURE;
 }
+
+/**
+ * Application entry point.
+ */
+int main(int argc, char* argv[])
+{
+    int rc;
+
+    setlocale(LC_ALL, "");
+
+    // open window from the resident server if it is running
+    rc = run_locally(argc, argv) ? -1 : server_client(argc, argv);
+    if (rc < 0) {
+        rc = run(argc, argv);
+    }
+
+    return rc;
+}
@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: MIT
+// Performance counters: always-on timers and statistics for diagnostics.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "perf.h"
+
+#include "trace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Max number of image formats with separate decoding statistics
+#define MAX_FORMATS 16
+
+// Size of the text buffers
+#define LINE_MAX_LEN 128
+
+/** Timer statistics. */
+struct perf_stat {
+    uint64_t count; ///< Number of operations
+    uint64_t total; ///< Total duration in nanoseconds
+    uint64_t max;   ///< Max duration in nanoseconds
+};
+
+/** Per format decoding statistics. */
+struct perf_format {
+    char name[16];         ///< Format name (first word of description)
+    struct perf_stat stat; ///< Decoding statistics
+};
+
+/** Cache lookup statistics. */
+struct perf_hits {
+    uint64_t hit;  ///< Number of successful lookups
+    uint64_t miss; ///< Number of failed lookups
+};
+
+/** Current and peak values of queue depth or memory size. */
+struct perf_gauge {
+    ssize_t current; ///< Current value
+    ssize_t max;     ///< Peak value
+};
+
+/** Counter names. */
+static const char* timer_names[] = {
+    [perf_file_io] = "File I/O",
+    [perf_decode] = "Decode",
+    [perf_exif] = "EXIF",
+    [perf_orient] = "Orientation",
+    [perf_thumbnail] = "Thumbnail",
+    [perf_scale] = "Scale",
+    [perf_blend] = "Blend",
+    [perf_text] = "Text",
+    [perf_redraw] = "Redraw",
+    [perf_commit] = "Commit",
+};
+static const char* cache_names[] = {
+    [perf_shmcache] = "Shared cache",
+    [perf_diskcache] = "Disk cache",
+    [perf_thumbdb] = "Thumbnail DB",
+};
+static const char* queue_names[] = {
+    [perf_load_queue] = "Load queue",
+    [perf_event_queue] = "Event queue",
+};
+static const char* mem_names[] = {
+    [perf_mem_heap] = "Memory total",
+    [perf_mem_current] = "Memory current",
+    [perf_mem_history] = "Memory history",
+    [perf_mem_preload] = "Memory preload",
+    [perf_mem_thumbnails] = "Memory thumbnails",
+    [perf_mem_frames] = "Memory frames",
+    [perf_mem_window] = "Memory window",
+};
+#define TIMERS_NUM (sizeof(timer_names) / sizeof(timer_names[0]))
+#define CACHES_NUM (sizeof(cache_names) / sizeof(cache_names[0]))
+#define QUEUES_NUM (sizeof(queue_names) / sizeof(queue_names[0]))
+#define MEMS_NUM   (sizeof(mem_names) / sizeof(mem_names[0]))
+
+/** Performance counters context. */
+struct perf_context {
+    struct perf_stat timers[TIMERS_NUM];  ///< Timers
+    struct perf_hits caches[CACHES_NUM];  ///< Cache lookups
+    struct perf_gauge queues[QUEUES_NUM]; ///< Queue depths
+    struct perf_gauge mems[MEMS_NUM];     ///< Pixel memory sizes
+
+    struct perf_format formats[MAX_FORMATS]; ///< Per format decoding
+    size_t formats_num;                      ///< Number of known formats
+    pthread_mutex_t formats_lock;            ///< Format table writers lock
+};
+
+static struct perf_context ctx = {
+    .formats_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * Update max value atomically.
+ * @param max pointer to the current max value
+ * @param value new value
+ */
+static void update_max(uint64_t* max, uint64_t value)
+{
+    uint64_t current = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > current &&
+           !__atomic_compare_exchange_n(max, &current, value, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * Put timed operation to the statistics.
+ * @param stat destination statistics
+ * @param duration operation duration in nanoseconds
+ */
+static void stat_add(struct perf_stat* stat, uint64_t duration)
+{
+    __atomic_add_fetch(&stat->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stat->total, duration, __ATOMIC_RELAXED);
+    update_max(&stat->max, duration);
+}
+
+/**
+ * Change gauge value and update its peak.
+ * @param gauge pointer to the gauge
+ * @param value value to add or set
+ * @param set flag to set the value instead of adding
+ */
+static void gauge_update(struct perf_gauge* gauge, ssize_t value, bool set)
+{
+    ssize_t current, max;
+
+    if (set) {
+        current = value;
+        __atomic_store_n(&gauge->current, value, __ATOMIC_RELAXED);
+    } else {
+        current = __atomic_add_fetch(&gauge->current, value, __ATOMIC_RELAXED);
+    }
+
+    max = __atomic_load_n(&gauge->max, __ATOMIC_RELAXED);
+    while (current > max &&
+           !__atomic_compare_exchange_n(&gauge->max, &max, current, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/**
+ * Find format in the table.
+ * @param name format name
+ * @param len length of the format name
+ * @return pointer to the format entry or NULL if not found
+ */
+static struct perf_format* find_format(const char* name, size_t len)
+{
+    // entries are never changed after publishing, readers don't need a lock
+    const size_t num = __atomic_load_n(&ctx.formats_num, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < num; ++i) {
+        struct perf_format* entry = &ctx.formats[i];
+        if (strncmp(entry->name, name, len) == 0 && !entry->name[len]) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Format timer statistics.
+ * @param stat timer statistics
+ * @param buf output buffer
+ * @param size size of the buffer
+ * @return false if timer is empty
+ */
+static bool stat_text(const struct perf_stat* stat, char* buf, size_t size)
+{
+    const uint64_t count = __atomic_load_n(&stat->count, __ATOMIC_RELAXED);
+    const double total = __atomic_load_n(&stat->total, __ATOMIC_RELAXED);
+    const double max = __atomic_load_n(&stat->max, __ATOMIC_RELAXED);
+
+    if (count == 0) {
+        return false;
+    }
+    snprintf(buf, size, "%" PRIu64 " in %.1f ms, avg %.2f, max %.2f", count,
+             total / 1000000, total / count / 1000000, max / 1000000);
+    return true;
+}
+
+uint64_t perf_start(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void perf_stop(enum perf_timer timer, uint64_t start)
+{
+    const uint64_t end = perf_start();
+    stat_add(&ctx.timers[timer], end - start);
+    trace_span(timer_names[timer], start, end);
+}
+
+void perf_decoded(const char* format, uint64_t start)
+{
+    const uint64_t end = perf_start();
+    const uint64_t duration = end - start;
+    struct perf_format* entry = NULL;
+    size_t len;
+
+    stat_add(&ctx.timers[perf_decode], duration);
+    trace_span(timer_names[perf_decode], start, end);
+
+    if (!format) {
+        return;
+    }
+
+    // use first word as format name: "JPEG 8bit" -> "JPEG"
+    len = strcspn(format, " ");
+    if (len >= sizeof(entry->name)) {
+        len = sizeof(entry->name) - 1;
+    }
+
+    entry = find_format(format, len);
+    if (!entry) {
+        pthread_mutex_lock(&ctx.formats_lock);
+        entry = find_format(format, len);
+        if (!entry && ctx.formats_num < MAX_FORMATS) {
+            entry = &ctx.formats[ctx.formats_num];
+            memcpy(entry->name, format, len);
+            __atomic_store_n(&ctx.formats_num, ctx.formats_num + 1,
+                             __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&ctx.formats_lock);
+    }
+    if (entry) {
+        stat_add(&entry->stat, duration);
+    }
+}
+
+void perf_cache(enum perf_cache cache, bool hit)
+{
+    struct perf_hits* hits = &ctx.caches[cache];
+    __atomic_add_fetch(hit ? &hits->hit : &hits->miss, 1, __ATOMIC_RELAXED);
+}
+
+void perf_queue(enum perf_queue queue, ssize_t delta)
+{
+    gauge_update(&ctx.queues[queue], delta, false);
+}
+
+void perf_mem_add(enum perf_mem mem, ssize_t delta)
+{
+    gauge_update(&ctx.mems[mem], delta, false);
+}
+
+void perf_mem_set(enum perf_mem mem, size_t size)
+{
+    gauge_update(&ctx.mems[mem], size, true);
+}
+
+size_t perf_mem_peak(enum perf_mem mem)
+{
+    struct perf_gauge* gauge = &ctx.mems[mem];
+    const ssize_t current = __atomic_load_n(&gauge->current, __ATOMIC_RELAXED);
+    const ssize_t max =
+        __atomic_exchange_n(&gauge->max, current, __ATOMIC_RELAXED);
+    return max > 0 ? max : 0;
+}
+
+bool perf_line(size_t index, char* key, char* value, size_t size)
+{
+    // timers
+    for (size_t i = 0; i < TIMERS_NUM; ++i) {
+        if (stat_text(&ctx.timers[i], value, size) && index-- == 0) {
+            snprintf(key, size, "%s", timer_names[i]);
+            return true;
+        }
+        if (i == perf_decode) {
+            // per format decoding statistics
+            const size_t num =
+                __atomic_load_n(&ctx.formats_num, __ATOMIC_ACQUIRE);
+            for (size_t j = 0; j < num; ++j) {
+                const struct perf_format* fmt = &ctx.formats[j];
+                if (stat_text(&fmt->stat, value, size) && index-- == 0) {
+                    snprintf(key, size, "%s %s", timer_names[i], fmt->name);
+                    return true;
+                }
+            }
+        }
+    }
+
+    // caches
+    for (size_t i = 0; i < CACHES_NUM; ++i) {
+        const uint64_t hit =
+            __atomic_load_n(&ctx.caches[i].hit, __ATOMIC_RELAXED);
+        const uint64_t miss =
+            __atomic_load_n(&ctx.caches[i].miss, __ATOMIC_RELAXED);
+        if (hit + miss != 0 && index-- == 0) {
+            snprintf(key, size, "%s", cache_names[i]);
+            snprintf(value, size,
+                     "%" PRIu64 " hits, %" PRIu64 " misses (%" PRIu64 "%%)",
+                     hit, miss, hit * 100 / (hit + miss));
+            return true;
+        }
+    }
+
+    // queues
+    for (size_t i = 0; i < QUEUES_NUM; ++i) {
+        const ssize_t max =
+            __atomic_load_n(&ctx.queues[i].max, __ATOMIC_RELAXED);
+        if (max != 0 && index-- == 0) {
+            snprintf(key, size, "%s", queue_names[i]);
+            snprintf(value, size, "depth %zd, max %zd",
+                     __atomic_load_n(&ctx.queues[i].current, __ATOMIC_RELAXED),
+                     max);
+            return true;
+        }
+    }
+
+    // pixel memory
+    for (size_t i = 0; i < MEMS_NUM; ++i) {
+        const double mib = 1024 * 1024;
+        const ssize_t max = __atomic_load_n(&ctx.mems[i].max, __ATOMIC_RELAXED);
+        if (max != 0 && index-- == 0) {
+            const ssize_t current =
+                __atomic_load_n(&ctx.mems[i].current, __ATOMIC_RELAXED);
+            snprintf(key, size, "%s", mem_names[i]);
+            snprintf(value, size, "%.1f MiB, peak %.1f MiB", current / mib,
+                     max / mib);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void perf_dump(int fd)
+{
+    char key[LINE_MAX_LEN];
+    char value[LINE_MAX_LEN];
+    char line[LINE_MAX_LEN * 2 + 8];
+    int len;
+
+    // called from the main loop (perf action, exit): formatting is not
+    // async-signal-safe, so the dump must not be requested from a signal
+    // handler directly
+    len = snprintf(line, sizeof(line), "Performance counters:\n");
+    if (write(fd, line, len) != len) {
+        return;
+    }
+
+    for (size_t i = 0; perf_line(i, key, value, sizeof(key)); ++i) {
+        len = snprintf(line, sizeof(line), "  %s: %s\n", key, value);
+        if (len > 0 && write(fd, line, len) != len) {
+            break;
+        }
+    }
+}
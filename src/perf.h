@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: MIT
+// Performance counters: always-on timers and statistics for diagnostics.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Timed operations. */
+enum perf_timer {
+    perf_file_io,   ///< Reading image files
+    perf_decode,    ///< Decoding images (all formats)
+    perf_exif,      ///< Reading EXIF meta data
+    perf_orient,    ///< Fixing image orientation
+    perf_thumbnail, ///< Creating thumbnails
+    perf_scale,     ///< Scaling pixmaps
+    perf_blend,     ///< Blending semi-transparent areas
+    perf_text,      ///< Rendering and printing text
+    perf_redraw,    ///< Drawing the window content
+    perf_commit,    ///< Committing window buffer
+};
+
+/** Caches with hit/miss statistics. */
+enum perf_cache {
+    perf_shmcache,  ///< Shared memory cache of decoded images
+    perf_diskcache, ///< Disk cache of decoded images
+    perf_thumbdb,   ///< Persistent thumbnail storage
+};
+
+/** Queues with depth statistics. */
+enum perf_queue {
+    perf_load_queue,  ///< Background loader queue
+    perf_event_queue, ///< Application event queue
+};
+
+/** Owners of pixel memory. */
+enum perf_mem {
+    perf_mem_heap,       ///< All allocated pixmaps
+    perf_mem_current,    ///< Current image in viewer mode
+    perf_mem_history,    ///< Recently viewed images
+    perf_mem_preload,    ///< Preloaded images
+    perf_mem_thumbnails, ///< Gallery thumbnails
+    perf_mem_frames,     ///< Animation frames decoded on the fly
+    perf_mem_window,     ///< Window buffers
+};
+
+/**
+ * Get start point for timer.
+ * @return current monotonic time in nanoseconds
+ */
+uint64_t perf_start(void);
+
+/**
+ * Register timed operation.
+ * @param timer operation type
+ * @param start start point returned by `perf_start`
+ */
+void perf_stop(enum perf_timer timer, uint64_t start);
+
+/**
+ * Register decoding operation, updates total and per format statistics.
+ * @param format image format description, NULL if decoding failed
+ * @param start start point returned by `perf_start`
+ */
+void perf_decoded(const char* format, uint64_t start);
+
+/**
+ * Register cache lookup.
+ * @param cache cache type
+ * @param hit true if the image was found in the cache
+ */
+void perf_cache(enum perf_cache cache, bool hit);
+
+/**
+ * Register queue depth change.
+ * @param queue queue type
+ * @param delta number of added (positive) or removed (negative) entries
+ */
+void perf_queue(enum perf_queue queue, ssize_t delta);
+
+/**
+ * Register change of the pixel memory size.
+ * @param mem memory owner
+ * @param delta size of allocated (positive) or freed (negative) memory
+ */
+void perf_mem_add(enum perf_mem mem, ssize_t delta);
+
+/**
+ * Set current size of the pixel memory.
+ * @param mem memory owner
+ * @param size total size of memory in bytes
+ */
+void perf_mem_set(enum perf_mem mem, size_t size);
+
+/**
+ * Get peak size of the pixel memory and reset the high-water mark.
+ * @param mem memory owner
+ * @return peak size of memory in bytes since the previous call
+ */
+size_t perf_mem_peak(enum perf_mem mem);
+
+/**
+ * Get text description of the counter.
+ * @param index line index, only non-empty counters are enumerated
+ * @param key,value output buffers for counter name and its value
+ * @param size size of each buffer
+ * @return false if there are no more lines
+ */
+bool perf_line(size_t index, char* key, char* value, size_t size);
+
+/**
+ * Print all counters, not async-signal-safe.
+ * @param fd output file descriptor
+ */
+void perf_dump(int fd);
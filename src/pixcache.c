@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+// Container of decoded images used by the persistent caches.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "pixcache.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Container format identifier, changed with the layout
+#define PIXCACHE_MAGIC 0x31435053
+// Max length of the format description
+#define MAX_FORMAT 64
+// Alignment of pixel data
+#define PIXEL_ALIGN 64
+
+/** Frame description. */
+struct pixcache_frame {
+    uint32_t width;    ///< Frame width
+    uint32_t height;   ///< Frame height
+    uint32_t duration; ///< Frame duration
+    uint32_t reserved; ///< Padding
+    uint64_t offset;   ///< Offset of pixel data from the container start
+};
+
+/** Container header, followed by frames table and pixel data. */
+struct pixcache_header {
+    uint32_t magic;           ///< Format identifier
+    uint32_t num_frames;      ///< Number of frames
+    struct pixcache_key key;  ///< Cached image identifier
+    uint8_t alpha;            ///< Image has alpha channel
+    uint8_t exif;             ///< EXIF meta info can be loaded from the file
+    uint16_t reserved[3];     ///< Padding
+    char format[MAX_FORMAT];  ///< Format description
+    struct pixcache_frame frames[];
+};
+
+/**
+ * Align offset of pixel data.
+ * @param offset offset to align
+ * @return aligned offset
+ */
+static inline uint64_t align(uint64_t offset)
+{
+    return (offset + PIXEL_ALIGN - 1) & ~(uint64_t)(PIXEL_ALIGN - 1);
+}
+
+void pixcache_make_key(struct pixcache_key* key, const struct stat* st)
+{
+    memset(key, 0, sizeof(*key));
+    key->dev = st->st_dev;
+    key->ino = st->st_ino;
+    key->size = st->st_size;
+    key->mtime = st->st_mtim.tv_sec;
+    key->mtime_ns = st->st_mtim.tv_nsec;
+}
+
+size_t pixcache_size(const struct image* img)
+{
+    uint64_t size;
+
+    // meta info is not cached, only EXIF can be loaded again from the file
+    if (img->stream || img->num_frames == 0 || img->num_info ||
+        img->num_frames > UINT32_MAX) {
+        return 0;
+    }
+
+    size = sizeof(struct pixcache_header) +
+        img->num_frames * sizeof(struct pixcache_frame);
+    for (size_t i = 0; i < img->num_frames; ++i) {
+        const struct image_frame* frame = &img->frames[i];
+        if (!frame->pm.data || frame->pm.width > UINT32_MAX ||
+            frame->pm.height > UINT32_MAX || frame->duration > UINT32_MAX) {
+            return 0;
+        }
+        size = align(size);
+        size += (uint64_t)frame->pm.width * frame->pm.height * sizeof(argb_t);
+    }
+
+    return size > SIZE_MAX ? 0 : size;
+}
+
+bool pixcache_write(int fd, const struct image* img,
+                    const struct pixcache_key* key, size_t size)
+{
+    struct pixcache_header* hdr;
+    uint64_t offset;
+    void* data;
+
+    if (ftruncate(fd, size) == -1) {
+        return false;
+    }
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    hdr = data;
+    hdr->key = *key;
+    hdr->num_frames = img->num_frames;
+    hdr->alpha = img->alpha;
+    hdr->exif = img->exif_deferred;
+    if (img->format) {
+        strncpy(hdr->format, img->format, MAX_FORMAT - 1);
+    }
+
+    offset = sizeof(*hdr) + img->num_frames * sizeof(struct pixcache_frame);
+    for (size_t i = 0; i < img->num_frames; ++i) {
+        const struct image_frame* frame = &img->frames[i];
+        const size_t len = frame->pm.width * frame->pm.height * sizeof(argb_t);
+        offset = align(offset);
+        hdr->frames[i].width = frame->pm.width;
+        hdr->frames[i].height = frame->pm.height;
+        hdr->frames[i].duration = frame->duration;
+        hdr->frames[i].offset = offset;
+        memcpy((uint8_t*)data + offset, frame->pm.data, len);
+        offset += len;
+    }
+
+    // mark container as complete
+    __atomic_store_n(&hdr->magic, PIXCACHE_MAGIC, __ATOMIC_RELEASE);
+
+    munmap(data, size);
+
+    return true;
+}
+
+bool pixcache_map(struct image* img, int fd, const struct pixcache_key* key)
+{
+    const struct pixcache_header* hdr;
+    struct image_frame* frames;
+    struct stat st;
+    size_t size;
+    void* data;
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(*hdr)) {
+        return false;
+    }
+    size = st.st_size;
+
+    // private mapping: frames can be modified in place (copy-on-write)
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    // validate container
+    hdr = data;
+    if (hdr->magic != PIXCACHE_MAGIC ||
+        memcmp(&hdr->key, key, sizeof(*key)) != 0 || hdr->num_frames == 0 ||
+        hdr->num_frames >
+            (size - sizeof(*hdr)) / sizeof(struct pixcache_frame)) {
+        goto fail;
+    }
+    for (size_t i = 0; i < hdr->num_frames; ++i) {
+        const struct pixcache_frame* frame = &hdr->frames[i];
+        const uint64_t len =
+            (uint64_t)frame->width * frame->height * sizeof(argb_t);
+        if (frame->offset % PIXEL_ALIGN || frame->offset > size ||
+            len > size - frame->offset) {
+            goto fail;
+        }
+    }
+
+    frames = image_create_frames(img, hdr->num_frames);
+    if (!frames) {
+        goto fail;
+    }
+    for (size_t i = 0; i < hdr->num_frames; ++i) {
+        const struct pixcache_frame* frame = &hdr->frames[i];
+        frames[i].pm.width = frame->width;
+        frames[i].pm.height = frame->height;
+        frames[i].pm.data = (argb_t*)((uint8_t*)data + frame->offset);
+        frames[i].duration = frame->duration;
+    }
+    image_set_format(img, "%.*s", MAX_FORMAT, hdr->format);
+    img->alpha = hdr->alpha;
+    img->exif_deferred = hdr->exif;
+    img->file_size = key->size;
+    img->map = data;
+    img->map_size = size;
+
+    return true;
+
+fail:
+    munmap(data, size);
+    return false;
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+// Container of decoded images used by the persistent caches.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "image.h"
+
+#include <sys/stat.h>
+
+/** Cached image identifier: the file and its modification time. */
+struct pixcache_key {
+    uint64_t dev;     ///< Device containing the file
+    uint64_t ino;     ///< File inode
+    uint64_t size;    ///< File size
+    int64_t mtime;    ///< Modification time, seconds
+    int64_t mtime_ns; ///< Modification time, nanoseconds
+};
+
+/**
+ * Compose cache key.
+ * @param key output key
+ * @param st attributes of the image file
+ */
+void pixcache_make_key(struct pixcache_key* key, const struct stat* st);
+
+/**
+ * Get size of the container for the image.
+ * @param img image to store
+ * @return size of the container in bytes, 0 if image can not be cached
+ */
+size_t pixcache_size(const struct image* img);
+
+/**
+ * Write image to the container file.
+ * @param fd container file descriptor, must be opened for read and write
+ * @param img image to store
+ * @param key cached image identifier
+ * @param size size of the container, see `pixcache_size`
+ * @return false on errors
+ */
+bool pixcache_write(int fd, const struct image* img,
+                    const struct pixcache_key* key, size_t size);
+
+/**
+ * Load image from the container file. Frames of the loaded image reference
+ * the container via copy-on-write image mapping.
+ * @param img destination image
+ * @param fd container file descriptor
+ * @param key expected image identifier
+ * @return false if container is invalid or doesn't match the key
+ */
+bool pixcache_map(struct image* img, int fd, const struct pixcache_key* key);
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: MIT
+// Pixel format conversion: row converters used by image decoders.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "pixconv.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// SSSE3 code is built with target attribute and selected in runtime
+#define PIXCONV_SSSE3
+#include <tmmintrin.h>
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+
+// Alpha channel of opaque pixel
+#define OPAQUE ARGB_SET_A(0xff)
+
+/**
+ * Reduce 16-bit sample to 8 bits: round(v / 257).
+ * @param v 16-bit value
+ * @return 8-bit value
+ */
+static inline uint8_t reduce16(uint16_t v)
+{
+    return (v - (v >> 8) - ((v >> 7) & 1) + 128) >> 8;
+}
+
+/* Scalar implementation, used as a fallback and to handle tails. */
+
+static void rgba_scalar(argb_t* dst, const uint8_t* src, size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t* px = src + i * 4;
+        dst[i] = ARGB(px[3], px[0], px[1], px[2]);
+    }
+}
+
+static void bgrx_scalar(argb_t* dst, const uint8_t* src, size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t* px = src + i * 4;
+        dst[i] = OPAQUE | ARGB_SET_R(px[2]) | ARGB_SET_G(px[1]) | px[0];
+    }
+}
+
+static void rgb_scalar(argb_t* restrict dst, const uint8_t* restrict src,
+                       size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t* px = src + i * 3;
+        dst[i] = OPAQUE | ARGB_SET_R(px[0]) | ARGB_SET_G(px[1]) | px[2];
+    }
+}
+
+static void bgr_scalar(argb_t* restrict dst, const uint8_t* restrict src,
+                       size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t* px = src + i * 3;
+        dst[i] = OPAQUE | ARGB_SET_R(px[2]) | ARGB_SET_G(px[1]) | px[0];
+    }
+}
+
+static void gray_scalar(argb_t* restrict dst, const uint8_t* restrict src,
+                        size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        dst[i] = OPAQUE | (argb_t)src[i] * 0x010101;
+    }
+}
+
+static void be16_scalar(uint8_t* restrict dst, const uint8_t* restrict src,
+                        size_t num)
+{
+    for (size_t i = 0; i < num; ++i) {
+        dst[i] = reduce16(src[i * 2] << 8 | src[i * 2 + 1]);
+    }
+}
+
+#ifdef PIXCONV_SSSE3
+
+/**
+ * Check if SSSE3 implementation can be used.
+ * @return true if CPU supports SSSE3
+ */
+static inline bool use_ssse3(void)
+{
+#ifdef __SSSE3__
+    return true;
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+TARGET_SSSE3 static void rgba_ssse3(argb_t* dst, const uint8_t* src,
+                                    size_t num)
+{
+    const __m128i swap =
+        _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+
+    for (; i + 4 <= num; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(px, swap));
+    }
+
+    rgba_scalar(dst + i, src + i * 4, num - i);
+}
+
+TARGET_SSSE3 static void bgrx_ssse3(argb_t* dst, const uint8_t* src,
+                                    size_t num)
+{
+    const __m128i alpha = _mm_set1_epi32((int)OPAQUE);
+    size_t i = 0;
+
+    for (; i + 4 <= num; i += 4) {
+        const __m128i px = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(px, alpha));
+    }
+
+    bgrx_scalar(dst + i, src + i * 4, num - i);
+}
+
+/**
+ * Expand 16 pixels of 24-bit color to 32-bit.
+ * @param dst destination buffer
+ * @param src source pixels, 48 bytes
+ * @param shuffle byte order of 4 pixels in the 12-byte group
+ */
+TARGET_SSSE3 static inline void expand24_ssse3(argb_t* dst, const uint8_t* src,
+                                               __m128i shuffle)
+{
+    const __m128i alpha = _mm_set1_epi32((int)OPAQUE);
+    const __m128i s0 = _mm_loadu_si128((const __m128i*)src);
+    const __m128i s1 = _mm_loadu_si128((const __m128i*)(src + 16));
+    const __m128i s2 = _mm_loadu_si128((const __m128i*)(src + 32));
+    // each vector gets 12 source bytes at the beginning
+    const __m128i p0 = s0;
+    const __m128i p1 = _mm_alignr_epi8(s1, s0, 12);
+    const __m128i p2 = _mm_alignr_epi8(s2, s1, 8);
+    const __m128i p3 = _mm_srli_si128(s2, 4);
+
+    _mm_storeu_si128((__m128i*)dst,
+                     _mm_or_si128(_mm_shuffle_epi8(p0, shuffle), alpha));
+    _mm_storeu_si128((__m128i*)(dst + 4),
+                     _mm_or_si128(_mm_shuffle_epi8(p1, shuffle), alpha));
+    _mm_storeu_si128((__m128i*)(dst + 8),
+                     _mm_or_si128(_mm_shuffle_epi8(p2, shuffle), alpha));
+    _mm_storeu_si128((__m128i*)(dst + 12),
+                     _mm_or_si128(_mm_shuffle_epi8(p3, shuffle), alpha));
+}
+
+TARGET_SSSE3 static void rgb_ssse3(argb_t* dst, const uint8_t* src, size_t num)
+{
+    const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6,
+                                          -1, 11, 10, 9, -1);
+    size_t i = 0;
+
+    for (; i + 16 <= num; i += 16) {
+        expand24_ssse3(dst + i, src + i * 3, shuffle);
+    }
+
+    rgb_scalar(dst + i, src + i * 3, num - i);
+}
+
+TARGET_SSSE3 static void bgr_ssse3(argb_t* dst, const uint8_t* src, size_t num)
+{
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8,
+                                          -1, 9, 10, 11, -1);
+    size_t i = 0;
+
+    for (; i + 16 <= num; i += 16) {
+        expand24_ssse3(dst + i, src + i * 3, shuffle);
+    }
+
+    bgr_scalar(dst + i, src + i * 3, num - i);
+}
+
+TARGET_SSSE3 static void gray_ssse3(argb_t* dst, const uint8_t* src,
+                                    size_t num)
+{
+    const __m128i alpha = _mm_set1_epi32((int)OPAQUE);
+    const __m128i shuffle[] = {
+        _mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1),
+        _mm_setr_epi8(4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1),
+        _mm_setr_epi8(8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11,
+                      -1),
+        _mm_setr_epi8(12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15,
+                      15, -1),
+    };
+    size_t i = 0;
+
+    for (; i + 16 <= num; i += 16) {
+        const __m128i px = _mm_loadu_si128((const __m128i*)(src + i));
+        for (size_t j = 0; j < 4; ++j) {
+            const __m128i argb = _mm_shuffle_epi8(px, shuffle[j]);
+            _mm_storeu_si128((__m128i*)(dst + i + j * 4),
+                             _mm_or_si128(argb, alpha));
+        }
+    }
+
+    gray_scalar(dst + i, src + i, num - i);
+}
+
+/**
+ * Reduce 8 samples of 16 bits, see `reduce16`.
+ * @param src source samples, 16 bytes
+ * @return 16-bit vector of 8-bit values
+ */
+TARGET_SSSE3 static inline __m128i reduce16_ssse3(const uint8_t* src)
+{
+    const __m128i swap =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i be = _mm_loadu_si128((const __m128i*)src);
+    const __m128i v = _mm_shuffle_epi8(be, swap);
+    const __m128i hi = _mm_srli_epi16(v, 8);
+    const __m128i rnd = _mm_and_si128(_mm_srli_epi16(v, 7), one);
+    __m128i r = _mm_sub_epi16(v, hi);
+    r = _mm_add_epi16(_mm_sub_epi16(r, rnd), half);
+    return _mm_srli_epi16(r, 8);
+}
+
+TARGET_SSSE3 static void be16_ssse3(uint8_t* dst, const uint8_t* src,
+                                    size_t num)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= num; i += 16) {
+        const __m128i lo = reduce16_ssse3(src + i * 2);
+        const __m128i hi = reduce16_ssse3(src + i * 2 + 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    be16_scalar(dst + i, src + i * 2, num - i);
+}
+
+#endif // PIXCONV_SSSE3
+
+void pixconv_rgba(argb_t* dst, const void* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        rgba_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    rgba_scalar(dst, src, num);
+}
+
+void pixconv_bgrx(argb_t* dst, const void* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        bgrx_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    bgrx_scalar(dst, src, num);
+}
+
+void pixconv_rgb(argb_t* dst, const uint8_t* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        rgb_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    rgb_scalar(dst, src, num);
+}
+
+void pixconv_bgr(argb_t* dst, const uint8_t* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        bgr_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    bgr_scalar(dst, src, num);
+}
+
+void pixconv_gray(argb_t* dst, const uint8_t* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        gray_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    gray_scalar(dst, src, num);
+}
+
+void pixconv_cmyk(argb_t* dst, const uint8_t* src, size_t num, bool inverted)
+{
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t* cmyk = src + i * 4;
+        uint32_t c = cmyk[0], m = cmyk[1], y = cmyk[2], k = cmyk[3];
+        if (!inverted) {
+            c = UINT8_MAX - c;
+            m = UINT8_MAX - m;
+            y = UINT8_MAX - y;
+            k = UINT8_MAX - k;
+        }
+        dst[i] = ARGB(UINT8_MAX, c * k / UINT8_MAX, m * k / UINT8_MAX,
+                      y * k / UINT8_MAX);
+    }
+}
+
+bool pixconv_palette(argb_t* dst, const uint8_t* src, size_t num,
+                     const argb_t* palette, size_t size)
+{
+    if (size > UINT8_MAX) {
+        // any index is valid, no checks required
+        for (size_t i = 0; i < num; ++i) {
+            dst[i] = palette[src[i]];
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < num; ++i) {
+        const uint8_t index = src[i];
+        if (index >= size) {
+            return false;
+        }
+        dst[i] = palette[index];
+    }
+
+    return true;
+}
+
+void pixconv_be16(uint8_t* dst, const uint8_t* src, size_t num)
+{
+#ifdef PIXCONV_SSSE3
+    if (use_ssse3()) {
+        be16_ssse3(dst, src, num);
+        return;
+    }
+#endif
+    be16_scalar(dst, src, num);
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+// Pixel format conversion: row converters used by image decoders.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "pixmap.h"
+
+/**
+ * Convert RGBA pixels (byte order in memory) to ARGB.
+ * @param dst destination buffer, may be the same as the source
+ * @param src source pixels, 4 bytes per pixel
+ * @param num number of pixels to convert
+ */
+void pixconv_rgba(argb_t* dst, const void* src, size_t num);
+
+/**
+ * Convert BGRX pixels (byte order in memory) to opaque ARGB.
+ * @param dst destination buffer, may be the same as the source
+ * @param src source pixels, 4 bytes per pixel, last byte is ignored
+ * @param num number of pixels to convert
+ */
+void pixconv_bgrx(argb_t* dst, const void* src, size_t num);
+
+/**
+ * Expand RGB pixels (byte order in memory) to opaque ARGB.
+ * @param dst destination buffer
+ * @param src source pixels, 3 bytes per pixel
+ * @param num number of pixels to convert
+ */
+void pixconv_rgb(argb_t* dst, const uint8_t* src, size_t num);
+
+/**
+ * Expand BGR pixels (byte order in memory) to opaque ARGB.
+ * @param dst destination buffer
+ * @param src source pixels, 3 bytes per pixel
+ * @param num number of pixels to convert
+ */
+void pixconv_bgr(argb_t* dst, const uint8_t* src, size_t num);
+
+/**
+ * Expand grayscale pixels to opaque ARGB.
+ * @param dst destination buffer
+ * @param src source pixels, 1 byte per pixel
+ * @param num number of pixels to convert
+ */
+void pixconv_gray(argb_t* dst, const uint8_t* src, size_t num);
+
+/**
+ * Convert CMYK pixels to opaque ARGB.
+ * @param dst destination buffer
+ * @param src source pixels, 4 bytes per pixel
+ * @param num number of pixels to convert
+ * @param inverted true if samples are stored inverted (Adobe)
+ */
+void pixconv_cmyk(argb_t* dst, const uint8_t* src, size_t num, bool inverted);
+
+/**
+ * Expand indexed pixels using color palette.
+ * @param dst destination buffer
+ * @param src source pixels, 1 byte index per pixel
+ * @param num number of pixels to convert
+ * @param palette color palette
+ * @param size number of entries in the palette
+ * @return false if any of the indices is out of the palette
+ */
+bool pixconv_palette(argb_t* dst, const uint8_t* src, size_t num,
+                     const argb_t* palette, size_t size);
+
+/**
+ * Reduce 16-bit big-endian samples to 8 bits with rounding.
+ * @param dst destination buffer
+ * @param src source samples, 2 bytes per sample
+ * @param num number of samples to convert
+ */
+void pixconv_be16(uint8_t* dst, const uint8_t* src, size_t num);
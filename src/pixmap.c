@@ -4,14 +4,11 @@
 
 #include "pixmap.h"
 
-#include <pthread.h>
+#include "perf.h"
+#include "tpool.h"
+
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-
-#ifdef __FreeBSD__
-#include <sys/sysctl.h>
-#endif
 
 /** Scale filter parameters. */
 struct scale_param {
@@ -31,21 +28,19 @@ struct scale_param {
  */
 typedef void (*scale_fn)(struct scale_param* sp, size_t start, size_t step);
 
-/** Scale filter thread task. */
+/** Scale filter task executed by thread pool. */
 struct scale_task {
-    pthread_t tid;          ///< Thread id
     struct scale_param* sp; ///< Scaling parameters
-    size_t start;           ///< Index of the first line to draw
     size_t step;            ///< Number of lines to skip on each iteration
     scale_fn fn;            ///< Scale function
 };
 
-/** Background thread scaler handler. */
-static void* scale_thread(void* data)
+/** Thread pool scaler handler, see tpool_fn. */
+static void scale_thread(void* data, size_t index,
+                         __attribute__((unused)) size_t thread)
 {
     const struct scale_task* task = data;
-    task->fn(task->sp, task->start, task->step);
-    return NULL;
+    task->fn(task->sp, index, task->step);
 }
 
 /**
@@ -291,13 +286,18 @@ bool pixmap_create(struct pixmap* pm, size_t width, size_t height)
         pm->width = width;
         pm->height = height;
         pm->data = data;
+        perf_mem_add(perf_mem_heap, height * width * sizeof(argb_t));
     }
     return !!data;
 }
 
 void pixmap_free(struct pixmap* pm)
 {
-    free(pm->data);
+    if (pm->data) {
+        perf_mem_add(perf_mem_heap,
+                     -(ssize_t)(pm->width * pm->height * sizeof(argb_t)));
+        free(pm->data);
+    }
 }
 
 void pixmap_fill(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
@@ -355,6 +355,7 @@ void pixmap_blend(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
     const ssize_t top = max(0, y);
     const ssize_t right = min((ssize_t)pm->width, x + (ssize_t)width);
     const ssize_t bottom = min((ssize_t)pm->height, y + (ssize_t)height);
+    const uint64_t start = perf_start();
 
     for (y = top; y < bottom; ++y) {
         argb_t* line = &pm->data[y * pm->width];
@@ -362,6 +363,8 @@ void pixmap_blend(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
             alpha_blend(color, &line[x]);
         }
     }
+
+    perf_stop(perf_blend, start);
 }
 
 void pixmap_hline(struct pixmap* pm, ssize_t x, ssize_t y, size_t width,
@@ -493,19 +496,6 @@ void pixmap_scale(enum pixmap_scale scaler, const struct pixmap* src,
                   struct pixmap* dst, ssize_t x, ssize_t y, float scale,
                   bool alpha)
 {
-    // get numper of active CPUs
-#ifdef __FreeBSD__
-    uint32_t cpus = 0;
-    size_t cpus_len = sizeof(cpus);
-    sysctlbyname("hw.ncpu", &cpus, &cpus_len, 0, 0);
-#else
-    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
-#endif
-
-    // background threads
-    const size_t threads_num = min(16, max(cpus, 1)) - 1;
-    struct scale_task* tasks = NULL;
-
     // scaling parameters
     struct scale_param sp = {
         .src = src,
@@ -516,6 +506,8 @@ void pixmap_scale(enum pixmap_scale scaler, const struct pixmap* src,
         .alpha = alpha,
     };
     scale_fn scaler_fn;
+    struct scale_task task;
+    const uint64_t start = perf_start();
 
     switch (scaler) {
         case pixmap_nearest:
@@ -531,34 +523,13 @@ void pixmap_scale(enum pixmap_scale scaler, const struct pixmap* src,
             return;
     }
 
-    // create task for each CPU core
-    if (threads_num) {
-        tasks = malloc(threads_num * sizeof(struct scale_task));
-        if (!tasks) {
-            return;
-        }
-    }
-
-    // start background threads
-    for (size_t i = 0; i < threads_num; ++i) {
-        struct scale_task* task = &tasks[i];
-        task->tid = 0;
-        task->sp = &sp;
-        task->start = i + 1; // skip first line
-        task->step = threads_num + 1;
-        task->fn = scaler_fn;
-        pthread_create(&task->tid, NULL, scale_thread, task);
-    }
-
-    // execute the first task in the current thread
-    scaler_fn(&sp, 0, threads_num + 1);
-
-    // wait for all threads to complete
-    for (size_t i = 0; i < threads_num; ++i) {
-        pthread_join(tasks[i].tid, NULL);
-    }
+    // interleave lines between threads
+    task.sp = &sp;
+    task.step = tpool_threads();
+    task.fn = scaler_fn;
+    tpool_run(scale_thread, &task, task.step);
 
-    free(tasks);
+    perf_stop(perf_scale, start);
 }
 
 void pixmap_flip_vertical(struct pixmap* pm)
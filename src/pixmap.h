@@ -32,10 +32,6 @@ typedef uint32_t argb_t;
 #define ARGB(a, r, g, b) \
     (ARGB_SET_A(a) | ARGB_SET_R(r) | ARGB_SET_G(g) | ARGB_SET_B(b))
 
-// convert ABGR to ARGB
-#define ABGR_TO_ARGB(c) \
-    ((c & 0xff00ff00) | ARGB_SET_R(ARGB_GET_B(c)) | ARGB_SET_B(ARGB_GET_R(c)))
-
 #define max(a, b) ((a) > (b) ? (a) : (b))
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
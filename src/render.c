@@ -0,0 +1,521 @@
+// SPDX-License-Identifier: MIT
+// Batch render: scale images to files without window.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "render.h"
+
+#include "buildcfg.h"
+#include "imagelist.h"
+#include "loader.h"
+#include "memdata.h"
+#include "tpool.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+// QOI chunk tags
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+
+// Size of QOI color map
+#define QOI_CLRMAP_SIZE 64
+// Max length of QOI run
+#define QOI_MAX_RUN 62
+
+/** Output image formats. */
+enum render_format {
+    render_png, ///< PNG with alpha channel
+    render_qoi, ///< QOI with alpha channel
+    render_ppm, ///< Binary PPM (P6) without alpha channel
+};
+
+// clang-format off
+static const char* format_names[] = {
+    [render_png] = "png",
+    [render_qoi] = "qoi",
+    [render_ppm] = "ppm",
+};
+// clang-format on
+
+/** Batch render context. */
+struct render {
+    size_t width;              ///< Max width of output images
+    size_t height;             ///< Max height of output images
+    const char* output;        ///< Output directory
+    enum render_format format; ///< Output format
+
+    size_t* suffix; ///< Suffixes of output names, 0 for unique names
+
+    size_t next;    ///< Index of the next image in the list
+    size_t done;    ///< Number of rendered images
+    size_t skipped; ///< Number of non-image files
+    size_t failed;  ///< Number of errors
+    size_t pixels;  ///< Total number of decoded pixels
+};
+
+static struct render ctx = {
+    .output = ".",
+#ifdef HAVE_LIBPNG
+    .format = render_png,
+#else
+    .format = render_qoi,
+#endif
+};
+
+#ifdef HAVE_LIBPNG
+/**
+ * Write pixmap in PNG format.
+ * @param file output file
+ * @param pm pixmap to write
+ * @return true if file was written
+ */
+static bool write_png(FILE* file, const struct pixmap* pm)
+{
+    png_image png = {
+        .version = PNG_IMAGE_VERSION,
+        .width = pm->width,
+        .height = pm->height,
+        .format = PNG_FORMAT_RGBA,
+    };
+    const size_t pixels = pm->width * pm->height;
+    uint8_t* data;
+    bool rc;
+
+    data = malloc(pixels * 4);
+    if (!data) {
+        return false;
+    }
+    for (size_t i = 0; i < pixels; ++i) {
+        const argb_t color = pm->data[i];
+        uint8_t* rgba = &data[i * 4];
+        rgba[0] = ARGB_GET_R(color);
+        rgba[1] = ARGB_GET_G(color);
+        rgba[2] = ARGB_GET_B(color);
+        rgba[3] = ARGB_GET_A(color);
+    }
+    rc = png_image_write_to_stdio(&png, file, 0, data, 0, NULL);
+    free(data);
+
+    return rc;
+}
+#endif // HAVE_LIBPNG
+
+/**
+ * Write 32-bit big endian number.
+ * @param file output file
+ * @param value number to write
+ */
+static void write_be32(FILE* file, uint32_t value)
+{
+    fputc((value >> 24) & 0xff, file);
+    fputc((value >> 16) & 0xff, file);
+    fputc((value >> 8) & 0xff, file);
+    fputc(value & 0xff, file);
+}
+
+/**
+ * Write pixmap in QOI format.
+ * @param file output file
+ * @param pm pixmap to write
+ * @return true if file was written
+ */
+static bool write_qoi(FILE* file, const struct pixmap* pm)
+{
+    static const uint8_t padding[] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    const size_t pixels = pm->width * pm->height;
+    argb_t color_map[QOI_CLRMAP_SIZE] = { 0 };
+    argb_t prev = ARGB(0xff, 0, 0, 0);
+    size_t run = 0;
+
+    // header: magic, size, channels (RGBA), color space (sRGB)
+    fputs("qoif", file);
+    write_be32(file, pm->width);
+    write_be32(file, pm->height);
+    fputc(4, file);
+    fputc(0, file);
+
+    for (size_t i = 0; i < pixels; ++i) {
+        const argb_t color = pm->data[i];
+        const uint8_t a = ARGB_GET_A(color);
+        const uint8_t r = ARGB_GET_R(color);
+        const uint8_t g = ARGB_GET_G(color);
+        const uint8_t b = ARGB_GET_B(color);
+        size_t index;
+
+        if (color == prev) {
+            if (++run == QOI_MAX_RUN || i == pixels - 1) {
+                fputc(QOI_OP_RUN | (run - 1), file);
+                run = 0;
+            }
+            continue;
+        }
+        if (run) {
+            fputc(QOI_OP_RUN | (run - 1), file);
+            run = 0;
+        }
+
+        index = (r * 3 + g * 5 + b * 7 + a * 11) % QOI_CLRMAP_SIZE;
+        if (color_map[index] == color) {
+            fputc(QOI_OP_INDEX | index, file);
+        } else if (a == ARGB_GET_A(prev)) {
+            const int8_t dr = r - ARGB_GET_R(prev);
+            const int8_t dg = g - ARGB_GET_G(prev);
+            const int8_t db = b - ARGB_GET_B(prev);
+            const int8_t dr_dg = dr - dg;
+            const int8_t db_dg = db - dg;
+            if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 &&
+                db <= 1) {
+                fputc(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2),
+                      file);
+            } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 &&
+                       db_dg >= -8 && db_dg <= 7) {
+                fputc(QOI_OP_LUMA | (dg + 32), file);
+                fputc((dr_dg + 8) << 4 | (db_dg + 8), file);
+            } else {
+                fputc(QOI_OP_RGB, file);
+                fputc(r, file);
+                fputc(g, file);
+                fputc(b, file);
+            }
+        } else {
+            fputc(QOI_OP_RGBA, file);
+            fputc(r, file);
+            fputc(g, file);
+            fputc(b, file);
+            fputc(a, file);
+        }
+
+        color_map[index] = color;
+        prev = color;
+    }
+
+    return fwrite(padding, sizeof(padding), 1, file) == 1;
+}
+
+/**
+ * Write pixmap in binary PPM format, alpha channel is ignored.
+ * @param file output file
+ * @param pm pixmap to write
+ * @return true if file was written
+ */
+static bool write_ppm(FILE* file, const struct pixmap* pm)
+{
+    fprintf(file, "P6\n%zu %zu\n255\n", pm->width, pm->height);
+
+    for (size_t i = 0; i < pm->width * pm->height; ++i) {
+        const argb_t color = pm->data[i];
+        fputc(ARGB_GET_R(color), file);
+        fputc(ARGB_GET_G(color), file);
+        fputc(ARGB_GET_B(color), file);
+    }
+
+    return !ferror(file);
+}
+
+/**
+ * Get file name from the source path.
+ * @param source path to the source file
+ * @return pointer to the file name within the source path
+ */
+static const char* source_name(const char* source)
+{
+    const char* name = strrchr(source, '/');
+    return name ? name + 1 : source;
+}
+
+/** Output name entry used to find files with the same name. */
+struct output_name {
+    const char* name; ///< Source file name
+    size_t index;     ///< Index of the image in the list
+};
+
+/** Compare output names, see qsort. */
+static int compare_names(const void* a, const void* b)
+{
+    const struct output_name* na = a;
+    const struct output_name* nb = b;
+    const int cmp = strcmp(na->name, nb->name);
+    if (cmp) {
+        return cmp;
+    }
+    return na->index < nb->index ? -1 : (na->index > nb->index ? 1 : 0);
+}
+
+/**
+ * Assign suffixes to output names of the files with the same name from
+ * different directories, the first file in the list gets the plain name.
+ * Must be called before rendering, as output files are written in parallel.
+ * @return false if not enough memory
+ */
+static bool make_suffixes(void)
+{
+    const size_t total = image_list_size();
+    struct output_name* names;
+    size_t num = 0;
+
+    ctx.suffix = calloc(total, sizeof(*ctx.suffix));
+    names = malloc(total * sizeof(*names));
+    if (!ctx.suffix || !names) {
+        free(names);
+        return false;
+    }
+
+    for (size_t i = 0; i < total; ++i) {
+        const char* source = image_list_get(i);
+        if (source) {
+            names[num].name = source_name(source);
+            names[num].index = i;
+            ++num;
+        }
+    }
+    qsort(names, num, sizeof(*names), compare_names);
+    for (size_t i = 1; i < num; ++i) {
+        if (strcmp(names[i].name, names[i - 1].name) == 0) {
+            ctx.suffix[names[i].index] = ctx.suffix[names[i - 1].index] + 1;
+        }
+    }
+
+    free(names);
+    return true;
+}
+
+/**
+ * Write pixmap to the output directory. The output file name is the source
+ * file name with the output format extension, so images with different
+ * formats but the same base name (e.g. a.jpg and a.png) don't collide.
+ * @param pm pixmap to write
+ * @param index index of the image in the list
+ * @return true if file was written
+ */
+static bool write_image(const struct pixmap* pm, size_t index)
+{
+    const char* source = image_list_get(index);
+    const char* name = source ? source_name(source) : "";
+    const char* fmt = format_names[ctx.format];
+    char path[PATH_MAX];
+    FILE* file;
+    int len;
+    bool rc;
+
+    if (!*name) {
+        name = "image"; // e.g. stdin
+    }
+    if (ctx.suffix[index]) {
+        len = snprintf(path, sizeof(path), "%s/%s.%zu.%s", ctx.output, name,
+                       ctx.suffix[index], fmt);
+    } else {
+        len = snprintf(path, sizeof(path), "%s/%s.%s", ctx.output, name, fmt);
+    }
+    if (len < 0 || (size_t)len >= sizeof(path)) {
+        fprintf(stderr, "Output path is too long: %s/%s\n", ctx.output, name);
+        return false;
+    }
+
+    file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    switch (ctx.format) {
+#ifdef HAVE_LIBPNG
+        case render_png:
+            rc = write_png(file, pm);
+            break;
+#endif
+        case render_qoi:
+            rc = write_qoi(file, pm);
+            break;
+        case render_ppm:
+            rc = write_ppm(file, pm);
+            break;
+        default:
+            rc = false;
+            break;
+    }
+
+    if (fclose(file) != 0 || !rc) {
+        fprintf(stderr, "Unable to write %s\n", path);
+        rc = false;
+    }
+
+    return rc;
+}
+
+/**
+ * Load, scale and write single image, updates counters.
+ * @param index index of the image in the list
+ */
+static void render_image(size_t index)
+{
+    struct image* image = NULL;
+    const struct pixmap* full;
+    struct pixmap thumb = { 0 };
+    const struct pixmap* out;
+    enum loader_status status;
+    float scale;
+
+    status = loader_from_index(index, &image);
+    if (status == ldr_unsupported) {
+        __atomic_add_fetch(&ctx.skipped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (status != ldr_success || !image_load_frame(image, 0)) {
+        const char* source = image_list_get(index);
+        fprintf(stderr, "%s: Unable to load\n", source ? source : "image");
+        __atomic_add_fetch(&ctx.failed, 1, __ATOMIC_RELAXED);
+        image_free(image);
+        return;
+    }
+
+    full = &image->frames[0].pm;
+    __atomic_add_fetch(&ctx.pixels, full->width * full->height,
+                       __ATOMIC_RELAXED);
+
+    // fit into the output size, the image is never enlarged
+    scale = min((float)ctx.width / full->width,
+                (float)ctx.height / full->height);
+    if (scale < 1.0) {
+        const size_t width = max(1, scale * full->width);
+        const size_t height = max(1, scale * full->height);
+        if (!pixmap_create(&thumb, width, height)) {
+            __atomic_add_fetch(&ctx.failed, 1, __ATOMIC_RELAXED);
+            image_free(image);
+            return;
+        }
+        pixmap_scale(pixmap_average, full, &thumb, 0, 0, scale, image->alpha);
+        out = &thumb;
+    } else {
+        out = full;
+    }
+
+    if (write_image(out, index)) {
+        __atomic_add_fetch(&ctx.done, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_add_fetch(&ctx.failed, 1, __ATOMIC_RELAXED);
+    }
+
+    pixmap_free(&thumb);
+    image_free(image);
+}
+
+/** Thread pool task: render images until the list ends, see tpool_fn. */
+static void render_task(__attribute__((unused)) void* data,
+                        __attribute__((unused)) size_t index,
+                        __attribute__((unused)) size_t thread)
+{
+    const size_t total = image_list_size();
+    size_t next;
+
+    while ((next = __atomic_fetch_add(&ctx.next, 1, __ATOMIC_RELAXED)) <
+           total) {
+        if (image_list_get(next)) {
+            render_image(next);
+        }
+    }
+}
+
+bool render_set_size(const char* size)
+{
+    size_t width, height;
+    char tail;
+
+    if (sscanf(size, "%zux%zu%c", &width, &height, &tail) != 2 ||
+        width == 0 || height == 0) {
+        return false;
+    }
+
+    ctx.width = width;
+    ctx.height = height;
+
+    return true;
+}
+
+void render_set_output(const char* dir)
+{
+    ctx.output = dir;
+}
+
+bool render_set_format(const char* format)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(format_names); ++i) {
+#ifndef HAVE_LIBPNG
+        if (i == render_png) {
+            continue;
+        }
+#endif
+        if (strcmp(format, format_names[i]) == 0) {
+            ctx.format = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool render_enabled(void)
+{
+    return ctx.width != 0;
+}
+
+bool render_run(struct config* cfg, const char** sources, size_t num)
+{
+    struct timespec start, end;
+    double elapsed;
+
+    if (num == 0) {
+        // no input files specified, use all from the current directory
+        static const char* current_dir = ".";
+        sources = &current_dir;
+        num = 1;
+    }
+    ctx.next = ctx.done = ctx.skipped = ctx.failed = ctx.pixels = 0;
+    loader_configure(cfg);
+
+    if (image_list_init(cfg, sources, num) == 0) {
+        fprintf(stderr, "No image files found to render\n");
+        return false;
+    }
+    if (mkdir(ctx.output, 0755) == -1 && errno != EEXIST) {
+        fprintf(stderr, "Unable to create %s: %s\n", ctx.output,
+                strerror(errno));
+        image_list_destroy();
+        return false;
+    }
+    if (!make_suffixes()) {
+        fprintf(stderr, "Not enough memory\n");
+        image_list_destroy();
+        return false;
+    }
+
+    // each thread holds one image at a time, which limits memory usage
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    tpool_run(render_task, NULL, tpool_threads());
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (end.tv_sec - start.tv_sec) +
+        (double)(end.tv_nsec - start.tv_nsec) / 1000000000;
+    printf("Rendered %zu images (%zu skipped, %zu failed) in %.2f sec: "
+           "%.1f images/sec, %.1f MP/sec\n",
+           ctx.done, ctx.skipped, ctx.failed, elapsed, ctx.done / elapsed,
+           (double)ctx.pixels / 1000000 / elapsed);
+
+    free(ctx.suffix);
+    ctx.suffix = NULL;
+    image_list_destroy();
+    tpool_destroy();
+
+    return ctx.failed == 0;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: MIT
+// Batch render: scale images to files without window.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+
+/**
+ * Enable batch render mode and set max size of output images.
+ * @param size text size description in format "WxH"
+ * @return false if size has invalid format
+ */
+bool render_set_size(const char* size);
+
+/**
+ * Set output directory.
+ * @param dir path to the directory
+ */
+void render_set_output(const char* dir);
+
+/**
+ * Set output image format.
+ * @param format format name: png, qoi or ppm
+ * @return false if format is not supported
+ */
+bool render_set_format(const char* format);
+
+/**
+ * Check if batch render mode is enabled.
+ * @return true if images should be rendered to files
+ */
+bool render_enabled(void);
+
+/**
+ * Render all images from the list to the output directory.
+ * @param cfg config instance
+ * @param sources list of sources
+ * @param num number of sources in the list
+ * @return false if any of images was not rendered
+ */
+bool render_run(struct config* cfg, const char** sources, size_t num);
@@ -0,0 +1,771 @@
+// SPDX-License-Identifier: MIT
+// Resident server: new windows are opened by forked server processes.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "server.h"
+
+#include "application.h"
+#include "buildcfg.h"
+#include "diskcache.h"
+#include "font.h"
+#include "loader.h"
+#include "pixcache.h"
+#include "shmcache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Number of standard streams passed from client to server
+#define STD_STREAMS 3
+// Max size of the request strings block
+#define MAX_REQUEST (1024 * 1024)
+// Number of threads in the decoder process
+#define DECODER_THREADS 4
+// Default size of the shared cache in MiB used by the server windows
+#define SERVER_SHMCACHE_DEF "256"
+// Decoder reply: image can't be passed to the viewer, decode it there
+#define DECODE_LOCALLY (-1)
+
+/**
+ * Request header, followed by null-terminated strings: working directory,
+ * arguments and environment variables. Standard streams of the client are
+ * attached to the header as ancillary data.
+ */
+struct request {
+    uint32_t size; ///< Size of the strings block in bytes
+    uint32_t argc; ///< Number of arguments
+    uint32_t envc; ///< Number of environment variables
+};
+
+/** Control message buffer used to pass file descriptors. */
+union fds_message {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(int) * STD_STREAMS)];
+};
+
+extern char** environ;
+
+/** Server stop flag, set by signal handler. */
+static volatile sig_atomic_t stop_server;
+
+/** Socket of the decoder process, -1 if the decoder is not available. */
+static int decoder_sock = -1;
+
+/**
+ * Compose address of the server socket.
+ * @param addr output address
+ * @return false if runtime directory is not available
+ */
+static bool get_address(struct sockaddr_un* addr)
+{
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    const char* display = getenv("WAYLAND_DISPLAY");
+    const char* delim;
+    int len;
+
+    if (!runtime || !*runtime) {
+        return false;
+    }
+    if (!display || !*display) {
+        display = "wayland-0";
+    }
+    // display can be set as absolute path
+    delim = strrchr(display, '/');
+    if (delim) {
+        display = delim + 1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    len = snprintf(addr->sun_path, sizeof(addr->sun_path),
+                   "%s/" APP_NAME "-%s.sock", runtime, display);
+
+    return len > 0 && (size_t)len < sizeof(addr->sun_path);
+}
+
+/**
+ * Connect to the server socket.
+ * @param addr server address
+ * @return socket descriptor or -1 if server is not running
+ */
+static int connect_server(const struct sockaddr_un* addr)
+{
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd != -1 &&
+        connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Write data to socket.
+ * @param fd socket descriptor
+ * @param data pointer to the data to write
+ * @param size number of bytes to write
+ * @return false on errors
+ */
+static bool write_all(int fd, const void* data, size_t size)
+{
+    while (size) {
+        const ssize_t rc = send(fd, data, size, MSG_NOSIGNAL);
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        data = (const uint8_t*)data + rc;
+        size -= rc;
+    }
+    return true;
+}
+
+/**
+ * Read data from socket.
+ * @param fd socket descriptor
+ * @param data destination buffer
+ * @param size number of bytes to read
+ * @return false on errors
+ */
+static bool read_all(int fd, void* data, size_t size)
+{
+    while (size) {
+        const ssize_t rc = recv(fd, data, size, 0);
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        data = (uint8_t*)data + rc;
+        size -= rc;
+    }
+    return true;
+}
+
+/**
+ * Send data with attached file descriptors.
+ * @param fd socket descriptor
+ * @param data pointer to the data to send
+ * @param size number of bytes to send
+ * @param fds array of file descriptors to attach
+ * @param num number of file descriptors, up to STD_STREAMS
+ * @return false on errors
+ */
+static bool send_fds(int fd, const void* data, size_t size, const int* fds,
+                     size_t num)
+{
+    struct iovec iov = { .iov_base = (void*)data, .iov_len = size };
+    union fds_message cmsg;
+    struct msghdr msg = { .msg_iov = &iov,
+                          .msg_iovlen = 1,
+                          .msg_control = cmsg.buf,
+                          .msg_controllen = CMSG_SPACE(sizeof(int) * num) };
+    struct cmsghdr* hdr;
+
+    memset(&cmsg, 0, sizeof(cmsg));
+    hdr = CMSG_FIRSTHDR(&msg);
+    hdr->cmsg_level = SOL_SOCKET;
+    hdr->cmsg_type = SCM_RIGHTS;
+    hdr->cmsg_len = CMSG_LEN(sizeof(int) * num);
+    memcpy(CMSG_DATA(hdr), fds, sizeof(int) * num);
+
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == (ssize_t)size;
+}
+
+/**
+ * Receive data with attached file descriptors.
+ * @param fd socket descriptor
+ * @param data destination buffer
+ * @param size size of the buffer
+ * @param fds output array of file descriptors, set to -1 if the message
+ *            doesn't contain descriptors
+ * @param num number of expected file descriptors, up to STD_STREAMS
+ * @return number of received bytes, -1 on errors or if the message contains
+ *         unexpected number of descriptors
+ */
+static ssize_t recv_fds(int fd, void* data, size_t size, int* fds, size_t num)
+{
+    struct iovec iov = { .iov_base = data, .iov_len = size };
+    union fds_message cmsg;
+    struct msghdr msg = { .msg_iov = &iov,
+                          .msg_iovlen = 1,
+                          .msg_control = cmsg.buf,
+                          .msg_controllen = sizeof(cmsg.buf) };
+    struct cmsghdr* hdr;
+    ssize_t rc;
+
+    do {
+        rc = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (rc == -1 && errno == EINTR);
+    if (rc <= 0) {
+        return -1;
+    }
+
+    hdr = CMSG_FIRSTHDR(&msg);
+    if (!hdr) {
+        for (size_t i = 0; i < num; ++i) {
+            fds[i] = -1;
+        }
+        return rc;
+    }
+    if (hdr->cmsg_level != SOL_SOCKET ||
+        hdr->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    if (hdr->cmsg_len != CMSG_LEN(sizeof(int) * num)) {
+        // close unexpected descriptors
+        const size_t len = hdr->cmsg_len - CMSG_LEN(0);
+        int unexpected[STD_STREAMS];
+        if (len <= sizeof(unexpected)) {
+            memcpy(unexpected, CMSG_DATA(hdr), len);
+            for (size_t i = 0; i < len / sizeof(int); ++i) {
+                close(unexpected[i]);
+            }
+        }
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(hdr), sizeof(int) * num);
+
+    return rc;
+}
+
+/** Client disconnection handler: close the viewer. */
+static void on_disconnect(__attribute__((unused)) void* data)
+{
+    app_exit(0);
+}
+
+/**
+ * Run the viewer in a separate process and wait for its exit code.
+ * The viewer can exit from any place (e.g. after printing help), so the
+ * exit code is taken from the process status.
+ * @param fd client socket descriptor
+ * @param handler request handler
+ * @param argc number of arguments
+ * @param argv arguments array
+ * @param envp environment variables of the client
+ * @return exit code
+ */
+static int32_t run_viewer(int fd, server_fn handler, int argc, char** argv,
+                          char** envp)
+{
+    int status;
+    pid_t pid;
+
+    pid = fork();
+    if (pid == -1) {
+        perror("Unable to create process");
+        return EXIT_FAILURE;
+    }
+
+    if (pid == 0) {
+        // use environment of the client
+        environ = envp;
+        setlocale(LC_ALL, "");
+
+        // close viewer if client was terminated, the socket is closed by
+        // the viewer on exit, the exit code is sent by the parent process
+        app_watch(fd, on_disconnect, NULL);
+
+        // command line is parsed again in the forked process
+#ifdef __GLIBC__
+        optind = 0;
+#else
+        optind = 1;
+#endif
+        exit(handler(argc, argv));
+    }
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
+
+/**
+ * Handle client request in the forked process, never returns.
+ * @param fd client socket descriptor
+ * @param handler request handler
+ */
+static void handle_client(int fd, server_fn handler)
+{
+    struct request req;
+    int fds[STD_STREAMS];
+    char* block = NULL;
+    char** argv = NULL;
+    int32_t rc = EXIT_FAILURE;
+    size_t pos;
+
+    if (recv_fds(fd, &req, sizeof(req), fds, STD_STREAMS) != sizeof(req) ||
+        fds[0] == -1) {
+        goto done;
+    }
+
+    // use standard streams of the client
+    for (int i = 0; i < STD_STREAMS; ++i) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+
+    // read working directory, arguments and environment
+    if (req.size == 0 || req.size > MAX_REQUEST || req.argc == 0 ||
+        req.argc > req.size || req.envc > req.size - req.argc) {
+        goto done;
+    }
+    block = malloc(req.size);
+    argv = calloc(req.argc + req.envc + 2, sizeof(*argv));
+    if (!block || !argv || !read_all(fd, block, req.size) ||
+        block[req.size - 1]) {
+        goto done;
+    }
+    pos = strlen(block) + 1;
+    for (size_t i = 0; i < req.argc + req.envc; ++i) {
+        // environment is placed after the arguments terminator
+        const size_t idx = i < req.argc ? i : i + 1;
+        if (pos >= req.size) {
+            goto done;
+        }
+        argv[idx] = block + pos;
+        pos += strlen(argv[idx]) + 1;
+    }
+    if (chdir(block) == -1) {
+        fprintf(stderr, "Unable to change directory to %s: %s\n", block,
+                strerror(errno));
+        goto done;
+    }
+
+    rc = run_viewer(fd, handler, req.argc, argv, &argv[req.argc + 1]);
+
+done:
+    fflush(stdout);
+    fflush(stderr);
+    write_all(fd, &rc, sizeof(rc));
+    exit(rc);
+}
+
+/**
+ * Create anonymous shared memory object.
+ * @return file descriptor or -1 on errors
+ */
+static int create_segment(void)
+{
+    static unsigned int counter;
+    char name[NAME_MAX];
+    int fd;
+
+    snprintf(name, sizeof(name), "/" APP_NAME "-%u-%d-%u",
+             (unsigned)getuid(), (int)getpid(),
+             __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED));
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd != -1) {
+        shm_unlink(name);
+    }
+    return fd;
+}
+
+/**
+ * Decode image file and put it to the container.
+ * @param path path to the image file
+ * @param fd output container file descriptor, -1 if the image can not be
+ *           passed to the viewer
+ * @return loader status
+ */
+static enum loader_status decode_file(const char* path, int* fd)
+{
+    struct image_header header;
+    struct pixcache_key key;
+    struct image* img = NULL;
+    enum loader_status status;
+    struct stat st;
+    size_t size;
+
+    *fd = -1;
+
+    if (stat(path, &st) == -1) {
+        return ldr_ioerror;
+    }
+
+    // images with frames decoded on demand can't be passed to the viewer,
+    // don't decode them twice
+    if (loader_probe(path, &header) == ldr_success && header.lazy) {
+        return ldr_success;
+    }
+
+    status = loader_from_source(path, &img);
+    if (status != ldr_success) {
+        return status;
+    }
+
+    size = pixcache_size(img);
+    if (size) {
+        pixcache_make_key(&key, &st);
+        *fd = create_segment();
+        if (*fd != -1 && !pixcache_write(*fd, img, &key, size)) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+
+    image_free(img);
+
+    return ldr_success;
+}
+
+/**
+ * Decoder thread: handle requests from viewers until all of them are
+ * disconnected.
+ * @param data pointer to the socket of the decoder process
+ * @return always NULL
+ */
+static void* decoder_thread(void* data)
+{
+    const int sock = *(const int*)data;
+    char path[PATH_MAX];
+    ssize_t len;
+    int reply;
+
+    // request contains path to the file and reply socket of the viewer
+    while ((len = recv_fds(sock, path, sizeof(path) - 1, &reply, 1)) > 0) {
+        int32_t status;
+        int fd;
+
+        if (reply == -1) {
+            continue; // no reply socket
+        }
+        path[len] = 0;
+        status = decode_file(path, &fd);
+        if (fd != -1) {
+            send_fds(reply, &status, sizeof(status), &fd, 1);
+            close(fd);
+        } else {
+            if (status == ldr_success) {
+                status = DECODE_LOCALLY; // decoded but can't be passed
+            }
+            write_all(reply, &status, sizeof(status));
+        }
+        close(reply);
+    }
+
+    return NULL;
+}
+
+/**
+ * Enable shared cache for the process started by the server if it is not
+ * configured explicitly.
+ * @param cfg config instance
+ */
+static void set_shmcache(struct config** cfg)
+{
+    if (!config_get(*cfg, APP_CFG_SECTION, APP_CFG_SHMCACHE)) {
+        config_set(cfg, APP_CFG_SECTION, APP_CFG_SHMCACHE,
+                   SERVER_SHMCACHE_DEF);
+    }
+}
+
+/**
+ * Start decoder process shared by all viewers opened by the server: images
+ * are decoded by the single thread pool and stored in the shared cache, so
+ * the file opened in several windows is decoded only once.
+ * @param cfg config instance
+ * @return false on errors
+ */
+static bool start_decoder(struct config* cfg)
+{
+    pthread_t threads[DECODER_THREADS];
+    struct sigaction sigact;
+    size_t num = 0;
+    int fds[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == -1) {
+        return false;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid) {
+        close(fds[0]);
+        decoder_sock = fds[1];
+        return true;
+    }
+
+    // decoder process lives until the server and all viewers are closed,
+    // its own loader decodes images locally instead of sending requests
+    // to itself
+    close(fds[1]);
+    decoder_sock = -1;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    // windows opened by the server share decoded images
+    set_shmcache(&cfg);
+    shmcache_init(cfg);
+    diskcache_init(cfg);
+
+    for (size_t i = 0; i < DECODER_THREADS; ++i) {
+        if (pthread_create(&threads[num], NULL, decoder_thread, &fds[0]) ==
+            0) {
+            ++num;
+        }
+    }
+    if (num == 0) {
+        decoder_thread(&fds[0]);
+    }
+    for (size_t i = 0; i < num; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    shmcache_destroy();
+    diskcache_destroy();
+    exit(EXIT_SUCCESS);
+}
+
+/** Termination signal handler. */
+static void on_signal(__attribute__((unused)) int signum)
+{
+    stop_server = 1;
+}
+
+bool server_run(struct config* cfg, server_fn handler)
+{
+    struct sockaddr_un addr;
+    struct sigaction sigact;
+    int fd;
+
+    if (!get_address(&addr)) {
+        fprintf(stderr, "Unable to start server: XDG_RUNTIME_DIR not set\n");
+        return false;
+    }
+
+    fd = connect_server(&addr);
+    if (fd != -1) {
+        fprintf(stderr, "Server is already running: %s\n", addr.sun_path);
+        close(fd);
+        return false;
+    }
+    unlink(addr.sun_path); // remove stale socket file
+
+    // load everything that can be shared with the viewer processes
+    loader_configure(cfg);
+    loader_load_modules();
+    font_init(cfg); // fontconfig and FreeType are slow on cold start
+    if (!start_decoder(cfg)) {
+        perror("Unable to start decoder process");
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 ||
+        bind(fd, (const struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(fd, SOMAXCONN) == -1) {
+        perror("Unable to start server");
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+
+    // child processes are reaped automatically
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = SIG_IGN;
+    sigaction(SIGCHLD, &sigact, NULL);
+    // interrupt accept on termination
+    sigact.sa_handler = on_signal;
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    while (!stop_server) {
+        const int conn = accept(fd, NULL, NULL);
+        pid_t pid;
+
+        if (conn == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("Unable to accept connection");
+            break;
+        }
+
+        pid = fork();
+        if (pid == 0) {
+            close(fd);
+            sigact.sa_handler = SIG_DFL;
+            sigaction(SIGCHLD, &sigact, NULL);
+            sigaction(SIGINT, &sigact, NULL);
+            sigaction(SIGTERM, &sigact, NULL);
+            handle_client(conn, handler);
+        }
+        if (pid == -1) {
+            perror("Unable to create process");
+        }
+        close(conn);
+    }
+
+    close(fd);
+    unlink(addr.sun_path);
+    close(decoder_sock);
+    decoder_sock = -1;
+    font_destroy();
+
+    return true;
+}
+
+void server_setup(struct config** cfg)
+{
+    if (decoder_sock != -1) {
+        // images decoded by the server are mapped from the shared cache
+        set_shmcache(cfg);
+    }
+}
+
+bool server_decode(struct image* img, const char* file, const struct stat* st,
+                   enum loader_status* status)
+{
+    struct pixcache_key key;
+    char path[PATH_MAX];
+    int32_t reply_status;
+    ssize_t received;
+    int reply[2];
+    bool rc = false;
+    int fd = -1;
+
+    if (decoder_sock == -1) {
+        return false;
+    }
+
+    // decoder process has its own working directory
+    if (*file == '/') {
+        if (strlen(file) >= sizeof(path)) {
+            return false;
+        }
+        strcpy(path, file);
+    } else {
+        char cwd[PATH_MAX];
+        int len;
+        if (!getcwd(cwd, sizeof(cwd))) {
+            return false;
+        }
+        len = snprintf(path, sizeof(path), "%s/%s", cwd, file);
+        if (len < 0 || (size_t)len >= sizeof(path)) {
+            return false;
+        }
+    }
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, reply) == -1) {
+        return false;
+    }
+    if (send_fds(decoder_sock, path, strlen(path), &reply[1], 1)) {
+        close(reply[1]);
+        received = recv_fds(reply[0], &reply_status, sizeof(reply_status),
+                            &fd, 1);
+        if (received == sizeof(reply_status)) {
+            if (fd != -1) {
+                pixcache_make_key(&key, st);
+                rc = pixcache_map(img, fd, &key);
+                *status = ldr_success;
+                close(fd);
+            } else if (reply_status == ldr_unsupported ||
+                       reply_status == ldr_fmterror) {
+                // the file is not readable by any decoder, don't try again
+                rc = true;
+                *status = reply_status;
+            }
+        }
+    } else {
+        close(reply[1]);
+    }
+    close(reply[0]);
+
+    return rc;
+}
+
+int server_client(int argc, char* argv[])
+{
+    struct sockaddr_un addr;
+    struct request req;
+    char cwd[PATH_MAX];
+    const int std_fds[STD_STREAMS] = { STDIN_FILENO, STDOUT_FILENO,
+                                       STDERR_FILENO };
+    char* block;
+    size_t size, pos, envc;
+    int32_t rc = EXIT_FAILURE;
+    int fd;
+
+    if (!get_address(&addr)) {
+        return -1;
+    }
+    fd = connect_server(&addr);
+    if (fd == -1) {
+        return -1;
+    }
+    if (!getcwd(cwd, sizeof(cwd))) {
+        close(fd);
+        return -1;
+    }
+
+    // compose strings block: working directory, arguments and environment
+    size = strlen(cwd) + 1;
+    for (int i = 0; i < argc; ++i) {
+        size += strlen(argv[i]) + 1;
+    }
+    for (envc = 0; environ[envc]; ++envc) {
+        size += strlen(environ[envc]) + 1;
+    }
+    block = malloc(size);
+    if (!block) {
+        close(fd);
+        return -1;
+    }
+    pos = strlen(cwd) + 1;
+    memcpy(block, cwd, pos);
+    for (int i = 0; i < argc; ++i) {
+        const size_t len = strlen(argv[i]) + 1;
+        memcpy(block + pos, argv[i], len);
+        pos += len;
+    }
+    for (size_t i = 0; i < envc; ++i) {
+        const size_t len = strlen(environ[i]) + 1;
+        memcpy(block + pos, environ[i], len);
+        pos += len;
+    }
+
+    // send request and wait for the viewer exit code
+    req.size = size;
+    req.argc = argc;
+    req.envc = envc;
+    if (!send_fds(fd, &req, sizeof(req), std_fds, STD_STREAMS) ||
+        !write_all(fd, block, size) || !read_all(fd, &rc, sizeof(rc))) {
+        rc = EXIT_FAILURE;
+    }
+
+    free(block);
+    close(fd);
+
+    return rc;
+}
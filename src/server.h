@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: MIT
+// Resident server: new windows are opened by forked server processes.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+#include "loader.h"
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/**
+ * Request handler: parse command line and run the viewer.
+ * @param argc number of arguments
+ * @param argv arguments array
+ * @return exit code
+ */
+typedef int (*server_fn)(int argc, char* argv[]);
+
+/**
+ * Run resident server. Each client request is handled in a process forked
+ * from the server, so libraries, decoder modules and other data loaded by
+ * the server are not initialized again. Images are decoded by the decoder
+ * process shared by all windows.
+ * @param cfg config instance
+ * @param handler request handler
+ * @return false on errors
+ */
+bool server_run(struct config* cfg, server_fn handler);
+
+/**
+ * Pass command line to the running server and wait until the viewer
+ * window is closed. Standard streams, working directory and environment of
+ * the caller are used by the viewer.
+ * @param argc number of arguments
+ * @param argv arguments array
+ * @return exit code of the viewer or -1 if server is not running
+ */
+int server_client(int argc, char* argv[]);
+
+/**
+ * Apply defaults for the viewer opened by the server: the shared cache is
+ * enabled unless it is configured explicitly. Does nothing in processes not
+ * started by the server.
+ * @param cfg config instance
+ */
+void server_setup(struct config** cfg);
+
+/**
+ * Decode image file by the decoder process of the server.
+ * @param img destination image
+ * @param file path to the image file
+ * @param st attributes of the image file
+ * @param status output loader status
+ * @return false if the viewer is not opened by the server or image must be
+ *         decoded by the viewer itself
+ */
+bool server_decode(struct image* img, const char* file, const struct stat* st,
+                   enum loader_status* status);
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: MIT
+// Decoded image cache shared between processes.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "shmcache.h"
+
+#include "application.h"
+#include "buildcfg.h"
+#include "perf.h"
+#include "pixcache.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Default cache size limit in MiB, 0 disables the cache
+#define CFG_SHMCACHE_DEF 0
+
+// Number of entries in the cache index
+#define INDEX_SLOTS 256
+// Identifier of the shared structures layout
+#define INDEX_MAGIC 0x31434d53
+
+// Atomic operations on the shared memory
+#define LOAD(ptr)       __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define ADD(ptr, val)   __atomic_add_fetch(ptr, val, __ATOMIC_ACQ_REL)
+#define SUB(ptr, val)   __atomic_sub_fetch(ptr, val, __ATOMIC_ACQ_REL)
+#define CAS(ptr, exp, val)                                              \
+    __atomic_compare_exchange_n(ptr, exp, val, false, __ATOMIC_ACQ_REL, \
+                                __ATOMIC_ACQUIRE)
+
+/**
+ * Index entry, protected by sequence lock: writers make the sequence odd
+ * while the entry is modified, readers retry if the sequence was changed.
+ */
+struct shm_slot {
+    uint64_t seq;            ///< Sequence lock
+    struct pixcache_key key; ///< Cached image identifier
+    uint64_t id;             ///< Segment id, 0 if the slot is empty
+    uint64_t size;           ///< Segment size in bytes
+    uint64_t atime;          ///< Last access stamp
+};
+
+/** Cache index, new index is zero-filled that is a valid empty state. */
+struct shm_index {
+    uint32_t magic;   ///< Layout identifier
+    uint32_t reserved;
+    uint64_t next_id; ///< Last allocated segment id
+    uint64_t clock;   ///< Access stamp counter
+    uint64_t total;   ///< Total size of cached segments in bytes
+    struct shm_slot slots[INDEX_SLOTS];
+};
+
+/** Shared cache context. */
+struct shmcache {
+    struct shm_index* index; ///< Shared index, NULL if cache is disabled
+    uint64_t limit;          ///< Max total size of cached images
+};
+
+static struct shmcache ctx;
+
+/**
+ * Compose name of the shared memory object.
+ * @param name output buffer
+ * @param id segment id, 0 for index
+ */
+static void object_name(char* name, uint64_t id)
+{
+    if (id) {
+        snprintf(name, NAME_MAX, "/" APP_NAME "-%u-%" PRIx64,
+                 (unsigned)getuid(), id);
+    } else {
+        snprintf(name, NAME_MAX, "/" APP_NAME "-%u", (unsigned)getuid());
+    }
+}
+
+/**
+ * Open shared memory object owned by the current user.
+ * @param name object name
+ * @param flags open flags
+ * @param st output object attributes
+ * @return file descriptor or -1 on errors
+ */
+static int object_open(const char* name, int flags, struct stat* st)
+{
+    const int fd = shm_open(name, flags, 0600);
+    if (fd != -1 && (fstat(fd, st) == -1 || st->st_uid != getuid())) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Lock index slot for writing.
+ * @param slot slot to lock
+ * @param seq output sequence number to restore with `unlock_slot`
+ * @return false if slot is already locked by another writer
+ */
+static bool lock_slot(struct shm_slot* slot, uint64_t* seq)
+{
+    *seq = LOAD(&slot->seq);
+    return !(*seq & 1) && CAS(&slot->seq, seq, *seq + 1);
+}
+
+/**
+ * Unlock index slot.
+ * @param slot slot to unlock
+ * @param seq sequence number returned by `lock_slot`
+ */
+static void unlock_slot(struct shm_slot* slot, uint64_t seq)
+{
+    STORE(&slot->seq, seq + 2);
+}
+
+/**
+ * Remove segment referenced by the locked slot. The segment stays valid for
+ * processes that already mapped it.
+ * @param slot locked slot
+ */
+static void drop_segment(struct shm_slot* slot)
+{
+    if (slot->id) {
+        char name[NAME_MAX];
+        object_name(name, slot->id);
+        shm_unlink(name);
+        SUB(&ctx.index->total, slot->size);
+        slot->id = 0;
+        slot->size = 0;
+        memset(&slot->key, 0, sizeof(slot->key));
+    }
+}
+
+/**
+ * Find slot to reuse.
+ * @param empty true to take the first empty slot, false to skip empty slots
+ * @return the least recently used slot or NULL if no slots available
+ */
+static struct shm_slot* victim_slot(bool empty)
+{
+    struct shm_slot* victim = NULL;
+    uint64_t oldest = UINT64_MAX;
+
+    for (size_t i = 0; i < INDEX_SLOTS; ++i) {
+        struct shm_slot* slot = &ctx.index->slots[i];
+        uint64_t atime;
+        if (LOAD(&slot->seq) & 1) {
+            continue; // locked
+        }
+        if (__atomic_load_n(&slot->id, __ATOMIC_RELAXED) == 0) {
+            if (empty) {
+                return slot;
+            }
+            continue;
+        }
+        atime = __atomic_load_n(&slot->atime, __ATOMIC_RELAXED);
+        if (atime <= oldest) {
+            oldest = atime;
+            victim = slot;
+        }
+    }
+
+    return victim;
+}
+
+/**
+ * Publish segment in the index, the least recently used entries are evicted
+ * to fit the size limit.
+ * @param key cached image identifier
+ * @param id segment id
+ * @param size segment size in bytes
+ * @return false if no slot available
+ */
+static bool publish(const struct pixcache_key* key, uint64_t id, uint64_t size)
+{
+    struct shm_slot* slot;
+    uint64_t seq;
+
+    // free space for the new entry
+    for (size_t i = 0;
+         i < INDEX_SLOTS && LOAD(&ctx.index->total) + size > ctx.limit; ++i) {
+        slot = victim_slot(false);
+        if (!slot) {
+            break;
+        }
+        if (lock_slot(slot, &seq)) {
+            drop_segment(slot);
+            unlock_slot(slot, seq);
+        }
+    }
+
+    for (size_t i = 0; i < INDEX_SLOTS; ++i) {
+        slot = victim_slot(true);
+        if (slot && lock_slot(slot, &seq)) {
+            drop_segment(slot);
+            slot->key = *key;
+            slot->id = id;
+            slot->size = size;
+            slot->atime = ADD(&ctx.index->clock, 1);
+            ADD(&ctx.index->total, size);
+            unlock_slot(slot, seq);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Find segment of the cached image.
+ * @param key cached image identifier
+ * @return segment id or 0 if image is not cached
+ */
+static uint64_t lookup(const struct pixcache_key* key)
+{
+    for (size_t i = 0; i < INDEX_SLOTS; ++i) {
+        struct shm_slot* slot = &ctx.index->slots[i];
+        const uint64_t seq = LOAD(&slot->seq);
+        struct pixcache_key slot_key;
+        uint64_t id;
+
+        if (seq & 1) {
+            continue; // slot is being modified
+        }
+        memcpy(&slot_key, &slot->key, sizeof(slot_key));
+        id = slot->id;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (LOAD(&slot->seq) != seq || id == 0 ||
+            memcmp(&slot_key, key, sizeof(slot_key)) != 0) {
+            continue;
+        }
+
+        __atomic_store_n(&slot->atime, ADD(&ctx.index->clock, 1),
+                         __ATOMIC_RELAXED);
+        return id;
+    }
+
+    return 0;
+}
+
+void shmcache_init(struct config* cfg)
+{
+    const ssize_t limit = config_get_num(cfg, APP_CFG_SECTION, APP_CFG_SHMCACHE,
+                                         0, 1024 * 1024, CFG_SHMCACHE_DEF);
+    struct shm_index* index;
+    char name[NAME_MAX];
+    uint32_t magic = 0;
+    struct stat st;
+    int fd;
+
+    if (limit == 0) {
+        return;
+    }
+
+    object_name(name, 0);
+    fd = object_open(name, O_RDWR | O_CREAT, &st);
+    if (fd == -1) {
+        return;
+    }
+    if (st.st_size == 0 && ftruncate(fd, sizeof(*index)) == 0) {
+        st.st_size = sizeof(*index);
+    }
+    index = st.st_size == sizeof(*index)
+        ? mmap(NULL, sizeof(*index), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+        : MAP_FAILED;
+    close(fd);
+    if (index == MAP_FAILED) {
+        fprintf(stderr, "Unable to open shared cache %s\n", name);
+        return;
+    }
+
+    if (!CAS(&index->magic, &magic, INDEX_MAGIC) && magic != INDEX_MAGIC) {
+        fprintf(stderr, "Incompatible shared cache %s\n", name);
+        munmap(index, sizeof(*index));
+        return;
+    }
+
+    ctx.index = index;
+    ctx.limit = (uint64_t)limit * 1024 * 1024;
+}
+
+void shmcache_destroy(void)
+{
+    if (ctx.index) {
+        munmap(ctx.index, sizeof(*ctx.index));
+        ctx.index = NULL;
+    }
+}
+
+bool shmcache_load(struct image* img, const struct stat* st)
+{
+    struct pixcache_key key;
+    char name[NAME_MAX];
+    struct stat seg_st;
+    uint64_t id;
+    bool rc;
+    int fd;
+
+    if (!ctx.index) {
+        return false;
+    }
+
+    pixcache_make_key(&key, st);
+    id = lookup(&key);
+    if (!id) {
+        perf_cache(perf_shmcache, false);
+        return false;
+    }
+
+    // segment can be already removed from the index by another process
+    object_name(name, id);
+    fd = object_open(name, O_RDONLY, &seg_st);
+    if (fd == -1) {
+        perf_cache(perf_shmcache, false);
+        return false;
+    }
+    rc = pixcache_map(img, fd, &key);
+    close(fd);
+
+    perf_cache(perf_shmcache, rc);
+
+    return rc;
+}
+
+void shmcache_save(const struct image* img, const struct stat* st)
+{
+    struct pixcache_key key;
+    char name[NAME_MAX];
+    struct stat seg_st;
+    size_t size;
+    uint64_t id;
+    int fd;
+
+    if (!ctx.index) {
+        return;
+    }
+    size = pixcache_size(img);
+    if (size == 0 || size > ctx.limit) {
+        return;
+    }
+
+    // create segment, segment ids are never reused
+    id = ADD(&ctx.index->next_id, 1);
+    object_name(name, id);
+    fd = object_open(name, O_RDWR | O_CREAT | O_EXCL, &seg_st);
+    if (fd == -1) {
+        return;
+    }
+    pixcache_make_key(&key, st);
+    if (!pixcache_write(fd, img, &key, size) || !publish(&key, id, size)) {
+        shm_unlink(name);
+    }
+    close(fd);
+}
@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+// Decoded image cache shared between processes.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "config.h"
+#include "image.h"
+
+#include <sys/stat.h>
+
+/**
+ * Initialize shared cache: open (or create) the index in shared memory.
+ * The cache is disabled if its size limit is not set in the config.
+ * @param cfg config instance
+ */
+void shmcache_init(struct config* cfg);
+
+/**
+ * Detach from the shared cache, cached images stay available for other
+ * instances.
+ */
+void shmcache_destroy(void);
+
+/**
+ * Load decoded image from the cache. Frames of the loaded image reference
+ * the shared memory segment via copy-on-write image mapping.
+ * @param img destination image
+ * @param st attributes of the image file
+ * @return true if image was found in the cache
+ */
+bool shmcache_load(struct image* img, const struct stat* st);
+
+/**
+ * Put decoded image to the cache.
+ * @param img image to store
+ * @param st attributes of the image file
+ */
+void shmcache_save(const struct image* img, const struct stat* st);
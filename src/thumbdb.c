@@ -0,0 +1,1090 @@
+// SPDX-License-Identifier: MIT
+// Persistent storage of gallery thumbnails with background indexer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "thumbdb.h"
+
+#include "config.h"
+#include "imagelist.h"
+#include "loader.h"
+#include "memdata.h"
+#include "perf.h"
+#include "pixcache.h"
+#include "tpool.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Name of the storage directory
+#define STORAGE_DIR "thumbs"
+// Database file format identifier
+#define DB_MAGIC 0x31424454
+// Max number of simultaneously opened databases
+#define MAX_OPEN 8
+// Max length of the format description
+#define MAX_FORMAT 32
+// Delay after the last user activity before indexing (ms)
+#define IDLE_DELAY 1000
+// Min size of the database file to check for compaction
+#define COMPACT_MIN (1024 * 1024)
+// Max number of attempts to reopen the database replaced by compaction
+#define REOPEN_MAX 3
+
+/** Database file header. */
+struct db_header {
+    uint32_t magic;      ///< Format identifier
+    uint32_t size;       ///< Thumbnail size
+    uint8_t fill;        ///< Scale mode
+    uint8_t aa;          ///< Anti-aliasing mode
+    uint8_t reserved[6]; ///< Padding
+};
+
+/** Thumbnail record, followed by pixel data. */
+struct db_record {
+    uint32_t size;           ///< Record size including pixel data
+    uint8_t alpha;           ///< Image has alpha channel
+    uint8_t exif;            ///< EXIF meta info can be loaded from the file
+    uint16_t reserved;       ///< Padding
+    struct pixcache_key key; ///< Source file identifier
+    uint32_t width;          ///< Original image width
+    uint32_t height;         ///< Original image height
+    uint32_t thumb_width;    ///< Thumbnail width
+    uint32_t thumb_height;   ///< Thumbnail height
+    char format[MAX_FORMAT]; ///< Format description
+};
+
+/** Index entry: position of the record in the database file. */
+struct db_entry {
+    uint64_t dev;  ///< Source file device
+    uint64_t ino;  ///< Source file inode
+    size_t offset; ///< Record offset
+};
+
+/**
+ * Database of thumbnails from the same directory. Records are appended to
+ * the file, the last record of the source file overrides previous ones.
+ */
+struct db {
+    char* dir;                ///< Directory path, NULL if not opened
+    uint64_t dev;             ///< Directory device
+    uint64_t ino;             ///< Directory inode
+    int fd;                   ///< Database file descriptor
+    uint8_t* data;            ///< Mapped file
+    size_t map_size;          ///< Size of the mapping
+    size_t end;               ///< End of the last valid record
+    size_t live;              ///< Total size of actual records
+    struct db_entry* entries; ///< Index of records sorted by inode
+    size_t num_entries;       ///< Number of entries in the index
+    size_t max_entries;       ///< Capacity of the index
+    size_t atime;             ///< Last access stamp
+};
+
+/**
+ * Set of opened databases. Main thread and indexer use their own sets, so
+ * file operations don't require any lock shared between the threads.
+ */
+struct db_set {
+    struct db dbs[MAX_OPEN]; ///< Opened databases
+    size_t clock;            ///< Access stamp counter
+    size_t size;             ///< Thumbnail size
+    bool fill;               ///< Scale mode (fill/fit)
+    bool aa;                 ///< Anti-aliasing mode
+    bool writable;           ///< Databases can be created and modified
+};
+
+/** Thumbnail queued by the main thread to be saved by the indexer. */
+struct db_save {
+    struct list list;      ///< Links to prev/next entry
+    char* source;          ///< Path to the image file
+    struct db_record* rec; ///< Record to append
+    size_t size;           ///< Thumbnail size
+    bool fill;             ///< Scale mode (fill/fit)
+    bool aa;               ///< Anti-aliasing mode
+};
+
+/** Thumbnail storage context. */
+struct thumbdb {
+    char* path;            ///< Storage directory, NULL if disabled
+    struct db_set readers; ///< Databases used by the main thread
+
+    // the lock protects following fields only, file operations are
+    // performed without the lock
+    size_t size;              ///< Thumbnail size
+    bool fill;                ///< Scale mode (fill/fit)
+    bool aa;                  ///< Anti-aliasing mode
+    size_t generation;        ///< Parameters change counter
+    struct db_save* saves;    ///< Queue of thumbnails to save
+    pthread_mutex_t lock;     ///< Context access lock
+    pthread_cond_t wakeup;    ///< Indexer wakeup signal
+    struct timespec activity; ///< Time of the last user activity
+    pthread_t indexer;        ///< Background indexer thread
+    bool stop;                ///< Indexer stop flag
+};
+
+static struct thumbdb ctx;
+
+/**
+ * Lock or unlock the whole database file.
+ * @param fd database file descriptor
+ * @param type lock type (F_WRLCK/F_UNLCK)
+ * @return false on errors
+ */
+static bool file_lock(int fd, short type)
+{
+    struct flock fl = { .l_type = type, .l_whence = SEEK_SET };
+    while (fcntl(fd, F_SETLKW, &fl) == -1) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Write data to the file.
+ * @param fd file descriptor
+ * @param data data to write
+ * @param size number of bytes to write
+ * @param offset file offset
+ * @return false on errors
+ */
+static bool write_at(int fd, const void* data, size_t size, off_t offset)
+{
+    while (size) {
+        const ssize_t rc = pwrite(fd, data, size, offset);
+        if (rc == -1 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        data = (const uint8_t*)data + rc;
+        size -= rc;
+        offset += rc;
+    }
+    return true;
+}
+
+/**
+ * Get size of the record.
+ * @param width,height thumbnail size
+ * @return record size in bytes
+ */
+static inline size_t record_size(size_t width, size_t height)
+{
+    const size_t size =
+        sizeof(struct db_record) + width * height * sizeof(argb_t);
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * Compose path to the database file.
+ * @param set database set
+ * @param path output buffer
+ * @param dev,ino directory identifier
+ * @return false if path is too long
+ */
+static bool db_path(const struct db_set* set, char* path, uint64_t dev,
+                    uint64_t ino)
+{
+    const int len = snprintf(path, PATH_MAX,
+                             "%s/%" PRIx64 "-%" PRIx64 "-%zu%s%s.db",
+                             ctx.path, dev, ino, set->size,
+                             set->fill ? "f" : "", set->aa ? "a" : "");
+    return len > 0 && len < PATH_MAX;
+}
+
+/**
+ * Find index entry.
+ * @param db database
+ * @param dev,ino source file identifier
+ * @param pos output position of the entry or position to insert new one
+ * @return pointer to the entry or NULL if not found
+ */
+static struct db_entry* db_find_entry(struct db* db, uint64_t dev,
+                                      uint64_t ino, size_t* pos)
+{
+    size_t lo = 0, hi = db->num_entries;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        struct db_entry* entry = &db->entries[mid];
+        if (entry->ino == ino && entry->dev == dev) {
+            *pos = mid;
+            return entry;
+        }
+        if (entry->ino < ino || (entry->ino == ino && entry->dev < dev)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return NULL;
+}
+
+/**
+ * Parse new records and put them to the index.
+ * @param db database
+ */
+static void db_parse(struct db* db)
+{
+    while (db->end + sizeof(struct db_record) <= db->map_size) {
+        const struct db_record* rec =
+            (const struct db_record*)(db->data + db->end);
+        struct db_entry* entry;
+        size_t pos;
+
+        if (rec->size != record_size(rec->thumb_width, rec->thumb_height) ||
+            rec->size > db->map_size - db->end) {
+            break; // incomplete record
+        }
+
+        entry = db_find_entry(db, rec->key.dev, rec->key.ino, &pos);
+        if (entry) {
+            const struct db_record* prev =
+                (const struct db_record*)(db->data + entry->offset);
+            db->live -= prev->size;
+        } else {
+            if (db->num_entries == db->max_entries) {
+                const size_t max = db->max_entries ? db->max_entries * 2 : 64;
+                struct db_entry* entries =
+                    realloc(db->entries, max * sizeof(*entries));
+                if (!entries) {
+                    break;
+                }
+                db->entries = entries;
+                db->max_entries = max;
+            }
+            entry = &db->entries[pos];
+            memmove(entry + 1, entry,
+                    (db->num_entries - pos) * sizeof(*entry));
+            entry->dev = rec->key.dev;
+            entry->ino = rec->key.ino;
+            ++db->num_entries;
+        }
+        entry->offset = db->end;
+        db->live += rec->size;
+        db->end += rec->size;
+    }
+}
+
+/**
+ * Map records appended to the database file.
+ * @param db database
+ */
+static void db_refresh(struct db* db)
+{
+    struct stat st;
+    void* data;
+
+    if (fstat(db->fd, &st) == -1 || (size_t)st.st_size <= db->map_size) {
+        return;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, db->fd, 0);
+    if (data == MAP_FAILED) {
+        return;
+    }
+    if (db->data) {
+        munmap(db->data, db->map_size);
+    }
+    db->data = data;
+    db->map_size = st.st_size;
+
+    db_parse(db);
+}
+
+/**
+ * Close database.
+ * @param db database to close
+ */
+static void db_close(struct db* db)
+{
+    if (db->dir) {
+        if (db->data) {
+            munmap(db->data, db->map_size);
+        }
+        close(db->fd);
+        free(db->dir);
+        free(db->entries);
+        memset(db, 0, sizeof(*db));
+    }
+}
+
+/**
+ * Close all databases of the set and change thumbnail parameters.
+ * @param set database set
+ * @param size thumbnail size in pixels
+ * @param fill scale mode (fill/fit)
+ * @param aa anti-aliasing mode
+ */
+static void db_set_params(struct db_set* set, size_t size, bool fill, bool aa)
+{
+    if (set->size != size || set->fill != fill || set->aa != aa) {
+        for (size_t i = 0; i < MAX_OPEN; ++i) {
+            db_close(&set->dbs[i]);
+        }
+        set->size = size;
+        set->fill = fill;
+        set->aa = aa;
+    }
+}
+
+/**
+ * Check database file header, reinitialize file if header is invalid.
+ * @param set database set
+ * @param fd database file descriptor
+ * @return false on errors
+ */
+static bool db_check_header(const struct db_set* set, int fd)
+{
+    const struct db_header expect = { .magic = DB_MAGIC,
+                                      .size = set->size,
+                                      .fill = set->fill,
+                                      .aa = set->aa };
+    struct db_header hdr;
+    bool rc;
+
+    if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+        memcmp(&hdr, &expect, sizeof(hdr)) == 0) {
+        return true;
+    }
+    if (!set->writable) {
+        return false;
+    }
+
+    // new or incompatible file
+    if (!file_lock(fd, F_WRLCK)) {
+        return false;
+    }
+    rc = (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+          memcmp(&hdr, &expect, sizeof(hdr)) == 0) ||
+        (ftruncate(fd, 0) == 0 && write_at(fd, &expect, sizeof(expect), 0));
+    file_lock(fd, F_UNLCK);
+
+    return rc;
+}
+
+/**
+ * Check if the opened file is still the database at the path: compaction
+ * replaces the file, records appended to the old one are lost.
+ * @param fd database file descriptor
+ * @param path path to the database file
+ * @return true if the descriptor refers to the file at the path
+ */
+static bool db_is_current(int fd, const char* path)
+{
+    struct stat fst, pst;
+    return fstat(fd, &fst) == 0 && stat(path, &pst) == 0 &&
+        fst.st_dev == pst.st_dev && fst.st_ino == pst.st_ino;
+}
+
+/**
+ * Reopen database file replaced by another process.
+ * @param set database set
+ * @param db database to reopen
+ * @param path path to the database file
+ * @return false on errors
+ */
+static bool db_reopen(const struct db_set* set, struct db* db,
+                      const char* path)
+{
+    const int fd = open(path, O_RDWR | O_CREAT, 0600);
+
+    if (fd == -1) {
+        return false;
+    }
+    if (!db_check_header(set, fd)) {
+        close(fd);
+        return false;
+    }
+
+    if (db->data) {
+        munmap(db->data, db->map_size);
+    }
+    close(db->fd);
+    free(db->entries);
+
+    db->fd = fd;
+    db->data = NULL;
+    db->map_size = 0;
+    db->end = sizeof(struct db_header);
+    db->live = 0;
+    db->entries = NULL;
+    db->num_entries = 0;
+    db->max_entries = 0;
+    db_refresh(db);
+
+    return true;
+}
+
+/**
+ * Rewrite database file without outdated records.
+ * @param db database
+ * @param path path to the database file
+ * @return false on errors
+ */
+static bool db_compact(struct db* db, const char* path)
+{
+    char tmp[PATH_MAX];
+    size_t offset;
+    int fd;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp)) {
+        return false;
+    }
+    fd = mkstemp(tmp);
+    if (fd == -1) {
+        return false;
+    }
+
+    offset = sizeof(struct db_header);
+    for (size_t i = 0; i < db->num_entries; ++i) {
+        const struct db_record* rec =
+            (const struct db_record*)(db->data + db->entries[i].offset);
+        if (!write_at(fd, rec, rec->size, offset)) {
+            goto fail;
+        }
+        offset += rec->size;
+    }
+    if (!write_at(fd, db->data, sizeof(struct db_header), 0) ||
+        rename(tmp, path) == -1) {
+        goto fail;
+    }
+
+    close(fd);
+    return true;
+
+fail:
+    close(fd);
+    unlink(tmp);
+    return false;
+}
+
+/**
+ * Open database of the directory.
+ * @param set database set
+ * @param dir path to the directory
+ * @return database or NULL on errors
+ */
+static struct db* db_open(struct db_set* set, const char* dir)
+{
+    struct db* db = NULL;
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    // search in already opened
+    for (size_t i = 0; i < MAX_OPEN; ++i) {
+        if (set->dbs[i].dir && strcmp(set->dbs[i].dir, dir) == 0) {
+            db = &set->dbs[i];
+            db->atime = ++set->clock;
+            return db;
+        }
+    }
+
+    if (stat(dir, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        return NULL;
+    }
+
+    // the same directory can be referenced by different path
+    for (size_t i = 0; i < MAX_OPEN; ++i) {
+        db = &set->dbs[i];
+        if (db->dir && db->dev == (uint64_t)st.st_dev &&
+            db->ino == (uint64_t)st.st_ino) {
+            db->atime = ++set->clock;
+            return db;
+        }
+    }
+
+    // reuse free or the least recently used slot
+    db = &set->dbs[0];
+    for (size_t i = 1; i < MAX_OPEN && db->dir; ++i) {
+        if (!set->dbs[i].dir || set->dbs[i].atime < db->atime) {
+            db = &set->dbs[i];
+        }
+    }
+    db_close(db);
+
+    if (!db_path(set, path, st.st_dev, st.st_ino)) {
+        return NULL;
+    }
+    fd = set->writable ? open(path, O_RDWR | O_CREAT, 0600)
+                       : open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (!db_check_header(set, fd)) {
+        close(fd);
+        return NULL;
+    }
+
+    db->dir = str_dup(dir, NULL);
+    if (!db->dir) {
+        close(fd);
+        return NULL;
+    }
+    db->dev = st.st_dev;
+    db->ino = st.st_ino;
+    db->fd = fd;
+    db->end = sizeof(struct db_header);
+    db->atime = ++set->clock;
+    db_refresh(db);
+
+    // remove outdated records, the lock is held until the new file replaces
+    // the old one, so no record can be appended to the old file
+    if (set->writable && db->map_size >= COMPACT_MIN &&
+        db->live < db->end / 2 && file_lock(fd, F_WRLCK)) {
+        bool compacted = false;
+        if (db_is_current(fd, path)) {
+            db_refresh(db); // records appended before locking
+            compacted = db->live < db->end / 2 && db_compact(db, path);
+        }
+        file_lock(fd, F_UNLCK);
+        if (compacted || !db_is_current(fd, path)) {
+            db_close(db);
+            return db_open(set, dir);
+        }
+    }
+
+    return db;
+}
+
+/**
+ * Find thumbnail record.
+ * @param db database
+ * @param key source file identifier
+ * @return pointer to the record or NULL if not found
+ */
+static const struct db_record* db_find(struct db* db,
+                                       const struct pixcache_key* key)
+{
+    for (size_t i = 0; i < 2; ++i) {
+        size_t pos;
+        const struct db_entry* entry =
+            db_find_entry(db, key->dev, key->ino, &pos);
+        if (entry) {
+            const struct db_record* rec =
+                (const struct db_record*)(db->data + entry->offset);
+            if (memcmp(&rec->key, key, sizeof(*key)) == 0) {
+                return rec;
+            }
+        }
+        // record can be added by another process
+        if (i == 0) {
+            db_refresh(db);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Create thumbnail record.
+ * @param thumb thumbnail image
+ * @param width,height size of the original image
+ * @return record, caller must free it, or NULL on errors
+ */
+static struct db_record* record_create(const struct image* thumb,
+                                       size_t width, size_t height)
+{
+    const struct pixmap* pm = &thumb->frames[0].pm;
+    const size_t size = record_size(pm->width, pm->height);
+    struct db_record* rec;
+
+    if (width > UINT32_MAX || height > UINT32_MAX || size > UINT32_MAX) {
+        return NULL;
+    }
+
+    rec = calloc(1, size);
+    if (!rec) {
+        return NULL;
+    }
+    rec->size = size;
+    rec->alpha = thumb->alpha;
+    rec->exif = thumb->exif_deferred;
+    rec->width = width;
+    rec->height = height;
+    rec->thumb_width = pm->width;
+    rec->thumb_height = pm->height;
+    if (thumb->format) {
+        strncpy(rec->format, thumb->format, MAX_FORMAT - 1);
+    }
+    memcpy(rec + 1, pm->data, pm->width * pm->height * sizeof(argb_t));
+
+    return rec;
+}
+
+/**
+ * Create thumbnail image from the record.
+ * @param source path to the image file
+ * @param rec thumbnail record
+ * @param width,height output size of the original image
+ * @return thumbnail image or NULL on errors
+ */
+static struct image* record_image(const char* source,
+                                  const struct db_record* rec, size_t* width,
+                                  size_t* height)
+{
+    struct image* thumb;
+    struct pixmap* pm;
+
+    thumb = image_create();
+    if (!thumb) {
+        return NULL;
+    }
+    thumb->source = str_dup(source, NULL);
+    pm = thumb->source
+        ? image_allocate_frame(thumb, rec->thumb_width, rec->thumb_height)
+        : NULL;
+    if (!pm) {
+        image_free(thumb);
+        return NULL;
+    }
+    memcpy(pm->data, rec + 1, pm->width * pm->height * sizeof(argb_t));
+
+    thumb->name = strrchr(thumb->source, '/');
+    if (!thumb->name || strcmp(thumb->name, "/") == 0) {
+        thumb->name = thumb->source;
+    } else {
+        ++thumb->name; // skip slash
+    }
+    image_set_format(thumb, "%.*s", MAX_FORMAT, rec->format);
+    thumb->file_size = rec->key.size;
+    thumb->alpha = rec->alpha;
+    thumb->exif_deferred = rec->exif;
+    *width = rec->width;
+    *height = rec->height;
+
+    return thumb;
+}
+
+/**
+ * Append thumbnail record to the database.
+ * @param set database set
+ * @param db database
+ * @param rec record to append
+ */
+static void db_append(const struct db_set* set, struct db* db,
+                      const struct db_record* rec)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    size_t attempt = 0;
+
+    if (!db_path(set, path, db->dev, db->ino)) {
+        return;
+    }
+
+    // the file can be replaced by compaction in another process
+    while (true) {
+        if (!file_lock(db->fd, F_WRLCK)) {
+            return;
+        }
+        if (db_is_current(db->fd, path)) {
+            break;
+        }
+        file_lock(db->fd, F_UNLCK);
+        if (++attempt > REOPEN_MAX || !db_reopen(set, db, path)) {
+            return;
+        }
+    }
+
+    db_refresh(db);
+    // drop incomplete record left by interrupted writer
+    if (fstat(db->fd, &st) == 0 &&
+        ((size_t)st.st_size == db->end || ftruncate(db->fd, db->end) == 0)) {
+        write_at(db->fd, rec, rec->size, db->end);
+    }
+    file_lock(db->fd, F_UNLCK);
+    db_refresh(db);
+}
+
+/**
+ * Get identifier of the image file.
+ * @param source path to the image file
+ * @param key output source file identifier
+ * @return false if file is not available
+ */
+static bool source_key(const char* source, struct pixcache_key* key)
+{
+    struct stat st;
+
+    if (stat(source, &st) == -1 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    pixcache_make_key(key, &st);
+
+    return true;
+}
+
+/**
+ * Open database for the image file.
+ * @param set database set
+ * @param source path to the image file
+ * @return database or NULL on errors
+ */
+static struct db* open_source(struct db_set* set, const char* source)
+{
+    const char* delim = strrchr(source, '/');
+    char dir[PATH_MAX];
+
+    if (!delim) {
+        strcpy(dir, ".");
+    } else if (delim == source) {
+        strcpy(dir, "/");
+    } else if ((size_t)(delim - source) < sizeof(dir)) {
+        memcpy(dir, source, delim - source);
+        dir[delim - source] = 0;
+    } else {
+        return NULL;
+    }
+
+    return db_open(set, dir);
+}
+
+/**
+ * Save thumbnail record if it is not in the storage yet.
+ * @param set database set of the indexer
+ * @param source path to the image file
+ * @param rec record to save
+ */
+static void save_record(struct db_set* set, const char* source,
+                        const struct db_record* rec)
+{
+    struct db* db = open_source(set, source);
+    if (db && !db_find(db, &rec->key)) {
+        db_append(set, db, rec);
+    }
+}
+
+/**
+ * Write thumbnails queued by the main thread.
+ * @param set database set of the indexer
+ * @param saves queue of thumbnails to save
+ */
+static void write_saves(struct db_set* set, struct db_save* saves)
+{
+    list_for_each(saves, struct db_save, it) {
+        db_set_params(set, it->size, it->fill, it->aa);
+        save_record(set, it->source, it->rec);
+        free(it->source);
+        free(it->rec);
+        free(it);
+    }
+}
+
+/**
+ * Check if the user is idle, must be called with the lock held.
+ * @param deadline output time when the user becomes idle
+ * @return true if the user is idle
+ */
+static bool is_idle(struct timespec* deadline)
+{
+    struct timespec now;
+
+    *deadline = ctx.activity;
+    deadline->tv_sec += IDLE_DELAY / 1000;
+    deadline->tv_nsec += (IDLE_DELAY % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        ++deadline->tv_sec;
+        deadline->tv_nsec -= 1000000000;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return now.tv_sec > deadline->tv_sec ||
+        (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+/**
+ * Wait until the user is idle or thumbnails to save are queued.
+ * @param generation parameters used by the indexer
+ * @param done true if all images are indexed
+ * @return false if indexer must be stopped
+ */
+static bool wait_idle(size_t generation, bool done)
+{
+    bool run;
+
+    pthread_mutex_lock(&ctx.lock);
+    while (!ctx.stop && !ctx.saves) {
+        struct timespec deadline;
+        if (done && generation == ctx.generation) {
+            pthread_cond_wait(&ctx.wakeup, &ctx.lock);
+            continue;
+        }
+        if (is_idle(&deadline)) {
+            break;
+        }
+        pthread_cond_timedwait(&ctx.wakeup, &ctx.lock, &deadline);
+    }
+    run = !ctx.stop;
+    pthread_mutex_unlock(&ctx.lock);
+
+    return run;
+}
+
+/**
+ * Create thumbnail for the image file if it is not in the storage yet.
+ * @param set database set of the indexer
+ * @param source path to the image file
+ * @param generation parameters used by the indexer
+ */
+static void index_image(struct db_set* set, const char* source,
+                        size_t generation)
+{
+    struct pixcache_key key;
+    struct image* image = NULL;
+    struct db_record* rec;
+    size_t width, height;
+    struct db* db;
+    bool actual;
+
+    if (!source_key(source, &key)) {
+        return;
+    }
+    db = open_source(set, source);
+    if (!db || db_find(db, &key)) {
+        return;
+    }
+
+    // previews are not published for background decodes, see loader
+    if (loader_from_source(source, &image) != ldr_success) {
+        return;
+    }
+    width = image->frames[0].pm.width;
+    height = image->frames[0].pm.height;
+    image_thumbnail(image, set->size, set->fill, set->aa);
+    rec = image->num_frames ? record_create(image, width, height) : NULL;
+    image_free(image);
+    if (!rec) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    actual = (generation == ctx.generation);
+    pthread_mutex_unlock(&ctx.lock);
+    if (actual) {
+        rec->key = key;
+        save_record(set, source, rec);
+    }
+    free(rec);
+}
+
+/** Background indexer thread: creates thumbnails for all images. */
+static void* indexer_thread(__attribute__((unused)) void* data)
+{
+    struct db_set set = { .writable = true };
+    size_t generation = SIZE_MAX;
+    size_t index = IMGLIST_INVALID;
+    bool indexed = false;
+    struct db_save* saves;
+
+    tpool_set_qos(tpool_background);
+    trace_thread("indexer");
+
+    while (wait_idle(generation, index == IMGLIST_INVALID)) {
+        struct timespec deadline;
+        char* source = NULL;
+        size_t size;
+        bool fill, aa;
+
+        // get queued thumbnails and the next image to index
+        pthread_mutex_lock(&ctx.lock);
+        saves = ctx.saves;
+        ctx.saves = NULL;
+        if (generation != ctx.generation) {
+            generation = ctx.generation;
+            index = image_list_first();
+            indexed = false;
+        } else if (indexed) {
+            index = image_list_nearest(index, true, false);
+            indexed = false;
+        }
+        if (index != IMGLIST_INVALID && is_idle(&deadline)) {
+            str_dup(image_list_get(index), &source);
+            indexed = true;
+        }
+        size = ctx.size;
+        fill = ctx.fill;
+        aa = ctx.aa;
+        pthread_mutex_unlock(&ctx.lock);
+
+        write_saves(&set, saves);
+
+        if (source) {
+            db_set_params(&set, size, fill, aa);
+            index_image(&set, source, generation);
+            free(source);
+        }
+    }
+
+    // write thumbnails queued before stop
+    pthread_mutex_lock(&ctx.lock);
+    saves = ctx.saves;
+    ctx.saves = NULL;
+    pthread_mutex_unlock(&ctx.lock);
+    write_saves(&set, saves);
+
+    for (size_t i = 0; i < MAX_OPEN; ++i) {
+        db_close(&set.dbs[i]);
+    }
+
+    return NULL;
+}
+
+void thumbdb_init(size_t size, bool fill, bool aa)
+{
+    ctx.path = config_cache_path(STORAGE_DIR);
+    if (!ctx.path) {
+        return;
+    }
+    if (mkdir(ctx.path, 0700) == -1 && errno != EEXIST) {
+        free(ctx.path);
+        ctx.path = NULL;
+        return;
+    }
+
+    ctx.size = size;
+    ctx.fill = fill;
+    ctx.aa = aa;
+    ctx.stop = false;
+    clock_gettime(CLOCK_REALTIME, &ctx.activity);
+    ctx.readers.size = size;
+    ctx.readers.fill = fill;
+    ctx.readers.aa = aa;
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.wakeup, NULL);
+    if (pthread_create(&ctx.indexer, NULL, indexer_thread, NULL) != 0) {
+        ctx.indexer = 0;
+    }
+}
+
+void thumbdb_destroy(void)
+{
+    if (!ctx.path) {
+        return;
+    }
+
+    if (ctx.indexer) {
+        pthread_mutex_lock(&ctx.lock);
+        ctx.stop = true;
+        pthread_cond_signal(&ctx.wakeup);
+        pthread_mutex_unlock(&ctx.lock);
+        pthread_join(ctx.indexer, NULL);
+        ctx.indexer = 0;
+    }
+
+    for (size_t i = 0; i < MAX_OPEN; ++i) {
+        db_close(&ctx.readers.dbs[i]);
+    }
+    pthread_mutex_destroy(&ctx.lock);
+    pthread_cond_destroy(&ctx.wakeup);
+    free(ctx.path);
+    ctx.path = NULL;
+}
+
+void thumbdb_set_params(size_t size, bool fill, bool aa)
+{
+    if (!ctx.path) {
+        return;
+    }
+
+    db_set_params(&ctx.readers, size, fill, aa);
+
+    pthread_mutex_lock(&ctx.lock);
+    ctx.size = size;
+    ctx.fill = fill;
+    ctx.aa = aa;
+    ++ctx.generation;
+    pthread_cond_signal(&ctx.wakeup);
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+struct image* thumbdb_load(const char* source, size_t* width, size_t* height)
+{
+    const struct db_record* rec;
+    struct image* thumb = NULL;
+    struct pixcache_key key;
+    struct db* db;
+
+    if (!ctx.path || !source_key(source, &key)) {
+        return NULL;
+    }
+
+    // thumbnail can be queued but not written yet
+    pthread_mutex_lock(&ctx.lock);
+    list_for_each(ctx.saves, struct db_save, it) {
+        if (it->size == ctx.readers.size && it->fill == ctx.readers.fill &&
+            it->aa == ctx.readers.aa &&
+            memcmp(&it->rec->key, &key, sizeof(key)) == 0) {
+            thumb = record_image(source, it->rec, width, height);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    if (!thumb) {
+        db = open_source(&ctx.readers, source);
+        rec = db ? db_find(db, &key) : NULL;
+        if (rec) {
+            thumb = record_image(source, rec, width, height);
+        }
+    }
+
+    perf_cache(perf_thumbdb, thumb != NULL);
+    return thumb;
+}
+
+void thumbdb_save(const struct image* thumb, size_t width, size_t height)
+{
+    struct db_save* save;
+
+    if (!ctx.path || !ctx.indexer || !thumb->source || !thumb->num_frames) {
+        return;
+    }
+
+    save = calloc(1, sizeof(*save));
+    if (!save) {
+        return;
+    }
+    save->source = str_dup(thumb->source, NULL);
+    save->rec = record_create(thumb, width, height);
+    if (!save->source || !save->rec ||
+        !source_key(save->source, &save->rec->key)) {
+        free(save->source);
+        free(save->rec);
+        free(save);
+        return;
+    }
+    save->size = ctx.readers.size;
+    save->fill = ctx.readers.fill;
+    save->aa = ctx.readers.aa;
+
+    // written by the indexer, file locks can block for a long time
+    pthread_mutex_lock(&ctx.lock);
+    ctx.saves = list_append(ctx.saves, save);
+    pthread_cond_signal(&ctx.wakeup);
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+void thumbdb_busy(void)
+{
+    if (ctx.path) {
+        pthread_mutex_lock(&ctx.lock);
+        clock_gettime(CLOCK_REALTIME, &ctx.activity);
+        pthread_mutex_unlock(&ctx.lock);
+    }
+}
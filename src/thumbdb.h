@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+// Persistent storage of gallery thumbnails with background indexer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "image.h"
+
+/**
+ * Initialize thumbnail storage and start background indexer.
+ * @param size thumbnail size in pixels
+ * @param fill scale mode (fill/fit)
+ * @param aa anti-aliasing mode
+ */
+void thumbdb_init(size_t size, bool fill, bool aa);
+
+/**
+ * Stop background indexer and close storage.
+ */
+void thumbdb_destroy(void);
+
+/**
+ * Change thumbnail parameters, indexer restarts from the first image.
+ * @param size thumbnail size in pixels
+ * @param fill scale mode (fill/fit)
+ * @param aa anti-aliasing mode
+ */
+void thumbdb_set_params(size_t size, bool fill, bool aa);
+
+/**
+ * Load thumbnail from the storage, must be called from the main thread.
+ * @param source path to the image file
+ * @param width,height output size of the original image
+ * @return thumbnail image or NULL if not found
+ */
+struct image* thumbdb_load(const char* source, size_t* width, size_t* height);
+
+/**
+ * Put thumbnail to the storage, must be called from the main thread.
+ * The thumbnail is written by the background indexer, but it can be loaded
+ * right after this call.
+ * @param thumb thumbnail image
+ * @param width,height size of the original image
+ */
+void thumbdb_save(const struct image* thumb, size_t width, size_t height);
+
+/**
+ * Notify about user activity: background indexer is paused while the user
+ * interacts with the application.
+ */
+void thumbdb_busy(void);
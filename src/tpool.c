@@ -0,0 +1,477 @@
+// SPDX-License-Identifier: MIT
+// Thread pool: worker threads for parallel tasks.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#ifdef __linux__
+#define _GNU_SOURCE // SCHED_IDLE and CPU affinity
+#endif
+
+#include "tpool.h"
+
+#include "memdata.h"
+#include "trace.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __FreeBSD__
+#include <stdint.h>
+#include <sys/sysctl.h>
+#endif
+
+// Max number of threads used by a single task
+#define MAX_THREADS 16
+
+// Min number of pixels worth splitting into bands
+#define ROWS_MIN_PIXELS (512 * 512)
+// Number of bands per thread, more bands give better load balancing
+#define ROWS_BANDS 4
+
+// Number of work classes
+#define QOS_NUM (tpool_background + 1)
+// Nice value of user-initiated work
+#define USER_NICE 5
+// Nice value of background work if idle scheduling is not available
+#define BACKGROUND_NICE 19
+// Max number of ranges in the CPU list
+#define MAX_CPU_RANGES 32
+
+/** Job: set of tasks passed to tpool_run. */
+struct tpool_job {
+    struct list list;   ///< Links to prev/next entry
+    tpool_fn fn;        ///< Task handler
+    void* data;         ///< User data for handler
+    size_t num;         ///< Total number of tasks
+    size_t next;        ///< Index of the next task to execute
+    size_t done;        ///< Number of completed tasks
+    enum tpool_qos qos; ///< Work class
+};
+
+/** Row bands job for tpool_rows. */
+struct rows_job {
+    tpool_rows_fn fn;                  ///< Row band handler
+    void* data;                        ///< User data for handler
+    size_t height;                     ///< Total number of rows
+    size_t bands;                      ///< Number of bands
+    bool rc[MAX_THREADS * ROWS_BANDS]; ///< Result of each band
+};
+
+/** Set of worker threads. */
+struct workers {
+    pthread_t* threads; ///< Worker threads
+    size_t num;         ///< Number of worker threads
+};
+
+/** Thread pool context. */
+struct tpool {
+    struct workers normal;     ///< Workers for interactive and user tasks
+    struct workers background; ///< Idle priority workers
+    size_t limit;              ///< Max number of threads, 0 for no limit
+
+    struct tpool_job* jobs[QOS_NUM]; ///< Queues of jobs with unclaimed tasks
+    size_t busy[QOS_NUM];            ///< Number of busy workers per class
+
+    pthread_mutex_t lock;    ///< Queue lock
+    pthread_cond_t wakeup;   ///< New job notification
+    pthread_cond_t complete; ///< Task completion notification
+    bool stop;               ///< Stop flag for worker threads
+
+    pthread_key_t qos_key; ///< Work class of the thread
+#ifdef __linux__
+    cpu_set_t bkg_cpus; ///< CPU affinity of background threads
+    bool bkg_affinity;  ///< Background CPU affinity is set
+#endif
+};
+
+/** Global thread pool context. */
+static struct tpool ctx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wakeup = PTHREAD_COND_INITIALIZER,
+    .complete = PTHREAD_COND_INITIALIZER,
+};
+
+/** Work class key initialization guard. */
+static pthread_once_t qos_once = PTHREAD_ONCE_INIT;
+
+/** Create key for the thread work class. */
+static void create_qos_key(void)
+{
+    pthread_key_create(&ctx.qos_key, NULL);
+}
+
+/**
+ * Get the next task from the job, must be called with lock held.
+ * @param job pointer to the job
+ * @param index pointer to output task index
+ * @return false if all tasks already claimed
+ */
+static bool claim_task(struct tpool_job* job, size_t* index)
+{
+    if (job->next >= job->num) {
+        return false;
+    }
+    *index = job->next++;
+    if (job->next == job->num) {
+        // nothing more to execute
+        ctx.jobs[job->qos] = list_remove(job);
+    }
+    return true;
+}
+
+/**
+ * Mark task as completed, must be called with lock held.
+ * @param job pointer to the job
+ */
+static void complete_task(struct tpool_job* job)
+{
+    if (++job->done == job->num) {
+        pthread_cond_broadcast(&ctx.complete);
+    }
+}
+
+/**
+ * Get the next job for the worker, must be called with lock held.
+ * @param background true for idle priority worker
+ * @return pointer to the job or NULL if there is nothing to execute
+ */
+static struct tpool_job* next_job(bool background)
+{
+    if (background) {
+        return ctx.jobs[tpool_background];
+    }
+    if (ctx.jobs[tpool_interactive]) {
+        return ctx.jobs[tpool_interactive];
+    }
+    // keep half of workers free for interactive tasks
+    if (ctx.jobs[tpool_user] &&
+        ctx.busy[tpool_user] < (ctx.normal.num + 1) / 2) {
+        return ctx.jobs[tpool_user];
+    }
+    return NULL;
+}
+
+/**
+ * Apply work class to the calling thread.
+ * @param qos work class
+ */
+static void apply_qos(enum tpool_qos qos)
+{
+#ifdef __linux__
+    // nice value is applied to the current thread only on Linux
+    if (qos == tpool_user) {
+        setpriority(PRIO_PROCESS, 0, USER_NICE);
+    } else if (qos == tpool_background) {
+        const struct sched_param param = { 0 };
+        if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+            setpriority(PRIO_PROCESS, 0, BACKGROUND_NICE);
+        }
+        if (ctx.bkg_affinity) {
+            pthread_setaffinity_np(pthread_self(), sizeof(ctx.bkg_cpus),
+                                   &ctx.bkg_cpus);
+        }
+    }
+#else
+    (void)qos; // priority is per-process, admission control only
+#endif
+}
+
+/**
+ * Worker thread.
+ * @param data thread index, background workers are offset by MAX_THREADS
+ */
+static void* worker_thread(void* data)
+{
+    const bool background = (size_t)data >= MAX_THREADS;
+    const size_t thread = (size_t)data % MAX_THREADS;
+
+    if (background) {
+        tpool_set_qos(tpool_background);
+        trace_thread("background worker");
+    } else {
+        trace_thread("worker");
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+    while (!ctx.stop) {
+        struct tpool_job* job = next_job(background);
+        enum tpool_qos qos;
+        uint64_t start;
+        size_t index;
+        if (!job || thread >= tpool_threads() || !claim_task(job, &index)) {
+            pthread_cond_wait(&ctx.wakeup, &ctx.lock);
+            continue;
+        }
+        qos = job->qos;
+        ++ctx.busy[qos];
+        pthread_mutex_unlock(&ctx.lock);
+        start = trace_begin();
+        job->fn(job->data, index, thread);
+        trace_end("Task", start);
+        pthread_mutex_lock(&ctx.lock);
+        --ctx.busy[qos];
+        complete_task(job);
+        if (qos == tpool_user && ctx.jobs[tpool_user]) {
+            pthread_cond_broadcast(&ctx.wakeup); // admit waiting user tasks
+        }
+    }
+    pthread_mutex_unlock(&ctx.lock);
+
+    return NULL;
+}
+
+/**
+ * Get number of active CPUs.
+ * @return number of CPUs limited by MAX_THREADS
+ */
+static size_t cpu_threads(void)
+{
+    static size_t threads;
+
+    if (!threads) {
+        // get numper of active CPUs
+#ifdef __FreeBSD__
+        uint32_t cpus = 0;
+        size_t cpus_len = sizeof(cpus);
+        sysctlbyname("hw.ncpu", &cpus, &cpus_len, 0, 0);
+#else
+        const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (cpus <= 0) {
+            threads = 1;
+        } else if (cpus > MAX_THREADS) {
+            threads = MAX_THREADS;
+        } else {
+            threads = cpus;
+        }
+    }
+
+    return threads;
+}
+
+/**
+ * Start worker threads if they are not running yet, lock must be held.
+ * @param background true to start idle priority workers
+ * @return number of worker threads
+ */
+static size_t start_workers(bool background)
+{
+    struct workers* workers = background ? &ctx.background : &ctx.normal;
+    const size_t num = cpu_threads() - 1;
+
+    if (workers->threads || num == 0 || ctx.stop) {
+        return workers->num;
+    }
+
+    workers->threads = calloc(1, num * sizeof(*workers->threads));
+    if (!workers->threads) {
+        return 0;
+    }
+    for (size_t i = 0; i < num; ++i) {
+        // thread index 0 is reserved for the caller
+        const size_t thread = i + 1 + (background ? MAX_THREADS : 0);
+        if (pthread_create(&workers->threads[i], NULL, worker_thread,
+                           (void*)thread)) {
+            break;
+        }
+        ++workers->num;
+    }
+
+    return workers->num;
+}
+
+/**
+ * Stop worker threads.
+ * @param workers set of workers to stop
+ */
+static void stop_workers(struct workers* workers)
+{
+    for (size_t i = 0; i < workers->num; ++i) {
+        pthread_join(workers->threads[i], NULL);
+    }
+    free(workers->threads);
+    workers->threads = NULL;
+    workers->num = 0;
+}
+
+bool tpool_affinity(const char* cpus)
+{
+#ifdef __linux__
+    struct str_slice ranges[MAX_CPU_RANGES];
+    size_t num;
+
+    CPU_ZERO(&ctx.bkg_cpus);
+
+    num = str_split(cpus, ',', ranges, ARRAY_SIZE(ranges));
+    if (num == 0 || num > ARRAY_SIZE(ranges)) {
+        return false;
+    }
+    for (size_t i = 0; i < num; ++i) {
+        struct str_slice bounds[2];
+        ssize_t first, last;
+        const size_t len = ranges[i].len;
+        char range[32];
+
+        if (len == 0 || len >= sizeof(range)) {
+            return false;
+        }
+        memcpy(range, ranges[i].value, len);
+        range[len] = 0;
+
+        switch (str_split(range, '-', bounds, 2)) {
+            case 1:
+                if (!str_to_num(bounds[0].value, bounds[0].len, &first, 0)) {
+                    return false;
+                }
+                last = first;
+                break;
+            case 2:
+                if (!str_to_num(bounds[0].value, bounds[0].len, &first, 0) ||
+                    !str_to_num(bounds[1].value, bounds[1].len, &last, 0)) {
+                    return false;
+                }
+                break;
+            default:
+                return false;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (ssize_t cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &ctx.bkg_cpus);
+        }
+    }
+
+    ctx.bkg_affinity = true;
+    return true;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+void tpool_set_qos(enum tpool_qos qos)
+{
+    pthread_once(&qos_once, create_qos_key);
+    pthread_setspecific(ctx.qos_key, (void*)(size_t)(qos + 1));
+    apply_qos(qos);
+}
+
+enum tpool_qos tpool_get_qos(void)
+{
+    size_t qos;
+
+    pthread_once(&qos_once, create_qos_key);
+    qos = (size_t)pthread_getspecific(ctx.qos_key);
+
+    return qos ? qos - 1 : tpool_interactive;
+}
+
+size_t tpool_threads(void)
+{
+    const size_t threads = cpu_threads();
+    const size_t limit = __atomic_load_n(&ctx.limit, __ATOMIC_RELAXED);
+    return limit && limit < threads ? limit : threads;
+}
+
+void tpool_limit(size_t num)
+{
+    __atomic_store_n(&ctx.limit, num, __ATOMIC_RELAXED);
+}
+
+void tpool_run(tpool_fn fn, void* data, size_t num)
+{
+    struct tpool_job job = {
+        .fn = fn, .data = data, .num = num, .qos = tpool_get_qos()
+    };
+    uint64_t wait;
+    size_t index;
+
+    pthread_mutex_lock(&ctx.lock);
+
+    if (num < 2 || !start_workers(job.qos == tpool_background)) {
+        // nothing to parallelize
+        pthread_mutex_unlock(&ctx.lock);
+        for (index = 0; index < num; ++index) {
+            fn(data, index, 0);
+        }
+        return;
+    }
+
+    ctx.jobs[job.qos] = list_append(ctx.jobs[job.qos], &job);
+    pthread_cond_broadcast(&ctx.wakeup);
+
+    // execute tasks in the current thread, the rest are taken by workers
+    while (claim_task(&job, &index)) {
+        const uint64_t start = trace_begin();
+        pthread_mutex_unlock(&ctx.lock);
+        fn(data, index, 0);
+        trace_end("Task", start);
+        pthread_mutex_lock(&ctx.lock);
+        complete_task(&job);
+    }
+
+    // wait for tasks executed by workers
+    wait = trace_begin();
+    while (job.done != job.num) {
+        pthread_cond_wait(&ctx.complete, &ctx.lock);
+    }
+    trace_end("Pool wait", wait);
+
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+/** Thread pool task: handle single band of rows, see tpool_fn. */
+static void rows_task(void* data, size_t index,
+                      __attribute__((unused)) size_t thread)
+{
+    struct rows_job* job = data;
+    const size_t start = job->height * index / job->bands;
+    const size_t end = job->height * (index + 1) / job->bands;
+
+    job->rc[index] = job->fn(job->data, start, end);
+}
+
+bool tpool_rows(tpool_rows_fn fn, void* data, size_t height, size_t width)
+{
+    struct rows_job job = { .fn = fn, .data = data, .height = height };
+    const size_t threads = tpool_threads();
+
+    if (threads == 1 || height < 2 || width * height < ROWS_MIN_PIXELS) {
+        return fn(data, 0, height);
+    }
+
+    job.bands = threads * ROWS_BANDS;
+    if (job.bands > height) {
+        job.bands = height;
+    }
+    tpool_run(rows_task, &job, job.bands);
+
+    for (size_t i = 0; i < job.bands; ++i) {
+        if (!job.rc[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void tpool_destroy(void)
+{
+    pthread_mutex_lock(&ctx.lock);
+    ctx.stop = true;
+    pthread_cond_broadcast(&ctx.wakeup);
+    pthread_mutex_unlock(&ctx.lock);
+
+    stop_workers(&ctx.normal);
+    stop_workers(&ctx.background);
+
+    // workers will be started again on the next run
+    pthread_mutex_lock(&ctx.lock);
+    ctx.stop = false;
+    pthread_mutex_unlock(&ctx.lock);
+}
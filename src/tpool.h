@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: MIT
+// Thread pool: worker threads for parallel tasks.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Work classes (QoS): priority of threads and admission to the pool. */
+enum tpool_qos {
+    tpool_interactive, ///< Rendering and loading the current image
+    tpool_user,        ///< Work visible to the user, e.g. gallery thumbnails
+    tpool_background,  ///< Speculative work: preloading, indexing
+};
+
+/**
+ * Parallel task handler.
+ * @param data user defined data passed to tpool_run
+ * @param index index of the task, [0, num)
+ * @param thread index of the thread executing the task, [0, tpool_threads)
+ */
+typedef void (*tpool_fn)(void* data, size_t index, size_t thread);
+
+/**
+ * Row band handler.
+ * @param data user defined data passed to tpool_rows
+ * @param start index of the first row in the band
+ * @param end index of the row after the last one in the band
+ * @return false on errors
+ */
+typedef bool (*tpool_rows_fn)(void* data, size_t start, size_t end);
+
+/**
+ * Set CPU affinity of background threads.
+ * Must be called before any background thread is started.
+ * @param cpus list of CPU numbers and ranges, e.g. "0-3,6"
+ * @return false if list has invalid format or affinity is not supported
+ */
+bool tpool_affinity(const char* cpus);
+
+/**
+ * Set work class of the calling thread, applied to the thread priority,
+ * CPU affinity and tasks started by the thread.
+ * The class can only be lowered as unprivileged process can't raise the
+ * priority back, so it should be set once at the thread start.
+ * @param qos work class
+ */
+void tpool_set_qos(enum tpool_qos qos);
+
+/**
+ * Get work class of the calling thread.
+ * @return work class, interactive by default
+ */
+enum tpool_qos tpool_get_qos(void);
+
+/**
+ * Get number of threads available for parallel tasks.
+ * The budget includes the calling thread and is never less than 1.
+ * @return number of worker threads
+ */
+size_t tpool_threads(void);
+
+/**
+ * Limit number of threads used for parallel tasks, e.g. for benchmarking.
+ * Must not be called while any tasks are executed.
+ * @param num max number of threads including the calling one, 0 to reset
+ */
+void tpool_limit(size_t num);
+
+/**
+ * Execute set of tasks in parallel and wait for completion.
+ * The calling thread participates in the execution with thread index 0.
+ * Background tasks are executed by idle priority workers, user tasks can
+ * occupy only half of the normal workers and are started after interactive
+ * ones.
+ * @param fn task handler
+ * @param data user defined data passed to the handler
+ * @param num total number of tasks
+ */
+void tpool_run(tpool_fn fn, void* data, size_t num);
+
+/**
+ * Process image rows, large images are split into bands of rows that are
+ * handled in parallel.
+ * @param fn row band handler
+ * @param data user defined data passed to the handler
+ * @param height total number of rows
+ * @param width number of pixels in a row, used to estimate the cost
+ * @return false if any of the handlers failed
+ */
+bool tpool_rows(tpool_rows_fn fn, void* data, size_t height, size_t width);
+
+/**
+ * Stop worker threads.
+ */
+void tpool_destroy(void);
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: MIT
+// Timeline trace: per-thread event recording in Chrome trace-event format.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "trace.h"
+
+#include "memdata.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Max number of events kept per thread, older events are overwritten
+#define RING_SIZE 32768
+
+/** Traced operation. */
+struct trace_event {
+    const char* name; ///< Operation name
+    uint64_t start;   ///< Start timestamp in nanoseconds
+    uint64_t end;     ///< End timestamp in nanoseconds
+};
+
+/** Per thread ring buffer of events. */
+struct trace_buffer {
+    struct trace_buffer* next;            ///< Next buffer in the list
+    const char* name;                     ///< Thread name
+    size_t tid;                           ///< Thread id in the trace
+    size_t head;                          ///< Total number of events
+    struct trace_event events[RING_SIZE]; ///< Ring buffer
+};
+
+/** Trace context. */
+struct trace {
+    char* path;                   ///< Output file, NULL if tracing disabled
+    uint64_t origin;              ///< Timestamp of the trace start
+    pthread_key_t key;            ///< Thread specific buffer
+    pthread_mutex_t lock;         ///< Buffer list lock
+    struct trace_buffer* buffers; ///< List of all thread buffers
+    size_t threads;               ///< Number of traced threads
+};
+
+static struct trace ctx;
+
+/**
+ * Get current monotonic time.
+ * @return timestamp in nanoseconds
+ */
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get ring buffer of the current thread, create it on first use.
+ * @return pointer to the buffer or NULL on errors
+ */
+static struct trace_buffer* thread_buffer(void)
+{
+    struct trace_buffer* buf = pthread_getspecific(ctx.key);
+
+    if (!buf) {
+        buf = calloc(1, sizeof(*buf));
+        if (!buf) {
+            return NULL;
+        }
+        pthread_mutex_lock(&ctx.lock);
+        buf->tid = ++ctx.threads;
+        buf->next = ctx.buffers;
+        ctx.buffers = buf;
+        pthread_mutex_unlock(&ctx.lock);
+        pthread_setspecific(ctx.key, buf);
+    }
+
+    return buf;
+}
+
+/**
+ * Write events of single thread.
+ * @param file output file
+ * @param buf thread buffer
+ * @param first pointer to the flag of the first record in the file
+ */
+static void write_buffer(FILE* file, const struct trace_buffer* buf,
+                         bool* first)
+{
+    const size_t head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+    const size_t tail = head > RING_SIZE ? head - RING_SIZE : 0;
+    const pid_t pid = getpid();
+
+    if (buf->name) {
+        fprintf(file,
+                "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                *first ? "" : ",", pid, buf->tid, buf->name);
+        *first = false;
+    }
+
+    for (size_t i = tail; i < head; ++i) {
+        const struct trace_event* ev = &buf->events[i % RING_SIZE];
+        const double ts = ev->start > ctx.origin ? ev->start - ctx.origin : 0;
+        fprintf(file,
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%zu,"
+                "\"ts\":%.3f,\"dur\":%.3f}",
+                *first ? "" : ",", ev->name, pid, buf->tid, ts / 1000,
+                (double)(ev->end - ev->start) / 1000);
+        *first = false;
+    }
+}
+
+void trace_init(const char* path)
+{
+    if (ctx.path) {
+        return; // already enabled
+    }
+    if (pthread_key_create(&ctx.key, NULL) != 0) {
+        return;
+    }
+    pthread_mutex_init(&ctx.lock, NULL);
+    ctx.origin = now();
+    ctx.path = str_dup(path, NULL);
+    if (ctx.path) {
+        trace_thread("main");
+    }
+}
+
+void trace_destroy(void)
+{
+    struct trace_buffer* buf;
+    bool first = true;
+    FILE* file;
+
+    if (!ctx.path) {
+        return;
+    }
+
+    file = fopen(ctx.path, "w");
+    if (file) {
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+        for (buf = ctx.buffers; buf; buf = buf->next) {
+            write_buffer(file, buf, &first);
+        }
+        fputs("\n]}\n", file);
+        fclose(file);
+    } else {
+        fprintf(stderr, "Unable to write trace file %s: %s\n", ctx.path,
+                strerror(errno));
+    }
+
+    while (ctx.buffers) {
+        buf = ctx.buffers;
+        ctx.buffers = buf->next;
+        free(buf);
+    }
+    pthread_key_delete(ctx.key);
+    pthread_mutex_destroy(&ctx.lock);
+    free(ctx.path);
+    ctx.path = NULL;
+}
+
+void trace_thread(const char* name)
+{
+    if (ctx.path) {
+        struct trace_buffer* buf = thread_buffer();
+        if (buf) {
+            buf->name = name;
+        }
+    }
+}
+
+uint64_t trace_begin(void)
+{
+    return ctx.path ? now() : 0;
+}
+
+void trace_end(const char* name, uint64_t start)
+{
+    if (start) {
+        trace_span(name, start, now());
+    }
+}
+
+void trace_span(const char* name, uint64_t start, uint64_t end)
+{
+    struct trace_buffer* buf;
+    struct trace_event* ev;
+
+    if (!ctx.path) {
+        return;
+    }
+    buf = thread_buffer();
+    if (!buf) {
+        return;
+    }
+
+    // the buffer has only one writer: the owner thread
+    ev = &buf->events[buf->head % RING_SIZE];
+    ev->name = name;
+    ev->start = start;
+    ev->end = end;
+    __atomic_store_n(&buf->head, buf->head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: MIT
+// Timeline trace: per-thread event recording in Chrome trace-event format.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Enable tracing, must be called before any threads are created.
+ * @param path path to the output file
+ */
+void trace_init(const char* path);
+
+/**
+ * Write recorded events to the output file and stop tracing.
+ * All traced threads must be stopped at this point.
+ */
+void trace_destroy(void);
+
+/**
+ * Set name of the current thread displayed in trace viewer.
+ * @param name thread name, must be a static string
+ */
+void trace_thread(const char* name);
+
+/**
+ * Get start point of the traced operation.
+ * @return timestamp in nanoseconds or 0 if tracing is disabled
+ */
+uint64_t trace_begin(void);
+
+/**
+ * Record traced operation that is started by `trace_begin`.
+ * @param name operation name, must be a static string
+ * @param start start point returned by `trace_begin`
+ */
+void trace_end(const char* name, uint64_t start);
+
+/**
+ * Record traced operation with known start and end time.
+ * @param name operation name, must be a static string
+ * @param start,end monotonic timestamps of the operation in nanoseconds
+ */
+void trace_span(const char* name, uint64_t start, uint64_t end);
@@ -7,6 +7,8 @@
 #include "application.h"
 #include "buildcfg.h"
 #include "config.h"
+#include "headless.h"
+#include "perf.h"
 #include "xdg-shell-protocol.h"
 
 #include <errno.h>
@@ -35,9 +37,6 @@
 #define BTN_EXTRA  0x114
 #endif
 
-// Uncomment the following line to enable printing draw time
-// #define TRACE_DRAW_TIME
-
 /** UI context */
 struct ui {
     // wayland specific
@@ -68,9 +67,7 @@ struct ui {
         size_t width;
         size_t height;
         int32_t scale;
-#ifdef TRACE_DRAW_TIME
-        struct timespec draw_time;
-#endif
+        uint64_t draw_start;
     } wnd;
 
     // cross-desktop
@@ -219,6 +216,8 @@ static bool recreate_buffers(void)
 
     ctx.wnd.pm.width = ctx.wnd.width;
     ctx.wnd.pm.height = ctx.wnd.height;
+    perf_mem_set(perf_mem_window,
+                 2 * ctx.wnd.width * ctx.wnd.height * sizeof(argb_t));
 
     ctx.wnd.current = ctx.wnd.buffer0;
 
@@ -631,6 +630,10 @@ static void on_wayland_event(__attribute__((unused)) void* data)
 
 bool ui_init(const char* app_id, size_t width, size_t height)
 {
+    if (headless_enabled()) {
+        return headless_init(width, height);
+    }
+
     ctx.wnd.width = width;
     ctx.wnd.height = height;
     if (ctx.wnd.width < WINDOW_MIN || ctx.wnd.height < WINDOW_MIN ||
@@ -688,6 +691,11 @@ bool ui_init(const char* app_id, size_t width, size_t height)
 
 void ui_destroy(void)
 {
+    if (headless_enabled()) {
+        headless_destroy();
+        return;
+    }
+
     if (ctx.repeat.fd != -1) {
         close(ctx.repeat.fd);
     }
@@ -742,6 +750,10 @@ void ui_destroy(void)
 
 void ui_event_prepare(void)
 {
+    if (headless_enabled()) {
+        return;
+    }
+
     ctx.event_handled = false;
 
     while (wl_display_prepare_read(ctx.wl.display) != 0) {
@@ -753,13 +765,16 @@ void ui_event_prepare(void)
 
 void ui_event_done(void)
 {
-    if (!ctx.event_handled) {
+    if (!headless_enabled() && !ctx.event_handled) {
         wl_display_cancel_read(ctx.wl.display);
     }
 }
 
 struct pixmap* ui_draw_begin(void)
 {
+    if (headless_enabled()) {
+        return headless_draw_begin();
+    }
     if (!ctx.wnd.current) {
         return NULL; // not yet initialized
     }
@@ -773,27 +788,31 @@ struct pixmap* ui_draw_begin(void)
 
     ctx.wnd.pm.data = wl_buffer_get_user_data(ctx.wnd.current);
 
-#ifdef TRACE_DRAW_TIME
-    clock_gettime(CLOCK_MONOTONIC, &ctx.wnd.draw_time);
-#endif
+    ctx.wnd.draw_start = perf_start();
 
     return &ctx.wnd.pm;
 }
 
 void ui_draw_commit(void)
 {
-#ifdef TRACE_DRAW_TIME
-    struct timespec curr;
-    clock_gettime(CLOCK_MONOTONIC, &curr);
-    const double ns = (curr.tv_sec * 1000000000 + curr.tv_nsec) -
-        (ctx.wnd.draw_time.tv_sec * 1000000000 + ctx.wnd.draw_time.tv_nsec);
-    printf("Rendered in %.6f sec\n", ns / 1000000000);
-#endif
+    uint64_t start;
+
+    if (headless_enabled()) {
+        headless_draw_commit();
+        return;
+    }
+
+    start = perf_start();
+    perf_stop(perf_redraw, ctx.wnd.draw_start);
 
     wl_surface_attach(ctx.wl.surface, ctx.wnd.current, 0, 0);
     wl_surface_damage(ctx.wl.surface, 0, 0, ctx.wnd.width, ctx.wnd.height);
     wl_surface_set_buffer_scale(ctx.wl.surface, ctx.wnd.scale);
     wl_surface_commit(ctx.wl.surface);
+    // commit can be done outside the main loop (e.g. progressive preview)
+    wl_display_flush(ctx.wl.display);
+
+    perf_stop(perf_commit, start);
 }
 
 void ui_set_title(const char* name)
@@ -804,19 +823,21 @@ void ui_set_title(const char* name)
     str_append(name, 0, &title);
 
     if (title) {
-        xdg_toplevel_set_title(ctx.xdg.toplevel, title);
+        if (ctx.xdg.toplevel) {
+            xdg_toplevel_set_title(ctx.xdg.toplevel, title);
+        }
         free(title);
     }
 }
 
 size_t ui_get_width(void)
 {
-    return ctx.wnd.width;
+    return headless_enabled() ? headless_get_width() : ctx.wnd.width;
 }
 
 size_t ui_get_height(void)
 {
-    return ctx.wnd.height;
+    return headless_enabled() ? headless_get_height() : ctx.wnd.height;
 }
 
 size_t ui_get_scale(void)
@@ -7,10 +7,12 @@
 #include "application.h"
 #include "buildcfg.h"
 #include "fetcher.h"
+#include "gallery.h"
 #include "imagelist.h"
 #include "info.h"
 #include "keybind.h"
 #include "loader.h"
+#include "thumbdb.h"
 #include "ui.h"
 
 #include <stdio.h>
@@ -36,6 +38,8 @@
 #define CFG_SLIDESHOW_TIME_DEF 3
 #define CFG_HISTORY_DEF        1
 #define CFG_PRELOAD_DEF        1
+#define CFG_PREFETCH_DEF       4
+#define CFG_SCRUB_DEF          200
 
 // Scale thresholds
 #define MIN_SCALE 10    // pixels
@@ -80,6 +84,17 @@ struct viewer {
     bool slideshow_enable; ///< Slideshow enable/disable
     int slideshow_fd;      ///< Slideshow timer
     size_t slideshow_time; ///< Slideshow image display time (seconds)
+
+    bool scrubbing;     ///< Fast navigation: images are not decoded
+    bool scrub_forward; ///< Fast navigation direction
+    size_t scrub_delay; ///< Time to start loading after navigation (ms)
+    int scrub_fd;       ///< Fast navigation timer
+
+    bool loading;              ///< Next image is being loaded in background
+    struct image* placeholder; ///< Thumbnail shown while image is loading
+    size_t placeholder_w;      ///< Width of the original image
+    size_t placeholder_h;      ///< Height of the original image
+    size_t reloading;          ///< Image being reloaded
 };
 
 /** Global viewer context. */
@@ -305,8 +320,8 @@ static void animation_ctl(bool enable)
 
     if (enable) {
         const struct image* img = fetcher_current();
-        const size_t duration = img->frames[ctx.frame].duration;
-        enable = (img->num_frames > 1 && duration);
+        const size_t duration = img ? img->frames[ctx.frame].duration : 0;
+        enable = (duration && img->num_frames > 1);
         if (enable) {
             ts.it_value.tv_sec = duration / 1000;
             ts.it_value.tv_nsec = (duration % 1000) * 1000000;
@@ -333,12 +348,111 @@ static void slideshow_ctl(bool enable)
     timerfd_settime(ctx.slideshow_fd, 0, &ts, NULL);
 }
 
+/**
+ * Get index of the image being displayed or loaded.
+ * @return index of the image in the image list
+ */
+static size_t current_index(void)
+{
+    const size_t pending = fetcher_pending();
+    return pending != IMGLIST_INVALID ? pending : fetcher_current()->index;
+}
+
+/**
+ * Update window title and info for the image being loaded.
+ */
+static void loading_info(void)
+{
+    const size_t index = fetcher_pending();
+    const char* source = image_list_get(index);
+    const char* name;
+
+    if (!source) {
+        return;
+    }
+    name = strrchr(source, '/');
+    name = name ? name + 1 : source;
+
+    ui_set_title(name);
+    info_update(info_file_name, "%s", name);
+    info_update(info_file_path, "%s", source);
+    info_update(info_index, "%zu of %zu", index + 1, image_list_size());
+    if (ctx.scrubbing) {
+        info_update(info_status, "%zu of %zu: %s", index + 1,
+                    image_list_size(), name);
+    } else {
+        info_update(info_status, "Loading...");
+    }
+}
+
+/**
+ * Start displaying the image being loaded: gallery or stored thumbnail is
+ * used as a placeholder, otherwise the previous image stays with loading
+ * status.
+ */
+static void start_loading(void)
+{
+    const size_t index = fetcher_pending();
+    const struct image* current = fetcher_current();
+    const char* source = image_list_get(index);
+
+    image_free(ctx.placeholder);
+    ctx.placeholder = NULL;
+    if (source && !(current && current->index == index)) {
+        ctx.placeholder = gallery_thumbnail(index, &ctx.placeholder_w,
+                                            &ctx.placeholder_h);
+        if (!ctx.placeholder) {
+            ctx.placeholder =
+                thumbdb_load(source, &ctx.placeholder_w, &ctx.placeholder_h);
+        }
+    }
+    ctx.loading = true;
+    loader_set_preview(index);
+
+    loading_info();
+    app_redraw();
+}
+
+/**
+ * Start/stop fast navigation timer.
+ * @param enable state to set
+ */
+static void scrub_ctl(bool enable)
+{
+    struct itimerspec ts = { 0 };
+
+    ctx.scrubbing = enable;
+    if (enable) {
+        ts.it_value.tv_sec = ctx.scrub_delay / 1000;
+        ts.it_value.tv_nsec = (ctx.scrub_delay % 1000) * 1000000;
+    }
+
+    timerfd_settime(ctx.scrub_fd, 0, &ts, NULL);
+}
+
+/**
+ * Stop displaying the image being loaded.
+ */
+static void stop_loading(void)
+{
+    if (ctx.scrubbing) {
+        scrub_ctl(false);
+    }
+    if (ctx.loading) {
+        ctx.loading = false;
+        loader_set_preview(IMGLIST_INVALID);
+        image_free(ctx.placeholder);
+        ctx.placeholder = NULL;
+        info_update(info_status, NULL);
+    }
+}
+
 /**
  * Reset state to defaults.
  */
 static void reset_state(void)
 {
-    const struct image* img = fetcher_current();
+    struct image* img = fetcher_current();
     const size_t total_img = image_list_size();
 
     ctx.frame = 0;
@@ -356,70 +470,170 @@ static void reset_state(void)
     if (total_img) {
         info_update(info_index, "%zu of %zu", img->index + 1, total_img);
     }
+    if (ctx.loading) {
+        loading_info();
+    }
 
     app_redraw();
 }
 
+/**
+ * Open image: switch to it if it is cached, otherwise start loading it in
+ * background.
+ * @param index index of the image to open
+ * @param forward direction to look for the next image if loading fails
+ */
+static void open_image(size_t index, bool forward)
+{
+    ctx.reloading = IMGLIST_INVALID;
+    if (ctx.scrubbing) {
+        scrub_ctl(false);
+    }
+    if (fetcher_open(index, forward)) {
+        stop_loading();
+        reset_state();
+    } else {
+        start_loading();
+    }
+}
+
+/**
+ * Move to the image without decoding it (fast navigation), the image is
+ * loaded when navigation stops.
+ * @param index index of the image to move to
+ * @param forward navigation direction
+ */
+static void scrub_image(size_t index, bool forward)
+{
+    ctx.reloading = IMGLIST_INVALID;
+    fetcher_seek(index);
+    ctx.scrub_forward = forward;
+
+    if (fetcher_pending() == IMGLIST_INVALID) {
+        // back to the current image
+        stop_loading();
+        reset_state();
+        scrub_ctl(true);
+    } else {
+        scrub_ctl(true);
+        start_loading();
+    }
+}
+
+/**
+ * Background load handler.
+ * @param image loaded image instance, NULL if load error
+ * @param index index of the image in the image list
+ */
+static void on_load(struct image* image, size_t index)
+{
+    const size_t pending = fetcher_pending();
+    const bool opened = fetcher_attach(image, index);
+
+    if (fetcher_pending() != IMGLIST_INVALID) {
+        if (fetcher_pending() != pending) {
+            start_loading(); // pending image failed, loading the next one
+        }
+    } else if (!fetcher_current()) {
+        printf("No more images to view, exit\n");
+        app_exit(0);
+    } else if (opened || pending != IMGLIST_INVALID) {
+        stop_loading();
+        reset_state();
+        if (ctx.reloading != IMGLIST_INVALID) {
+            if (ctx.reloading == fetcher_current()->index) {
+                info_update(info_status, "Image reloaded");
+            } else {
+                info_update(info_status, "Unable to update, open next file");
+            }
+            ctx.reloading = IMGLIST_INVALID;
+        }
+    }
+}
+
+/**
+ * Progressive decoding handler: preview replaces the placeholder.
+ * @param image preview of the image being loaded
+ * @param index index of the image in the image list
+ */
+static void on_preview(struct image* image, size_t index)
+{
+    if (ctx.loading && index == fetcher_pending()) {
+        image_free(ctx.placeholder);
+        ctx.placeholder = image;
+        ctx.placeholder_w = image->frames[0].pm.width;
+        ctx.placeholder_h = image->frames[0].pm.height;
+        app_redraw();
+    } else {
+        image_free(image);
+    }
+}
+
 /**
  * Skip current image.
- * @return true if next image was loaded
+ * @return true if next image was opened or is being loaded
  */
 static bool skip_image(void)
 {
-    size_t index;
-    const size_t current = fetcher_current()->index;
+    const size_t index = image_list_skip(current_index());
 
-    index = image_list_skip(current);
-    while (index != IMGLIST_INVALID && !fetcher_open(index)) {
-        index = image_list_skip(index);
+    if (index == IMGLIST_INVALID) {
+        return false;
     }
 
-    return (index != IMGLIST_INVALID);
+    open_image(index, true);
+
+    return true;
 }
 
 /**
  * Switch to the next image.
  * @param direction next image position
- * @return true if next image was loaded
+ * @return true if next image was opened or is being loaded
  */
 static bool next_image(enum action_type direction)
 {
-    size_t index = fetcher_current()->index;
+    size_t index = current_index();
+    bool forward = true;
 
-    do {
-        switch (direction) {
-            case action_first_file:
-                index = image_list_first();
-                // look forward in case the first file fails to load
-                direction = action_next_file;
-                break;
-            case action_last_file:
-                index = image_list_last();
-                // look backward in case the last file fails to load
-                direction = action_prev_file;
-                break;
-            case action_prev_dir:
-                index = image_list_prev_dir(index);
-                break;
-            case action_next_dir:
-                index = image_list_next_dir(index);
-                break;
-            case action_prev_file:
-                index = image_list_prev_file(index);
-                break;
-            case action_next_file:
-                index = image_list_next_file(index);
-                break;
-            default:
-                break;
-        }
-    } while (index != IMGLIST_INVALID && !fetcher_open(index));
+    switch (direction) {
+        case action_first_file:
+            // look forward in case the first file fails to load
+            index = image_list_first();
+            break;
+        case action_last_file:
+            // look backward in case the last file fails to load
+            index = image_list_last();
+            forward = false;
+            break;
+        case action_prev_dir:
+            index = image_list_prev_dir(index);
+            forward = false;
+            break;
+        case action_next_dir:
+            index = image_list_next_dir(index);
+            break;
+        case action_prev_file:
+            index = image_list_prev_file(index);
+            forward = false;
+            break;
+        case action_next_file:
+            index = image_list_next_file(index);
+            break;
+        default:
+            break;
+    }
 
     if (index == IMGLIST_INVALID) {
         return false;
     }
 
-    reset_state();
+    if (ctx.loading && ctx.scrub_delay) {
+        // navigation is faster than decoding, skip intermediate images
+        scrub_image(index, forward);
+    } else {
+        open_image(index, forward);
+    }
 
     return true;
 }
@@ -456,8 +670,10 @@ static void next_frame(bool forward)
  */
 static void on_animation_timer(__attribute__((unused)) void* data)
 {
-    next_frame(true);
-    animation_ctl(true);
+    if (fetcher_current()) {
+        next_frame(true);
+        animation_ctl(true);
+    }
 }
 
 /**
@@ -465,7 +681,19 @@ static void on_animation_timer(__attribute__((unused)) void* data)
  */
 static void on_slideshow_timer(__attribute__((unused)) void* data)
 {
-    slideshow_ctl(next_image(action_next_file));
+    // don't switch until the current image is shown
+    slideshow_ctl(ctx.loading || next_image(action_next_file));
+}
+
+/**
+ * Fast navigation timer event handler.
+ */
+static void on_scrub_timer(__attribute__((unused)) void* data)
+{
+    if (ctx.scrubbing) {
+        // navigation stopped, load the image at the final position
+        open_image(current_index(), ctx.scrub_forward);
+    }
 }
 
 /**
@@ -474,8 +702,11 @@ static void on_slideshow_timer(__attribute__((unused)) void* data)
  */
 static void draw_image(struct pixmap* wnd)
 {
-    const struct image* img = fetcher_current();
-    const struct pixmap* img_pm = &img->frames[ctx.frame].pm;
+    struct image* img = fetcher_current();
+    // frames of lazy loaded animation are decoded in background, the
+    // previous frame is drawn until the current one is ready
+    const size_t frame = image_show_frame(img, ctx.frame, app_redraw);
+    const struct pixmap* img_pm = &img->frames[frame].pm;
     const size_t width = ctx.scale * img_pm->width;
     const size_t height = ctx.scale * img_pm->height;
 
@@ -510,25 +741,57 @@ static void draw_image(struct pixmap* wnd)
 }
 
 /**
- * Reload image file and reset state (position, scale, etc).
+ * Reset cache and start loading the image in background, the state
+ * (position, scale, etc) is reset when the load completes.
+ * @param index index of the image to load
  */
-static void reload(void)
+static void reset_image(size_t index)
 {
-    const size_t index = fetcher_current()->index;
-
-    if (fetcher_reset(index, false)) {
-        if (index == fetcher_current()->index) {
-            info_update(info_status, "Image reloaded");
-        } else {
-            info_update(info_status, "Unable to update, open next file");
-        }
-        reset_state();
-    } else {
+    stop_loading();
+    fetcher_reset(index);
+    if (fetcher_pending() == IMGLIST_INVALID) {
         printf("No more images to view, exit\n");
         app_exit(0);
+    } else {
+        start_loading();
     }
 }
 
+/**
+ * Reload image file.
+ */
+static void reload(void)
+{
+    const size_t index = current_index();
+    reset_image(index);
+    ctx.reloading = index;
+}
+
+/**
+ * Draw approximation of the image (preview or thumbnail) fitted to window.
+ * @param wnd pixel map of target window
+ * @param img image with approximation in the first frame
+ * @param width,height size of the original image
+ */
+static void draw_fitted(struct pixmap* wnd, const struct image* img,
+                        size_t width, size_t height)
+{
+    const struct pixmap* pm = &img->frames[0].pm;
+
+    // fit original size to window, but not more than 100%
+    const float scale_w = (float)wnd->width / width;
+    const float scale_h = (float)wnd->height / height;
+    const float fit = min(1.0, min(scale_w, scale_h));
+
+    // stretch approximation to the original size
+    const float scale = min(fit * width / pm->width, fit * height / pm->height);
+    const ssize_t x = (wnd->width - scale * pm->width) / 2;
+    const ssize_t y = (wnd->height - scale * pm->height) / 2;
+
+    pixmap_fill(wnd, 0, 0, wnd->width, wnd->height, ctx.window_bkg);
+    pixmap_scale(pixmap_nearest, pm, wnd, x, y, scale, img->alpha);
+}
+
 /**
  * Redraw handler.
  */
@@ -536,7 +799,16 @@ static void redraw(void)
 {
     struct pixmap* window = ui_draw_begin();
     if (window) {
-        draw_image(window);
+        if (ctx.placeholder) {
+            draw_fitted(window, ctx.placeholder, ctx.placeholder_w,
+                        ctx.placeholder_h);
+        } else if (!fetcher_current() || (ctx.loading && ctx.scrubbing)) {
+            // no thumbnail, only name and index of the image are shown
+            pixmap_fill(window, 0, 0, window->width, window->height,
+                        ctx.window_bkg);
+        } else {
+            draw_image(window);
+        }
         info_print(window);
         ui_draw_commit();
     }
@@ -547,8 +819,12 @@ static void redraw(void)
  */
 static void on_resize(void)
 {
-    fixup_position(false);
-    reset_state();
+    if (fetcher_current()) {
+        fixup_position(false);
+        reset_state();
+    } else {
+        app_redraw(); // image is not loaded yet
+    }
 }
 
 /**
@@ -557,6 +833,27 @@ static void on_resize(void)
  */
 static void apply_action(const struct action* action)
 {
+    if (!fetcher_current()) {
+        // image is not loaded yet, only navigation is available
+        switch (action->type) {
+            case action_prev_frame:
+            case action_next_frame:
+            case action_animation:
+            case action_step_left:
+            case action_step_right:
+            case action_step_up:
+            case action_step_down:
+            case action_zoom:
+            case action_rotate_left:
+            case action_rotate_right:
+            case action_flip_vertical:
+            case action_flip_horizontal:
+                return;
+            default:
+                break;
+        }
+    }
+
     switch (action->type) {
         case action_first_file:
         case action_last_file:
@@ -567,9 +864,7 @@ static void apply_action(const struct action* action)
             next_image(action->type);
             break;
         case action_skip_file:
-            if (skip_image()) {
-                reset_state();
-            } else {
+            if (!skip_image()) {
                 printf("No more images, exit\n");
                 app_exit(0);
             }
@@ -587,7 +882,8 @@ static void apply_action(const struct action* action)
                           next_image(action_next_file));
             break;
         case action_mode:
-            app_switch_mode(fetcher_current()->index);
+            stop_loading(); // previews are not used by gallery
+            app_switch_mode(current_index());
             break;
         case action_step_left:
             move_image(true, true, action->params);
@@ -628,7 +924,11 @@ static void apply_action(const struct action* action)
             reload();
             break;
         case action_exec:
-            app_execute(action->params, fetcher_current()->source);
+            if (ctx.loading) {
+                app_execute(action->params, image_list_get(current_index()));
+            } else {
+                app_execute(action->params, fetcher_current()->source);
+            }
             break;
         default:
             break;
@@ -644,6 +944,10 @@ static void on_drag(int dx, int dy)
     const ssize_t old_x = ctx.img_x;
     const ssize_t old_y = ctx.img_y;
 
+    if (!fetcher_current()) {
+        return; // image is not loaded yet
+    }
+
     ctx.img_x += dx;
     ctx.img_y += dy;
 
@@ -657,6 +961,7 @@ void viewer_init(struct config* cfg, struct image* image)
 {
     size_t history;
     size_t preload;
+    size_t prefetch;
     const char* value;
     ssize_t index;
 
@@ -692,6 +997,8 @@ void viewer_init(struct config* cfg, struct image* image)
                              CFG_HISTORY_DEF);
     preload = config_get_num(cfg, VIEWER_SECTION, VIEWER_PRELOAD, 0, 1024,
                              CFG_PRELOAD_DEF);
+    prefetch = config_get_num(cfg, VIEWER_SECTION, VIEWER_PREFETCH, 0, 1024,
+                              CFG_PREFETCH_DEF);
 
     // setup animation timer
     ctx.animation_enable = true;
@@ -713,11 +1020,23 @@ void viewer_init(struct config* cfg, struct image* image)
         app_watch(ctx.slideshow_fd, on_slideshow_timer, NULL);
     }
 
-    fetcher_init(image, history, preload);
+    // setup fast navigation timer
+    ctx.scrub_delay = config_get_num(cfg, VIEWER_SECTION, VIEWER_SCRUB, 0,
+                                     10000, CFG_SCRUB_DEF);
+    ctx.scrub_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ctx.scrub_fd != -1) {
+        app_watch(ctx.scrub_fd, on_scrub_timer, NULL);
+    } else {
+        ctx.scrub_delay = 0;
+    }
+
+    ctx.reloading = IMGLIST_INVALID;
+    fetcher_init(image, history, preload, prefetch);
 }
 
 void viewer_destroy(void)
 {
+    image_free(ctx.placeholder);
     fetcher_destroy();
 
     if (ctx.animation_fd != -1) {
@@ -726,6 +1045,9 @@ void viewer_destroy(void)
     if (ctx.slideshow_fd != -1) {
         close(ctx.slideshow_fd);
     }
+    if (ctx.scrub_fd != -1) {
+        close(ctx.scrub_fd);
+    }
 }
 
 void viewer_handle(const struct event* event)
@@ -744,14 +1066,17 @@ void viewer_handle(const struct event* event)
             on_drag(event->param.drag.dx, event->param.drag.dy);
             break;
         case event_activate:
-            if (fetcher_reset(event->param.activate.index, false)) {
-                reset_state();
-            } else {
-                app_exit(0);
-            }
+            ctx.reloading = IMGLIST_INVALID;
+            reset_image(event->param.activate.index);
+            break;
+        case event_open:
+            open_image(event->param.open.index, true);
             break;
         case event_load:
-            fetcher_attach(event->param.load.image, event->param.load.index);
+            on_load(event->param.load.image, event->param.load.index);
+            break;
+        case event_preview:
+            on_preview(event->param.load.image, event->param.load.index);
             break;
     }
 }
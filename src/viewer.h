@@ -19,6 +19,8 @@
 #define VIEWER_SLIDESHOW_TIME "slideshow_time"
 #define VIEWER_HISTORY        "history"
 #define VIEWER_PRELOAD        "preload"
+#define VIEWER_PREFETCH       "prefetch"
+#define VIEWER_SCRUB          "scrub"
 
 /**
  * Initialize global viewer context.
@@ -6,6 +6,10 @@ extern "C" {
 }
 
 #include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
 
 class Config : public ::testing::Test {
 protected:
@@ -51,6 +55,26 @@ TEST_F(Config, Load)
     EXPECT_STREQ(config_get(config, "test.section", "empty"), "");
 }
 
+TEST_F(Config, CachePath)
+{
+    char tmp[] = "/tmp/swayimg_test_XXXXXX";
+    ASSERT_NE(mkdtemp(tmp), nullptr);
+    const std::string dir = std::string(tmp) + "/sub/swayimg";
+    struct stat st;
+
+    setenv("XDG_CACHE_HOME", (std::string(tmp) + "/sub").c_str(), 1);
+    char* path = config_cache_path("file");
+    ASSERT_NE(path, nullptr);
+    EXPECT_EQ(dir + "/file", path);
+    EXPECT_EQ(stat(dir.c_str(), &st), 0);
+    EXPECT_TRUE(S_ISDIR(st.st_mode));
+    free(path);
+
+    rmdir(dir.c_str());
+    rmdir((std::string(tmp) + "/sub").c_str());
+    rmdir(tmp);
+}
+
 TEST_F(Config, GetString)
 {
     config_set(&config, "section", "key", "value");
@@ -0,0 +1,641 @@
+// SPDX-License-Identifier: MIT
+// Benchmark of image decoders.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "application.h"
+#include "buildcfg.h"
+#include "font.h"
+#include "loader.h"
+#include "memdata.h"
+#include "perf.h"
+#include "tpool.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+#ifdef HAVE_LIBPNG
+#include <png.h>
+#endif
+
+// Max number of image formats in the summary
+#define MAX_FORMATS 32
+
+/** Decoding statistics of a single image format. */
+struct bench_format {
+    char name[32]; ///< Format name
+    size_t files;  ///< Number of decoded files
+    double pixels; ///< Total number of decoded megapixels
+    double time;   ///< Total decoding time (ms)
+};
+
+/** Benchmark context. */
+struct bench {
+    size_t repeat;   ///< Number of repetitions for each file
+    size_t size;     ///< Thumbnail size to decode to, 0 for full size
+    char* generated; ///< Directory with generated files
+    size_t allocs;   ///< Number of allocations made by the application
+
+    struct bench_format formats[MAX_FORMATS]; ///< Per format statistics
+    size_t formats_num;                       ///< Number of formats
+};
+
+static struct bench ctx = { .repeat = 3 };
+
+// stubs for linker (application and font are not included to benchmark)
+void font_init(__attribute__((unused)) struct config* cfg) { }
+void font_destroy(void) { }
+void app_watch(__attribute__((unused)) int fd,
+               __attribute__((unused)) fd_callback cb,
+               __attribute__((unused)) void* data)
+{
+}
+void app_exit(__attribute__((unused)) int rc) { }
+void app_reload(void) { }
+bool app_is_viewer(void)
+{
+    return false;
+}
+void app_on_load(__attribute__((unused)) struct image* image,
+                 __attribute__((unused)) size_t index)
+{
+}
+void app_on_preview(__attribute__((unused)) struct image* image,
+                    __attribute__((unused)) size_t index)
+{
+}
+void app_on_resize(void) { }
+void app_on_keyboard(__attribute__((unused)) xkb_keysym_t key,
+                     __attribute__((unused)) uint8_t mods)
+{
+}
+void app_on_drag(__attribute__((unused)) int dx, __attribute__((unused)) int dy)
+{
+}
+
+// allocation counters, the linker redirects calls with --wrap option, so
+// only calls from the application code are counted, allocations made inside
+// the decoder libraries (libjpeg, libpng, etc) are not visible here
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t num, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&ctx.allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size)
+{
+    __atomic_add_fetch(&ctx.allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(num, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    __atomic_add_fetch(&ctx.allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * Get current monotonic time.
+ * @return timestamp in nanoseconds
+ */
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Get synthetic pixel color.
+ * @param x,y pixel coordinates
+ * @param width,height image size
+ * @return RGB color as 0x00RRGGBB
+ */
+static uint32_t synthetic(size_t x, size_t y, size_t width, size_t height)
+{
+    // gradient with some noise to make the image compressible but not trivial
+    const uint32_t r = x * 0xff / width;
+    const uint32_t g = y * 0xff / height;
+    const uint32_t b = ((x * 7) ^ (y * 13)) & 0xff;
+    return (r << 16) | (g << 8) | b;
+}
+
+/**
+ * Write synthetic image in BMP format.
+ * @param file output file
+ * @param width,height image size
+ * @return true if file was written
+ */
+static bool write_bmp(FILE* file, size_t width, size_t height)
+{
+    const size_t stride = width * 4;
+    const uint32_t hdr_size = 14 + 40;
+    const uint32_t file_size = hdr_size + stride * height;
+    uint8_t hdr[14 + 40] = { 'B', 'M' };
+    uint8_t* line;
+    bool rc = true;
+
+    // file header and BITMAPINFOHEADER, little endian
+    for (size_t i = 0; i < 4; ++i) {
+        hdr[2 + i] = file_size >> (i * 8);
+        hdr[10 + i] = hdr_size >> (i * 8);
+        hdr[18 + i] = width >> (i * 8);
+        hdr[22 + i] = height >> (i * 8);
+    }
+    hdr[14] = 40; // info header size
+    hdr[26] = 1;  // planes
+    hdr[28] = 32; // bpp
+    if (fwrite(hdr, sizeof(hdr), 1, file) != 1) {
+        return false;
+    }
+
+    line = malloc(stride);
+    if (!line) {
+        return false;
+    }
+    for (size_t y = height; rc && y > 0; --y) { // bottom-up
+        for (size_t x = 0; x < width; ++x) {
+            const uint32_t color = synthetic(x, y - 1, width, height);
+            line[x * 4 + 0] = color & 0xff;
+            line[x * 4 + 1] = (color >> 8) & 0xff;
+            line[x * 4 + 2] = (color >> 16) & 0xff;
+            line[x * 4 + 3] = 0;
+        }
+        rc = fwrite(line, stride, 1, file) == 1;
+    }
+    free(line);
+
+    return rc;
+}
+
+/**
+ * Write synthetic image in PNM (PPM) format.
+ * @param file output file
+ * @param width,height image size
+ * @return true if file was written
+ */
+static bool write_pnm(FILE* file, size_t width, size_t height)
+{
+    const size_t stride = width * 3;
+    uint8_t* line;
+    bool rc = true;
+
+    fprintf(file, "P6\n%zu %zu\n255\n", width, height);
+
+    line = malloc(stride);
+    if (!line) {
+        return false;
+    }
+    for (size_t y = 0; rc && y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const uint32_t color = synthetic(x, y, width, height);
+            line[x * 3 + 0] = (color >> 16) & 0xff;
+            line[x * 3 + 1] = (color >> 8) & 0xff;
+            line[x * 3 + 2] = color & 0xff;
+        }
+        rc = fwrite(line, stride, 1, file) == 1;
+    }
+    free(line);
+
+    return rc;
+}
+
+/**
+ * Write synthetic image in TGA format.
+ * @param file output file
+ * @param width,height image size
+ * @return true if file was written
+ */
+static bool write_tga(FILE* file, size_t width, size_t height)
+{
+    const size_t stride = width * 4;
+    uint8_t hdr[18] = { 0 };
+    uint8_t* line;
+    bool rc = true;
+
+    hdr[2] = 2; // uncompressed true-color
+    hdr[12] = width & 0xff;
+    hdr[13] = (width >> 8) & 0xff;
+    hdr[14] = height & 0xff;
+    hdr[15] = (height >> 8) & 0xff;
+    hdr[16] = 32;           // bpp
+    hdr[17] = 8 | (1 << 5); // alpha bits, top-left origin
+    if (fwrite(hdr, sizeof(hdr), 1, file) != 1) {
+        return false;
+    }
+
+    line = malloc(stride);
+    if (!line) {
+        return false;
+    }
+    for (size_t y = 0; rc && y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const uint32_t color = synthetic(x, y, width, height);
+            line[x * 4 + 0] = color & 0xff;
+            line[x * 4 + 1] = (color >> 8) & 0xff;
+            line[x * 4 + 2] = (color >> 16) & 0xff;
+            line[x * 4 + 3] = 0xff;
+        }
+        rc = fwrite(line, stride, 1, file) == 1;
+    }
+    free(line);
+
+    return rc;
+}
+
+#ifdef HAVE_LIBJPEG
+/**
+ * Write synthetic image in JPEG format.
+ * @param file output file
+ * @param width,height image size
+ * @return true if file was written
+ */
+static bool write_jpeg(FILE* file, size_t width, size_t height)
+{
+    struct jpeg_compress_struct jpg;
+    struct jpeg_error_mgr err;
+    uint8_t* line;
+
+    line = malloc(width * 3);
+    if (!line) {
+        return false;
+    }
+
+    jpg.err = jpeg_std_error(&err);
+    jpeg_create_compress(&jpg);
+    jpeg_stdio_dest(&jpg, file);
+    jpg.image_width = width;
+    jpg.image_height = height;
+    jpg.input_components = 3;
+    jpg.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&jpg);
+    jpeg_set_quality(&jpg, 90, TRUE);
+    jpeg_start_compress(&jpg, TRUE);
+    while (jpg.next_scanline < jpg.image_height) {
+        const size_t y = jpg.next_scanline;
+        for (size_t x = 0; x < width; ++x) {
+            const uint32_t color = synthetic(x, y, width, height);
+            line[x * 3 + 0] = (color >> 16) & 0xff;
+            line[x * 3 + 1] = (color >> 8) & 0xff;
+            line[x * 3 + 2] = color & 0xff;
+        }
+        jpeg_write_scanlines(&jpg, &line, 1);
+    }
+    jpeg_finish_compress(&jpg);
+    jpeg_destroy_compress(&jpg);
+    free(line);
+
+    return true;
+}
+#endif // HAVE_LIBJPEG
+
+#ifdef HAVE_LIBPNG
+/**
+ * Write synthetic image in PNG format.
+ * @param file output file
+ * @param width,height image size
+ * @return true if file was written
+ */
+static bool write_png(FILE* file, size_t width, size_t height)
+{
+    png_image png = {
+        .version = PNG_IMAGE_VERSION,
+        .width = width,
+        .height = height,
+        .format = PNG_FORMAT_RGB,
+    };
+    uint8_t* data;
+    bool rc;
+
+    data = malloc(width * height * 3);
+    if (!data) {
+        return false;
+    }
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            const uint32_t color = synthetic(x, y, width, height);
+            uint8_t* pixel = &data[(y * width + x) * 3];
+            pixel[0] = (color >> 16) & 0xff;
+            pixel[1] = (color >> 8) & 0xff;
+            pixel[2] = color & 0xff;
+        }
+    }
+    rc = png_image_write_to_stdio(&png, file, 0, data, 0, NULL);
+    free(data);
+
+    return rc;
+}
+#endif // HAVE_LIBPNG
+
+/**
+ * Generate synthetic images of all supported formats.
+ * @param width,height image size
+ * @return true if files were generated
+ */
+static bool generate(size_t width, size_t height)
+{
+    static const struct {
+        const char* ext;
+        bool (*write)(FILE*, size_t, size_t);
+    } writers[] = {
+        { "bmp", write_bmp },
+        { "pnm", write_pnm },
+        { "tga", write_tga },
+#ifdef HAVE_LIBJPEG
+        { "jpg", write_jpeg },
+#endif
+#ifdef HAVE_LIBPNG
+        { "png", write_png },
+#endif
+    };
+    char tmpl[] = "/tmp/swayimg_bench_XXXXXX";
+
+    if (width > 0xffff || height > 0xffff) {
+        fprintf(stderr, "Image is too large: %zux%zu\n", width, height);
+        return false;
+    }
+    if (!mkdtemp(tmpl)) {
+        perror("Unable to create temporary directory");
+        return false;
+    }
+    ctx.generated = str_dup(tmpl, NULL);
+
+    for (size_t i = 0; i < sizeof(writers) / sizeof(writers[0]); ++i) {
+        char path[PATH_MAX];
+        FILE* file;
+        bool rc;
+        snprintf(path, sizeof(path), "%s/%zux%zu.%s", tmpl, width, height,
+                 writers[i].ext);
+        file = fopen(path, "wb");
+        if (!file) {
+            perror(path);
+            return false;
+        }
+        rc = writers[i].write(file, width, height);
+        fclose(file);
+        if (!rc) {
+            fprintf(stderr, "Unable to write %s\n", path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Remove generated files.
+ */
+static void remove_generated(void)
+{
+    DIR* dir;
+
+    if (!ctx.generated) {
+        return;
+    }
+    dir = opendir(ctx.generated);
+    if (dir) {
+        struct dirent* de;
+        while ((de = readdir(dir))) {
+            char path[PATH_MAX];
+            if (de->d_name[0] != '.') {
+                snprintf(path, sizeof(path), "%s/%s", ctx.generated,
+                         de->d_name);
+                unlink(path);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(ctx.generated);
+    free(ctx.generated);
+    ctx.generated = NULL;
+}
+
+/**
+ * Register decoding time in the per format statistics.
+ * @param format image format name
+ * @param pixels number of decoded megapixels
+ * @param time decoding time (ms)
+ */
+static void add_stat(const char* format, double pixels, double time)
+{
+    struct bench_format* bf = NULL;
+
+    for (size_t i = 0; i < ctx.formats_num; ++i) {
+        if (strcmp(ctx.formats[i].name, format) == 0) {
+            bf = &ctx.formats[i];
+            break;
+        }
+    }
+    if (!bf) {
+        if (ctx.formats_num >= MAX_FORMATS) {
+            return;
+        }
+        bf = &ctx.formats[ctx.formats_num++];
+        snprintf(bf->name, sizeof(bf->name), "%s", format);
+    }
+
+    ++bf->files;
+    bf->pixels += pixels;
+    bf->time += time;
+}
+
+/**
+ * Decode file and print statistics.
+ * @param path path to the image file
+ */
+static void bench_file(const char* path)
+{
+    const char* name = strrchr(path, '/');
+    double best = 0, total = 0, pixels = 0;
+    size_t pixmaps = 0, allocs = 0;
+    struct image* image = NULL;
+    char format[32] = { 0 };
+
+    name = name ? name + 1 : path;
+
+    for (size_t i = 0; i < ctx.repeat; ++i) {
+        size_t width, height;
+        uint64_t start;
+        double time;
+
+        // reset high-water mark of pixel data, it doesn't include memory
+        // used by decoder libraries internally
+        perf_mem_peak(perf_mem_heap);
+        __atomic_store_n(&ctx.allocs, 0, __ATOMIC_RELAXED);
+
+        start = now();
+        if (loader_from_source(path, &image) != ldr_success) {
+            fprintf(stderr, "%-24.24s unsupported\n", name);
+            return;
+        }
+        width = image->frames[0].pm.width;
+        height = image->frames[0].pm.height;
+        if (ctx.size) {
+            image_thumbnail(image, ctx.size, false, true);
+        }
+        time = (double)(now() - start) / 1000000;
+
+        pixmaps = perf_mem_peak(perf_mem_heap);
+        allocs = __atomic_load_n(&ctx.allocs, __ATOMIC_RELAXED);
+        pixels = (double)(width * height) / 1000000;
+        // format name is the first word of the description
+        snprintf(format, sizeof(format), "%.*s",
+                 (int)strcspn(image->format, " "), image->format);
+        image_free(image);
+
+        total += time;
+        if (i == 0 || time < best) {
+            best = time;
+        }
+    }
+
+    add_stat(format, pixels, best);
+
+    printf("%-24.24s %-8s %8.3f %10.2f %10.2f %8.1f %12.1f %10zu\n", name,
+           format, pixels, best, total / ctx.repeat, pixels * 1000 / best,
+           (double)pixmaps / (1024 * 1024), allocs);
+    fflush(stdout);
+}
+
+/**
+ * Decode all files in the directory or a single file.
+ * @param path path to the directory or file
+ */
+static void bench_path(const char* path)
+{
+    struct dirent** list;
+    struct stat st;
+    int num;
+
+    if (stat(path, &st) == -1) {
+        perror(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        bench_file(path);
+        return;
+    }
+
+    num = scandir(path, &list, NULL, alphasort);
+    if (num < 0) {
+        perror(path);
+        return;
+    }
+    for (int i = 0; i < num; ++i) {
+        char file[PATH_MAX];
+        snprintf(file, sizeof(file), "%s/%s", path, list[i]->d_name);
+        if (list[i]->d_name[0] != '.' && stat(file, &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+            bench_file(file);
+        }
+        free(list[i]);
+    }
+    free(list);
+}
+
+/**
+ * Print help.
+ * @param app application name
+ */
+static void usage(const char* app)
+{
+    printf("Usage: %s [OPTION...] [PATH...]\n", app);
+    puts("Decode image files or all files in directories, the default is the "
+         "test data.");
+    puts("  -r NUM  number of repetitions for each file (default 3)");
+    puts("  -s NUM  decode to thumbnail of specified size");
+    puts("  -t NUM  max number of decoding threads");
+    puts("  -g WxH  add generated images of specified size");
+    puts("  -h      print this help and exit");
+}
+
+int main(int argc, char* argv[])
+{
+    struct rusage usage_info;
+    size_t width, height;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:t:g:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                ctx.repeat = strtoul(optarg, NULL, 0);
+                if (ctx.repeat == 0) {
+                    ctx.repeat = 1;
+                }
+                break;
+            case 's':
+                ctx.size = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                tpool_limit(strtoul(optarg, NULL, 0));
+                break;
+            case 'g':
+                if (sscanf(optarg, "%zux%zu", &width, &height) != 2 ||
+                    !width || !height) {
+                    fprintf(stderr, "Invalid size: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (!generate(width, height)) {
+                    remove_generated();
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("Threads: %zu, repetitions: %zu, size: ", tpool_threads(),
+           ctx.repeat);
+    if (ctx.size) {
+        printf("%zu\n", ctx.size);
+    } else {
+        puts("full");
+    }
+    printf("%-24s %-8s %8s %10s %10s %8s %12s %10s\n", "File", "Format", "MP",
+           "Best, ms", "Avg, ms", "MP/s", "Pixmap, MiB", "App allocs");
+
+    if (optind == argc && !ctx.generated) {
+        bench_path(TEST_DATA_DIR);
+    }
+    for (int i = optind; i < argc; ++i) {
+        bench_path(argv[i]);
+    }
+    if (ctx.generated) {
+        bench_path(ctx.generated);
+        remove_generated();
+    }
+
+    // summary
+    printf("\n%-8s %8s %10s %10s %8s\n", "Format", "Files", "MP", "Time, ms",
+           "MP/s");
+    for (size_t i = 0; i < ctx.formats_num; ++i) {
+        const struct bench_format* bf = &ctx.formats[i];
+        printf("%-8s %8zu %10.3f %10.2f %8.1f\n", bf->name, bf->files,
+               bf->pixels, bf->time, bf->pixels * 1000 / bf->time);
+    }
+    if (getrusage(RUSAGE_SELF, &usage_info) == 0) {
+        printf("\nMax RSS: %.1f MiB\n", (double)usage_info.ru_maxrss / 1024);
+    }
+
+    tpool_destroy();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "event.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+class EventQueue : public ::testing::Test {
+protected:
+    void SetUp() override { evqueue_reset(); }
+
+    static struct event Open(size_t index)
+    {
+        struct event event {};
+        event.type = event_open;
+        event.param.open.index = index;
+        return event;
+    }
+};
+
+TEST_F(EventQueue, Order)
+{
+    struct event event;
+
+    EXPECT_FALSE(evqueue_pop(&event));
+
+    for (size_t i = 0; i < 10; ++i) {
+        const struct event open = Open(i);
+        ASSERT_TRUE(evqueue_push(&open));
+    }
+    for (size_t i = 0; i < 10; ++i) {
+        ASSERT_TRUE(evqueue_pop(&event));
+        EXPECT_EQ(event.type, event_open);
+        EXPECT_EQ(event.param.open.index, i);
+    }
+    EXPECT_FALSE(evqueue_pop(&event));
+}
+
+TEST_F(EventQueue, Overflow)
+{
+    constexpr size_t num = 3000; // more than the ring capacity
+    struct event event;
+
+    for (size_t i = 0; i < num; ++i) {
+        event = Open(i);
+        ASSERT_TRUE(evqueue_push(&event));
+        if (i == num / 2) {
+            // coalesced events don't need cells
+            event.type = event_redraw;
+            EXPECT_TRUE(evqueue_push(&event));
+        }
+    }
+
+    // order is preserved across the ring and the overflow list
+    for (size_t i = 0; i < num; ++i) {
+        ASSERT_TRUE(evqueue_pop(&event));
+        EXPECT_EQ(event.type, event_open);
+        EXPECT_EQ(event.param.open.index, i);
+    }
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_redraw);
+    EXPECT_FALSE(evqueue_pop(&event));
+
+    // ring is used again after the overflow is drained
+    event = Open(42);
+    ASSERT_TRUE(evqueue_push(&event));
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.param.open.index, 42);
+    EXPECT_FALSE(evqueue_pop(&event));
+}
+
+TEST_F(EventQueue, Coalesce)
+{
+    struct event event {};
+    const struct event open = Open(42);
+
+    event.type = event_redraw;
+    evqueue_push(&event);
+    evqueue_push(&event);
+    event.type = event_drag;
+    event.param.drag.dx = 1;
+    event.param.drag.dy = 2;
+    evqueue_push(&event);
+    event.param.drag.dx = -3;
+    event.param.drag.dy = 4;
+    evqueue_push(&event);
+    evqueue_push(&open);
+    event.type = event_resize;
+    evqueue_push(&event);
+    evqueue_push(&event);
+
+    event.type = event_drag;
+    event.param.drag.dx = 5;
+    event.param.drag.dy = 0;
+    evqueue_push(&event);
+
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_resize);
+    // drag before the queued event is delivered first
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_drag);
+    EXPECT_EQ(event.param.drag.dx, -2);
+    EXPECT_EQ(event.param.drag.dy, 6);
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_open);
+    EXPECT_EQ(event.param.open.index, 42);
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_drag);
+    EXPECT_EQ(event.param.drag.dx, 5);
+    EXPECT_EQ(event.param.drag.dy, 0);
+    ASSERT_TRUE(evqueue_pop(&event));
+    EXPECT_EQ(event.type, event_redraw);
+    EXPECT_FALSE(evqueue_pop(&event));
+}
+
+TEST_F(EventQueue, Producers)
+{
+    constexpr size_t threads_num = 4;
+    constexpr size_t events_num = 10000;
+    std::vector<std::thread> threads;
+    std::vector<size_t> next(threads_num, 0);
+    size_t received = 0;
+
+    for (size_t t = 0; t < threads_num; ++t) {
+        threads.emplace_back([t]() {
+            for (size_t i = 0; i < events_num; ++i) {
+                const struct event event = Open(t * events_num + i);
+                ASSERT_TRUE(evqueue_push(&event));
+            }
+        });
+    }
+
+    // events from each producer must be received in order
+    while (received < threads_num * events_num) {
+        struct event event;
+        if (evqueue_pop(&event)) {
+            const size_t thread = event.param.open.index / events_num;
+            const size_t index = event.param.open.index % events_num;
+            ASSERT_LT(thread, threads_num);
+            EXPECT_EQ(index, next[thread]);
+            next[thread] = index + 1;
+            ++received;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto& it : threads) {
+        it.join();
+    }
+}
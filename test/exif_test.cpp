@@ -9,14 +9,83 @@ extern "C" {
 
 #include <fstream>
 
+static std::vector<uint8_t> ReadFile(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)),
+                                (std::istreambuf_iterator<char>()));
+}
+
+TEST(Exif, Orientation)
+{
+    const std::vector<uint8_t> data = ReadFile(TEST_DATA_DIR "/exif.jpg");
+    const uint8_t* exif;
+    size_t size = 0;
+
+    exif = exif_from_jpeg(data.data(), data.size(), &size);
+    ASSERT_NE(exif, nullptr);
+    EXPECT_EQ(exif[0], 'I');
+    EXPECT_EQ(exif_orientation(exif, size), 1);
+}
+
+TEST(Exif, OrientationBigEndian)
+{
+    const uint8_t exif[] = {
+        'M', 'M', 0x00, 0x2a, 0x00, 0x00, 0x00, 0x08, // header
+        0x00, 0x02,                                   // 2 entries
+        0x01, 0x0f, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01, // make
+        0x00, 0x00, 0x00, 0x00,                         //
+        0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01, // orientation
+        0x00, 0x06, 0x00, 0x00,                         //
+    };
+
+    EXPECT_EQ(exif_orientation(exif, sizeof(exif)), 6);
+    // truncated IFD
+    EXPECT_EQ(exif_orientation(exif, sizeof(exif) - 1), 0);
+}
+
+TEST(Exif, Block)
+{
+    const uint8_t block[] = {
+        'E', 'x', 'i', 'f', 0x00, 0x00,                 // header
+        'I', 'I', 0x2a, 0x00, 0x08, 0x00, 0x00, 0x00,   // TIFF header
+        0x01, 0x00,                                     // 1 entry
+        0x12, 0x01, 0x03, 0x00, 0x01, 0x00, 0x00, 0x00, // orientation
+        0x03, 0x00, 0x00, 0x00,                         //
+    };
+    const uint8_t* exif;
+    size_t size = 0;
+
+    exif = exif_from_block(block, sizeof(block), &size);
+    EXPECT_EQ(exif, block + 6);
+    EXPECT_EQ(size, sizeof(block) - 6);
+    EXPECT_EQ(exif_orientation(exif, size), 3);
+
+    // block without header
+    exif = exif_from_block(block + 6, sizeof(block) - 6, &size);
+    EXPECT_EQ(exif, block + 6);
+    EXPECT_EQ(exif_orientation(exif, size), 3);
+}
+
+TEST(Exif, OrientationFail)
+{
+    const uint8_t jpeg[] = { 0xff, 0xd8, 0xff, 0xe1, 0xff, 0xff, 'E', 'x' };
+    const uint8_t tiff[] = { 'I', 'I', 0x2a, 0x00, 0xff, 0xff, 0xff, 0xff };
+    size_t size;
+
+    EXPECT_EQ(exif_from_jpeg(nullptr, 0, &size), nullptr);
+    EXPECT_EQ(exif_from_jpeg(jpeg, sizeof(jpeg), &size), nullptr);
+    EXPECT_EQ(exif_orientation(nullptr, 0), 0);
+    EXPECT_EQ(exif_orientation(tiff, sizeof(tiff)), 0);
+}
+
+#ifdef HAVE_LIBEXIF
 TEST(Exif, Read)
 {
-    std::ifstream file(TEST_DATA_DIR "/exif.jpg", std::ios::binary);
-    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)),
-                                    (std::istreambuf_iterator<char>()));
+    const std::vector<uint8_t> data = ReadFile(TEST_DATA_DIR "/exif.jpg");
 
     struct image* image = image_create();
-    process_exif(image, data.data(), data.size());
+    exif_read_meta(image, data.data(), data.size());
 
     EXPECT_EQ(image->num_info, static_cast<size_t>(7));
     EXPECT_STREQ(image->info[0].value, "2024:07:06 12:31:44");
@@ -34,11 +103,12 @@ TEST(Exif, Fail)
 {
     struct image* image = image_create();
 
-    process_exif(image, nullptr, 0);
+    exif_read_meta(image, nullptr, 0);
     EXPECT_EQ(image->num_info, static_cast<size_t>(0));
 
-    process_exif(image, reinterpret_cast<const uint8_t*>("abcd"), 4);
+    exif_read_meta(image, reinterpret_cast<const uint8_t*>("abcd"), 4);
     EXPECT_EQ(image->num_info, static_cast<size_t>(0));
 
     image_free(image);
 }
+#endif // HAVE_LIBEXIF
@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "fetcher.h"
+#include "imagelist.h"
+#include "loader.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+
+// loader thread is not started: background loads are completed by tests
+class Fetcher : public ::testing::Test {
+protected:
+    void TearDown() override
+    {
+        fetcher_destroy();
+        loader_queue_reset();
+        image_list_destroy();
+    }
+
+    void Init(size_t history, size_t preload)
+    {
+        const char* sources[] = { "exec://cmd0", "exec://cmd1",
+                                  "exec://cmd2", "exec://cmd3" };
+        ASSERT_EQ(image_list_init(nullptr, sources, 4), 4U);
+        fetcher_init(Image(0), history, preload, 0);
+    }
+
+    // create image loaded in background
+    static struct image* Image(size_t index)
+    {
+        struct image* img = image_create();
+        img->index = index;
+        img->source = strdup(image_list_get(index));
+        image_allocate_frame(img, 1, 1);
+        return img;
+    }
+};
+
+TEST_F(Fetcher, Pending)
+{
+    Init(1, 1);
+
+    EXPECT_FALSE(fetcher_open(1, true));
+    EXPECT_EQ(fetcher_pending(), 1U);
+    EXPECT_EQ(fetcher_current()->index, 0U); // previous image stays
+
+    EXPECT_TRUE(fetcher_attach(Image(1), 1));
+    EXPECT_EQ(fetcher_pending(), IMGLIST_INVALID);
+    EXPECT_EQ(fetcher_current()->index, 1U);
+
+    // previous image is taken from the history
+    EXPECT_TRUE(fetcher_open(0, false));
+    EXPECT_EQ(fetcher_current()->index, 0U);
+}
+
+TEST_F(Fetcher, Superseded)
+{
+    Init(0, 1);
+
+    EXPECT_FALSE(fetcher_open(1, true));
+    EXPECT_FALSE(fetcher_open(2, true));
+    EXPECT_EQ(fetcher_pending(), 2U);
+
+    // outdated load goes to the preload cache
+    EXPECT_FALSE(fetcher_attach(Image(1), 1));
+    EXPECT_EQ(fetcher_current()->index, 0U);
+    EXPECT_EQ(fetcher_pending(), 2U);
+
+    // back to the preloaded image
+    EXPECT_TRUE(fetcher_open(1, false));
+    EXPECT_EQ(fetcher_current()->index, 1U);
+    EXPECT_EQ(fetcher_pending(), IMGLIST_INVALID);
+    EXPECT_FALSE(fetcher_attach(Image(2), 2));
+}
+
+TEST_F(Fetcher, SupersededNoCache)
+{
+    Init(0, 0);
+
+    EXPECT_FALSE(fetcher_open(1, true));
+    EXPECT_FALSE(fetcher_open(2, true));
+
+    // image is freed, there is no cache to keep it
+    EXPECT_FALSE(fetcher_attach(Image(1), 1));
+    EXPECT_EQ(fetcher_current()->index, 0U);
+    EXPECT_FALSE(fetcher_open(1, true));
+}
+
+TEST_F(Fetcher, Duplicate)
+{
+    Init(0, 1);
+
+    // the same image is decoded by the interactive and preload threads
+    EXPECT_FALSE(fetcher_open(1, true));
+    EXPECT_TRUE(fetcher_attach(Image(1), 1));
+    EXPECT_FALSE(fetcher_attach(Image(1), 1));
+    EXPECT_EQ(fetcher_current()->index, 1U);
+}
+
+TEST_F(Fetcher, Failed)
+{
+    Init(0, 0);
+
+    EXPECT_FALSE(fetcher_open(1, true));
+
+    // broken image is skipped, the next one in the same direction is loaded
+    EXPECT_FALSE(fetcher_attach(nullptr, 1));
+    EXPECT_EQ(fetcher_pending(), 2U);
+    EXPECT_EQ(image_list_next_file(0), 2U);
+    EXPECT_EQ(fetcher_current()->index, 0U);
+
+    EXPECT_TRUE(fetcher_attach(Image(2), 2));
+    EXPECT_EQ(fetcher_current()->index, 2U);
+}
+
+TEST_F(Fetcher, FailedBackward)
+{
+    Init(0, 0);
+
+    EXPECT_FALSE(fetcher_open(2, false));
+    EXPECT_FALSE(fetcher_attach(nullptr, 2));
+    EXPECT_EQ(fetcher_pending(), 1U);
+}
+
+TEST_F(Fetcher, Reset)
+{
+    Init(1, 1);
+
+    // outdated image is displayed until it is reloaded
+    fetcher_reset(0);
+    EXPECT_EQ(fetcher_pending(), 0U);
+    EXPECT_EQ(fetcher_current()->index, 0U);
+    EXPECT_FALSE(fetcher_open(0, true));
+
+    EXPECT_TRUE(fetcher_attach(Image(0), 0));
+    EXPECT_EQ(fetcher_pending(), IMGLIST_INVALID);
+    EXPECT_EQ(fetcher_current()->index, 0U);
+}
+
+TEST_F(Fetcher, ResetOther)
+{
+    Init(1, 1);
+
+    fetcher_reset(2);
+    EXPECT_EQ(fetcher_pending(), 2U);
+    EXPECT_EQ(fetcher_current(), nullptr);
+
+    EXPECT_TRUE(fetcher_attach(Image(2), 2));
+    EXPECT_EQ(fetcher_current()->index, 2U);
+}
+
+TEST_F(Fetcher, ResetFailed)
+{
+    const char* sources[] = { "exec://cmd0" };
+    ASSERT_EQ(image_list_init(nullptr, sources, 1), 1U);
+    fetcher_init(Image(0), 1, 1, 0);
+
+    // reloaded image is broken and there is nothing else to open
+    fetcher_reset(0);
+    EXPECT_FALSE(fetcher_attach(nullptr, 0));
+    EXPECT_EQ(fetcher_pending(), IMGLIST_INVALID);
+    EXPECT_EQ(fetcher_current(), nullptr);
+}
+
+TEST_F(Fetcher, Seek)
+{
+    Init(0, 1);
+
+    // fast navigation: loading is suspended until the position is fixed
+    fetcher_seek(1);
+    fetcher_seek(2);
+    EXPECT_EQ(fetcher_pending(), 2U);
+    EXPECT_EQ(fetcher_current()->index, 0U);
+
+    // back to the current image
+    fetcher_seek(0);
+    EXPECT_EQ(fetcher_pending(), IMGLIST_INVALID);
+
+    fetcher_seek(3);
+    EXPECT_FALSE(fetcher_open(3, true));
+    EXPECT_TRUE(fetcher_attach(Image(3), 3));
+    EXPECT_EQ(fetcher_current()->index, 3U);
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "headless.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+class Headless : public ::testing::Test {
+protected:
+    void TearDown() override { headless_destroy(); }
+
+    // load script from text
+    bool Load(const char* text)
+    {
+        char path[] = "/tmp/swayimg_script_XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd == -1) {
+            return false;
+        }
+        close(fd);
+        std::ofstream(path) << text;
+        const bool rc = headless_load(path);
+        unlink(path);
+        return rc;
+    }
+};
+
+TEST_F(Headless, Load)
+{
+    EXPECT_TRUE(headless_load(TEST_DATA_DIR "/script.txt"));
+    EXPECT_TRUE(headless_enabled());
+}
+
+TEST_F(Headless, LoadInvalid)
+{
+    EXPECT_FALSE(headless_load(TEST_DATA_DIR "/not_exist"));
+    EXPECT_FALSE(Load("key NoSuchKey"));
+    EXPECT_FALSE(Load("key Ctrl+"));
+    EXPECT_FALSE(Load("drag 1"));
+    EXPECT_FALSE(Load("resize 1 100"));
+    EXPECT_FALSE(Load("wait 1 2"));
+    EXPECT_FALSE(Load("jump 1"));
+    EXPECT_FALSE(Load("e"));
+    EXPECT_FALSE(Load("exi"));
+    EXPECT_FALSE(Load("exit 1"));
+    EXPECT_FALSE(Load("repeat 2 x\nexit"));
+    EXPECT_FALSE(Load("repeat 0\nexit"));
+    EXPECT_FALSE(headless_enabled());
+}
+
+TEST_F(Headless, Window)
+{
+    ASSERT_TRUE(Load("exit"));
+    ASSERT_TRUE(headless_init(320, 240));
+    EXPECT_EQ(headless_get_width(), static_cast<size_t>(320));
+    EXPECT_EQ(headless_get_height(), static_cast<size_t>(240));
+
+    struct pixmap* wnd = headless_draw_begin();
+    ASSERT_NE(wnd, nullptr);
+    EXPECT_EQ(wnd->width, static_cast<size_t>(320));
+    EXPECT_EQ(wnd->height, static_cast<size_t>(240));
+    pixmap_fill(wnd, 0, 0, wnd->width, wnd->height, 0xff000000);
+    headless_draw_commit();
+}
+
+TEST_F(Headless, WindowDefault)
+{
+    ASSERT_TRUE(Load("exit"));
+    ASSERT_TRUE(headless_init(0, 0));
+    EXPECT_EQ(headless_get_width(), static_cast<size_t>(800));
+    EXPECT_EQ(headless_get_height(), static_cast<size_t>(600));
+}
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "image.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <unistd.h>
+
+// lazy stream with frames filled by their index
+class ImageStream : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        ready = false;
+        image = image_create();
+        ASSERT_NE(image, nullptr);
+        ASSERT_NE(image_create_frames(image, 5), nullptr);
+        for (size_t i = 0; i < image->num_frames; ++i) {
+            image->frames[i].pm.width = 4;
+            image->frames[i].pm.height = 2;
+        }
+        ASSERT_TRUE(image_set_stream(image, Decode, free, nullptr));
+        ASSERT_TRUE(image_load_frame(image, 0));
+    }
+
+    void TearDown() override { image_free(image); }
+
+    static bool Decode(void*, size_t index, struct pixmap* pm)
+    {
+        if (!pixmap_create(pm, 4, 2)) {
+            return false;
+        }
+        pixmap_fill(pm, 0, 0, pm->width, pm->height, index);
+        return true;
+    }
+
+    static void Ready() { ready = true; }
+
+    // show frame that is decoded in background
+    size_t Show(size_t index)
+    {
+        size_t shown = image_show_frame(image, index, Ready);
+        for (size_t i = 0; i < 1000 && shown != index; ++i) {
+            if (ready.exchange(false)) {
+                shown = image_show_frame(image, index, Ready);
+            } else {
+                usleep(1000);
+            }
+        }
+        return shown;
+    }
+
+    struct image* image;
+    static std::atomic<bool> ready;
+};
+
+std::atomic<bool> ImageStream::ready;
+
+TEST_F(ImageStream, Show)
+{
+    EXPECT_EQ(image_show_frame(image, 0, Ready), 0U);
+    EXPECT_EQ(image->frames[0].pm.data[0], 0U);
+
+    // the last shown frame is drawn until the requested one is decoded
+    EXPECT_EQ(Show(3), 3U);
+    EXPECT_EQ(image->frames[3].pm.data[0], 3U);
+
+    // frames out of the window are released
+    EXPECT_EQ(image->frames[1].pm.data, nullptr);
+    EXPECT_EQ(image->frames[2].pm.data, nullptr);
+
+    EXPECT_EQ(Show(1), 1U);
+    EXPECT_EQ(image->frames[1].pm.data[0], 1U);
+    EXPECT_EQ(image->frames[4].pm.data, nullptr);
+    EXPECT_EQ(image->frames[0].pm.data, nullptr);
+}
+
+TEST_F(ImageStream, Rotate)
+{
+    image_rotate(image, 90);
+    EXPECT_EQ(image->frames[0].pm.width, 2U);
+    EXPECT_EQ(image->frames[4].pm.width, 2U);
+
+    // transformation is applied to the frames decoded later
+    EXPECT_EQ(Show(4), 4U);
+    EXPECT_EQ(image->frames[4].pm.width, 2U);
+    EXPECT_EQ(image->frames[4].pm.height, 4U);
+}
+
+TEST_F(ImageStream, Free)
+{
+    // decoder thread is stopped with the image
+    image_show_frame(image, 2, Ready);
+}
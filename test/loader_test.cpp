@@ -11,8 +11,15 @@ extern "C" {
 
 #include <gtest/gtest.h>
 
-// stubs for linker (application and ui are not included to tests)
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+// stubs for linker (application, ui and font are not included to tests)
 extern "C" {
+void font_init(struct config*) { }
+void font_destroy() { }
 void app_watch(int, fd_callback, void*) { }
 void app_reload() { }
 void app_redraw() { }
@@ -21,6 +28,7 @@ void app_on_keyboard(xkb_keysym_t, uint8_t) { }
 void app_on_drag(int, int) { }
 void app_exit(int) { }
 void app_on_load(struct image*, size_t) { }
+void app_on_preview(struct image*, size_t) { }
 bool app_is_viewer()
 {
     return true;
@@ -39,6 +47,17 @@ protected:
         EXPECT_NE(image->frames[0].pm.height, static_cast<size_t>(0));
         EXPECT_NE(image->frames[0].pm.data[0], static_cast<argb_t>(0));
     }
+
+    void Probe(const char* file)
+    {
+        struct image_header header;
+        ASSERT_EQ(loader_probe(file, &header), ldr_success);
+        ASSERT_NE(image, nullptr);
+        EXPECT_EQ(header.width, image->frames[0].pm.width);
+        EXPECT_EQ(header.height, image->frames[0].pm.height);
+        EXPECT_EQ(header.frames, image->num_frames);
+        EXPECT_NE(header.bpp, static_cast<size_t>(0));
+    }
     struct image* image = nullptr;
 };
 
@@ -50,10 +69,96 @@ TEST_F(Loader, External)
     ASSERT_NE(image, nullptr);
 }
 
-#define TEST_LOADER(n)                    \
-    TEST_F(Loader, n)                     \
-    {                                     \
-        Load(TEST_DATA_DIR "/image." #n); \
+TEST_F(Loader, ZeroCopy)
+{
+    // top-down 32-bit image with aligned pixel data
+    Load(TEST_DATA_DIR "/zerocopy.tga");
+    ASSERT_NE(image->map, nullptr);
+    const uint8_t* map = static_cast<const uint8_t*>(image->map);
+    const argb_t* data = image->frames[0].pm.data;
+    EXPECT_EQ(reinterpret_cast<const uint8_t*>(data), map + 20);
+    EXPECT_EQ(data[0], static_cast<argb_t>(0xff112233));
+    EXPECT_EQ(data[3], static_cast<argb_t>(0xffaabbcc));
+
+    // flip in place (copy-on-write)
+    image_flip_vertical(image);
+    EXPECT_EQ(image->frames[0].pm.data, data);
+    EXPECT_EQ(data[0], static_cast<argb_t>(0x80778899));
+
+    // rotation moves frame out of the mapping
+    image_rotate(image, 90);
+    EXPECT_NE(image->frames[0].pm.data, data);
+    EXPECT_EQ(image->frames[0].pm.data[0], static_cast<argb_t>(0xff112233));
+}
+
+TEST_F(Loader, ZeroCopyFileMapping)
+{
+    Load(TEST_DATA_DIR "/zerocopy.tga");
+    const uintptr_t data =
+        reinterpret_cast<uintptr_t>(image->frames[0].pm.data);
+
+    // frame data must be inside the mapping of the source file
+    bool mapped = false;
+    char line[PATH_MAX + 128];
+    FILE* maps = fopen("/proc/self/maps", "r");
+    ASSERT_NE(maps, nullptr);
+    while (!mapped && fgets(line, sizeof(line), maps)) {
+        uintptr_t begin, end;
+        int path = 0;
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %*s %*s %*s %*s %n",
+                   &begin, &end, &path) == 2 &&
+            path && data >= begin && data < end) {
+            mapped = strstr(line + path, "/zerocopy.tga") != nullptr;
+        }
+    }
+    fclose(maps);
+    EXPECT_TRUE(mapped);
+}
+
+TEST_F(Loader, MaxPixels)
+{
+    // grayscale image larger than 1 MiB pixels
+    char path[] = "/tmp/swayimg_maxpixels_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_NE(fd, -1);
+    FILE* file = fdopen(fd, "wb");
+    ASSERT_NE(file, nullptr);
+    fprintf(file, "P5 1025 1024 255\n");
+    for (size_t i = 0; i < 1025 * 1024; ++i) {
+        fputc(0x42, file);
+    }
+    fclose(file);
+
+    // the first image is loaded before loader_init(), the limit from the
+    // config must be applied anyway
+    struct config* cfg = nullptr;
+    config_set(&cfg, APP_CFG_SECTION, APP_CFG_MAXPIXELS, "1");
+    loader_configure(cfg);
+    EXPECT_NE(loader_from_source(path, &image), ldr_success);
+    EXPECT_EQ(image, nullptr);
+
+    config_set(&cfg, APP_CFG_SECTION, APP_CFG_MAXPIXELS, "2");
+    loader_configure(cfg);
+    Load(path);
+
+    // restore default limit
+    config_free(cfg);
+    loader_configure(nullptr);
+    unlink(path);
+}
+
+TEST_F(Loader, ProbeStream)
+{
+    struct image_header header;
+    EXPECT_EQ(loader_probe(LDRSRC_STDIN, &header), ldr_unsupported);
+    EXPECT_EQ(loader_probe(TEST_DATA_DIR "/notexist", &header), ldr_ioerror);
+}
+
+#define TEST_LOADER(n)                     \
+    TEST_F(Loader, n)                      \
+    {                                      \
+        Load(TEST_DATA_DIR "/image." #n);  \
+        Probe(TEST_DATA_DIR "/image." #n); \
     }
 
 TEST_LOADER(bmp);
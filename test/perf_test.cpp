@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "perf.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+class Perf : public ::testing::Test {
+protected:
+    // get all counters as "key: value" lines
+    std::vector<std::string> Lines()
+    {
+        std::vector<std::string> lines;
+        char key[128], value[128];
+        for (size_t i = 0; perf_line(i, key, value, sizeof(key)); ++i) {
+            lines.push_back(std::string(key) + ": " + value);
+        }
+        return lines;
+    }
+
+    // check if any line starts with the prefix
+    bool HasLine(const std::string& prefix)
+    {
+        for (const auto& line : Lines()) {
+            if (line.compare(0, prefix.length(), prefix) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+TEST_F(Perf, Timer)
+{
+    EXPECT_FALSE(HasLine("Commit:"));
+    perf_stop(perf_commit, perf_start());
+    perf_stop(perf_commit, perf_start());
+    EXPECT_TRUE(HasLine("Commit: 2 in "));
+}
+
+TEST_F(Perf, Decode)
+{
+    perf_decoded("PerfTest 8bit", perf_start());
+    perf_decoded("PerfTest 16bit", perf_start());
+    perf_decoded(nullptr, perf_start());
+    EXPECT_TRUE(HasLine("Decode PerfTest: 2 in "));
+}
+
+TEST_F(Perf, Cache)
+{
+    perf_cache(perf_diskcache, true);
+    perf_cache(perf_diskcache, true);
+    perf_cache(perf_diskcache, true);
+    perf_cache(perf_diskcache, false);
+    EXPECT_TRUE(HasLine("Disk cache: 3 hits, 1 misses (75%)"));
+}
+
+TEST_F(Perf, Queue)
+{
+    // event queue is used by event tests, its max depth is unpredictable
+    perf_queue(perf_load_queue, 3);
+    perf_queue(perf_load_queue, -2);
+    EXPECT_TRUE(HasLine("Load queue: depth 1, max 3"));
+    perf_queue(perf_load_queue, -1);
+}
+
+TEST_F(Perf, Memory)
+{
+    perf_mem_add(perf_mem_window, 2 * 1024 * 1024);
+    perf_mem_add(perf_mem_window, -1024 * 1024);
+    EXPECT_TRUE(HasLine("Memory window: 1.0 MiB, peak 2.0 MiB"));
+    perf_mem_set(perf_mem_window, 0);
+    EXPECT_TRUE(HasLine("Memory window: 0.0 MiB, peak 2.0 MiB"));
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "pixcache.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+
+class PixCache : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        struct stat st;
+
+        file = tmpfile();
+        ASSERT_NE(file, nullptr);
+        fd = fileno(file);
+
+        ASSERT_EQ(fstat(fd, &st), 0);
+        pixcache_make_key(&key, &st);
+
+        image = image_create();
+        ASSERT_NE(image, nullptr);
+        ASSERT_NE(image_create_frames(image, 2), nullptr);
+        for (size_t i = 0; i < image->num_frames; ++i) {
+            struct image_frame* frame = &image->frames[i];
+            ASSERT_TRUE(pixmap_create(&frame->pm, 3 + i, 2));
+            for (size_t j = 0; j < frame->pm.width * frame->pm.height; ++j) {
+                frame->pm.data[j] = static_cast<argb_t>(i * 100 + j);
+            }
+            frame->duration = 10 * (i + 1);
+        }
+        image_set_format(image, "Test");
+        image->alpha = true;
+    }
+
+    void TearDown() override
+    {
+        image_free(image);
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    FILE* file = nullptr;
+    int fd = -1;
+    struct pixcache_key key;
+    struct image* image = nullptr;
+};
+
+TEST_F(PixCache, WriteMap)
+{
+    const size_t size = pixcache_size(image);
+    struct image* cached = image_create();
+
+    ASSERT_NE(size, static_cast<size_t>(0));
+    ASSERT_TRUE(pixcache_write(fd, image, &key, size));
+    ASSERT_TRUE(pixcache_map(cached, fd, &key));
+
+    EXPECT_NE(cached->map, nullptr);
+    EXPECT_STREQ(cached->format, "Test");
+    EXPECT_TRUE(cached->alpha);
+    ASSERT_EQ(cached->num_frames, image->num_frames);
+    for (size_t i = 0; i < image->num_frames; ++i) {
+        const struct image_frame* expect = &image->frames[i];
+        const struct image_frame* frame = &cached->frames[i];
+        ASSERT_EQ(frame->pm.width, expect->pm.width);
+        ASSERT_EQ(frame->pm.height, expect->pm.height);
+        EXPECT_EQ(frame->duration, expect->duration);
+        EXPECT_EQ(memcmp(frame->pm.data, expect->pm.data,
+                         expect->pm.width * expect->pm.height *
+                             sizeof(argb_t)),
+                  0);
+    }
+
+    // copy-on-write: container is not changed
+    cached->frames[0].pm.data[0] = 0xdeadbeef;
+    image_free(cached);
+    cached = image_create();
+    ASSERT_TRUE(pixcache_map(cached, fd, &key));
+    EXPECT_EQ(cached->frames[0].pm.data[0], image->frames[0].pm.data[0]);
+
+    image_free(cached);
+}
+
+TEST_F(PixCache, KeyMismatch)
+{
+    struct pixcache_key other = key;
+    struct image* cached = image_create();
+
+    ASSERT_TRUE(pixcache_write(fd, image, &key, pixcache_size(image)));
+    ++other.mtime_ns;
+    EXPECT_FALSE(pixcache_map(cached, fd, &other));
+    EXPECT_EQ(cached->num_frames, static_cast<size_t>(0));
+
+    image_free(cached);
+}
+
+TEST_F(PixCache, Invalid)
+{
+    struct image* cached = image_create();
+
+    // empty file
+    EXPECT_FALSE(pixcache_map(cached, fd, &key));
+
+    // truncated container
+    ASSERT_TRUE(pixcache_write(fd, image, &key, pixcache_size(image)));
+    ASSERT_EQ(ftruncate(fd, pixcache_size(image) - 1), 0);
+    EXPECT_FALSE(pixcache_map(cached, fd, &key));
+
+    // images with meta info are not cached
+    image_add_meta(image, "Key", "Value");
+    EXPECT_EQ(pixcache_size(image), static_cast<size_t>(0));
+
+    image_free(cached);
+}
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "pixconv.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+// Number of pixels: covers both vectorized blocks and scalar tail
+#define NUM_PIXELS 37
+
+class PixConv : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        for (size_t i = 0; i < sizeof(src); ++i) {
+            src[i] = static_cast<uint8_t>(i * 7 + 3);
+        }
+        dst.assign(NUM_PIXELS, 0);
+    }
+
+    uint8_t src[NUM_PIXELS * 4];
+    std::vector<argb_t> dst;
+};
+
+TEST_F(PixConv, Rgba)
+{
+    pixconv_rgba(dst.data(), src, NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        const uint8_t* px = &src[i * 4];
+        EXPECT_EQ(dst[i], ARGB(px[3], px[0], px[1], px[2])) << i;
+    }
+}
+
+TEST_F(PixConv, RgbaInPlace)
+{
+    std::vector<argb_t> buf(NUM_PIXELS);
+    memcpy(buf.data(), src, NUM_PIXELS * 4);
+    pixconv_rgba(buf.data(), buf.data(), NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        const uint8_t* px = &src[i * 4];
+        EXPECT_EQ(buf[i], ARGB(px[3], px[0], px[1], px[2])) << i;
+    }
+}
+
+TEST_F(PixConv, Bgrx)
+{
+    pixconv_bgrx(dst.data(), src, NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        const uint8_t* px = &src[i * 4];
+        EXPECT_EQ(dst[i], ARGB(0xff, px[2], px[1], px[0])) << i;
+    }
+}
+
+TEST_F(PixConv, Rgb)
+{
+    pixconv_rgb(dst.data(), src, NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        const uint8_t* px = &src[i * 3];
+        EXPECT_EQ(dst[i], ARGB(0xff, px[0], px[1], px[2])) << i;
+    }
+}
+
+TEST_F(PixConv, Bgr)
+{
+    pixconv_bgr(dst.data(), src, NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        const uint8_t* px = &src[i * 3];
+        EXPECT_EQ(dst[i], ARGB(0xff, px[2], px[1], px[0])) << i;
+    }
+}
+
+TEST_F(PixConv, Gray)
+{
+    pixconv_gray(dst.data(), src, NUM_PIXELS);
+    for (size_t i = 0; i < NUM_PIXELS; ++i) {
+        EXPECT_EQ(dst[i], ARGB(0xff, src[i], src[i], src[i])) << i;
+    }
+}
+
+TEST_F(PixConv, Cmyk)
+{
+    const uint8_t cmyk[] = {
+        0x00, 0x00, 0x00, 0x00, // white
+        0x00, 0x00, 0x00, 0xff, // black
+        0xff, 0x00, 0x00, 0x00, // cyan
+        0x00, 0x00, 0x00, 0x80, // gray
+    };
+
+    pixconv_cmyk(dst.data(), cmyk, 4, false);
+    EXPECT_EQ(dst[0], 0xffffffff);
+    EXPECT_EQ(dst[1], 0xff000000);
+    EXPECT_EQ(dst[2], 0xff00ffff);
+    EXPECT_EQ(dst[3], 0xff7f7f7f);
+
+    // Adobe CMYK: samples are inverted
+    const uint8_t adobe[] = {
+        0xff, 0xff, 0xff, 0xff, // white
+        0xff, 0xff, 0xff, 0x00, // black
+        0x00, 0xff, 0xff, 0xff, // cyan
+    };
+    pixconv_cmyk(dst.data(), adobe, 3, true);
+    EXPECT_EQ(dst[0], 0xffffffff);
+    EXPECT_EQ(dst[1], 0xff000000);
+    EXPECT_EQ(dst[2], 0xff00ffff);
+}
+
+TEST_F(PixConv, Palette)
+{
+    const argb_t palette[] = { 0xff000000, 0xff112233, 0x80445566 };
+    const uint8_t indices[] = { 2, 0, 1, 1, 2 };
+    const uint8_t invalid[] = { 0, 1, 3 };
+
+    EXPECT_TRUE(pixconv_palette(dst.data(), indices, sizeof(indices), palette,
+                                sizeof(palette) / sizeof(palette[0])));
+    for (size_t i = 0; i < sizeof(indices); ++i) {
+        EXPECT_EQ(dst[i], palette[indices[i]]) << i;
+    }
+
+    EXPECT_FALSE(pixconv_palette(dst.data(), invalid, sizeof(invalid),
+                                 palette,
+                                 sizeof(palette) / sizeof(palette[0])));
+}
+
+TEST_F(PixConv, Be16)
+{
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+
+    for (size_t v = 0; v <= UINT16_MAX; ++v) {
+        in.push_back(static_cast<uint8_t>(v >> 8));
+        in.push_back(static_cast<uint8_t>(v));
+    }
+    out.resize(in.size() / 2);
+
+    pixconv_be16(out.data(), in.data(), out.size());
+    for (size_t v = 0; v <= UINT16_MAX; ++v) {
+        ASSERT_EQ(out[v], (v * UINT8_MAX + UINT16_MAX / 2) / UINT16_MAX) << v;
+    }
+}
@@ -0,0 +1,304 @@
+// SPDX-License-Identifier: MIT
+// Benchmark of pixmap kernels.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "pixmap.h"
+#include "tpool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Min duration of a single measurement (ns)
+#define MIN_TIME 200000000ULL
+
+// Max number of pixels in the destination pixmap
+#define MAX_PIXELS (64 * 1024 * 1024)
+
+/** Data for a single benchmark run. */
+struct bench_data {
+    struct pixmap src; ///< Source pixmap
+    struct pixmap dst; ///< Destination pixmap
+    uint8_t* mask;     ///< Alpha mask of the source size
+    float scale;       ///< Scale factor
+    bool alpha;        ///< Source has semi-transparent pixels
+};
+
+/**
+ * Benchmarked kernel handler.
+ * @param bd benchmark data
+ */
+typedef void (*bench_fn)(struct bench_data* bd);
+
+/** Benchmarked kernel. */
+struct bench_kernel {
+    const char* name; ///< Kernel name
+    bench_fn fn;      ///< Kernel handler
+    float scale;      ///< Scale factor, 0 if the kernel doesn't scale
+    bool alpha;       ///< Kernel depends on source transparency
+    bool threaded;    ///< Kernel uses thread pool
+};
+
+/** Size of the source pixmap. */
+struct bench_size {
+    const char* name; ///< Size name
+    size_t width;     ///< Width (px)
+    size_t height;    ///< Height (px)
+};
+
+static void bench_fill(struct bench_data* bd)
+{
+    pixmap_fill(&bd->dst, 0, 0, bd->dst.width, bd->dst.height, 0xff123456);
+}
+
+static void bench_blend(struct bench_data* bd)
+{
+    pixmap_blend(&bd->dst, 0, 0, bd->dst.width, bd->dst.height, 0x80123456);
+}
+
+static void bench_grid(struct bench_data* bd)
+{
+    pixmap_grid(&bd->dst, 0, 0, bd->dst.width, bd->dst.height, 10, 0xff333333,
+                0xff4c4c4c);
+}
+
+static void bench_mask(struct bench_data* bd)
+{
+    pixmap_apply_mask(&bd->dst, 0, 0, bd->mask, bd->src.width, bd->src.height,
+                      0xff123456);
+}
+
+static void bench_copy(struct bench_data* bd)
+{
+    pixmap_copy(&bd->src, &bd->dst, 0, 0, bd->alpha);
+}
+
+static void bench_rotate90(struct bench_data* bd)
+{
+    pixmap_rotate(&bd->dst, 90);
+}
+
+static void bench_rotate180(struct bench_data* bd)
+{
+    pixmap_rotate(&bd->dst, 180);
+}
+
+static void bench_flip(struct bench_data* bd)
+{
+    pixmap_flip_horizontal(&bd->dst);
+}
+
+static void bench_nearest(struct bench_data* bd)
+{
+    pixmap_scale(pixmap_nearest, &bd->src, &bd->dst, 0, 0, bd->scale,
+                 bd->alpha);
+}
+
+static void bench_bicubic(struct bench_data* bd)
+{
+    pixmap_scale(pixmap_bicubic, &bd->src, &bd->dst, 0, 0, bd->scale,
+                 bd->alpha);
+}
+
+static void bench_average(struct bench_data* bd)
+{
+    pixmap_scale(pixmap_average, &bd->src, &bd->dst, 0, 0, bd->scale,
+                 bd->alpha);
+}
+
+// clang-format off
+static const struct bench_kernel kernels[] = {
+    { "fill",            bench_fill,      0,     false, false },
+    { "blend",           bench_blend,     0,     false, false },
+    { "grid",            bench_grid,      0,     false, false },
+    { "mask",            bench_mask,      0,     false, false },
+    { "copy",            bench_copy,      0,     true,  false },
+    { "rotate 90",       bench_rotate90,  0,     false, false },
+    { "rotate 180",      bench_rotate180, 0,     false, false },
+    { "flip",            bench_flip,      0,     false, false },
+    { "nearest x0.25",   bench_nearest,   0.25f, true,  true  },
+    { "nearest x0.5",    bench_nearest,   0.5f,  true,  true  },
+    { "nearest x2",      bench_nearest,   2.0f,  true,  true  },
+    { "bicubic x0.5",    bench_bicubic,   0.5f,  true,  true  },
+    { "bicubic x2",      bench_bicubic,   2.0f,  true,  true  },
+    { "average x0.25",   bench_average,   0.25f, true,  true  },
+    { "average x0.5",    bench_average,   0.5f,  true,  true  },
+};
+
+static const struct bench_size sizes[] = {
+    { "thumbnail", 200,  200  },
+    { "1080p",     1920, 1080 },
+    { "4K",        3840, 2160 },
+    { "50MP",      8192, 6144 },
+};
+// clang-format on
+
+/**
+ * Get current monotonic time.
+ * @return timestamp in nanoseconds
+ */
+static uint64_t now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Fill source pixmap and mask with synthetic gradient.
+ * @param bd benchmark data
+ */
+static void make_source(struct bench_data* bd)
+{
+    for (size_t y = 0; y < bd->src.height; ++y) {
+        for (size_t x = 0; x < bd->src.width; ++x) {
+            const size_t pos = y * bd->src.width + x;
+            const argb_t a = bd->alpha ? (x + y) & 0xff : 0xff;
+            bd->src.data[pos] = ARGB(a, x & 0xff, y & 0xff, (x ^ y) & 0xff);
+            bd->mask[pos] = (x * y) & 0xff;
+        }
+    }
+}
+
+/**
+ * Measure kernel throughput.
+ * @param kernel benchmarked kernel
+ * @param bd benchmark data
+ * @return throughput in megapixels of the source pixmap per second
+ */
+static double measure(const struct bench_kernel* kernel, struct bench_data* bd)
+{
+    const size_t pixels = bd->src.width * bd->src.height;
+    size_t count = 0;
+    uint64_t start, elapsed;
+
+    kernel->fn(bd); // warm up
+
+    start = now();
+    do {
+        kernel->fn(bd);
+        ++count;
+        elapsed = now() - start;
+    } while (elapsed < MIN_TIME);
+
+    return (double)(pixels * count) * 1000 / elapsed;
+}
+
+/**
+ * Check if the benchmark matches filters from the command line.
+ * @param name benchmark name
+ * @param argc,argv command line arguments
+ * @return true if the benchmark should be executed
+ */
+static bool match(const char* name, int argc, char* argv[])
+{
+    if (argc < 2) {
+        return true;
+    }
+    for (int i = 1; i < argc; ++i) {
+        if (strstr(name, argv[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Run benchmark of the kernel with all thread counts.
+ * @param kernel benchmarked kernel
+ * @param size source pixmap size
+ * @param bd benchmark data
+ */
+static void run(const struct bench_kernel* kernel,
+                const struct bench_size* size, struct bench_data* bd)
+{
+    const size_t max_threads = kernel->threaded ? tpool_threads() : 1;
+    size_t dst_width = size->width;
+    size_t dst_height = size->height;
+    double single = 0;
+
+    if (kernel->scale) {
+        dst_width *= kernel->scale;
+        dst_height *= kernel->scale;
+    }
+    if (dst_width * dst_height > MAX_PIXELS) {
+        return;
+    }
+    bd->scale = kernel->scale;
+    if (!pixmap_create(&bd->dst, dst_width, dst_height)) {
+        fprintf(stderr, "Not enough memory for %s %s\n", kernel->name,
+                size->name);
+        return;
+    }
+    if (!kernel->scale) {
+        memcpy(bd->dst.data, bd->src.data,
+               dst_width * dst_height * sizeof(argb_t));
+    }
+
+    // powers of two up to the number of available threads
+    for (size_t threads = 1;; threads *= 2) {
+        double mps;
+        if (threads > max_threads) {
+            threads = max_threads;
+        }
+        tpool_limit(threads);
+        mps = measure(kernel, bd);
+        if (threads == 1) {
+            single = mps;
+        }
+        printf("%-16s %-10s %-6s %7zu %10.1f %9.0f%%\n", kernel->name,
+               size->name, bd->alpha ? "yes" : "no", threads, mps,
+               mps * 100 / (single * threads));
+        fflush(stdout);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+    tpool_limit(0);
+
+    pixmap_free(&bd->dst);
+}
+
+int main(int argc, char* argv[])
+{
+    printf("%-16s %-10s %-6s %7s %10s %10s\n", "Kernel", "Size", "Alpha",
+           "Threads", "MP/s", "Efficiency");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        const struct bench_size* size = &sizes[i];
+        struct bench_data bd = { 0 };
+
+        if (!pixmap_create(&bd.src, size->width, size->height)) {
+            fprintf(stderr, "Not enough memory for %s\n", size->name);
+            continue;
+        }
+        bd.mask = malloc(size->width * size->height);
+        if (!bd.mask) {
+            fprintf(stderr, "Not enough memory for %s\n", size->name);
+            pixmap_free(&bd.src);
+            continue;
+        }
+
+        for (size_t alpha = 0; alpha < 2; ++alpha) {
+            bd.alpha = alpha;
+            make_source(&bd);
+            for (size_t j = 0; j < sizeof(kernels) / sizeof(kernels[0]); ++j) {
+                const struct bench_kernel* kernel = &kernels[j];
+                char name[64];
+                snprintf(name, sizeof(name), "%s %s", kernel->name,
+                         size->name);
+                if ((!bd.alpha || kernel->alpha) && match(name, argc, argv)) {
+                    run(kernel, size, &bd);
+                }
+            }
+        }
+
+        free(bd.mask);
+        pixmap_free(&bd.src);
+    }
+
+    tpool_destroy();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "render.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TEST(Render, Size)
+{
+    EXPECT_TRUE(render_set_size("320x240"));
+    EXPECT_TRUE(render_enabled());
+    EXPECT_FALSE(render_set_size("320"));
+    EXPECT_FALSE(render_set_size("0x240"));
+    EXPECT_FALSE(render_set_size("320x240x"));
+    EXPECT_FALSE(render_set_size("abc"));
+}
+
+TEST(Render, Format)
+{
+    EXPECT_TRUE(render_set_format("qoi"));
+    EXPECT_TRUE(render_set_format("ppm"));
+    EXPECT_FALSE(render_set_format("bmp"));
+    EXPECT_FALSE(render_set_format(""));
+}
+
+// copy file from test data directory
+static void CopyFile(const char* name, const char* dst_dir)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_DIR, name);
+    FILE* src = fopen(path, "rb");
+    ASSERT_TRUE(src);
+    snprintf(path, sizeof(path), "%s/%s", dst_dir, name);
+    FILE* dst = fopen(path, "wb");
+    ASSERT_TRUE(dst);
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), src)) > 0) {
+        ASSERT_EQ(fwrite(buf, 1, len, dst), len);
+    }
+    fclose(src);
+    fclose(dst);
+}
+
+// remove directory with all its files
+static void RemoveDir(const char* dir)
+{
+    char path[256];
+    DIR* dir_handle = opendir(dir);
+    ASSERT_TRUE(dir_handle);
+    struct dirent* entry;
+    while ((entry = readdir(dir_handle))) {
+        if (entry->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir_handle);
+    EXPECT_EQ(rmdir(dir), 0);
+}
+
+TEST(Render, Run)
+{
+    char root[] = "/tmp/swayimg_render_XXXXXX";
+    ASSERT_TRUE(mkdtemp(root));
+
+    // same base names with different formats and in different directories
+    char dir_a[256], dir_b[256], out[256];
+    snprintf(dir_a, sizeof(dir_a), "%s/a", root);
+    snprintf(dir_b, sizeof(dir_b), "%s/b", root);
+    snprintf(out, sizeof(out), "%s/out", root);
+    ASSERT_EQ(mkdir(dir_a, 0755), 0);
+    ASSERT_EQ(mkdir(dir_b, 0755), 0);
+    CopyFile("image.bmp", dir_a);
+    CopyFile("image.pnm", dir_a);
+    CopyFile("image.tga", dir_a);
+    CopyFile("image.bmp", dir_b);
+
+    const char* sources[] = { dir_a, dir_b };
+    ASSERT_TRUE(render_set_size("4x4"));
+    ASSERT_TRUE(render_set_format("ppm"));
+    render_set_output(out);
+    ASSERT_TRUE(render_run(nullptr, sources, 2));
+
+    // one output file per source
+    const char* expected[] = { "image.bmp.ppm", "image.bmp.1.ppm",
+                               "image.pnm.ppm", "image.tga.ppm" };
+    for (const char* name : expected) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s", out, name);
+        FILE* file = fopen(path, "rb");
+        ASSERT_TRUE(file) << name;
+        size_t width = 0, height = 0;
+        EXPECT_EQ(fscanf(file, "P6 %zu %zu", &width, &height), 2);
+        fclose(file);
+        EXPECT_LE(width, static_cast<size_t>(4));
+        EXPECT_LE(height, static_cast<size_t>(4));
+        EXPECT_NE(width, static_cast<size_t>(0));
+    }
+    size_t count = 0;
+    DIR* dir_handle = opendir(out);
+    ASSERT_TRUE(dir_handle);
+    struct dirent* entry;
+    while ((entry = readdir(dir_handle))) {
+        count += entry->d_name[0] != '.';
+    }
+    closedir(dir_handle);
+    EXPECT_EQ(count, sizeof(expected) / sizeof(expected[0]));
+
+    RemoveDir(out);
+    RemoveDir(dir_a);
+    RemoveDir(dir_b);
+    EXPECT_EQ(rmdir(root), 0);
+}
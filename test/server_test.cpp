@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "application.h"
+#include "loader.h"
+#include "server.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// exit codes of the viewer handler
+#define VIEWER_OK       0
+#define VIEWER_NOIMAGE  3
+#define VIEWER_NOSERVER 4
+
+class Server : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        ASSERT_TRUE(mkdtemp(runtime_dir));
+        setenv("XDG_RUNTIME_DIR", runtime_dir, 1);
+    }
+
+    void TearDown() override
+    {
+        if (server > 0) {
+            kill(server, SIGTERM);
+            waitpid(server, nullptr, 0);
+            // decoder and viewers left after failed test
+            kill(-server, SIGKILL);
+        }
+        rmdir(runtime_dir);
+        unsetenv("XDG_RUNTIME_DIR");
+    }
+
+    // viewer started by the server: load the image specified as the last
+    // argument, it is decoded by the decoder process
+    static int Viewer(int argc, char* argv[])
+    {
+        struct image* image = nullptr;
+        int rc = VIEWER_NOIMAGE;
+
+        if (loader_from_source(argv[argc - 1], &image) == ldr_success) {
+            // images from the decoder are mapped from the shared segment
+            rc = image->map ? VIEWER_OK : VIEWER_NOSERVER;
+        }
+        image_free(image);
+
+        return rc;
+    }
+
+    void StartServer()
+    {
+        struct config* cfg = nullptr;
+
+        // disable caches to get each image from the decoder process
+        config_set(&cfg, APP_CFG_SECTION, APP_CFG_SHMCACHE, "0");
+        config_set(&cfg, APP_CFG_SECTION, APP_CFG_DISKCACHE, "0");
+
+        fflush(stdout);
+        server = fork();
+        ASSERT_NE(server, -1);
+        if (server == 0) {
+            setpgid(0, 0);
+            _exit(server_run(cfg, Viewer) ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        setpgid(server, server);
+        config_free(cfg);
+    }
+
+    // run client in a separate process to catch hangs
+    int RunClient(const char* file)
+    {
+        const char* argv[] = { "swayimg", file };
+        int status;
+        pid_t pid;
+
+        fflush(stdout);
+        pid = fork();
+
+        if (pid == 0) {
+            alarm(10);
+            for (size_t i = 0; i < 100; ++i) {
+                const int rc = server_client(2, const_cast<char**>(argv));
+                if (rc != -1) {
+                    _exit(rc);
+                }
+                usleep(50000); // server is not started yet
+            }
+            _exit(EXIT_FAILURE);
+        }
+
+        EXPECT_NE(pid, -1);
+        EXPECT_EQ(waitpid(pid, &status, 0), pid);
+        EXPECT_TRUE(WIFEXITED(status)) << "client hangs";
+
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    char runtime_dir[32] = "/tmp/swayimg_server_XXXXXX";
+    pid_t server = -1;
+};
+
+TEST_F(Server, Decode)
+{
+    StartServer();
+    EXPECT_EQ(RunClient(TEST_DATA_DIR "/image.pnm"), VIEWER_OK);
+    // the second request is served by the same decoder process
+    EXPECT_EQ(RunClient(TEST_DATA_DIR "/image.pnm"), VIEWER_OK);
+}
+
+TEST_F(Server, DecodeError)
+{
+    StartServer();
+    EXPECT_EQ(RunClient(TEST_DATA_DIR "/not_exist.pnm"), VIEWER_NOIMAGE);
+}
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "memdata.h"
+#include "thumbdb.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <string>
+
+class ThumbDb : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmp[] = "/tmp/swayimg_test_XXXXXX";
+        ASSERT_NE(mkdtemp(tmp), nullptr);
+        dir = tmp;
+        setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+        file = dir + "/image.bin";
+        std::ofstream(file) << "image";
+    }
+
+    void TearDown() override
+    {
+        thumbdb_destroy();
+        const std::string cmd = "rm -rf " + dir;
+        system(cmd.c_str());
+    }
+
+    struct image* CreateThumb(size_t width, size_t height)
+    {
+        struct image* thumb = image_create();
+        struct pixmap* pm = image_allocate_frame(thumb, width, height);
+        for (size_t i = 0; i < width * height; ++i) {
+            pm->data[i] = static_cast<argb_t>(i * 0x01020304);
+        }
+        thumb->source = str_dup(file.c_str(), nullptr);
+        image_set_format(thumb, "Test");
+        thumb->alpha = true;
+        return thumb;
+    }
+
+    std::string dir;
+    std::string file;
+};
+
+TEST_F(ThumbDb, SaveLoad)
+{
+    struct image* thumb = CreateThumb(4, 3);
+    struct image* loaded;
+    size_t width = 0, height = 0;
+
+    thumbdb_init(4, false, false);
+    EXPECT_EQ(thumbdb_load(file.c_str(), &width, &height), nullptr);
+
+    thumbdb_save(thumb, 40, 30);
+    loaded = thumbdb_load(file.c_str(), &width, &height);
+    ASSERT_NE(loaded, nullptr);
+    EXPECT_EQ(width, static_cast<size_t>(40));
+    EXPECT_EQ(height, static_cast<size_t>(30));
+    EXPECT_STREQ(loaded->source, file.c_str());
+    EXPECT_STREQ(loaded->name, "image.bin");
+    EXPECT_STREQ(loaded->format, "Test");
+    EXPECT_TRUE(loaded->alpha);
+    ASSERT_EQ(loaded->num_frames, static_cast<size_t>(1));
+    ASSERT_EQ(loaded->frames[0].pm.width, static_cast<size_t>(4));
+    ASSERT_EQ(loaded->frames[0].pm.height, static_cast<size_t>(3));
+    EXPECT_EQ(memcmp(loaded->frames[0].pm.data, thumb->frames[0].pm.data,
+                     4 * 3 * sizeof(argb_t)),
+              0);
+    image_free(loaded);
+
+    // another parameters
+    thumbdb_set_params(4, true, false);
+    EXPECT_EQ(thumbdb_load(file.c_str(), &width, &height), nullptr);
+    thumbdb_set_params(4, false, false);
+    loaded = thumbdb_load(file.c_str(), &width, &height);
+    EXPECT_NE(loaded, nullptr);
+    image_free(loaded);
+
+    // persistent between sessions
+    thumbdb_destroy();
+    thumbdb_init(4, false, false);
+    loaded = thumbdb_load(file.c_str(), &width, &height);
+    EXPECT_NE(loaded, nullptr);
+    image_free(loaded);
+
+    image_free(thumb);
+}
+
+TEST_F(ThumbDb, Modified)
+{
+    struct image* thumb = CreateThumb(2, 2);
+    size_t width, height;
+
+    thumbdb_init(2, false, false);
+    thumbdb_save(thumb, 20, 20);
+
+    // file size is a part of the key
+    std::ofstream(file, std::ios::app) << "modified";
+    EXPECT_EQ(thumbdb_load(file.c_str(), &width, &height), nullptr);
+
+    image_free(thumb);
+}
+
+TEST_F(ThumbDb, Disabled)
+{
+    struct image* thumb = CreateThumb(2, 2);
+    size_t width, height;
+
+    thumbdb_save(thumb, 20, 20);
+    EXPECT_EQ(thumbdb_load(file.c_str(), &width, &height), nullptr);
+
+    image_free(thumb);
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "tpool.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+struct TestTask {
+    std::vector<std::atomic<size_t>> calls;
+    std::atomic<size_t> bad_thread;
+    TestTask(size_t num) : calls(num), bad_thread(0) {}
+};
+
+static void handler(void* data, size_t index, size_t thread)
+{
+    TestTask* task = static_cast<TestTask*>(data);
+    ++task->calls[index];
+    if (thread >= tpool_threads()) {
+        ++task->bad_thread;
+    }
+}
+
+TEST(ThreadPool, Threads)
+{
+    EXPECT_GE(tpool_threads(), 1);
+}
+
+TEST(ThreadPool, Run)
+{
+    TestTask task(1000);
+    tpool_run(handler, &task, task.calls.size());
+    for (auto& it : task.calls) {
+        EXPECT_EQ(it, 1);
+    }
+    EXPECT_EQ(task.bad_thread, 0);
+}
+
+TEST(ThreadPool, Limit)
+{
+    TestTask task(100);
+    tpool_limit(1);
+    EXPECT_EQ(tpool_threads(), 1);
+    tpool_run(handler, &task, task.calls.size());
+    tpool_limit(0);
+    for (auto& it : task.calls) {
+        EXPECT_EQ(it, 1);
+    }
+    EXPECT_EQ(task.bad_thread, 0);
+}
+
+TEST(ThreadPool, RunEmpty)
+{
+    tpool_run(handler, nullptr, 0);
+}
+
+TEST(ThreadPool, Concurrent)
+{
+    TestTask task1(500), task2(500);
+    std::thread thread(
+        [&task2]() { tpool_run(handler, &task2, task2.calls.size()); });
+    tpool_run(handler, &task1, task1.calls.size());
+    thread.join();
+    for (size_t i = 0; i < task1.calls.size(); ++i) {
+        EXPECT_EQ(task1.calls[i], 1);
+        EXPECT_EQ(task2.calls[i], 1);
+    }
+}
+
+TEST(ThreadPool, Qos)
+{
+    TestTask task1(500), task2(500), task3(500);
+    EXPECT_EQ(tpool_get_qos(), tpool_interactive);
+    std::thread user([&task2]() {
+        tpool_set_qos(tpool_user);
+        EXPECT_EQ(tpool_get_qos(), tpool_user);
+        tpool_run(handler, &task2, task2.calls.size());
+    });
+    std::thread background([&task3]() {
+        tpool_set_qos(tpool_background);
+        EXPECT_EQ(tpool_get_qos(), tpool_background);
+        tpool_run(handler, &task3, task3.calls.size());
+    });
+    tpool_run(handler, &task1, task1.calls.size());
+    user.join();
+    background.join();
+    EXPECT_EQ(tpool_get_qos(), tpool_interactive);
+    for (size_t i = 0; i < task1.calls.size(); ++i) {
+        EXPECT_EQ(task1.calls[i], 1);
+        EXPECT_EQ(task2.calls[i], 1);
+        EXPECT_EQ(task3.calls[i], 1);
+    }
+}
+
+TEST(ThreadPool, Affinity)
+{
+    tpool_destroy(); // affinity is applied to new threads only
+    EXPECT_FALSE(tpool_affinity(""));
+    EXPECT_FALSE(tpool_affinity("abc"));
+    EXPECT_FALSE(tpool_affinity("3-1"));
+    EXPECT_FALSE(tpool_affinity("0,-1"));
+#ifdef __linux__
+    EXPECT_TRUE(tpool_affinity("0"));
+    EXPECT_TRUE(tpool_affinity("0-1,3"));
+#endif
+}
+
+static bool rows_handler(void* data, size_t start, size_t end)
+{
+    std::vector<std::atomic<size_t>>* rows =
+        static_cast<std::vector<std::atomic<size_t>>*>(data);
+    for (size_t i = start; i < end; ++i) {
+        ++(*rows)[i];
+    }
+    return true;
+}
+
+static bool rows_fail(void*, size_t start, size_t end)
+{
+    return !(start <= 42 && 42 < end);
+}
+
+TEST(ThreadPool, Rows)
+{
+    std::vector<std::atomic<size_t>> rows(1000);
+    EXPECT_TRUE(tpool_rows(rows_handler, &rows, rows.size(), 10000));
+    for (auto& it : rows) {
+        EXPECT_EQ(it, 1);
+    }
+}
+
+TEST(ThreadPool, RowsFail)
+{
+    EXPECT_FALSE(tpool_rows(rows_fail, nullptr, 1000, 10000));
+    EXPECT_FALSE(tpool_rows(rows_fail, nullptr, 100, 1));
+}
@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: MIT
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+extern "C" {
+#include "trace.h"
+}
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+class Trace : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        char tmp[] = "/tmp/swayimg_trace_XXXXXX";
+        const int fd = mkstemp(tmp);
+        ASSERT_NE(fd, -1);
+        close(fd);
+        file = tmp;
+    }
+
+    void TearDown() override { unlink(file.c_str()); }
+
+    std::string Read()
+    {
+        std::ifstream in(file);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    std::string file;
+};
+
+TEST_F(Trace, Disabled)
+{
+    EXPECT_EQ(trace_begin(), static_cast<uint64_t>(0));
+    trace_end("Test", 0);
+    trace_destroy();
+    EXPECT_EQ(Read(), "");
+}
+
+TEST_F(Trace, Events)
+{
+    trace_init(file.c_str());
+
+    const uint64_t start = trace_begin();
+    EXPECT_NE(start, static_cast<uint64_t>(0));
+    trace_end("Main event", start);
+
+    std::thread thread([]() {
+        trace_thread("test");
+        trace_span("Thread event", trace_begin(), trace_begin());
+    });
+    thread.join();
+
+    trace_destroy();
+    EXPECT_EQ(trace_begin(), static_cast<uint64_t>(0));
+
+    const std::string trace = Read();
+    EXPECT_EQ(trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+    EXPECT_EQ(trace.rfind("]}\n"), trace.length() - 3);
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"main\"}"), std::string::npos);
+    EXPECT_NE(trace.find("\"args\":{\"name\":\"test\"}"), std::string::npos);
+    EXPECT_NE(trace.find("{\"name\":\"Main event\",\"ph\":\"X\""),
+              std::string::npos);
+    EXPECT_NE(trace.find("{\"name\":\"Thread event\",\"ph\":\"X\""),
+              std::string::npos);
+}